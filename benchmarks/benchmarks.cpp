@@ -0,0 +1,594 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ * Throughput benchmarks of tsl::array_map and tsl::array_set under different
+ * template configurations, compared to std::unordered_map and
+ * std::unordered_set. The results are written as JSON so that they can be
+ * compared between versions.
+ *
+ * Usage: tsl_array_hash_benchmarks [--keys N] [--repeat R] [--output FILE]
+ */
+#include <tsl/array_map.h>
+#include <tsl/array_set.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+/**
+ * Lengths of the generated keys, uniformly distributed in
+ * [min_length, max_length]. The longest keys must fit in a std::uint8_t
+ * KeySizeT.
+ */
+struct key_distribution {
+  const char* name;
+  std::size_t min_length;
+  std::size_t max_length;
+};
+
+const key_distribution KEY_DISTRIBUTIONS[] = {
+    {"short", 4, 12}, {"medium", 16, 48}, {"long", 64, 200}};
+
+const std::uint64_t SEED = 0x5eed;
+
+/**
+ * Generate the keys of index [first_index, first_index + nb_keys). Each key is
+ * made of random characters followed by a '.' and its index, so that all the
+ * keys are different.
+ */
+std::vector<std::string> generate_keys(const key_distribution& distribution,
+                                       std::size_t first_index,
+                                       std::size_t nb_keys) {
+  static const char CHARS[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+
+  std::mt19937_64 generator(SEED + first_index);
+  std::uniform_int_distribution<std::size_t> length(distribution.min_length,
+                                                    distribution.max_length);
+  std::uniform_int_distribution<std::size_t> character(0,
+                                                       sizeof(CHARS) - 2);
+
+  std::vector<std::string> keys;
+  keys.reserve(nb_keys);
+  for (std::size_t i = first_index; i < first_index + nb_keys; i++) {
+    const std::string index = "." + std::to_string(i);
+    const std::size_t key_length = std::max(length(generator), index.size());
+
+    std::string key;
+    key.reserve(key_length);
+    for (std::size_t ichar = index.size(); ichar < key_length; ichar++) {
+      key.push_back(CHARS[character(generator)]);
+    }
+    key += index;
+
+    keys.push_back(std::move(key));
+  }
+
+  return keys;
+}
+
+/**
+ * Sink for the results of the benchmarked operations so that they are not
+ * optimized away.
+ */
+volatile std::uint64_t g_sink = 0;
+
+/**
+ * Serializer and deserializer to and from a buffer in memory.
+ */
+class buffer_serializer {
+ public:
+  explicit buffer_serializer(std::vector<char>& buffer) : m_buffer(buffer) {}
+
+  template <class U>
+  void operator()(const U& value) {
+    write(&value, sizeof(value));
+  }
+
+  void operator()(const char* data, std::uint64_t size) {
+    write(data, std::size_t(size));
+  }
+
+ private:
+  void write(const void* data, std::size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+  }
+
+  std::vector<char>& m_buffer;
+};
+
+class buffer_deserializer {
+ public:
+  explicit buffer_deserializer(const std::vector<char>& buffer)
+      : m_buffer(buffer), m_position(0) {}
+
+  template <class U>
+  U operator()() {
+    U value;
+    read(&value, sizeof(value));
+
+    return value;
+  }
+
+  void operator()(char* data_out, std::uint64_t size) {
+    read(data_out, std::size_t(size));
+  }
+
+ private:
+  void read(void* data_out, std::size_t size) {
+    if (m_position + size > m_buffer.size()) {
+      throw std::runtime_error("Reached the end of the serialized buffer.");
+    }
+
+    std::memcpy(data_out, m_buffer.data() + m_position, size);
+    m_position += size;
+  }
+
+  const std::vector<char>& m_buffer;
+  std::size_t m_position;
+};
+
+/*
+ * Operations on each kind of container. The value of an element is the index
+ * of its key.
+ */
+struct array_map_operations {
+  static const bool serializable = true;
+
+  template <class Map>
+  static void insert(Map& map, const std::string& key, std::uint64_t value) {
+    map.insert_ks(key.data(), key.size(), value);
+  }
+
+  template <class Map>
+  static bool find(const Map& map, const std::string& key) {
+    return map.find_ks(key.data(), key.size()) != map.cend();
+  }
+
+  template <class Map>
+  static std::size_t erase(Map& map, const std::string& key) {
+    return map.erase_ks(key.data(), key.size());
+  }
+
+  template <class Map>
+  static std::uint64_t iterate(const Map& map) {
+    std::uint64_t sum = 0;
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+      sum += it.key_size() + it.value();
+    }
+
+    return sum;
+  }
+
+  template <class Map>
+  static void serialize(const Map& map, std::vector<char>& buffer) {
+    buffer_serializer serializer(buffer);
+    map.serialize(serializer);
+  }
+
+  template <class Map>
+  static Map deserialize(const std::vector<char>& buffer) {
+    buffer_deserializer deserializer(buffer);
+    return Map::deserialize(deserializer, true);
+  }
+};
+
+struct array_set_operations : array_map_operations {
+  template <class Set>
+  static void insert(Set& set, const std::string& key,
+                     std::uint64_t /*value*/) {
+    set.insert_ks(key.data(), key.size());
+  }
+
+  template <class Set>
+  static std::uint64_t iterate(const Set& set) {
+    std::uint64_t sum = 0;
+    for (auto it = set.cbegin(); it != set.cend(); ++it) {
+      sum += it.key_size();
+    }
+
+    return sum;
+  }
+};
+
+struct std_map_operations {
+  static const bool serializable = false;
+
+  template <class Map>
+  static void insert(Map& map, const std::string& key, std::uint64_t value) {
+    map.emplace(key, value);
+  }
+
+  template <class Map>
+  static bool find(const Map& map, const std::string& key) {
+    return map.find(key) != map.cend();
+  }
+
+  template <class Map>
+  static std::size_t erase(Map& map, const std::string& key) {
+    return map.erase(key);
+  }
+
+  template <class Map>
+  static std::uint64_t iterate(const Map& map) {
+    std::uint64_t sum = 0;
+    for (const auto& element : map) {
+      sum += element.first.size() + element.second;
+    }
+
+    return sum;
+  }
+
+  template <class Map>
+  static void serialize(const Map& /*map*/, std::vector<char>& /*buffer*/) {}
+
+  template <class Map>
+  static Map deserialize(const std::vector<char>& /*buffer*/) {
+    return Map();
+  }
+};
+
+struct std_set_operations : std_map_operations {
+  template <class Set>
+  static void insert(Set& set, const std::string& key,
+                     std::uint64_t /*value*/) {
+    set.insert(key);
+  }
+
+  template <class Set>
+  static std::uint64_t iterate(const Set& set) {
+    std::uint64_t sum = 0;
+    for (const auto& key : set) {
+      sum += key.size();
+    }
+
+    return sum;
+  }
+};
+
+/**
+ * Template configuration of a benchmarked container, written with each result.
+ * The key_size_bits of a standard container is 0.
+ */
+struct container_config {
+  const char* container;
+  const char* growth_policy;
+  bool store_null_terminator;
+  std::size_t key_size_bits;
+};
+
+struct result {
+  container_config config;
+  const char* keys;
+  const char* operation;
+  std::size_t nb_operations;
+  double seconds;
+};
+
+class benchmark_runner {
+ public:
+  benchmark_runner(std::size_t nb_keys, std::size_t nb_repeats)
+      : m_nb_keys(nb_keys), m_nb_repeats(nb_repeats) {}
+
+  /**
+   * Run all the operations on Container for each key distribution.
+   */
+  template <class Container, class Operations>
+  void run(const container_config& config) {
+    for (const key_distribution& distribution : KEY_DISTRIBUTIONS) {
+      const std::vector<std::string> keys =
+          generate_keys(distribution, 0, m_nb_keys);
+      const std::vector<std::string> missing_keys =
+          generate_keys(distribution, m_nb_keys, m_nb_keys);
+
+      std::vector<std::size_t> lookup_order(m_nb_keys);
+      for (std::size_t i = 0; i < m_nb_keys; i++) {
+        lookup_order[i] = i;
+      }
+      std::shuffle(lookup_order.begin(), lookup_order.end(),
+                   std::mt19937_64(SEED));
+
+      run_distribution<Container, Operations>(config, distribution.name, keys,
+                                              missing_keys, lookup_order);
+    }
+  }
+
+  void write_json(std::ostream& out) const {
+    out << "{\n";
+    out << "  \"nb_keys\": " << m_nb_keys << ",\n";
+    out << "  \"nb_repeats\": " << m_nb_repeats << ",\n";
+    out << "  \"results\": [";
+    for (std::size_t i = 0; i < m_results.size(); i++) {
+      const result& res = m_results[i];
+      out << (i == 0 ? "\n" : ",\n");
+      out << "    {\"container\": \"" << res.config.container << "\", "
+          << "\"growth_policy\": \"" << res.config.growth_policy << "\", "
+          << "\"store_null_terminator\": "
+          << (res.config.store_null_terminator ? "true" : "false") << ", "
+          << "\"key_size_bits\": " << res.config.key_size_bits << ", "
+          << "\"keys\": \"" << res.keys << "\", "
+          << "\"operation\": \"" << res.operation << "\", "
+          << "\"nb_operations\": " << res.nb_operations << ", "
+          << "\"seconds\": " << res.seconds << ", "
+          << "\"ns_per_operation\": "
+          << res.seconds * 1e9 / double(res.nb_operations) << ", "
+          << "\"mops_per_second\": "
+          << double(res.nb_operations) / res.seconds / 1e6 << "}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+ private:
+  template <class Container, class Operations>
+  void run_distribution(const container_config& config, const char* keys_name,
+                        const std::vector<std::string>& keys,
+                        const std::vector<std::string>& missing_keys,
+                        const std::vector<std::size_t>& lookup_order) {
+    const auto fill = [&](Container& container) {
+      for (std::size_t i = 0; i < keys.size(); i++) {
+        Operations::insert(container, keys[i], i);
+      }
+    };
+
+    measure(config, keys_name, "insert", keys.size(), [] {}, [&] {
+      Container container;
+      fill(container);
+      g_sink = g_sink + container.size();
+    });
+
+    Container container;
+    fill(container);
+
+    measure(config, keys_name, "find_hit", keys.size(), [] {}, [&] {
+      std::size_t nb_found = 0;
+      for (std::size_t i : lookup_order) {
+        nb_found += Operations::find(container, keys[i]) ? 1 : 0;
+      }
+      check(nb_found == keys.size(), "find_hit");
+    });
+
+    measure(config, keys_name, "find_miss", missing_keys.size(), [] {}, [&] {
+      std::size_t nb_found = 0;
+      for (std::size_t i : lookup_order) {
+        nb_found += Operations::find(container, missing_keys[i]) ? 1 : 0;
+      }
+      check(nb_found == 0, "find_miss");
+    });
+
+    measure(config, keys_name, "iteration", keys.size(), [] {}, [&] {
+      g_sink = g_sink + Operations::iterate(container);
+    });
+
+    if (Operations::serializable) {
+      std::vector<char> buffer;
+      measure(config, keys_name, "serialize", keys.size(),
+              [&] { buffer.clear(); },
+              [&] { Operations::serialize(container, buffer); });
+
+      measure(config, keys_name, "deserialize", keys.size(), [] {}, [&] {
+        const Container deserialized =
+            Operations::template deserialize<Container>(buffer);
+        check(deserialized.size() == keys.size(), "deserialize");
+      });
+    }
+
+    Container to_modify;
+    measure(config, keys_name, "rehash", keys.size(),
+            [&] { to_modify = container; },
+            [&] { to_modify.rehash(to_modify.bucket_count() * 2); });
+
+    measure(config, keys_name, "erase", keys.size(),
+            [&] { to_modify = container; }, [&] {
+              std::size_t nb_erased = 0;
+              for (std::size_t i : lookup_order) {
+                nb_erased += Operations::erase(to_modify, keys[i]);
+              }
+              check(nb_erased == keys.size(), "erase");
+            });
+  }
+
+  /**
+   * Run 'setup' then time 'function' m_nb_repeats times and keep the fastest
+   * run.
+   */
+  template <class Setup, class Function>
+  void measure(const container_config& config, const char* keys_name,
+               const char* operation, std::size_t nb_operations, Setup setup,
+               Function function) {
+    double best_seconds = 0;
+    for (std::size_t i = 0; i < m_nb_repeats; i++) {
+      setup();
+
+      const auto start = std::chrono::steady_clock::now();
+      function();
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      if (i == 0 || elapsed.count() < best_seconds) {
+        best_seconds = elapsed.count();
+      }
+    }
+
+    std::cerr << config.container;
+    if (config.key_size_bits != 0) {
+      std::cerr << "<" << config.growth_policy << ", "
+                << (config.store_null_terminator ? "null terminator"
+                                                 : "no null terminator")
+                << ", " << config.key_size_bits << " bits key size>";
+    }
+    std::cerr << " " << keys_name << " keys, " << operation << ": "
+              << best_seconds * 1e9 / double(nb_operations) << " ns/op\n";
+
+    m_results.push_back(
+        {config, keys_name, operation, nb_operations, best_seconds});
+  }
+
+  static void check(bool condition, const char* operation) {
+    if (!condition) {
+      throw std::runtime_error(std::string("Unexpected result for ") +
+                               operation + ".");
+    }
+  }
+
+  std::size_t m_nb_keys;
+  std::size_t m_nb_repeats;
+  std::vector<result> m_results;
+};
+
+template <class KeySizeT, class GrowthPolicy, bool StoreNullTerminator = true>
+using bench_array_map =
+    tsl::array_map<char, std::uint64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, StoreNullTerminator, KeySizeT,
+                   std::uint32_t, GrowthPolicy>;
+
+template <class KeySizeT, class GrowthPolicy, bool StoreNullTerminator = true>
+using bench_array_set =
+    tsl::array_set<char, tsl::ah::str_hash<char>, tsl::ah::str_equal<char>,
+                   StoreNullTerminator, KeySizeT, std::uint32_t, GrowthPolicy>;
+
+using power_of_two = tsl::ah::power_of_two_growth_policy<2>;
+using fibonacci = tsl::ah::fibonacci_growth_policy<2>;
+using mod = tsl::ah::mod_growth_policy<>;
+using fastmod = tsl::ah::fastmod_growth_policy<>;
+using prime = tsl::ah::prime_growth_policy;
+
+void run_all(benchmark_runner& runner) {
+  // Growth policies
+  runner.run<bench_array_map<std::uint16_t, power_of_two>,
+             array_map_operations>({"array_map", "power_of_two", true, 16});
+  runner.run<bench_array_map<std::uint16_t, fibonacci>, array_map_operations>(
+      {"array_map", "fibonacci", true, 16});
+  runner.run<bench_array_map<std::uint16_t, mod>, array_map_operations>(
+      {"array_map", "mod", true, 16});
+  runner.run<bench_array_map<std::uint16_t, fastmod>,
+             array_map_operations>({"array_map", "fastmod", true, 16});
+  runner.run<bench_array_map<std::uint16_t, prime>, array_map_operations>(
+      {"array_map", "prime", true, 16});
+
+  runner.run<bench_array_set<std::uint16_t, power_of_two>,
+             array_set_operations>({"array_set", "power_of_two", true, 16});
+  runner.run<bench_array_set<std::uint16_t, fibonacci>, array_set_operations>(
+      {"array_set", "fibonacci", true, 16});
+  runner.run<bench_array_set<std::uint16_t, mod>, array_set_operations>(
+      {"array_set", "mod", true, 16});
+  runner.run<bench_array_set<std::uint16_t, fastmod>,
+             array_set_operations>({"array_set", "fastmod", true, 16});
+  runner.run<bench_array_set<std::uint16_t, prime>, array_set_operations>(
+      {"array_set", "prime", true, 16});
+
+  // StoreNullTerminator
+  runner.run<bench_array_map<std::uint16_t, power_of_two, false>,
+             array_map_operations>({"array_map", "power_of_two", false, 16});
+  runner.run<bench_array_set<std::uint16_t, power_of_two, false>,
+             array_set_operations>({"array_set", "power_of_two", false, 16});
+
+  // KeySizeT
+  runner.run<bench_array_map<std::uint8_t, power_of_two>,
+             array_map_operations>({"array_map", "power_of_two", true, 8});
+  runner.run<bench_array_map<std::uint32_t, power_of_two>,
+             array_map_operations>({"array_map", "power_of_two", true, 32});
+
+  // Standard containers
+  runner.run<std::unordered_map<std::string, std::uint64_t>,
+             std_map_operations>({"std::unordered_map", "std", true, 0});
+  runner.run<std::unordered_set<std::string>, std_set_operations>(
+      {"std::unordered_set", "std", true, 0});
+}
+
+void print_usage(const char* program) {
+  std::cerr << "Usage: " << program
+            << " [--keys N] [--repeat R] [--output FILE]\n"
+               "  --keys N       number of keys of each distribution "
+               "(default: 1000000)\n"
+               "  --repeat R     number of runs of each benchmark, the "
+               "fastest is kept (default: 3)\n"
+               "  --output FILE  write the JSON results to FILE instead of "
+               "the standard output\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t nb_keys = 1000000;
+  std::size_t nb_repeats = 3;
+  std::string output;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+
+    if (arg == "--keys") {
+      nb_keys = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--repeat") {
+      nb_repeats = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--output") {
+      output = argv[++i];
+    } else {
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (nb_keys == 0 || nb_repeats == 0) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    benchmark_runner runner(nb_keys, nb_repeats);
+    run_all(runner);
+
+    if (output.empty()) {
+      runner.write_json(std::cout);
+    } else {
+      std::ofstream file(output);
+      runner.write_json(file);
+      if (!file) {
+        std::cerr << "Can't write the results to " << output << ".\n";
+        return EXIT_FAILURE;
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
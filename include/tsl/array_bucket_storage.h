@@ -0,0 +1,442 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_ARRAY_BUCKET_STORAGE_H
+#define TSL_ARRAY_BUCKET_STORAGE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace tsl {
+namespace ah {
+
+namespace detail {
+
+static constexpr std::size_t log2_floor(std::size_t value) noexcept {
+  return (value <= 1) ? 0 : 1 + log2_floor(value / 2);
+}
+
+/**
+ * Return the index of the smallest size class of arena_bucket_storage which
+ * can contain 'size' bytes.
+ */
+static constexpr std::size_t arena_size_class(std::size_t size) noexcept {
+  return (size <= 64) ? ((size == 0) ? 0 : (size - 1) / 16)
+                      : 4 * (log2_floor(size - 1) - 5) +
+                            ((size - 1) >> (log2_floor(size - 1) - 2)) - 4;
+}
+
+/**
+ * Return the size in bytes of the blocks of the size class 'iclass'.
+ */
+static constexpr std::size_t arena_class_size(std::size_t iclass) noexcept {
+  return (iclass < 4) ? (iclass + 1) * 16
+                      : (5 + (iclass - 4) % 4) << ((iclass - 4) / 4 + 4);
+}
+
+/**
+ * Estimate of the bytes lost by std::malloc for each allocation: the header of
+ * the chunk and, on average, the padding to its alignment.
+ */
+static const std::size_t MALLOC_OVERHEAD_ESTIMATE = 2 * sizeof(std::size_t);
+
+}  // namespace detail
+
+/**
+ * Bucket storage which allocates the buffer of each bucket separately with
+ * std::malloc, std::realloc and std::free. Each bucket owns its buffer and
+ * frees it on destruction.
+ *
+ * A bucket storage must provide the following interface:
+ *  - owns_buffers: see below.
+ *  - good_size(size): return the size, >= size, which will actually be
+ *    reserved for a buffer of size bytes. The buckets which keep track of
+ *    their capacity use the extra space as free capacity.
+ *  - allocate(size), reallocate(ptr, old_size, new_size) and
+ *    deallocate(ptr, size): same as std::malloc, std::realloc and std::free
+ *    but throw std::bad_alloc on failure instead of returning nullptr. If
+ *    owns_buffers is false, old_size and size may be 0 as the buckets don't
+ *    necessarily know the size of their buffer.
+ *  - release(): deallocate all the buffers of the storage at once if
+ *    owns_buffers is true.
+ *  - overhead_bytes(buffers_bytes, nb_buffers): estimate of the memory used by
+ *    the storage and the underlying allocator on top of the 'nb_buffers'
+ *    buffers currently allocated, of 'buffers_bytes' bytes in total. Only
+ *    needed by the memory_usage() method of the hash tables.
+ */
+class malloc_bucket_storage {
+ public:
+  /**
+   * If true, the buffers belong to the storage and not to the buckets. A bucket
+   * never deallocates its buffer on destruction and the hash table releases all
+   * the buffers at once with release() on clear, rehash and destruction.
+   *
+   * The buckets must then also pass the exact size of a buffer, as given on its
+   * allocation, to reallocate and deallocate and thus always keep track of
+   * their capacity (see tsl::ah::exact_bucket_growth_policy).
+   */
+  static constexpr bool owns_buffers = false;
+
+  std::size_t good_size(std::size_t size) const noexcept { return size; }
+
+  void* allocate(std::size_t size) {
+    void* ptr = std::malloc(size);
+    if (ptr == nullptr) {
+      throw std::bad_alloc();
+    }
+
+    return ptr;
+  }
+
+  void* reallocate(void* ptr, std::size_t /*old_size*/, std::size_t new_size) {
+    void* new_ptr = std::realloc(ptr, new_size);
+    if (new_ptr == nullptr) {
+      throw std::bad_alloc();
+    }
+
+    return new_ptr;
+  }
+
+  void deallocate(void* ptr, std::size_t /*size*/) noexcept { std::free(ptr); }
+
+  void release() noexcept {}
+
+  std::size_t overhead_bytes(std::size_t /*buffers_bytes*/,
+                             std::size_t nb_buffers) const noexcept {
+    return nb_buffers * detail::MALLOC_OVERHEAD_ESTIMATE;
+  }
+};
+
+/**
+ * Bucket storage which serves the buffers of the buckets from slabs of
+ * SlabSize bytes. Each slab is divided in blocks of a same size class, the size
+ * classes being spaced by 16 bytes up to 64 bytes and then by a quarter of the
+ * power of two below them (80, 96, 112, 128, 160, 192, ...) up to SlabSize / 8
+ * bytes. The freed blocks are kept in a free list per size class for reuse.
+ * Bigger buffers are directly allocated with std::malloc but still tracked by
+ * the storage.
+ *
+ * Compared to tsl::ah::malloc_bucket_storage, it avoids the overhead of a
+ * malloc header for each bucket, reduces the fragmentation of the heap and the
+ * clear or destruction of a hash table only has to free the slabs. A
+ * reallocation which stays in the same size class is also free.
+ *
+ * The storage is not thread-safe, it's owned by a single hash table. The copy
+ * of a storage is an empty storage.
+ *
+ * SlabSize must be a power of two >= 1024.
+ */
+template <std::size_t SlabSize = 64 * 1024>
+class arena_bucket_storage {
+ public:
+  static constexpr bool owns_buffers = true;
+
+  arena_bucket_storage() noexcept
+      : m_size_classes(),
+        m_slabs(nullptr),
+        m_large_buffers(nullptr),
+        m_large_buffers_bytes(0) {}
+
+  arena_bucket_storage(const arena_bucket_storage& /*other*/) noexcept
+      : arena_bucket_storage() {}
+
+  arena_bucket_storage(arena_bucket_storage&& other) noexcept
+      : m_size_classes(other.m_size_classes),
+        m_slabs(other.m_slabs),
+        m_large_buffers(other.m_large_buffers),
+        m_large_buffers_bytes(other.m_large_buffers_bytes) {
+    other.reset();
+  }
+
+  arena_bucket_storage& operator=(const arena_bucket_storage& other) = delete;
+
+  arena_bucket_storage& operator=(arena_bucket_storage&& other) noexcept {
+    if (&other != this) {
+      release();
+
+      m_size_classes = other.m_size_classes;
+      m_slabs = other.m_slabs;
+      m_large_buffers = other.m_large_buffers;
+      m_large_buffers_bytes = other.m_large_buffers_bytes;
+      other.reset();
+    }
+
+    return *this;
+  }
+
+  ~arena_bucket_storage() { release(); }
+
+  void swap(arena_bucket_storage& other) noexcept {
+    std::swap(m_size_classes, other.m_size_classes);
+    std::swap(m_slabs, other.m_slabs);
+    std::swap(m_large_buffers, other.m_large_buffers);
+    std::swap(m_large_buffers_bytes, other.m_large_buffers_bytes);
+  }
+
+  friend void swap(arena_bucket_storage& lhs,
+                   arena_bucket_storage& rhs) noexcept {
+    lhs.swap(rhs);
+  }
+
+  std::size_t good_size(std::size_t size) const noexcept {
+    return (size <= MAX_BLOCK_SIZE)
+               ? detail::arena_class_size(detail::arena_size_class(size))
+               : size;
+  }
+
+  void* allocate(std::size_t size) {
+    if (size > MAX_BLOCK_SIZE) {
+      return allocate_large(size);
+    }
+
+    const std::size_t iclass = detail::arena_size_class(size);
+
+    size_class_state& state = m_size_classes[iclass];
+    if (state.free_list != nullptr) {
+      void* block = state.free_list;
+      std::memcpy(&state.free_list, block, sizeof(state.free_list));
+
+      return block;
+    }
+
+    const std::size_t block_size = detail::arena_class_size(iclass);
+    if (std::size_t(state.slab_end - state.slab_pos) < block_size) {
+      char* slab = static_cast<char*>(std::malloc(SlabSize));
+      if (slab == nullptr) {
+        throw std::bad_alloc();
+      }
+
+      std::memcpy(slab, &m_slabs, sizeof(m_slabs));
+      m_slabs = slab;
+
+      state.slab_pos = slab + HEADER_SIZE;
+      state.slab_end = slab + SlabSize;
+    }
+
+    void* block = state.slab_pos;
+    state.slab_pos += block_size;
+
+    return block;
+  }
+
+  void* reallocate(void* ptr, std::size_t old_size, std::size_t new_size) {
+    if (old_size <= MAX_BLOCK_SIZE && new_size <= MAX_BLOCK_SIZE &&
+        detail::arena_size_class(old_size) ==
+            detail::arena_size_class(new_size)) {
+      return ptr;
+    }
+
+    if (old_size > MAX_BLOCK_SIZE && new_size > MAX_BLOCK_SIZE) {
+      return reallocate_large(ptr, old_size, new_size);
+    }
+
+    void* new_ptr = allocate(new_size);
+    std::memcpy(new_ptr, ptr, std::min(old_size, new_size));
+    deallocate(ptr, old_size);
+
+    return new_ptr;
+  }
+
+  void deallocate(void* ptr, std::size_t size) noexcept {
+    if (size > MAX_BLOCK_SIZE) {
+      deallocate_large(ptr, size);
+      return;
+    }
+
+    size_class_state& state = m_size_classes[detail::arena_size_class(size)];
+    std::memcpy(ptr, &state.free_list, sizeof(state.free_list));
+    state.free_list = ptr;
+  }
+
+  /**
+   * Free all the slabs and big buffers at once. All the buffers previously
+   * allocated by the storage become invalid.
+   */
+  void release() noexcept {
+    while (m_slabs != nullptr) {
+      char* next_slab;
+      std::memcpy(&next_slab, m_slabs, sizeof(next_slab));
+
+      std::free(m_slabs);
+      m_slabs = next_slab;
+    }
+
+    while (m_large_buffers != nullptr) {
+      large_buffer_header* next = m_large_buffers->next;
+
+      std::free(m_large_buffers);
+      m_large_buffers = next;
+    }
+
+    reset();
+  }
+
+  /**
+   * The slabs are fully counted as used by the storage, the space of a slab
+   * which isn't part of an allocated buffer (free blocks, end of the slab not
+   * used yet, ...) is thus part of the overhead.
+   */
+  std::size_t overhead_bytes(std::size_t buffers_bytes,
+                             std::size_t /*nb_buffers*/) const noexcept {
+    std::size_t nb_slabs = 0;
+    for (char* slab = m_slabs; slab != nullptr;) {
+      std::memcpy(&slab, slab, sizeof(slab));
+      nb_slabs++;
+    }
+
+    std::size_t nb_large_buffers = 0;
+    for (large_buffer_header* header = m_large_buffers; header != nullptr;
+         header = header->next) {
+      nb_large_buffers++;
+    }
+
+    const std::size_t reserved_bytes =
+        nb_slabs * (SlabSize + detail::MALLOC_OVERHEAD_ESTIMATE) +
+        nb_large_buffers * (sizeof(large_buffer_header) +
+                            detail::MALLOC_OVERHEAD_ESTIMATE) +
+        m_large_buffers_bytes;
+
+    return (reserved_bytes > buffers_bytes) ? reserved_bytes - buffers_bytes
+                                            : 0;
+  }
+
+ private:
+  /**
+   * Link between the buffers bigger than MAX_BLOCK_SIZE, placed right before
+   * the buffer.
+   */
+  struct alignas(std::max_align_t) large_buffer_header {
+    large_buffer_header* prev;
+    large_buffer_header* next;
+  };
+
+  struct size_class_state {
+    void* free_list = nullptr;
+    char* slab_pos = nullptr;
+    char* slab_end = nullptr;
+  };
+
+  void reset() noexcept {
+    m_size_classes.fill(size_class_state());
+    m_slabs = nullptr;
+    m_large_buffers = nullptr;
+    m_large_buffers_bytes = 0;
+  }
+
+  void* allocate_large(std::size_t size) {
+    large_buffer_header* header = static_cast<large_buffer_header*>(
+        std::malloc(sizeof(large_buffer_header) + size));
+    if (header == nullptr) {
+      throw std::bad_alloc();
+    }
+
+    link_large(header);
+    m_large_buffers_bytes += size;
+
+    return header + 1;
+  }
+
+  void* reallocate_large(void* ptr, std::size_t old_size,
+                         std::size_t new_size) {
+    large_buffer_header* header = static_cast<large_buffer_header*>(ptr) - 1;
+    unlink_large(header);
+
+    large_buffer_header* new_header = static_cast<large_buffer_header*>(
+        std::realloc(header, sizeof(large_buffer_header) + new_size));
+    if (new_header == nullptr) {
+      link_large(header);
+      throw std::bad_alloc();
+    }
+
+    link_large(new_header);
+    m_large_buffers_bytes = m_large_buffers_bytes - old_size + new_size;
+
+    return new_header + 1;
+  }
+
+  void deallocate_large(void* ptr, std::size_t size) noexcept {
+    large_buffer_header* header = static_cast<large_buffer_header*>(ptr) - 1;
+    unlink_large(header);
+    m_large_buffers_bytes -= size;
+
+    std::free(header);
+  }
+
+  void link_large(large_buffer_header* header) noexcept {
+    header->prev = nullptr;
+    header->next = m_large_buffers;
+    if (m_large_buffers != nullptr) {
+      m_large_buffers->prev = header;
+    }
+
+    m_large_buffers = header;
+  }
+
+  void unlink_large(large_buffer_header* header) noexcept {
+    if (header->prev != nullptr) {
+      header->prev->next = header->next;
+    } else {
+      m_large_buffers = header->next;
+    }
+
+    if (header->next != nullptr) {
+      header->next->prev = header->prev;
+    }
+  }
+
+  static_assert(SlabSize >= 1024 && (SlabSize & (SlabSize - 1)) == 0,
+                "SlabSize must be a power of two >= 1024.");
+
+  /**
+   * Space reserved at the beginning of each slab to link the slabs together.
+   * Keep the blocks aligned as a buffer returned by std::malloc.
+   */
+  static const std::size_t HEADER_SIZE = alignof(std::max_align_t);
+  static const std::size_t MAX_BLOCK_SIZE = SlabSize / 8;
+  static const std::size_t NB_SIZE_CLASSES =
+      detail::arena_size_class(MAX_BLOCK_SIZE) + 1;
+
+  static_assert(detail::arena_class_size(NB_SIZE_CLASSES - 1) ==
+                    MAX_BLOCK_SIZE,
+                "MAX_BLOCK_SIZE should be the size of the last size class.");
+
+  std::array<size_class_state, NB_SIZE_CLASSES> m_size_classes;
+  char* m_slabs;
+  large_buffer_header* m_large_buffers;
+
+  /**
+   * Sum of the sizes of the buffers bigger than MAX_BLOCK_SIZE, headers
+   * excluded.
+   */
+  std::size_t m_large_buffers_bytes;
+};
+
+}  // namespace ah
+}  // namespace tsl
+
+#endif
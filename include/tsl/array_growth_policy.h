@@ -133,6 +133,113 @@ class power_of_two_growth_policy {
   std::size_t m_mask;
 };
 
+/**
+ * Grow the hash table by a factor of GrowthFactor keeping the bucket count to a
+ * power of two, like power_of_two_growth_policy, but map a hash to a bucket by
+ * multiplying it by 2^N / phi and keeping the highest bits of the product
+ * (Fibonacci hashing) instead of masking its lowest bits.
+ *
+ * All the bits of the hash contribute to the bucket, which keeps a good
+ * distribution with a hash function whose lowest bits are weak for the cost of
+ * a multiplication. The stored truncated hash can't be used on rehash with
+ * this policy when StoreHash is true and std::size_t is wider than 32 bits.
+ *
+ * GrowthFactor must be a power of two >= 2.
+ */
+template <std::size_t GrowthFactor>
+class fibonacci_growth_policy {
+ public:
+  explicit fibonacci_growth_policy(std::size_t& min_bucket_count_in_out) {
+    if (min_bucket_count_in_out > max_bucket_count()) {
+      throw std::length_error("The hash table exceeds its maximum size.");
+    }
+
+    if (min_bucket_count_in_out > 0) {
+      min_bucket_count_in_out =
+          round_up_to_power_of_two(min_bucket_count_in_out);
+      m_mask = min_bucket_count_in_out - 1;
+      m_shift = NB_BITS - log2(min_bucket_count_in_out);
+      // A shift by NB_BITS is undefined, the mask of 0 already maps every hash
+      // to the only bucket.
+      if (m_shift == NB_BITS) {
+        m_shift = 0;
+      }
+    } else {
+      m_mask = 0;
+      m_shift = 0;
+    }
+  }
+
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    return ((hash * MULTIPLIER) >> m_shift) & m_mask;
+  }
+
+  std::size_t next_bucket_count() const {
+    if ((m_mask + 1) > max_bucket_count() / GrowthFactor) {
+      throw std::length_error("The hash table exceeds its maximum size.");
+    }
+
+    return (m_mask + 1) * GrowthFactor;
+  }
+
+  std::size_t max_bucket_count() const {
+    // Largest power of two.
+    return (std::numeric_limits<std::size_t>::max() / 2) + 1;
+  }
+
+  void clear() noexcept {
+    m_mask = 0;
+    m_shift = 0;
+  }
+
+ private:
+  static const std::size_t NB_BITS = sizeof(std::size_t) * CHAR_BIT;
+
+  /**
+   * 2^N / phi rounded to an odd number, N being the number of bits of
+   * std::size_t.
+   */
+  static const std::size_t MULTIPLIER = static_cast<std::size_t>(
+      UINT64_C(0x9E3779B97F4A7C15) >> (64 - NB_BITS));
+
+  static std::size_t round_up_to_power_of_two(std::size_t value) {
+    if (is_power_of_two(value)) {
+      return value;
+    }
+
+    if (value == 0) {
+      return 1;
+    }
+
+    --value;
+    for (std::size_t i = 1; i < NB_BITS; i *= 2) {
+      value |= value >> i;
+    }
+
+    return value + 1;
+  }
+
+  static std::size_t log2(std::size_t power_of_two) {
+    std::size_t log = 0;
+    while (power_of_two > 1) {
+      power_of_two >>= 1;
+      log++;
+    }
+
+    return log;
+  }
+
+  static constexpr bool is_power_of_two(std::size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+  }
+
+  static_assert(is_power_of_two(GrowthFactor) && GrowthFactor >= 2,
+                "GrowthFactor must be a power of two >= 2.");
+
+  std::size_t m_mask;
+  std::size_t m_shift;
+};
+
 /**
  * Grow the hash table by GrowthFactor::num / GrowthFactor::den and use a modulo
  * to map a hash to a bucket. Slower but it can be useful if you want a slower
@@ -189,9 +296,95 @@ class mod_growth_policy {
   static_assert(REHASH_SIZE_MULTIPLICATION_FACTOR >= 1.1,
                 "Growth factor should be >= 1.1.");
 
+ protected:
   std::size_t m_mod;
 };
 
+#if defined(__SIZEOF_INT128__)
+#define TSL_AH_HAS_UINT128
+namespace detail {
+__extension__ typedef unsigned __int128 uint128_t;
+}
+#endif
+
+/**
+ * Same growth and same mapping of a hash to a bucket as mod_growth_policy, but
+ * compute hash % bucket_count() without a division with Lemire's fastmod:
+ * a multiplier M = ceil(2^(2N) / bucket_count) is precomputed when the bucket
+ * count changes, N being the number of bits of std::size_t, and the modulo is
+ * the high half of the product of the low half of M * hash by the bucket count.
+ * Two or three multiplications are cheaper than a 64-bit division on the
+ * lookup path.
+ *
+ * On a 64-bit platform, the 128-bit multiplier needs a compiler with
+ * unsigned __int128, the policy falls back to the modulo operator otherwise.
+ */
+template <class GrowthFactor = std::ratio<3, 2>>
+class fastmod_growth_policy : public mod_growth_policy<GrowthFactor> {
+ public:
+  explicit fastmod_growth_policy(std::size_t& min_bucket_count_in_out)
+      : mod_growth_policy<GrowthFactor>(min_bucket_count_in_out),
+        m_multiplier(compute_multiplier(this->m_mod)) {}
+
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    return fastmod(hash);
+  }
+
+  void clear() noexcept {
+    mod_growth_policy<GrowthFactor>::clear();
+    m_multiplier = compute_multiplier(this->m_mod);
+  }
+
+ private:
+#if SIZE_MAX <= UINT32_MAX
+  using multiplier_type = std::uint64_t;
+
+  static multiplier_type compute_multiplier(std::size_t divisor) {
+    // Wraps to 0 for a divisor of 1, which gives the expected remainder of 0.
+    return UINT64_C(0xFFFFFFFFFFFFFFFF) / divisor + 1;
+  }
+
+  std::size_t fastmod(std::size_t hash) const noexcept {
+    const std::uint64_t lowbits = m_multiplier * hash;
+    const std::uint64_t bottom_half =
+        ((lowbits & UINT32_MAX) * this->m_mod) >> 32;
+    const std::uint64_t top_half = (lowbits >> 32) * this->m_mod;
+
+    return static_cast<std::size_t>((bottom_half + top_half) >> 32);
+  }
+#elif defined(TSL_AH_HAS_UINT128)
+  using multiplier_type = detail::uint128_t;
+
+  static multiplier_type compute_multiplier(std::size_t divisor) {
+    // Wraps to 0 for a divisor of 1, which gives the expected remainder of 0.
+    return ~multiplier_type(0) / divisor + 1;
+  }
+
+  std::size_t fastmod(std::size_t hash) const noexcept {
+    const multiplier_type lowbits = m_multiplier * hash;
+    const multiplier_type bottom_half =
+        (static_cast<std::uint64_t>(lowbits) * multiplier_type(this->m_mod)) >>
+        64;
+    const multiplier_type top_half =
+        (lowbits >> 64) * multiplier_type(this->m_mod);
+
+    return static_cast<std::size_t>((bottom_half + top_half) >> 64);
+  }
+#else
+  using multiplier_type = std::size_t;
+
+  static multiplier_type compute_multiplier(std::size_t /*divisor*/) {
+    return 0;
+  }
+
+  std::size_t fastmod(std::size_t hash) const noexcept {
+    return hash % this->m_mod;
+  }
+#endif
+
+  multiplier_type m_multiplier;
+};
+
 namespace detail {
 
 #if SIZE_MAX >= ULLONG_MAX
@@ -357,6 +550,163 @@ class prime_growth_policy {
                 "The type of m_iprime is not big enough.");
 };
 
+/**
+ * Grow the hash table one bucket at a time with linear hashing instead of
+ * rehashing all the buckets at once.
+ *
+ * With a base bucket count B (a power of two) and a split pointer S (0 <= S <
+ * B), the hash table has B + S buckets. A hash goes to the bucket 'hash % B'
+ * unless this bucket has already been split in the current round (i.e. it's <
+ * S), in which case it goes to 'hash % 2B'. Splitting the bucket S moves some
+ * of its keys to the new bucket B + S and increments S. When S reaches B, the
+ * round is over and B is doubled.
+ *
+ * When the hash table uses this policy and is not empty, it splits a bounded
+ * number of buckets on each insertion past the load threshold (see
+ * split_bucket) instead of rehashing the whole table. The cost of the growth is
+ * thus spread over the insertions. Any bucket count can be represented, the
+ * policy never rounds up the requested bucket count.
+ */
+class linear_hashing_growth_policy {
+ public:
+  explicit linear_hashing_growth_policy(std::size_t& min_bucket_count_in_out) {
+    if (min_bucket_count_in_out > max_bucket_count()) {
+      throw std::length_error("The hash table exceeds its maximum size.");
+    }
+
+    if (min_bucket_count_in_out > 0) {
+      const std::size_t base =
+          round_down_to_power_of_two(min_bucket_count_in_out);
+      m_mask = base - 1;
+      m_split = min_bucket_count_in_out - base;
+    } else {
+      m_mask = 0;
+      m_split = 0;
+    }
+  }
+
+  std::size_t bucket_for_hash(std::size_t hash) const noexcept {
+    const std::size_t ibucket = hash & m_mask;
+    return (ibucket < m_split) ? (hash & ((m_mask << 1) | 1)) : ibucket;
+  }
+
+  /**
+   * Return the number of buckets to use on a full rehash, twice the current
+   * bucket count.
+   */
+  std::size_t next_bucket_count() const {
+    const std::size_t bucket_count = m_mask + 1 + m_split;
+    if (bucket_count > max_bucket_count() / 2) {
+      throw std::length_error("The hash table exceeds its maximum size.");
+    }
+
+    return bucket_count * 2;
+  }
+
+  std::size_t max_bucket_count() const {
+    // Largest power of two.
+    return (std::numeric_limits<std::size_t>::max() / 2) + 1;
+  }
+
+  void clear() noexcept {
+    m_mask = 0;
+    m_split = 0;
+  }
+
+  /**
+   * Advance the split pointer and return the index of the bucket to split. The
+   * keys of this bucket must then be redistributed, with bucket_for_hash,
+   * between the bucket itself and a new bucket appended at the end of the
+   * buckets.
+   *
+   * Must not be called if the bucket count is 0.
+   */
+  std::size_t split_bucket() {
+    if (m_mask + 1 + m_split >= max_bucket_count()) {
+      throw std::length_error("The hash table exceeds its maximum size.");
+    }
+
+    const std::size_t ibucket = m_split;
+
+    m_split++;
+    if (m_split == m_mask + 1) {
+      m_mask = (m_mask << 1) | 1;
+      m_split = 0;
+    }
+
+    return ibucket;
+  }
+
+ private:
+  static std::size_t round_down_to_power_of_two(std::size_t value) {
+    std::size_t power = 1;
+    while (value / 2 >= power) {
+      power *= 2;
+    }
+
+    return power;
+  }
+
+  std::size_t m_mask;
+  std::size_t m_split;
+};
+
+/**
+ * Bucket growth policy which grows the buffer of a bucket by exactly the size
+ * of the new entry on each insertion. The bucket doesn't need to store the
+ * capacity of its buffer, which keeps it as small as possible, but each
+ * insertion in a non-empty bucket needs a call to std::realloc.
+ */
+class exact_bucket_growth_policy {
+ public:
+  /**
+   * If true, the bucket stores the used size and the capacity of its buffer in
+   * a small header and only grows the buffer when the capacity is exhausted.
+   */
+  static constexpr bool track_capacity = false;
+
+  /**
+   * Return the new capacity, in bytes, of the buffer of a bucket which needs
+   * at least 'required_capacity' bytes while its current capacity is only
+   * 'current_capacity' bytes. The returned value must be >=
+   * 'required_capacity'.
+   *
+   * If track_capacity is false, the method must return 'required_capacity'.
+   */
+  static std::size_t next_capacity(std::size_t /*current_capacity*/,
+                                   std::size_t required_capacity) noexcept {
+    return required_capacity;
+  }
+};
+
+/**
+ * Bucket growth policy which grows the buffer of a bucket by a factor of
+ * GrowthFactor::num / GrowthFactor::den when it's full. An insertion is thus
+ * in amortized O(1) without a std::realloc on each insertion, at the cost of
+ * some unused space at the end of the buffers and of a small header in each
+ * non-empty bucket.
+ */
+template <class GrowthFactor = std::ratio<3, 2>>
+class geometric_bucket_growth_policy {
+ public:
+  static constexpr bool track_capacity = true;
+
+  static std::size_t next_capacity(std::size_t current_capacity,
+                                   std::size_t required_capacity) noexcept {
+    if (current_capacity >
+        std::numeric_limits<std::size_t>::max() / GrowthFactor::num) {
+      return required_capacity;
+    }
+
+    return std::max(current_capacity * GrowthFactor::num / GrowthFactor::den,
+                    required_capacity);
+  }
+
+ private:
+  static_assert(GrowthFactor::num > GrowthFactor::den,
+                "GrowthFactor must be > 1.");
+};
+
 }  // namespace ah
 }  // namespace tsl
 
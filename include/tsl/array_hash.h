@@ -26,19 +26,24 @@
 
 #include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
 #include <iterator>
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "array_bucket_storage.h"
 #include "array_growth_policy.h"
 
 /*
@@ -56,6 +61,57 @@
 #include <string_view>
 #endif
 
+/*
+ * SIMD instructions used to compare the hash tags of a bucket when
+ * StoreHashTags is true. Fall back to a scalar loop if not available.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TSL_AH_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#define TSL_AH_HAS_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+ * CRC32C instructions used to checksum the chunks of the chunked serialization
+ * format, see detail_array_hash::crc32c. With GCC and Clang on x86-64, the
+ * SSE4.2 instruction is detected at runtime if it isn't enabled at
+ * compile-time. Fall back to a table-based implementation if not available.
+ */
+#if defined(__SSE4_2__) && (defined(__x86_64__) || defined(_M_X64))
+#define TSL_AH_HAS_CRC32C_SSE42
+#define TSL_AH_CRC32C_TARGET
+#include <nmmintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define TSL_AH_HAS_CRC32C_SSE42
+#define TSL_AH_CRC32C_RUNTIME_CHECK
+#define TSL_AH_CRC32C_TARGET __attribute__((target("sse4.2")))
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+#define TSL_AH_HAS_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+ * Prefetch hint used by the batched lookups. No-op if not available.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define tsl_ah_prefetch(addr) __builtin_prefetch(addr)
+#elif defined(TSL_AH_HAS_SSE2)
+#define tsl_ah_prefetch(addr) \
+  _mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0)
+#else
+#define tsl_ah_prefetch(addr) (static_cast<void>(0))
+#endif
+
 #ifdef TSL_DEBUG
 #define tsl_ah_assert(expr) assert(expr)
 #else
@@ -99,15 +155,367 @@ struct str_hash {
 #endif
 };
 
+/**
+ * Fast string hash processing the key 8 to 48 bytes at a time, in the style of
+ * wyhash. Each step mixes two 64-bit words of the key with a 64x64->128 bits
+ * multiplication folded back to 64 bits, which gives a good avalanche at a low
+ * cost on long keys. Keys of at most 16 bytes are read with two overlapping
+ * loads, without any loop.
+ *
+ * The hash depends on the byte representation of the characters and thus on
+ * the endianness of the platform. A different seed gives a different hash
+ * function, which can be used to make the hashes less predictable.
+ */
+template <class CharT>
+class fast_str_hash {
+ public:
+  explicit fast_str_hash(std::uint64_t seed = 0) noexcept
+      : m_seed(seed ^ mix(seed ^ SECRET[0], SECRET[1])) {}
+
+  std::size_t operator()(const CharT* key, std::size_t key_size) const {
+    return static_cast<std::size_t>(
+        hash_bytes(reinterpret_cast<const unsigned char*>(key),
+                   key_size * sizeof(CharT)));
+  }
+
+ private:
+  std::uint64_t hash_bytes(const unsigned char* p, std::size_t len) const {
+    std::uint64_t seed = m_seed;
+    std::uint64_t a;
+    std::uint64_t b;
+
+    if (len <= 16) {
+      if (len >= 4) {
+        const std::size_t middle = (len >> 3) << 2;
+        a = (read32(p) << 32) | read32(p + middle);
+        b = (read32(p + len - 4) << 32) | read32(p + len - 4 - middle);
+      } else if (len > 0) {
+        a = (std::uint64_t(p[0]) << 16) | (std::uint64_t(p[len >> 1]) << 8) |
+            std::uint64_t(p[len - 1]);
+        b = 0;
+      } else {
+        a = 0;
+        b = 0;
+      }
+    } else {
+      std::size_t i = len;
+      if (i > 48) {
+        std::uint64_t seed1 = seed;
+        std::uint64_t seed2 = seed;
+        do {
+          seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+          seed1 = mix(read64(p + 16) ^ SECRET[2], read64(p + 24) ^ seed1);
+          seed2 = mix(read64(p + 32) ^ SECRET[3], read64(p + 40) ^ seed2);
+          p += 48;
+          i -= 48;
+        } while (i > 48);
+        seed ^= seed1 ^ seed2;
+      }
+
+      while (i > 16) {
+        seed = mix(read64(p) ^ SECRET[1], read64(p + 8) ^ seed);
+        p += 16;
+        i -= 16;
+      }
+
+      a = read64(p + i - 16);
+      b = read64(p + i - 8);
+    }
+
+    a ^= SECRET[1];
+    b ^= seed;
+    multiply(a, b);
+
+    return mix(a ^ SECRET[0] ^ std::uint64_t(len), b ^ SECRET[1]);
+  }
+
+  static std::uint64_t read64(const unsigned char* p) noexcept {
+    std::uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  static std::uint64_t read32(const unsigned char* p) noexcept {
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  /**
+   * Replace 'a' and 'b' by the low and high 64 bits of a * b.
+   */
+  static void multiply(std::uint64_t& a, std::uint64_t& b) noexcept {
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    a = static_cast<std::uint64_t>(product);
+    b = static_cast<std::uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    a = _umul128(a, b, &b);
+#else
+    const std::uint64_t a_high = a >> 32;
+    const std::uint64_t a_low = a & 0xffffffff;
+    const std::uint64_t b_high = b >> 32;
+    const std::uint64_t b_low = b & 0xffffffff;
+
+    const std::uint64_t high = a_high * b_high;
+    const std::uint64_t middle1 = a_high * b_low;
+    const std::uint64_t middle2 = a_low * b_high;
+    const std::uint64_t low = a_low * b_low;
+
+    const std::uint64_t middle =
+        (low >> 32) + (middle1 & 0xffffffff) + (middle2 & 0xffffffff);
+    a = (middle << 32) | (low & 0xffffffff);
+    b = high + (middle1 >> 32) + (middle2 >> 32) + (middle >> 32);
+#endif
+  }
+
+  static std::uint64_t mix(std::uint64_t a, std::uint64_t b) noexcept {
+    multiply(a, b);
+    return a ^ b;
+  }
+
+  static constexpr std::uint64_t SECRET[4] = {
+      0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull,
+      0x4d5a2da51de1aa47ull};
+
+  std::uint64_t m_seed;
+};
+
+template <class CharT>
+constexpr std::uint64_t fast_str_hash<CharT>::SECRET[4];
+
+/**
+ * Compare the byte representation of the keys. Keys of at most
+ * SHORT_KEY_MAX_BYTES bytes are compared inline with two overlapping unaligned
+ * loads of 1, 2, 4 or 8 bytes, which avoids the call to memcmp on the short
+ * keys which are the most common. Longer keys are compared 16 bytes at a time
+ * with SSE2 if available, with memcmp otherwise.
+ */
 template <class CharT>
 struct str_equal {
+  static constexpr std::size_t SHORT_KEY_MAX_BYTES = 16;
+
   bool operator()(const CharT* key_lhs, std::size_t key_size_lhs,
                   const CharT* key_rhs, std::size_t key_size_rhs) const {
     if (key_size_lhs != key_size_rhs) {
       return false;
+    }
+
+    const unsigned char* lhs = reinterpret_cast<const unsigned char*>(key_lhs);
+    const unsigned char* rhs = reinterpret_cast<const unsigned char*>(key_rhs);
+    const std::size_t nb_bytes = key_size_lhs * sizeof(CharT);
+
+    if (nb_bytes <= SHORT_KEY_MAX_BYTES) {
+      return equal_short(lhs, rhs, nb_bytes);
+    } else {
+      return equal_long(lhs, rhs, nb_bytes);
+    }
+  }
+
+ private:
+  template <class U>
+  static U load(const unsigned char* p) noexcept {
+    U value;
+    std::memcpy(&value, p, sizeof(U));
+    return value;
+  }
+
+  /**
+   * Compare the first and last sizeof(U) bytes, which overlap and cover the
+   * whole keys if sizeof(U) <= nb_bytes <= 2 * sizeof(U).
+   */
+  template <class U>
+  static bool equal_overlapping(const unsigned char* lhs,
+                                const unsigned char* rhs,
+                                std::size_t nb_bytes) noexcept {
+    const std::size_t last = nb_bytes - sizeof(U);
+    return ((load<U>(lhs) ^ load<U>(rhs)) |
+            (load<U>(lhs + last) ^ load<U>(rhs + last))) == 0;
+  }
+
+  static bool equal_short(const unsigned char* lhs, const unsigned char* rhs,
+                          std::size_t nb_bytes) noexcept {
+    // Characters of 2 and 4 bytes only need the branches for their multiples.
+    if (sizeof(CharT) <= 8 && nb_bytes >= 8) {
+      return equal_overlapping<std::uint64_t>(lhs, rhs, nb_bytes);
+    } else if (sizeof(CharT) <= 4 && nb_bytes >= 4) {
+      return equal_overlapping<std::uint32_t>(lhs, rhs, nb_bytes);
+    } else if (sizeof(CharT) <= 2 && nb_bytes >= 2) {
+      return equal_overlapping<std::uint16_t>(lhs, rhs, nb_bytes);
+    } else if (sizeof(CharT) == 1 && nb_bytes == 1) {
+      return lhs[0] == rhs[0];
     } else {
-      return std::memcmp(key_lhs, key_rhs, key_size_lhs * sizeof(CharT)) == 0;
+      return nb_bytes == 0 || std::memcmp(lhs, rhs, nb_bytes) == 0;
+    }
+  }
+
+  static bool equal_long(const unsigned char* lhs, const unsigned char* rhs,
+                         std::size_t nb_bytes) noexcept {
+#ifdef TSL_AH_HAS_SSE2
+    static const std::size_t VECTOR_SIZE = 16;
+    tsl_ah_assert(nb_bytes > VECTOR_SIZE);
+
+    const std::size_t last = nb_bytes - VECTOR_SIZE;
+    for (std::size_t i = 0; i < last; i += VECTOR_SIZE) {
+      if (!equal_vector(lhs + i, rhs + i)) {
+        return false;
+      }
     }
+
+    // Last 16 bytes, possibly overlapping with the previous ones.
+    return equal_vector(lhs + last, rhs + last);
+#else
+    return std::memcmp(lhs, rhs, nb_bytes) == 0;
+#endif
+  }
+
+#ifdef TSL_AH_HAS_SSE2
+  static bool equal_vector(const unsigned char* lhs,
+                           const unsigned char* rhs) noexcept {
+    const __m128i lhs_vector =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs));
+    const __m128i rhs_vector =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs));
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(lhs_vector, rhs_vector)) == 0xFFFF;
+  }
+#endif
+};
+
+template <class CharT>
+constexpr std::size_t str_equal<CharT>::SHORT_KEY_MAX_BYTES;
+
+/**
+ * Default value codec of the chunked serialization format, see
+ * `tsl::array_map::serialize_chunked`. Write and read the raw bytes of the
+ * value, which must be trivially copyable.
+ */
+struct raw_value_serializer {
+  template <class U, class Writer>
+  void operator()(const U& value, Writer& writer) const {
+    static_assert(std::is_trivially_copyable<U>::value,
+                  "raw_value_serializer requires a trivially copyable value, "
+                  "use a custom value serializer for other types.");
+    writer(reinterpret_cast<const char*>(&value), sizeof(U));
+  }
+};
+
+struct raw_value_deserializer {
+  template <class U, class Reader>
+  U operator()(Reader& reader) const {
+    static_assert(std::is_trivially_copyable<U>::value,
+                  "raw_value_deserializer requires a trivially copyable value, "
+                  "use a custom value deserializer for other types.");
+    U value;
+    reader(reinterpret_cast<char*>(&value), sizeof(U));
+
+    return value;
+  }
+};
+
+/**
+ * Element kept by `tsl::array_map::bulk_load` when a key appears multiple
+ * times in the loaded range.
+ */
+enum class duplicate_policy {
+  // Keep the first element, as `insert` would.
+  keep_first,
+  // Keep the last element, as `insert_or_assign` would.
+  keep_last
+};
+
+/**
+ * Memory used by a `tsl::array_map` or a `tsl::array_set`, see
+ * `tsl::array_map::memory_usage`.
+ */
+struct memory_usage {
+  // Bytes of the array of buckets.
+  std::size_t bucket_array_bytes = 0;
+
+  // Number of buckets with an allocated buffer.
+  std::size_t nb_bucket_buffers = 0;
+
+  // Bytes of the buffers of the buckets, the sum of key_bytes,
+  // inline_value_bytes, metadata_bytes and unused_bucket_bytes.
+  std::size_t bucket_buffers_bytes = 0;
+
+  // Bytes of the characters of the keys.
+  std::size_t key_bytes = 0;
+
+  // Bytes of the values stored in the buckets if InlineValues is true.
+  std::size_t inline_value_bytes = 0;
+
+  // Bytes of the sizes of the keys, the null terminators, the stored hashes,
+  // the indexes of the values, the headers and hash tags of the buckets, the
+  // end of bucket markers and the alignment padding.
+  std::size_t metadata_bytes = 0;
+
+  // Bytes reserved in the buffers of the buckets but not used yet.
+  std::size_t unused_bucket_bytes = 0;
+
+  // Estimate of the bytes used by the bucket storage and the allocator on top
+  // of the buffers of the buckets (malloc headers, free blocks of an arena,
+  // ...).
+  std::size_t allocator_overhead_bytes = 0;
+
+  // Bytes of the values of the elements in the values storage.
+  std::size_t live_value_bytes = 0;
+
+  // Bytes of the erased values still in the values storage.
+  std::size_t dead_value_bytes = 0;
+
+  // Bytes reserved in the values storage but not used yet.
+  std::size_t unused_value_bytes = 0;
+
+  // Bytes of the list of the slots of the erased values which can be reused.
+  std::size_t free_slots_bytes = 0;
+
+  std::size_t total_bytes() const noexcept {
+    return bucket_array_bytes + bucket_buffers_bytes +
+           allocator_overhead_bytes + live_value_bytes + dead_value_bytes +
+           unused_value_bytes + free_slots_bytes;
+  }
+};
+
+/**
+ * Statistics over the buckets of a `tsl::array_map` or a `tsl::array_set`, see
+ * `tsl::array_map::bucket_stats`.
+ */
+struct bucket_stats {
+  std::size_t bucket_count = 0;
+
+  std::size_t nb_empty_buckets = 0;
+
+  // Fraction of the buckets without any element, 0 without bucket.
+  float empty_buckets_fraction = 0.0f;
+
+  // Number of elements and size in bytes of the longest bucket.
+  std::size_t max_bucket_entries = 0;
+  std::size_t max_bucket_bytes = 0;
+
+  // entries_histogram[n] is the number of buckets with n elements.
+  std::vector<std::size_t> entries_histogram;
+
+  // bytes_histogram[n] is the number of buckets whose size in bytes, header,
+  // hash tags and end of bucket marker included, is in [2^(n-1), 2^n), the
+  // empty buckets without buffer being in bytes_histogram[0].
+  std::vector<std::size_t> bytes_histogram;
+
+  // cache_lines_histogram[n] is the number of buckets whose used part of the
+  // buffer spans n cache lines of CACHE_LINE_SIZE bytes, i.e. the number of
+  // cache lines read by a lookup which goes through the whole bucket.
+  std::vector<std::size_t> cache_lines_histogram;
+
+  static const std::size_t CACHE_LINE_SIZE = 64;
+};
+
+/**
+ * Chunk filter which loads all the chunks of a chunked serialization, see
+ * `tsl::array_map::deserialize_chunked`.
+ */
+struct all_chunks {
+  bool operator()(std::size_t /*ichunk*/, std::size_t /*nb_chunks*/) const {
+    return true;
   }
 };
 }  // namespace ah
@@ -163,1577 +571,4854 @@ static T deserialize_value(Deserializer& deserializer) {
 }
 
 /**
- * For each string in the bucket, store the size of the string, the chars of the
- * string and T, if it's not void. T should be either void or an unsigned type.
- *
- * End the buffer with END_OF_BUCKET flag. END_OF_BUCKET has the same type as
- * the string size variable.
- *
- * m_buffer (CharT*):
- * | size of str1 (KeySizeT) | str1 (const CharT*) | value (T if T != void) |
- * ... | | size of strN (KeySizeT) | strN (const CharT*) | value (T if T !=
- * void) | END_OF_BUCKET (KeySizeT) |
- *
- * m_buffer is null if there is no string in the bucket.
- *
- * KeySizeT and T are extended to be a multiple of CharT when stored in the
- * buffer.
+ * Call function(i) for each i in [0, nb_tasks), each call in its own thread.
+ * The call with i == 0 is done by the current thread and, if a thread can't be
+ * created, its task is also run by the current thread.
  *
- * Use std::malloc and std::free instead of new and delete so we can have access
- * to std::realloc.
+ * Wait for all the calls to end. If some of them threw an exception, rethrow
+ * the exception of the call with the lowest i.
  */
-template <class CharT, class T, class KeyEqual, class KeySizeT,
-          bool StoreNullTerminator>
-class array_bucket {
-  template <typename U>
-  using has_mapped_type =
-      typename std::integral_constant<bool, !std::is_same<U, void>::value>;
-
-  static_assert(!has_mapped_type<T>::value || std::is_unsigned<T>::value,
-                "T should be either void or an unsigned type.");
+template <class Function>
+static void parallel_for(std::size_t nb_tasks, Function function) {
+  std::vector<std::exception_ptr> exceptions(nb_tasks);
+  const auto run_task = [&](std::size_t i) {
+    try {
+      function(i);
+    } catch (...) {
+      exceptions[i] = std::current_exception();
+    }
+  };
 
-  static_assert(std::is_unsigned<KeySizeT>::value,
-                "KeySizeT should be an unsigned type.");
+  std::vector<std::thread> threads;
+  threads.reserve(nb_tasks);
+  for (std::size_t i = 1; i < nb_tasks; i++) {
+    try {
+      threads.emplace_back(run_task, i);
+    } catch (const std::system_error&) {
+      run_task(i);
+    }
+  }
 
- public:
-  template <bool IsConst>
-  class array_bucket_iterator;
+  run_task(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
 
-  using char_type = CharT;
-  using key_size_type = KeySizeT;
-  using mapped_type = T;
-  using size_type = std::size_t;
-  using key_equal = KeyEqual;
-  using iterator = array_bucket_iterator<false>;
-  using const_iterator = array_bucket_iterator<true>;
+  for (const std::exception_ptr& exception : exceptions) {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+}
 
-  static_assert(sizeof(KeySizeT) <= sizeof(size_type),
-                "sizeof(KeySizeT) should be <= sizeof(std::size_t;)");
-  static_assert(std::is_unsigned<size_type>::value, "");
+/**
+ * Increment histogram[ibin], growing the histogram if needed.
+ */
+static void add_to_histogram(std::vector<std::size_t>& histogram,
+                             std::size_t ibin) {
+  if (ibin >= histogram.size()) {
+    histogram.resize(ibin + 1, 0);
+  }
 
- private:
-  /**
-   * Return how much space in bytes the type U will take when stored in the
-   * buffer. As the buffer is of type CharT, U may take more space than
-   * sizeof(U).
-   *
-   * Example: sizeof(CharT) = 4, sizeof(U) = 2 => U will take 4 bytes in the
-   * buffer instead of 2.
-   */
-  template <typename U>
-  static constexpr size_type sizeof_in_buff() noexcept {
-    static_assert(is_power_of_two(sizeof(U)),
-                  "sizeof(U) should be a power of two.");
-    static_assert(is_power_of_two(sizeof(CharT)),
-                  "sizeof(CharT) should be a power of two.");
+  histogram[ibin]++;
+}
 
-    return std::max(sizeof(U), sizeof(CharT));
+/**
+ * Number of significant bits of 'value', 0 for 0.
+ */
+static std::size_t bit_width(std::size_t value) noexcept {
+  std::size_t width = 0;
+  while (value != 0) {
+    value >>= 1;
+    width++;
   }
 
-  /**
-   * Same as sizeof_in_buff<U>, but instead of returning the size in bytes
-   * return it in term of sizeof(CharT).
-   */
-  template <typename U>
-  static constexpr size_type size_as_char_t() noexcept {
-    return sizeof_in_buff<U>() / sizeof(CharT);
-  }
+  return width;
+}
 
-  static key_size_type read_key_size(const CharT* buffer) noexcept {
-    key_size_type key_size;
-    std::memcpy(&key_size, buffer, sizeof(key_size));
+/**
+ * Tables of the slicing-by-8 implementation of CRC32C. table[0] is the
+ * classic byte-at-a-time table, table[k][b] is the CRC of the byte 'b'
+ * followed by 'k' zero bytes.
+ */
+struct crc32c_tables {
+  // Reflected Castagnoli polynomial.
+  static const std::uint32_t POLYNOMIAL = 0x82F63B78;
+
+  crc32c_tables() {
+    for (std::uint32_t b = 0; b < 256; b++) {
+      std::uint32_t crc = b;
+      for (int i = 0; i < 8; i++) {
+        crc = (crc >> 1) ^ ((crc & 1) != 0 ? POLYNOMIAL : 0);
+      }
+      table[0][b] = crc;
+    }
 
-    return key_size;
+    for (std::uint32_t b = 0; b < 256; b++) {
+      for (std::size_t k = 1; k < 8; k++) {
+        table[k][b] =
+            (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+      }
+    }
   }
 
-  static mapped_type read_value(const CharT* buffer) noexcept {
-    mapped_type value;
-    std::memcpy(&value, buffer, sizeof(value));
+  std::uint32_t table[8][256];
+};
 
-    return value;
+inline std::uint32_t crc32c_software(std::uint32_t crc,
+                                     const unsigned char* data,
+                                     std::size_t size) noexcept {
+  static const crc32c_tables tables;
+  const auto& table = tables.table;
+
+  crc = ~crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    crc ^= std::uint32_t(data[0]) | (std::uint32_t(data[1]) << 8) |
+           (std::uint32_t(data[2]) << 16) | (std::uint32_t(data[3]) << 24);
+    crc = table[7][crc & 0xFF] ^ table[6][(crc >> 8) & 0xFF] ^
+          table[5][(crc >> 16) & 0xFF] ^ table[4][crc >> 24] ^
+          table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^
+          table[0][data[7]];
   }
 
-  static bool is_end_of_bucket(const CharT* buffer) noexcept {
-    return read_key_size(buffer) == END_OF_BUCKET;
+  for (; size > 0; size--, data++) {
+    crc = table[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
   }
 
- public:
-  /**
-   * Return the size required for an entry with a key of size 'key_size'.
-   */
-  template <class U = T, typename std::enable_if<
-                             !has_mapped_type<U>::value>::type* = nullptr>
-  static size_type entry_required_bytes(size_type key_size) noexcept {
-    return sizeof_in_buff<key_size_type>() +
-           (key_size + KEY_EXTRA_SIZE) * sizeof(CharT);
+  return ~crc;
+}
+
+#if defined(TSL_AH_HAS_CRC32C_SSE42)
+TSL_AH_CRC32C_TARGET inline std::uint32_t crc32c_hardware(
+    std::uint32_t crc, const unsigned char* data, std::size_t size) noexcept {
+  std::uint64_t crc64 = ~crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
   }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  static size_type entry_required_bytes(size_type key_size) noexcept {
-    return sizeof_in_buff<key_size_type>() +
-           (key_size + KEY_EXTRA_SIZE) * sizeof(CharT) +
-           sizeof_in_buff<mapped_type>();
+  std::uint32_t crc32 = static_cast<std::uint32_t>(crc64);
+  for (; size > 0; size--, data++) {
+    crc32 = _mm_crc32_u8(crc32, *data);
   }
 
- private:
-  /**
-   * Return the size of the current entry in buffer.
-   */
-  static size_type entry_size_bytes(const CharT* buffer) noexcept {
-    return entry_required_bytes(read_key_size(buffer));
+  return ~crc32;
+}
+#elif defined(TSL_AH_HAS_CRC32C_ARM)
+inline std::uint32_t crc32c_hardware(std::uint32_t crc,
+                                     const unsigned char* data,
+                                     std::size_t size) noexcept {
+  crc = ~crc;
+  for (; size >= 8; size -= 8, data += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    crc = __crc32cd(crc, word);
   }
 
- public:
-  template <bool IsConst>
-  class array_bucket_iterator {
-    friend class array_bucket;
+  for (; size > 0; size--, data++) {
+    crc = __crc32cb(crc, *data);
+  }
 
-    using buffer_type =
-        typename std::conditional<IsConst, const CharT, CharT>::type;
+  return ~crc;
+}
+#endif
 
-    explicit array_bucket_iterator(buffer_type* position) noexcept
-        : m_position(position) {}
+/**
+ * Return the CRC32C (CRC-32 with the Castagnoli polynomial, as used by iSCSI
+ * or ext4) of the 'size' bytes at 'data'. 'crc' is the CRC32C of the previous
+ * bytes if the checksum is computed in multiple calls, 0 otherwise.
+ */
+inline std::uint32_t crc32c(std::uint32_t crc, const void* data,
+                            std::size_t size) noexcept {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+#if defined(TSL_AH_CRC32C_RUNTIME_CHECK)
+  static const bool has_sse42 = __builtin_cpu_supports("sse4.2");
+  return has_sse42 ? crc32c_hardware(crc, bytes, size)
+                   : crc32c_software(crc, bytes, size);
+#elif defined(TSL_AH_HAS_CRC32C_SSE42) || defined(TSL_AH_HAS_CRC32C_ARM)
+  return crc32c_hardware(crc, bytes, size);
+#else
+  return crc32c_software(crc, bytes, size);
+#endif
+}
 
-   public:
-    using iterator_category = std::forward_iterator_tag;
-    using value_type = void;
-    using difference_type = std::ptrdiff_t;
-    using reference = void;
-    using pointer = void;
+/**
+ * Structures of the chunked serialization format, all stored as is in the
+ * native endianness.
+ *
+ * The format starts with a chunked_file_header followed by the chunks. Each
+ * chunk covers a range of consecutive buckets and is made of a chunk_header
+ * followed by 'payload_size' bytes. For each entry of its buckets, the payload
+ * contains the size of the key as a slz_size_type, the characters of the key
+ * (without null terminator) and the value, if any, as written by the value
+ * serializer. The chunks are followed by the chunk index, one
+ * chunk_index_entry per chunk, and a chunked_file_trailer.
+ */
+struct chunked_file_header {
+  slz_size_type magic;
+  slz_size_type version;
+  // sizeof(CharT) | (has mapped value) << 8
+  slz_size_type layout;
+};
 
-   public:
-    array_bucket_iterator() noexcept : m_position(nullptr) {}
+struct chunk_header {
+  slz_size_type first_bucket;
+  slz_size_type nb_buckets;
+  slz_size_type nb_entries;
+  slz_size_type payload_size;
+  // CRC32C of the payload.
+  slz_size_type crc;
+};
 
-    const CharT* key() const {
-      return m_position + size_as_char_t<key_size_type>();
-    }
+struct chunk_index_entry {
+  // Offset of the chunk_header from the start of the serialization.
+  slz_size_type offset;
+  chunk_header header;
+};
 
-    size_type key_size() const { return read_key_size(m_position); }
+struct chunked_file_trailer {
+  slz_size_type index_offset;
+  slz_size_type nb_chunks;
+  slz_size_type bucket_count;
+  slz_size_type nb_elements;
+  // Bits of the float max_load_factor.
+  slz_size_type max_load_factor;
+  // CRC32C of the chunk index.
+  slz_size_type index_crc;
+  slz_size_type magic;
+};
 
-    template <class U = T, typename std::enable_if<
-                               has_mapped_type<U>::value>::type* = nullptr>
-    U value() const {
-      return read_value(m_position + size_as_char_t<key_size_type>() +
-                        key_size() + KEY_EXTRA_SIZE);
-    }
+static const slz_size_type CHUNKED_SERIALIZATION_MAGIC =
+    0x4b484348414c5354;  // "TSLAHCHK" in little-endian
+static const slz_size_type CHUNKED_SERIALIZATION_PROTOCOL_VERSION = 1;
 
-    template <class U = T, typename std::enable_if<
-                               has_mapped_type<U>::value && !IsConst &&
-                               std::is_same<U, T>::value>::type* = nullptr>
-    void set_value(U value) noexcept {
-      std::memcpy(m_position + size_as_char_t<key_size_type>() + key_size() +
-                      KEY_EXTRA_SIZE,
-                  &value, sizeof(value));
-    }
+/**
+ * Output of the value serializer, append the bytes to the payload of the
+ * current chunk.
+ */
+class chunk_payload_writer {
+ public:
+  explicit chunk_payload_writer(std::vector<char>& payload) noexcept
+      : m_payload(payload) {}
 
-    array_bucket_iterator& operator++() {
-      m_position += entry_size_bytes(m_position) / sizeof(CharT);
-      if (is_end_of_bucket(m_position)) {
-        m_position = nullptr;
-      }
+  void operator()(const char* data, std::size_t size) {
+    m_payload.insert(m_payload.end(), data, data + size);
+  }
 
-      return *this;
-    }
+ private:
+  std::vector<char>& m_payload;
+};
 
-    array_bucket_iterator operator++(int) {
-      array_bucket_iterator tmp(*this);
-      ++*this;
+/**
+ * Input of the value deserializer, read the bytes of a chunk payload. Throw if
+ * the read goes past the end of the payload.
+ */
+class chunk_payload_reader {
+ public:
+  chunk_payload_reader(const char* data, std::size_t size) noexcept
+      : m_data(data), m_size(size), m_position(0) {}
 
-      return tmp;
+  void operator()(char* data, std::size_t size) {
+    if (size > m_size - m_position) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. An entry goes past "
+          "the end of its chunk.");
     }
 
-    friend bool operator==(const array_bucket_iterator& lhs,
-                           const array_bucket_iterator& rhs) {
-      return lhs.m_position == rhs.m_position;
-    }
+    std::memcpy(data, m_data + m_position, size);
+    m_position += size;
+  }
 
-    friend bool operator!=(const array_bucket_iterator& lhs,
-                           const array_bucket_iterator& rhs) {
-      return !(lhs == rhs);
-    }
+  bool at_end() const noexcept { return m_position == m_size; }
 
-   private:
-    buffer_type* m_position;
-  };
+ private:
+  const char* m_data;
+  std::size_t m_size;
+  std::size_t m_position;
+};
 
-  static iterator end_it() noexcept { return iterator(nullptr); }
+/**
+ * Return the number of trailing zero bits in 'value'. 'value' must not be 0.
+ */
+static unsigned int count_trailing_zeros(std::uint32_t value) noexcept {
+  tsl_ah_assert(value != 0);
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned int>(__builtin_ctz(value));
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, value);
+  return static_cast<unsigned int>(index);
+#else
+  unsigned int nb_zeros = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    nb_zeros++;
+  }
 
-  static const_iterator cend_it() noexcept { return const_iterator(nullptr); }
+  return nb_zeros;
+#endif
+}
 
- public:
-  array_bucket() : m_buffer(nullptr) {}
+/**
+ * Number of hash tags compared at once. The capacity of the hash tags array of
+ * a bucket is always a multiple of HASH_TAGS_GROUP_SIZE so that a whole group
+ * can be loaded without any bound check.
+ */
+static const std::size_t HASH_TAGS_GROUP_SIZE = 16;
 
-  /**
-   * Reserve 'size' in the buffer of the bucket. The created bucket is empty.
-   */
-  array_bucket(std::size_t size) : m_buffer(nullptr) {
-    if (size == 0) {
-      return;
+/**
+ * Return a mask where the bit i is set if tags[i] == tag, for i in
+ * [0, HASH_TAGS_GROUP_SIZE).
+ */
+static std::uint32_t match_hash_tags_group(const unsigned char* tags,
+                                           unsigned char tag) noexcept {
+#ifdef TSL_AH_HAS_SSE2
+  const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tags));
+  const __m128i matches =
+      _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(tag)));
+
+  return static_cast<std::uint32_t>(_mm_movemask_epi8(matches));
+#else
+  std::uint32_t mask = 0;
+  for (std::size_t i = 0; i < HASH_TAGS_GROUP_SIZE; i++) {
+    if (tags[i] == tag) {
+      mask |= std::uint32_t(1) << i;
     }
+  }
 
-    m_buffer = static_cast<CharT*>(std::malloc(
-        size * sizeof(CharT) + sizeof_in_buff<decltype(END_OF_BUCKET)>()));
-    if (m_buffer == nullptr) {
-      throw std::bad_alloc();
-    }
+  return mask;
+#endif
+}
 
-    const auto end_of_bucket = END_OF_BUCKET;
-    std::memcpy(m_buffer, &end_of_bucket, sizeof(end_of_bucket));
-  }
+#ifdef TSL_AH_HAS_AVX2
+/**
+ * Same as match_hash_tags_group but on two consecutive groups at once.
+ */
+static std::uint32_t match_hash_tags_two_groups(const unsigned char* tags,
+                                                unsigned char tag) noexcept {
+  const __m256i groups =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tags));
+  const __m256i matches =
+      _mm256_cmpeq_epi8(groups, _mm256_set1_epi8(static_cast<char>(tag)));
+
+  return static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+}
+#endif
 
-  ~array_bucket() { clear(); }
+/**
+ * Type of the hash stored in each entry of a bucket if StoreHash is true.
+ */
+using truncated_hash_type = std::uint32_t;
 
-  array_bucket(const array_bucket& other) {
-    if (other.m_buffer == nullptr) {
-      m_buffer = nullptr;
-      return;
-    }
+template <class GrowthPolicy>
+struct is_power_of_two_policy : std::false_type {};
 
-    const size_type other_buffer_size = other.size();
-    m_buffer = static_cast<CharT*>(
-        std::malloc(other_buffer_size * sizeof(CharT) +
-                    sizeof_in_buff<decltype(END_OF_BUCKET)>()));
-    if (m_buffer == nullptr) {
-      throw std::bad_alloc();
-    }
+template <std::size_t GrowthFactor>
+struct is_power_of_two_policy<tsl::ah::power_of_two_growth_policy<GrowthFactor>>
+    : std::true_type {};
 
-    std::memcpy(m_buffer, other.m_buffer, other_buffer_size * sizeof(CharT));
+template <class GrowthPolicy>
+struct is_linear_hashing_policy : std::false_type {};
 
-    const auto end_of_bucket = END_OF_BUCKET;
-    std::memcpy(m_buffer + other_buffer_size, &end_of_bucket,
-                sizeof(end_of_bucket));
-  }
+template <>
+struct is_linear_hashing_policy<tsl::ah::linear_hashing_growth_policy>
+    : std::true_type {};
 
-  array_bucket(array_bucket&& other) noexcept : m_buffer(other.m_buffer) {
-    other.m_buffer = nullptr;
-  }
+/**
+ * For each string in the bucket, store the size of the string, the chars of the
+ * string and T, if it's not void. T should be either void or an unsigned type,
+ * or a trivially copyable type if AlignValues is true.
+ *
+ * End the buffer with END_OF_BUCKET flag. END_OF_BUCKET has the same type as
+ * the string size variable.
+ *
+ * m_buffer (CharT*):
+ * | size of str1 (KeySizeT) | str1 (const CharT*) | value (T if T != void) |
+ * ... | | size of strN (KeySizeT) | strN (const CharT*) | value (T if T !=
+ * void) | END_OF_BUCKET (KeySizeT) |
+ *
+ * m_buffer is null if there is no string in the bucket.
+ *
+ * KeySizeT and T are extended to be a multiple of CharT when stored in the
+ * buffer.
+ *
+ * If StoreHash is true, the size of each string is followed by the lowest bits
+ * of the hash of the string (truncated_hash_type, also extended to be a
+ * multiple of CharT):
+ *
+ * | size of str1 (KeySizeT) | hash of str1 (truncated_hash_type) | str1 | ...
+ *
+ * On lookup, the stored hash is compared before the string itself, and on
+ * rehash the stored hash can be used instead of hashing the string again.
+ *
+ * If AlignValues is true, the string (and its null terminator) is followed by
+ * padding so that T starts on a multiple of alignof(T) from the start of the
+ * entry, and each entry size is a multiple of alignof(T). As the buffers
+ * returned by BucketStorage and the header are suitably aligned, T is always
+ * aligned in memory and can be accessed through a pointer (see value_ptr).
+ * Otherwise T is stored unaligned and only accessed through std::memcpy.
+ *
+ * If StoreHashTags is true or if BucketGrowthPolicy::track_capacity is true,
+ * the entries are preceded by a header of size_type fields. The header always
+ * starts with the size in bytes used by the entries. If
+ * BucketGrowthPolicy::track_capacity is true, it's followed by the capacity in
+ * bytes reserved for the entries, which may be larger than the used size. If
+ * StoreHashTags is true, it's followed by the number of entries and the
+ * capacity of an array of 8-bit hash tags, one per entry and in the same order
+ * as the entries, which is placed right after the header:
+ *
+ * | used size (size_type) | capacity (size_type) | number of entries
+ * (size_type) | capacity of the tags array (size_type) | tags (unsigned char
+ * [capacity]) | size of str1 (KeySizeT) | ... | END_OF_BUCKET (KeySizeT) |
+ * unused capacity |
+ *
+ * On lookup, the tag of the searched key is compared to all the tags of the
+ * bucket at once with SIMD instructions and only the entries with a matching
+ * tag have their key compared. A miss thus rarely needs to compare any key.
+ *
+ * The buffer is allocated through BucketStorage (see
+ * tsl::ah::malloc_bucket_storage) which is passed to each method which may
+ * allocate or deallocate the buffer. If BucketStorage::owns_buffers is true,
+ * the bucket doesn't deallocate its buffer on destruction, the owner of the
+ * storage releases all the buffers at once.
+ */
+template <class CharT, class T, class KeyEqual, class KeySizeT,
+          bool StoreNullTerminator, bool StoreHashTags,
+          class BucketGrowthPolicy, class BucketStorage, bool StoreHash,
+          bool AlignValues>
+class array_bucket {
+  template <typename U>
+  using has_mapped_type =
+      typename std::integral_constant<bool, !std::is_same<U, void>::value>;
 
-  array_bucket& operator=(array_bucket other) noexcept {
-    other.swap(*this);
+  static_assert(!has_mapped_type<T>::value || std::is_unsigned<T>::value ||
+                    (AlignValues && std::is_trivially_copyable<T>::value),
+                "T should be either void or an unsigned type, or a trivially "
+                "copyable type if AlignValues is true.");
 
-    return *this;
-  }
+  static_assert(std::is_unsigned<KeySizeT>::value,
+                "KeySizeT should be an unsigned type.");
 
-  void swap(array_bucket& other) noexcept {
-    std::swap(m_buffer, other.m_buffer);
-  }
+ public:
+  template <bool IsConst>
+  class array_bucket_iterator;
 
-  iterator begin() noexcept { return iterator(m_buffer); }
-  iterator end() noexcept { return iterator(nullptr); }
-  const_iterator begin() const noexcept { return cbegin(); }
-  const_iterator end() const noexcept { return cend(); }
-  const_iterator cbegin() const noexcept { return const_iterator(m_buffer); }
-  const_iterator cend() const noexcept { return const_iterator(nullptr); }
+  using char_type = CharT;
+  using key_size_type = KeySizeT;
+  using mapped_type = T;
+  using size_type = std::size_t;
+  using key_equal = KeyEqual;
+  using bucket_storage = BucketStorage;
+  using iterator = array_bucket_iterator<false>;
+  using const_iterator = array_bucket_iterator<true>;
+
+  static_assert(sizeof(KeySizeT) <= sizeof(size_type),
+                "sizeof(KeySizeT) should be <= sizeof(std::size_t;)");
+  static_assert(std::is_unsigned<size_type>::value, "");
+  static_assert(!StoreHashTags || HASH_TAGS_GROUP_SIZE % sizeof(CharT) == 0,
+                "HASH_TAGS_GROUP_SIZE should be a multiple of sizeof(CharT).");
+  static_assert(sizeof(size_type) % sizeof(CharT) == 0,
+                "sizeof(std::size_t) should be a multiple of sizeof(CharT).");
 
+ private:
   /**
-   * Return an iterator pointing to the key entry if presents or, if not there,
-   * to the position past the last element of the bucket. Return end() if the
-   * bucket has not be initialized yet.
-   *
-   * The boolean of the pair is set to true if the key is there, false
-   * otherwise.
+   * Alignment in bytes of the values in the buffer, 1 if they are stored
+   * unaligned.
    */
-  std::pair<const_iterator, bool> find_or_end_of_bucket(
-      const CharT* key, size_type key_size) const noexcept {
-    if (m_buffer == nullptr) {
-      return std::make_pair(cend(), false);
-    }
+  static constexpr size_type VALUE_ALIGNMENT =
+      AlignValues ? alignof(typename std::conditional<has_mapped_type<T>::value,
+                                                      T, char>::type)
+                  : 1;
 
-    const CharT* buffer_ptr_in_out = m_buffer;
-    const bool found =
-        find_or_end_of_bucket_impl(key, key_size, buffer_ptr_in_out);
-
-    return std::make_pair(const_iterator(buffer_ptr_in_out), found);
-  }
+  static_assert(VALUE_ALIGNMENT <= sizeof(size_type),
+                "The alignment of T should be <= sizeof(std::size_t).");
 
+ private:
   /**
-   * Append the element 'key' with its potential value at the end of the bucket.
-   * 'end_of_bucket' should point past the end of the last element in the
-   * bucket, end() if the bucket was not initialized yet. You usually get this
-   * value from find_or_end_of_bucket.
+   * Return how much space in bytes the type U will take when stored in the
+   * buffer. As the buffer is of type CharT, U may take more space than
+   * sizeof(U).
    *
-   * Return the position where the element was actually inserted.
+   * Example: sizeof(CharT) = 4, sizeof(U) = 2 => U will take 4 bytes in the
+   * buffer instead of 2.
    */
-  template <class... ValueArgs>
-  const_iterator append(const_iterator end_of_bucket, const CharT* key,
-                        size_type key_size, ValueArgs&&... value) {
-    const key_size_type key_sz = as_key_size_type(key_size);
-
-    if (end_of_bucket == cend()) {
-      tsl_ah_assert(m_buffer == nullptr);
+  template <typename U>
+  static constexpr size_type sizeof_in_buff() noexcept {
+    static_assert(is_power_of_two(sizeof(U)),
+                  "sizeof(U) should be a power of two.");
+    static_assert(is_power_of_two(sizeof(CharT)),
+                  "sizeof(CharT) should be a power of two.");
 
-      const size_type buffer_size = entry_required_bytes(key_sz) +
-                                    sizeof_in_buff<decltype(END_OF_BUCKET)>();
+    return std::max(sizeof(U), sizeof(CharT));
+  }
 
-      m_buffer = static_cast<CharT*>(std::malloc(buffer_size));
-      if (m_buffer == nullptr) {
-        throw std::bad_alloc();
-      }
+  /**
+   * Same as sizeof_in_buff<U>, but instead of returning the size in bytes
+   * return it in term of sizeof(CharT).
+   */
+  template <typename U>
+  static constexpr size_type size_as_char_t() noexcept {
+    return sizeof_in_buff<U>() / sizeof(CharT);
+  }
 
-      append_impl(key, key_sz, m_buffer, std::forward<ValueArgs>(value)...);
+  static key_size_type read_key_size(const CharT* buffer) noexcept {
+    key_size_type key_size;
+    std::memcpy(&key_size, buffer, sizeof(key_size));
 
-      return const_iterator(m_buffer);
-    } else {
-      tsl_ah_assert(is_end_of_bucket(end_of_bucket.m_position));
+    return key_size;
+  }
 
-      const size_type current_size =
-          ((end_of_bucket.m_position +
-            size_as_char_t<decltype(END_OF_BUCKET)>()) -
-           m_buffer) *
-          sizeof(CharT);
-      const size_type new_size = current_size + entry_required_bytes(key_sz);
+  static truncated_hash_type read_truncated_hash(const CharT* buffer) noexcept {
+    truncated_hash_type hash;
+    std::memcpy(&hash, buffer + size_as_char_t<key_size_type>(), sizeof(hash));
 
-      CharT* new_buffer = static_cast<CharT*>(std::realloc(m_buffer, new_size));
-      if (new_buffer == nullptr) {
-        throw std::bad_alloc();
-      }
-      m_buffer = new_buffer;
+    return hash;
+  }
 
-      CharT* buffer_append_pos = m_buffer + current_size / sizeof(CharT) -
-                                 size_as_char_t<decltype(END_OF_BUCKET)>();
-      append_impl(key, key_sz, buffer_append_pos,
-                  std::forward<ValueArgs>(value)...);
+  /**
+   * Offset, in number of CharT, of the key from the start of its entry.
+   */
+  static constexpr size_type key_offset() noexcept {
+    return size_as_char_t<key_size_type>() +
+           (StoreHash ? size_as_char_t<truncated_hash_type>() : 0);
+  }
 
-      return const_iterator(buffer_append_pos);
-    }
+  /**
+   * Return true if the key of the entry at 'buffer' is equal to 'key'. If
+   * StoreHash is true, the stored hash is compared first.
+   */
+  static bool entry_key_equals(const CharT* buffer, const CharT* key,
+                               size_type key_size, std::size_t hash) noexcept {
+    return (!StoreHash || read_truncated_hash(buffer) ==
+                              static_cast<truncated_hash_type>(hash)) &&
+           KeyEqual()(buffer + key_offset(), read_key_size(buffer), key,
+                      key_size);
   }
 
-  const_iterator erase(const_iterator position) noexcept {
-    tsl_ah_assert(position.m_position != nullptr &&
-                  !is_end_of_bucket(position.m_position));
+  /**
+   * Offset, in number of CharT, of the value from the start of an entry with a
+   * key of size 'key_size'.
+   */
+  static size_type value_offset(size_type key_size) noexcept {
+    const size_type offset_bytes =
+        (key_offset() + key_size + KEY_EXTRA_SIZE) * sizeof(CharT);
 
-    // get mutable pointers
-    CharT* start_entry = m_buffer + (position.m_position - m_buffer);
-    CharT* start_next_entry =
-        start_entry + entry_size_bytes(start_entry) / sizeof(CharT);
+    return ((offset_bytes + VALUE_ALIGNMENT - 1) / VALUE_ALIGNMENT *
+            VALUE_ALIGNMENT) /
+           sizeof(CharT);
+  }
 
-    CharT* end_buffer_ptr = start_next_entry;
-    while (!is_end_of_bucket(end_buffer_ptr)) {
-      end_buffer_ptr += entry_size_bytes(end_buffer_ptr) / sizeof(CharT);
-    }
-    end_buffer_ptr += size_as_char_t<decltype(END_OF_BUCKET)>();
+  static mapped_type read_value(const CharT* buffer) noexcept {
+    mapped_type value;
+    std::memcpy(&value, buffer, sizeof(value));
 
-    const size_type size_to_move =
-        (end_buffer_ptr - start_next_entry) * sizeof(CharT);
-    std::memmove(start_entry, start_next_entry, size_to_move);
+    return value;
+  }
 
-    if (is_end_of_bucket(m_buffer)) {
-      clear();
-      return cend();
-    } else if (is_end_of_bucket(start_entry)) {
-      return cend();
-    } else {
-      return const_iterator(start_entry);
-    }
+  static bool is_end_of_bucket(const CharT* buffer) noexcept {
+    return read_key_size(buffer) == END_OF_BUCKET;
   }
 
   /**
-   * Return true if an element has been erased
+   * Size in bytes of the header at the front of the buffer, 0 if there is no
+   * header.
    */
-  bool erase(const CharT* key, size_type key_size) noexcept {
-    if (m_buffer == nullptr) {
-      return false;
-    }
+  static constexpr size_type header_bytes() noexcept {
+    return NB_HEADER_FIELDS * sizeof(size_type);
+  }
 
-    const CharT* entry_buffer_ptr_in_out = m_buffer;
-    bool found =
-        find_or_end_of_bucket_impl(key, key_size, entry_buffer_ptr_in_out);
-    if (found) {
-      erase(const_iterator(entry_buffer_ptr_in_out));
+  static size_type read_header_field(const CharT* buffer,
+                                     size_type ifield) noexcept {
+    tsl_ah_assert(ifield < NB_HEADER_FIELDS);
 
-      return true;
-    } else {
-      return false;
-    }
+    size_type value;
+    std::memcpy(&value,
+                reinterpret_cast<const char*>(buffer) +
+                    ifield * sizeof(size_type),
+                sizeof(value));
+
+    return value;
   }
 
-  /**
-   * Bucket should be big enough and there is no check to see if the key already
-   * exists. No check on key_size.
-   */
-  template <class... ValueArgs>
-  void append_in_reserved_bucket_no_check(const CharT* key, size_type key_size,
-                                          ValueArgs&&... value) noexcept {
-    CharT* buffer_ptr = m_buffer;
-    while (!is_end_of_bucket(buffer_ptr)) {
-      buffer_ptr += entry_size_bytes(buffer_ptr) / sizeof(CharT);
-    }
+  static void write_header_field(CharT* buffer, size_type ifield,
+                                 size_type value) noexcept {
+    tsl_ah_assert(ifield < NB_HEADER_FIELDS);
 
-    append_impl(key, key_size_type(key_size), buffer_ptr,
-                std::forward<ValueArgs>(value)...);
+    std::memcpy(reinterpret_cast<char*>(buffer) + ifield * sizeof(size_type),
+                &value, sizeof(value));
   }
 
-  bool empty() const noexcept {
-    return m_buffer == nullptr || is_end_of_bucket(m_buffer);
+  static unsigned char* hash_tags(CharT* buffer) noexcept {
+    return reinterpret_cast<unsigned char*>(buffer) + header_bytes();
   }
 
-  void clear() noexcept {
-    std::free(m_buffer);
-    m_buffer = nullptr;
+  static const unsigned char* hash_tags(const CharT* buffer) noexcept {
+    return reinterpret_cast<const unsigned char*>(buffer) + header_bytes();
   }
 
-  iterator mutable_iterator(const_iterator pos) noexcept {
-    return iterator(m_buffer + (pos.m_position - m_buffer));
+  /**
+   * Return the 8-bit tag of a hash. Use the highest bits of the full hash as
+   * the lowest ones are usually the ones used to select the bucket. The
+   * highest bits of the truncated hash would become bucket bits too once a
+   * table has more than 2^24 buckets. A rehash from the stored hashes gets
+   * the tags back through stored_hash instead.
+   */
+  static unsigned char hash_tag(std::size_t hash) noexcept {
+    return static_cast<unsigned char>(hash >>
+                                      (sizeof(std::size_t) * CHAR_BIT - 8));
   }
 
-  template <class Serializer>
-  void serialize(Serializer& serializer) const {
-    const slz_size_type bucket_size = size();
-    tsl_ah_assert(m_buffer != nullptr || bucket_size == 0);
+  /**
+   * Size in bytes of everything in the buffer before the first entry.
+   */
+  static size_type entries_offset_bytes(const CharT* buffer) noexcept {
+    return StoreHashTags ? header_bytes() + read_header_field(
+                                                buffer, HEADER_TAGS_CAPACITY)
+                         : header_bytes();
+  }
 
-    serializer(bucket_size);
-    serializer(m_buffer, bucket_size);
+  static CharT* first_entry(CharT* buffer) noexcept {
+    return buffer + entries_offset_bytes(buffer) / sizeof(CharT);
   }
 
-  template <class Deserializer>
-  static array_bucket deserialize(Deserializer& deserializer) {
-    array_bucket bucket;
-    const slz_size_type bucket_size_ds =
-        deserialize_value<slz_size_type>(deserializer);
+  static const CharT* first_entry(const CharT* buffer) noexcept {
+    return buffer + entries_offset_bytes(buffer) / sizeof(CharT);
+  }
 
-    if (bucket_size_ds == 0) {
-      return bucket;
+  /**
+   * Return the capacity of the hash tags array needed for 'nb_entries'
+   * entries.
+   */
+  static size_type hash_tags_capacity_for(size_type nb_entries) noexcept {
+    return StoreHashTags
+               ? ((nb_entries + HASH_TAGS_GROUP_SIZE - 1) /
+                  HASH_TAGS_GROUP_SIZE) *
+                     HASH_TAGS_GROUP_SIZE
+               : 0;
+  }
+
+  /**
+   * Write the header of an empty buffer. Noop if there is no header.
+   */
+  static void write_empty_header(CharT* buffer, size_type capacity,
+                                 size_type tags_capacity) noexcept {
+    if (HAS_HEADER) {
+      write_header_field(buffer, HEADER_USED_SIZE, 0);
     }
 
-    const std::size_t bucket_size = numeric_cast<std::size_t>(
-        bucket_size_ds, "Deserialized bucket_size is too big.");
-    bucket.m_buffer = static_cast<CharT*>(
-        std::malloc(bucket_size * sizeof(CharT) +
-                    sizeof_in_buff<decltype(END_OF_BUCKET)>()));
-    if (bucket.m_buffer == nullptr) {
-      throw std::bad_alloc();
+    if (TRACK_CAPACITY) {
+      write_header_field(buffer, HEADER_CAPACITY, capacity);
+    }
+
+    if (StoreHashTags) {
+      write_header_field(buffer, HEADER_NB_ENTRIES, 0);
+      write_header_field(buffer, HEADER_TAGS_CAPACITY, tags_capacity);
     }
+  }
 
-    deserializer(bucket.m_buffer, bucket_size);
+  /**
+   * Allocate an empty buffer with room for at least 'capacity' bytes of
+   * entries and 'tags_capacity' hash tags.
+   */
+  static CharT* allocate_empty_buffer(BucketStorage& storage,
+                                      size_type capacity,
+                                      size_type tags_capacity) {
+    const size_type buffer_size =
+        good_buffer_size(storage, header_bytes() + tags_capacity, capacity);
+    CharT* buffer = static_cast<CharT*>(storage.allocate(buffer_size));
+
+    write_empty_header(
+        buffer,
+        buffer_size - header_bytes() - tags_capacity -
+            sizeof_in_buff<decltype(END_OF_BUCKET)>(),
+        tags_capacity);
 
     const auto end_of_bucket = END_OF_BUCKET;
-    std::memcpy(bucket.m_buffer + bucket_size, &end_of_bucket,
-                sizeof(end_of_bucket));
+    std::memcpy(first_entry(buffer), &end_of_bucket, sizeof(end_of_bucket));
 
-    tsl_ah_assert(bucket.size() == bucket_size);
-    return bucket;
+    return buffer;
   }
 
- private:
-  key_size_type as_key_size_type(size_type key_size) const {
-    if (key_size > MAX_KEY_SIZE) {
-      throw std::length_error("Key is too long.");
-    }
+  /**
+   * Return the size in bytes to allocate for a buffer with 'offset' bytes
+   * before its first entry and room for at least 'capacity' bytes of entries.
+   * If TRACK_CAPACITY is true, the extra space the storage would reserve
+   * anyway is included and can be used as capacity.
+   */
+  static size_type good_buffer_size(const BucketStorage& storage,
+                                    size_type offset,
+                                    size_type capacity) noexcept {
+    const size_type buffer_size =
+        offset + capacity + sizeof_in_buff<decltype(END_OF_BUCKET)>();
 
-    return key_size_type(key_size);
+    return TRACK_CAPACITY ? storage.good_size(buffer_size) : buffer_size;
   }
 
-  /*
-   * Return true if found, false otherwise.
-   * If true, buffer_ptr_in_out points to the start of the entry matching 'key'.
-   * If false, buffer_ptr_in_out points to where the 'key' should be inserted.
-   *
-   * Start search from buffer_ptr_in_out.
+  /**
+   * Return the number of bytes used by the entries of 'buffer', END_OF_BUCKET
+   * excluded. If there is no header, the used size is not stored to gain some
+   * space and the method need to find the END_OF_BUCKET marker and is thus in
+   * O(n).
    */
-  bool find_or_end_of_bucket_impl(
-      const CharT* key, size_type key_size,
-      const CharT*& buffer_ptr_in_out) const noexcept {
-    while (!is_end_of_bucket(buffer_ptr_in_out)) {
-      const key_size_type buffer_key_size = read_key_size(buffer_ptr_in_out);
-      const CharT* buffer_str =
-          buffer_ptr_in_out + size_as_char_t<key_size_type>();
-      if (KeyEqual()(buffer_str, buffer_key_size, key, key_size)) {
-        return true;
-      }
+  static size_type used_bytes(const CharT* buffer) noexcept {
+    if (HAS_HEADER) {
+      return read_header_field(buffer, HEADER_USED_SIZE);
+    }
 
-      buffer_ptr_in_out += entry_size_bytes(buffer_ptr_in_out) / sizeof(CharT);
+    const CharT* buffer_ptr = first_entry(buffer);
+    while (!is_end_of_bucket(buffer_ptr)) {
+      buffer_ptr += entry_size_bytes(buffer_ptr) / sizeof(CharT);
     }
 
-    return false;
+    return (buffer_ptr - first_entry(buffer)) * sizeof(CharT);
   }
 
-  template <typename U = T, typename std::enable_if<
-                                !has_mapped_type<U>::value>::type* = nullptr>
-  void append_impl(const CharT* key, key_size_type key_size,
-                   CharT* buffer_append_pos) noexcept {
-    std::memcpy(buffer_append_pos, &key_size, sizeof(key_size));
-    buffer_append_pos += size_as_char_t<key_size_type>();
-
-    std::memcpy(buffer_append_pos, key, key_size * sizeof(CharT));
-    buffer_append_pos += key_size;
+ public:
+  /**
+   * Return the size required for an entry with a key of size 'key_size'.
+   */
+  template <class U = T, typename std::enable_if<
+                             !has_mapped_type<U>::value>::type* = nullptr>
+  static size_type entry_required_bytes(size_type key_size) noexcept {
+    return key_offset() * sizeof(CharT) +
+           (key_size + KEY_EXTRA_SIZE) * sizeof(CharT);
+  }
 
-    const CharT zero = 0;
-    std::memcpy(buffer_append_pos, &zero, KEY_EXTRA_SIZE * sizeof(CharT));
-    buffer_append_pos += KEY_EXTRA_SIZE;
+  template <class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  static size_type entry_required_bytes(size_type key_size) noexcept {
+    return value_offset(key_size) * sizeof(CharT) +
+           sizeof_in_buff<mapped_type>();
+  }
 
-    const auto end_of_bucket = END_OF_BUCKET;
-    std::memcpy(buffer_append_pos, &end_of_bucket, sizeof(end_of_bucket));
+ private:
+  /**
+   * Return the size of the current entry in buffer.
+   */
+  static size_type entry_size_bytes(const CharT* buffer) noexcept {
+    return entry_required_bytes(read_key_size(buffer));
   }
 
-  template <typename U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  void append_impl(
-      const CharT* key, key_size_type key_size, CharT* buffer_append_pos,
-      typename array_bucket<CharT, U, KeyEqual, KeySizeT,
-                            StoreNullTerminator>::mapped_type value) noexcept {
-    std::memcpy(buffer_append_pos, &key_size, sizeof(key_size));
-    buffer_append_pos += size_as_char_t<key_size_type>();
+ public:
+  template <bool IsConst>
+  class array_bucket_iterator {
+    friend class array_bucket;
 
-    std::memcpy(buffer_append_pos, key, key_size * sizeof(CharT));
-    buffer_append_pos += key_size;
+    using buffer_type =
+        typename std::conditional<IsConst, const CharT, CharT>::type;
 
-    const CharT zero = 0;
-    std::memcpy(buffer_append_pos, &zero, KEY_EXTRA_SIZE * sizeof(CharT));
-    buffer_append_pos += KEY_EXTRA_SIZE;
+    explicit array_bucket_iterator(buffer_type* position) noexcept
+        : m_position(position) {}
 
-    std::memcpy(buffer_append_pos, &value, sizeof(value));
-    buffer_append_pos += size_as_char_t<mapped_type>();
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using reference = void;
+    using pointer = void;
 
-    const auto end_of_bucket = END_OF_BUCKET;
-    std::memcpy(buffer_append_pos, &end_of_bucket, sizeof(end_of_bucket));
-  }
+   public:
+    array_bucket_iterator() noexcept : m_position(nullptr) {}
 
-  /**
-   * Return the number of CharT in m_buffer. As the size of the buffer is not
-   * stored to gain some space, the method need to find the EOF marker and is
-   * thus in O(n).
-   */
-  size_type size() const noexcept {
-    if (m_buffer == nullptr) {
-      return 0;
+    const CharT* key() const { return m_position + key_offset(); }
+
+    size_type key_size() const { return read_key_size(m_position); }
+
+    /**
+     * Only available if StoreHash is true.
+     */
+    truncated_hash_type truncated_hash() const {
+      tsl_ah_assert(StoreHash);
+      return read_truncated_hash(m_position);
     }
 
-    CharT* buffer_ptr = m_buffer;
-    while (!is_end_of_bucket(buffer_ptr)) {
-      buffer_ptr += entry_size_bytes(buffer_ptr) / sizeof(CharT);
+    template <class U = T, typename std::enable_if<
+                               has_mapped_type<U>::value>::type* = nullptr>
+    U value() const {
+      return read_value(m_position + value_offset(key_size()));
     }
 
-    return buffer_ptr - m_buffer;
-  }
+    /**
+     * Only available if AlignValues is true.
+     */
+    template <class U = T,
+              typename std::enable_if<has_mapped_type<U>::value &&
+                                      AlignValues>::type* = nullptr>
+    const U* value_ptr() const {
+      return reinterpret_cast<const U*>(m_position +
+                                        value_offset(key_size()));
+    }
 
- private:
-  static const key_size_type END_OF_BUCKET =
-      std::numeric_limits<key_size_type>::max();
-  static const key_size_type KEY_EXTRA_SIZE = StoreNullTerminator ? 1 : 0;
+    template <class U = T, typename std::enable_if<
+                               has_mapped_type<U>::value && !IsConst &&
+                               std::is_same<U, T>::value>::type* = nullptr>
+    void set_value(U value) noexcept {
+      std::memcpy(m_position + value_offset(key_size()), &value,
+                  sizeof(value));
+    }
 
-  CharT* m_buffer;
+    array_bucket_iterator& operator++() {
+      m_position += entry_size_bytes(m_position) / sizeof(CharT);
+      if (is_end_of_bucket(m_position)) {
+        m_position = nullptr;
+      }
 
- public:
-  static const key_size_type MAX_KEY_SIZE =
-      // -1 for END_OF_BUCKET
-      key_size_type(std::numeric_limits<key_size_type>::max() - KEY_EXTRA_SIZE -
-                    1);
-};
+      return *this;
+    }
 
-template <class T>
-class value_container {
- public:
-  void clear() noexcept { m_values.clear(); }
+    array_bucket_iterator operator++(int) {
+      array_bucket_iterator tmp(*this);
+      ++*this;
 
-  void reserve(std::size_t new_cap) { m_values.reserve(new_cap); }
+      return tmp;
+    }
 
-  void shrink_to_fit() { m_values.shrink_to_fit(); }
+    friend bool operator==(const array_bucket_iterator& lhs,
+                           const array_bucket_iterator& rhs) {
+      return lhs.m_position == rhs.m_position;
+    }
 
-  friend void swap(value_container& lhs, value_container& rhs) {
-    lhs.m_values.swap(rhs.m_values);
-  }
+    friend bool operator!=(const array_bucket_iterator& lhs,
+                           const array_bucket_iterator& rhs) {
+      return !(lhs == rhs);
+    }
 
- protected:
-  static constexpr float VECTOR_GROWTH_RATE = 1.5f;
+   private:
+    buffer_type* m_position;
+  };
 
-  // TODO use a sparse array? or a std::deque
-  std::vector<T> m_values;
-};
+  static iterator end_it() noexcept { return iterator(nullptr); }
+
+  static const_iterator cend_it() noexcept { return const_iterator(nullptr); }
 
-template <>
-class value_container<void> {
  public:
-  void clear() noexcept {}
+  array_bucket() : m_buffer(nullptr) {}
 
-  void shrink_to_fit() {}
+  /**
+   * Reserve 'size' in the buffer of the bucket. The created bucket is empty.
+   *
+   * If StoreHashTags is true, also reserve enough hash tags for 'nb_entries'
+   * entries.
+   */
+  array_bucket(BucketStorage& storage, std::size_t size,
+               std::size_t nb_entries = 0)
+      : m_buffer(nullptr) {
+    if (size == 0) {
+      return;
+    }
 
-  void reserve(std::size_t /*new_cap*/) {}
-};
+    m_buffer = allocate_empty_buffer(storage, size * sizeof(CharT),
+                                     hash_tags_capacity_for(nb_entries));
+  }
 
-/**
- * If there is no value in the array_hash (in the case of a set for example), T
- * should be void.
- *
- * The size of a key string is limited to std::numeric_limits<KeySizeT>::max()
- * - 1.
- *
- * The number of elements in the map is limited to
- * std::numeric_limits<IndexSizeT>::max().
- */
-template <class CharT, class T, class Hash, class KeyEqual,
-          bool StoreNullTerminator, class KeySizeT, class IndexSizeT,
-          class GrowthPolicy>
-class array_hash : private value_container<T>,
-                   private Hash,
-                   private GrowthPolicy {
- private:
-  template <typename U>
-  using has_mapped_type =
-      typename std::integral_constant<bool, !std::is_same<U, void>::value>;
+  ~array_bucket() {
+    if (!BucketStorage::owns_buffers) {
+      BucketStorage storage;
+      clear(storage);
+    }
+  }
 
   /**
-   * If there is a mapped type in array_hash, we store the values in m_values of
-   * value_container class and we store an index to m_values in the bucket. The
-   * index is of type IndexSizeT.
+   * Only available if the buckets own their buffer, use the constructor with a
+   * storage otherwise.
    */
-  using array_bucket = tsl::detail_array_hash::array_bucket<
-      CharT,
-      typename std::conditional<has_mapped_type<T>::value, IndexSizeT,
-                                void>::type,
-      KeyEqual, KeySizeT, StoreNullTerminator>;
-
- public:
-  template <bool IsConst>
-  class array_hash_iterator;
+  array_bucket(const array_bucket& other) : m_buffer(nullptr) {
+    static_assert(!BucketStorage::owns_buffers,
+                  "The storage must be given to copy the bucket.");
 
-  using char_type = CharT;
-  using key_size_type = KeySizeT;
-  using index_size_type = IndexSizeT;
-  using size_type = std::size_t;
-  using hasher = Hash;
-  using key_equal = KeyEqual;
-  using iterator = array_hash_iterator<false>;
-  using const_iterator = array_hash_iterator<true>;
+    BucketStorage storage;
+    copy_buffer(storage, other);
+  }
 
-  /*
-   * Iterator classes
+  /**
+   * Copy 'other' in a buffer allocated from 'storage'.
    */
- public:
-  template <bool IsConst>
-  class array_hash_iterator {
-    friend class array_hash;
+  array_bucket(BucketStorage& storage, const array_bucket& other)
+      : m_buffer(nullptr) {
+    copy_buffer(storage, other);
+  }
 
-   private:
-    using iterator_array_bucket = typename array_bucket::const_iterator;
+  array_bucket(array_bucket&& other) noexcept : m_buffer(other.m_buffer) {
+    other.m_buffer = nullptr;
+  }
 
-    using iterator_buckets = typename std::conditional<
-        IsConst, typename std::vector<array_bucket>::const_iterator,
-        typename std::vector<array_bucket>::iterator>::type;
+  array_bucket& operator=(array_bucket other) noexcept {
+    other.swap(*this);
 
-    using array_hash_ptr = typename std::conditional<IsConst, const array_hash*,
-                                                     array_hash*>::type;
+    return *this;
+  }
 
-   public:
-    using iterator_category = std::forward_iterator_tag;
-    using value_type =
-        typename std::conditional<has_mapped_type<T>::value, T, void>::type;
-    using difference_type = std::ptrdiff_t;
-    using reference = typename std::conditional<
-        has_mapped_type<T>::value,
-        typename std::conditional<
-            IsConst, typename std::add_lvalue_reference<const T>::type,
-            typename std::add_lvalue_reference<T>::type>::type,
-        void>::type;
-    using pointer = typename std::conditional<
-        has_mapped_type<T>::value,
-        typename std::conditional<IsConst, const T*, T*>::type, void>::type;
+  void swap(array_bucket& other) noexcept {
+    std::swap(m_buffer, other.m_buffer);
+  }
 
-   private:
-    array_hash_iterator(iterator_buckets buckets_iterator,
-                        iterator_array_bucket array_bucket_iterator,
-                        array_hash_ptr array_hash_p) noexcept
-        : m_buckets_iterator(buckets_iterator),
-          m_array_bucket_iterator(array_bucket_iterator),
-          m_array_hash(array_hash_p) {
-      tsl_ah_assert(m_array_hash != nullptr);
+  iterator begin() noexcept {
+    return iterator(m_buffer != nullptr ? first_entry(m_buffer) : nullptr);
+  }
+  iterator end() noexcept { return iterator(nullptr); }
+  const_iterator begin() const noexcept { return cbegin(); }
+  const_iterator end() const noexcept { return cend(); }
+  const_iterator cbegin() const noexcept {
+    return const_iterator(m_buffer != nullptr ? first_entry(m_buffer)
+                                              : nullptr);
+  }
+  const_iterator cend() const noexcept { return const_iterator(nullptr); }
+
+  /**
+   * Return the hash stored for 'it', the 'ientry'-th entry of the bucket: the
+   * truncated hash with, if StoreHashTags is true, the hash tag in the highest
+   * bits. It maps to the same bucket as the full hash while the bucket count
+   * fits in truncated_hash_type and gives back the same hash tag. StoreHash
+   * must be true.
+   */
+  std::size_t stored_hash(const_iterator it, size_type ientry) const noexcept {
+    std::size_t hash = it.truncated_hash();
+    if (StoreHashTags) {
+      tsl_ah_assert(ientry < read_header_field(m_buffer, HEADER_NB_ENTRIES));
+      hash |= std::size_t(hash_tags(m_buffer)[ientry])
+              << (sizeof(std::size_t) * CHAR_BIT - 8);
     }
 
-   public:
-    array_hash_iterator() noexcept : m_array_hash(nullptr) {}
+    return hash;
+  }
 
-    template <bool TIsConst = IsConst,
-              typename std::enable_if<TIsConst>::type* = nullptr>
-    array_hash_iterator(const array_hash_iterator<!TIsConst>& other) noexcept
-        : m_buckets_iterator(other.m_buckets_iterator),
-          m_array_bucket_iterator(other.m_array_bucket_iterator),
-          m_array_hash(other.m_array_hash) {}
+  /**
+   * Return an iterator pointing to the key entry if presents or, if not there,
+   * to the position past the last element of the bucket. Return end() if the
+   * bucket has not be initialized yet.
+   *
+   * The boolean of the pair is set to true if the key is there, false
+   * otherwise.
+   *
+   * The hash of the key is only used if StoreHashTags or StoreHash is true.
+   */
+  std::pair<const_iterator, bool> find_or_end_of_bucket(
+      const CharT* key, size_type key_size, std::size_t hash) const noexcept {
+    if (m_buffer == nullptr) {
+      return std::make_pair(cend(), false);
+    }
 
-    array_hash_iterator(const array_hash_iterator& other) = default;
-    array_hash_iterator(array_hash_iterator&& other) = default;
-    array_hash_iterator& operator=(const array_hash_iterator& other) = default;
-    array_hash_iterator& operator=(array_hash_iterator&& other) = default;
+    const CharT* buffer_ptr_in_out = first_entry(m_buffer);
+    const bool found =
+        find_or_end_of_bucket_impl(key, key_size, hash, buffer_ptr_in_out);
 
-    const CharT* key() const { return m_array_bucket_iterator.key(); }
+    return std::make_pair(const_iterator(buffer_ptr_in_out), found);
+  }
 
-    size_type key_size() const { return m_array_bucket_iterator.key_size(); }
+  /**
+   * Append the element 'key' with its potential value at the end of the bucket.
+   * 'end_of_bucket' should point past the end of the last element in the
+   * bucket, end() if the bucket was not initialized yet. You usually get this
+   * value from find_or_end_of_bucket.
+   *
+   * Return the position where the element was actually inserted.
+   */
+  template <class... ValueArgs>
+  const_iterator append(BucketStorage& storage, const_iterator end_of_bucket,
+                        const CharT* key, size_type key_size, std::size_t hash,
+                        ValueArgs&&... value) {
+    const key_size_type key_sz = as_key_size_type(key_size);
+    const size_type entry_size = entry_required_bytes(key_sz);
 
-#ifdef TSL_AH_HAS_STRING_VIEW
-    std::basic_string_view<CharT> key_sv() const {
-      return std::basic_string_view<CharT>(key(), key_size());
+    if (end_of_bucket == cend()) {
+      tsl_ah_assert(m_buffer == nullptr);
+
+      m_buffer = allocate_empty_buffer(
+          storage, BucketGrowthPolicy::next_capacity(0, entry_size),
+          hash_tags_capacity_for(1));
+
+      CharT* buffer_append_pos = first_entry(m_buffer);
+      append_impl(key, key_sz, hash, buffer_append_pos,
+                  std::forward<ValueArgs>(value)...);
+      update_header_on_append(key_sz, hash);
+
+      return const_iterator(buffer_append_pos);
+    } else {
+      tsl_ah_assert(is_end_of_bucket(end_of_bucket.m_position));
+
+      const size_type used_size =
+          (end_of_bucket.m_position - first_entry(m_buffer)) * sizeof(CharT);
+
+      // Grow the hash tags array by one group if it is full.
+      size_type tags_growth = 0;
+      if (StoreHashTags && read_header_field(m_buffer, HEADER_NB_ENTRIES) ==
+                               read_header_field(m_buffer,
+                                                 HEADER_TAGS_CAPACITY)) {
+        tags_growth = HASH_TAGS_GROUP_SIZE;
+      }
+
+      const size_type capacity =
+          TRACK_CAPACITY ? read_header_field(m_buffer, HEADER_CAPACITY)
+                         : used_size;
+      if (tags_growth > 0 || used_size + entry_size > capacity) {
+        grow_buffer(storage, used_size,
+                    (used_size + entry_size <= capacity)
+                        ? capacity
+                        : BucketGrowthPolicy::next_capacity(
+                              capacity, used_size + entry_size),
+                    tags_growth);
+      }
+
+      CharT* buffer_append_pos =
+          first_entry(m_buffer) + used_size / sizeof(CharT);
+      append_impl(key, key_sz, hash, buffer_append_pos,
+                  std::forward<ValueArgs>(value)...);
+      update_header_on_append(key_sz, hash);
+
+      return const_iterator(buffer_append_pos);
     }
-#endif
+  }
 
-    template <class U = T, typename std::enable_if<
-                               has_mapped_type<U>::value>::type* = nullptr>
-    reference value() const {
-      return this->m_array_hash->m_values[value_position()];
+  const_iterator erase(BucketStorage& storage,
+                       const_iterator position) noexcept {
+    tsl_ah_assert(position.m_position != nullptr &&
+                  !is_end_of_bucket(position.m_position));
+
+    // get mutable pointers
+    CharT* start_entry = m_buffer + (position.m_position - m_buffer);
+    const size_type entry_size = entry_size_bytes(start_entry);
+    CharT* start_next_entry = start_entry + entry_size / sizeof(CharT);
+
+    CharT* end_buffer_ptr;
+    if (HAS_HEADER) {
+      end_buffer_ptr =
+          first_entry(m_buffer) +
+          read_header_field(m_buffer, HEADER_USED_SIZE) / sizeof(CharT);
+    } else {
+      end_buffer_ptr = start_next_entry;
+      while (!is_end_of_bucket(end_buffer_ptr)) {
+        end_buffer_ptr += entry_size_bytes(end_buffer_ptr) / sizeof(CharT);
+      }
     }
+    end_buffer_ptr += size_as_char_t<decltype(END_OF_BUCKET)>();
 
-    template <class U = T, typename std::enable_if<
-                               has_mapped_type<U>::value>::type* = nullptr>
-    reference operator*() const {
-      return value();
+    if (HAS_HEADER) {
+      update_header_on_erase(start_entry, entry_size);
     }
 
-    template <class U = T, typename std::enable_if<
-                               has_mapped_type<U>::value>::type* = nullptr>
-    pointer operator->() const {
-      return std::addressof(value());
+    const size_type size_to_move =
+        (end_buffer_ptr - start_next_entry) * sizeof(CharT);
+    std::memmove(start_entry, start_next_entry, size_to_move);
+
+    if (is_end_of_bucket(first_entry(m_buffer))) {
+      clear(storage);
+      return cend();
+    } else if (is_end_of_bucket(start_entry)) {
+      return cend();
+    } else {
+      return const_iterator(start_entry);
     }
+  }
 
-    array_hash_iterator& operator++() {
-      tsl_ah_assert(m_buckets_iterator != m_array_hash->m_buckets_data.end());
-      tsl_ah_assert(m_array_bucket_iterator != m_buckets_iterator->cend());
+  /**
+   * Return true if an element has been erased
+   */
+  bool erase(BucketStorage& storage, const CharT* key, size_type key_size,
+             std::size_t hash) noexcept {
+    if (m_buffer == nullptr) {
+      return false;
+    }
 
-      ++m_array_bucket_iterator;
-      if (m_array_bucket_iterator == m_buckets_iterator->cend()) {
-        do {
-          ++m_buckets_iterator;
-        } while (m_buckets_iterator != m_array_hash->m_buckets_data.end() &&
-                 m_buckets_iterator->empty());
+    const CharT* entry_buffer_ptr_in_out = first_entry(m_buffer);
+    bool found = find_or_end_of_bucket_impl(key, key_size, hash,
+                                            entry_buffer_ptr_in_out);
+    if (found) {
+      erase(storage, const_iterator(entry_buffer_ptr_in_out));
 
-        if (m_buckets_iterator != m_array_hash->m_buckets_data.end()) {
-          m_array_bucket_iterator = m_buckets_iterator->cbegin();
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  /**
+   * Erase the entries for which pred(const_iterator) returns true in a single
+   * pass over the buffer, each kept entry being moved at most once. The buffer
+   * is deallocated if the bucket becomes empty, its capacity is kept
+   * otherwise.
+   *
+   * If pred throws, the entries not visited yet are kept and the bucket stays
+   * valid.
+   */
+  template <class Predicate>
+  void erase_if(BucketStorage& storage, Predicate pred) {
+    if (m_buffer == nullptr) {
+      return;
+    }
+
+    CharT* read_ptr = first_entry(m_buffer);
+    CharT* write_ptr = read_ptr;
+    size_type ientry = 0;
+    size_type nb_kept = 0;
+    while (!is_end_of_bucket(read_ptr)) {
+      const size_type entry_size = entry_size_bytes(read_ptr);
+
+      bool erase_entry;
+      try {
+        erase_entry = pred(const_iterator(read_ptr));
+      } catch (...) {
+        end_erase_if(storage, read_ptr, write_ptr, ientry, nb_kept);
+        throw;
+      }
+
+      if (!erase_entry) {
+        if (write_ptr != read_ptr) {
+          std::memmove(write_ptr, read_ptr, entry_size);
+          if (StoreHashTags) {
+            hash_tags(m_buffer)[nb_kept] = hash_tags(m_buffer)[ientry];
+          }
         }
+
+        write_ptr += entry_size / sizeof(CharT);
+        nb_kept++;
       }
 
-      return *this;
+      read_ptr += entry_size / sizeof(CharT);
+      ientry++;
     }
 
-    array_hash_iterator operator++(int) {
-      array_hash_iterator tmp(*this);
-      ++*this;
+    end_erase_if(storage, read_ptr, write_ptr, ientry, nb_kept);
+  }
 
-      return tmp;
+  /**
+   * Grow the buffer, at most once and to the exact size needed, so that
+   * 'nb_entries' more entries using 'size' more bytes can be appended with
+   * append_in_reserved_bucket_no_check.
+   */
+  void reserve_append(BucketStorage& storage, size_type size,
+                      size_type nb_entries) {
+    if (size == 0) {
+      return;
     }
 
-    friend bool operator==(const array_hash_iterator& lhs,
-                           const array_hash_iterator& rhs) {
-      return lhs.m_buckets_iterator == rhs.m_buckets_iterator &&
-             lhs.m_array_bucket_iterator == rhs.m_array_bucket_iterator &&
-             lhs.m_array_hash == rhs.m_array_hash;
+    if (m_buffer == nullptr) {
+      m_buffer = allocate_empty_buffer(storage, size,
+                                       hash_tags_capacity_for(nb_entries));
+      return;
     }
 
-    friend bool operator!=(const array_hash_iterator& lhs,
-                           const array_hash_iterator& rhs) {
-      return !(lhs == rhs);
+    const size_type used_size = used_bytes(m_buffer);
+    const size_type capacity =
+        TRACK_CAPACITY ? read_header_field(m_buffer, HEADER_CAPACITY)
+                       : used_size;
+
+    size_type tags_growth = 0;
+    if (StoreHashTags) {
+      const size_type tags_capacity = hash_tags_capacity_for(
+          read_header_field(m_buffer, HEADER_NB_ENTRIES) + nb_entries);
+      const size_type current_tags_capacity =
+          read_header_field(m_buffer, HEADER_TAGS_CAPACITY);
+      if (tags_capacity > current_tags_capacity) {
+        tags_growth = tags_capacity - current_tags_capacity;
+      }
     }
 
-   private:
-    template <class U = T, typename std::enable_if<
-                               has_mapped_type<U>::value>::type* = nullptr>
-    IndexSizeT value_position() const {
-      return this->m_array_bucket_iterator.value();
+    if (tags_growth > 0 || used_size + size > capacity) {
+      grow_buffer(storage, used_size, std::max(capacity, used_size + size),
+                  tags_growth);
     }
+  }
 
-   private:
-    iterator_buckets m_buckets_iterator;
-    iterator_array_bucket m_array_bucket_iterator;
+  /**
+   * Bucket should be big enough and there is no check to see if the key already
+   * exists. No check on key_size.
+   */
+  template <class... ValueArgs>
+  void append_in_reserved_bucket_no_check(const CharT* key, size_type key_size,
+                                          std::size_t hash,
+                                          ValueArgs&&... value) noexcept {
+    CharT* buffer_ptr = first_entry(m_buffer);
+    if (HAS_HEADER) {
+      tsl_ah_assert(!StoreHashTags ||
+                    read_header_field(m_buffer, HEADER_NB_ENTRIES) <
+                        read_header_field(m_buffer, HEADER_TAGS_CAPACITY));
+      tsl_ah_assert(!TRACK_CAPACITY ||
+                    read_header_field(m_buffer, HEADER_USED_SIZE) +
+                            entry_required_bytes(key_size) <=
+                        read_header_field(m_buffer, HEADER_CAPACITY));
+      buffer_ptr +=
+          read_header_field(m_buffer, HEADER_USED_SIZE) / sizeof(CharT);
+    } else {
+      while (!is_end_of_bucket(buffer_ptr)) {
+        buffer_ptr += entry_size_bytes(buffer_ptr) / sizeof(CharT);
+      }
+    }
 
-    array_hash_ptr m_array_hash;
-  };
+    append_impl(key, key_size_type(key_size), hash, buffer_ptr,
+                std::forward<ValueArgs>(value)...);
+    update_header_on_append(key_size_type(key_size), hash);
+  }
 
- public:
-  array_hash(size_type bucket_count, const Hash& hash, float max_load_factor)
-      : value_container<T>(),
-        Hash(hash),
-        GrowthPolicy(bucket_count),
-        m_buckets_data(bucket_count > max_bucket_count()
-                           ? throw std::length_error(
-                                 "The map exceeds its maximum bucket count.")
-                           : bucket_count),
-        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data()),
-        m_nb_elements(0) {
-    this->max_load_factor(max_load_factor);
+  bool empty() const noexcept {
+    return m_buffer == nullptr || is_end_of_bucket(first_entry(m_buffer));
   }
 
-  array_hash(const array_hash& other)
-      : value_container<T>(other),
-        Hash(other),
-        GrowthPolicy(other),
-        m_buckets_data(other.m_buckets_data),
-        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data()),
-        m_nb_elements(other.m_nb_elements),
-        m_max_load_factor(other.m_max_load_factor),
-        m_load_threshold(other.m_load_threshold) {}
+  /**
+   * Hint the CPU to start loading the beginning of the buffer in the cache.
+   */
+  void prefetch() const noexcept { tsl_ah_prefetch(m_buffer); }
 
-  array_hash(array_hash&& other) noexcept(
-      std::is_nothrow_move_constructible<value_container<T>>::value&&
-          std::is_nothrow_move_constructible<Hash>::value&&
-              std::is_nothrow_move_constructible<GrowthPolicy>::value&&
-                  std::is_nothrow_move_constructible<
-                      std::vector<array_bucket>>::value)
-      : value_container<T>(std::move(other)),
-        Hash(std::move(other)),
-        GrowthPolicy(std::move(other)),
-        m_buckets_data(std::move(other.m_buckets_data)),
-        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data()),
-        m_nb_elements(other.m_nb_elements),
-        m_max_load_factor(other.m_max_load_factor),
-        m_load_threshold(other.m_load_threshold) {
-    other.value_container<T>::clear();
-    other.GrowthPolicy::clear();
-    other.m_buckets_data.clear();
-    other.m_buckets = static_empty_bucket_ptr();
-    other.m_nb_elements = 0;
-    other.m_load_threshold = 0;
+  void clear(BucketStorage& storage) noexcept {
+    if (m_buffer != nullptr) {
+      storage.deallocate(m_buffer, allocated_bytes());
+      m_buffer = nullptr;
+    }
   }
 
-  array_hash& operator=(const array_hash& other) {
-    if (&other != this) {
-      value_container<T>::operator=(other);
-      Hash::operator=(other);
-      GrowthPolicy::operator=(other);
-
-      m_buckets_data = other.m_buckets_data;
-      m_buckets = m_buckets_data.empty() ? static_empty_bucket_ptr()
-                                         : m_buckets_data.data();
-      m_nb_elements = other.m_nb_elements;
-      m_max_load_factor = other.m_max_load_factor;
-      m_load_threshold = other.m_load_threshold;
-    }
+  /**
+   * Forget the buffer without deallocating it. Used when all the buffers of
+   * the storage are released at once.
+   */
+  void clear_without_deallocation() noexcept { m_buffer = nullptr; }
 
-    return *this;
+  iterator mutable_iterator(const_iterator pos) noexcept {
+    return iterator(m_buffer + (pos.m_position - m_buffer));
   }
 
-  array_hash& operator=(array_hash&& other) {
-    other.swap(*this);
-    other.clear();
+  /**
+   * Only the entries are serialized, the hash tags are not part of the
+   * serialized bucket.
+   */
+  template <class Serializer>
+  void serialize(Serializer& serializer) const {
+    const slz_size_type bucket_size = size();
+    tsl_ah_assert(m_buffer != nullptr || bucket_size == 0);
 
-    return *this;
+    serializer(bucket_size);
+    serializer(m_buffer != nullptr ? first_entry(m_buffer) : m_buffer,
+               bucket_size);
   }
 
-  /*
-   * Iterators
+  /**
+   * If StoreHashTags is true, 'key_hash' is called with each key and its size
+   * to rebuild the hash tags of the bucket. It's unused otherwise.
+   *
+   * The capacity of the deserialized bucket is equal to its size.
    */
-  iterator begin() noexcept {
-    auto begin = m_buckets_data.begin();
-    while (begin != m_buckets_data.end() && begin->empty()) {
-      ++begin;
-    }
+  template <class Deserializer, class KeyHash>
+  static array_bucket deserialize(Deserializer& deserializer,
+                                  const KeyHash& key_hash,
+                                  BucketStorage& storage) {
+    array_bucket bucket;
+    const slz_size_type bucket_size_ds =
+        deserialize_value<slz_size_type>(deserializer);
 
-    return (begin != m_buckets_data.end())
-               ? iterator(begin, begin->cbegin(), this)
-               : end();
-  }
+    if (bucket_size_ds == 0) {
+      return bucket;
+    }
 
-  const_iterator begin() const noexcept { return cbegin(); }
+    const std::size_t bucket_size = numeric_cast<std::size_t>(
+        bucket_size_ds, "Deserialized bucket_size is too big.");
+    bucket.m_buffer = static_cast<CharT*>(
+        storage.allocate(bucket_size * sizeof(CharT) +
+                         sizeof_in_buff<decltype(END_OF_BUCKET)>()));
 
-  const_iterator cbegin() const noexcept {
-    auto begin = m_buckets_data.cbegin();
-    while (begin != m_buckets_data.cend() && begin->empty()) {
-      ++begin;
+    try {
+      deserializer(bucket.m_buffer, bucket_size);
+    } catch (...) {
+      bucket.clear_unfinished_buffer(storage, bucket_size);
+      throw;
     }
 
-    return (begin != m_buckets_data.cend())
-               ? const_iterator(begin, begin->cbegin(), this)
-               : cend();
-  }
+    const auto end_of_bucket = END_OF_BUCKET;
+    std::memcpy(bucket.m_buffer + bucket_size, &end_of_bucket,
+                sizeof(end_of_bucket));
 
-  iterator end() noexcept {
-    return iterator(m_buckets_data.end(), array_bucket::cend_it(), this);
+    if (HAS_HEADER) {
+      try {
+        bucket.add_header(storage, bucket_size, key_hash);
+      } catch (...) {
+        bucket.clear_unfinished_buffer(storage, bucket_size);
+        throw;
+      }
+    }
+
+    tsl_ah_assert(bucket.size() == bucket_size);
+    return bucket;
   }
 
-  const_iterator end() const noexcept { return cend(); }
+  /**
+   * Return a buffer of entries without any entry, only END_OF_BUCKET. See
+   * deserialize_entries.
+   */
+  static std::vector<CharT> empty_entries() {
+    std::vector<CharT> entries(size_as_char_t<key_size_type>());
+    const auto end_of_bucket = END_OF_BUCKET;
+    std::memcpy(entries.data(), &end_of_bucket, sizeof(end_of_bucket));
 
-  const_iterator cend() const noexcept {
-    return const_iterator(m_buckets_data.end(), array_bucket::cend_it(), this);
+    return entries;
   }
 
-  /*
-   * Capacity
+  /**
+   * Deserialize the entries of a serialized bucket at the end of 'entries',
+   * which must end with END_OF_BUCKET, without allocating a bucket. The
+   * END_OF_BUCKET is moved after the new entries.
+   *
+   * Used to deserialize the entries of multiple buckets one after the other in
+   * a single buffer. Return the offset of the first new entry, which is equal
+   * to the offset of END_OF_BUCKET if the serialized bucket is empty.
    */
-  bool empty() const noexcept { return m_nb_elements == 0; }
+  template <class Deserializer>
+  static std::size_t deserialize_entries(Deserializer& deserializer,
+                                         std::vector<CharT>& entries) {
+    tsl_ah_assert(!entries.empty() &&
+                  is_end_of_bucket(entries.data() + entries.size() -
+                                   size_as_char_t<key_size_type>()));
 
-  size_type size() const noexcept { return m_nb_elements; }
+    const slz_size_type bucket_size_ds =
+        deserialize_value<slz_size_type>(deserializer);
+    const std::size_t offset = entries.size() - size_as_char_t<key_size_type>();
+    if (bucket_size_ds == 0) {
+      return offset;
+    }
 
-  size_type max_size() const noexcept {
-    return std::numeric_limits<IndexSizeT>::max();
+    const std::size_t bucket_size = numeric_cast<std::size_t>(
+        bucket_size_ds, "Deserialized bucket_size is too big.");
+    entries.resize(offset + bucket_size + size_as_char_t<key_size_type>());
+    deserializer(entries.data() + offset, bucket_size);
+
+    const auto end_of_bucket = END_OF_BUCKET;
+    std::memcpy(entries.data() + offset + bucket_size, &end_of_bucket,
+                sizeof(end_of_bucket));
+
+    return offset;
   }
 
-  size_type max_key_size() const noexcept { return MAX_KEY_SIZE; }
+  /**
+   * Return an iterator to 'entry' in a buffer filled by deserialize_entries.
+   * The iterator is equal to cend_it() once it reaches END_OF_BUCKET.
+   */
+  static const_iterator entries_iterator(const CharT* entry) noexcept {
+    return const_iterator(!is_end_of_bucket(entry) ? entry : nullptr);
+  }
 
-  void shrink_to_fit() {
-    clear_old_erased_values();
-    value_container<T>::shrink_to_fit();
+ private:
+  key_size_type as_key_size_type(size_type key_size) const {
+    if (key_size > MAX_KEY_SIZE) {
+      throw std::length_error("Key is too long.");
+    }
 
-    rehash_impl(size_type(std::ceil(float(size()) / max_load_factor())));
+    return key_size_type(key_size);
   }
 
   /*
-   * Modifiers
+   * Return true if found, false otherwise.
+   * If true, buffer_ptr_in_out points to the start of the entry matching 'key'.
+   * If false, buffer_ptr_in_out points to where the 'key' should be inserted.
+   *
+   * Start search from buffer_ptr_in_out which must be the first entry of the
+   * bucket if StoreHashTags is true.
    */
-  void clear() noexcept {
-    value_container<T>::clear();
+  bool find_or_end_of_bucket_impl(
+      const CharT* key, size_type key_size, std::size_t hash,
+      const CharT*& buffer_ptr_in_out) const noexcept {
+    if (StoreHashTags) {
+      return find_or_end_of_bucket_with_hash_tags_impl(key, key_size, hash,
+                                                       buffer_ptr_in_out);
+    }
 
-    for (auto& bucket : m_buckets_data) {
-      bucket.clear();
+    while (!is_end_of_bucket(buffer_ptr_in_out)) {
+      if (entry_key_equals(buffer_ptr_in_out, key, key_size, hash)) {
+        return true;
+      }
+
+      buffer_ptr_in_out += entry_size_bytes(buffer_ptr_in_out) / sizeof(CharT);
     }
 
-    m_nb_elements = 0;
+    return false;
   }
 
-  template <class... ValueArgs>
-  std::pair<iterator, bool> emplace(const CharT* key, size_type key_size,
-                                    ValueArgs&&... value_args) {
-    const std::size_t hash = hash_key(key, key_size);
-    std::size_t ibucket = bucket_for_hash(hash);
+  bool find_or_end_of_bucket_with_hash_tags_impl(
+      const CharT* key, size_type key_size, std::size_t hash,
+      const CharT*& buffer_ptr_in_out) const noexcept {
+    tsl_ah_assert(buffer_ptr_in_out == first_entry(m_buffer));
+
+    const size_type nb_entries = read_header_field(m_buffer, HEADER_NB_ENTRIES);
+    const unsigned char* tags = hash_tags(m_buffer);
+    const unsigned char tag = hash_tag(hash);
+
+    // Entry at index 'ientry'. Only moved forward on a tag match.
+    const CharT* entry_ptr = buffer_ptr_in_out;
+    size_type ientry = 0;
+
+    size_type igroup = 0;
+    while (igroup < nb_entries) {
+      std::uint32_t matches;
+      size_type group_size;
+#ifdef TSL_AH_HAS_AVX2
+      if (igroup + 2 * HASH_TAGS_GROUP_SIZE <=
+          read_header_field(m_buffer, HEADER_TAGS_CAPACITY)) {
+        matches = match_hash_tags_two_groups(tags + igroup, tag);
+        group_size = 2 * HASH_TAGS_GROUP_SIZE;
+      } else
+#endif
+      {
+        matches = match_hash_tags_group(tags + igroup, tag);
+        group_size = HASH_TAGS_GROUP_SIZE;
+      }
 
-    auto it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
-    if (it_find.second) {
-      return std::make_pair(
-          iterator(m_buckets_data.begin() + ibucket, it_find.first, this),
-          false);
+      // Ignore the unused tags past the last entry.
+      if (nb_entries - igroup < group_size) {
+        matches &= (std::uint32_t(1) << (nb_entries - igroup)) - 1;
+      }
+
+      while (matches != 0) {
+        const size_type imatch = igroup + count_trailing_zeros(matches);
+        for (; ientry < imatch; ientry++) {
+          entry_ptr += entry_size_bytes(entry_ptr) / sizeof(CharT);
+        }
+
+        if (entry_key_equals(entry_ptr, key, key_size, hash)) {
+          buffer_ptr_in_out = entry_ptr;
+          return true;
+        }
+
+        matches &= matches - 1;
+      }
+
+      igroup += group_size;
     }
 
-    if (grow_on_high_load()) {
-      ibucket = bucket_for_hash(hash);
-      it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
+    buffer_ptr_in_out +=
+        read_header_field(m_buffer, HEADER_USED_SIZE) / sizeof(CharT);
+    tsl_ah_assert(is_end_of_bucket(buffer_ptr_in_out));
+
+    return false;
+  }
+
+  /**
+   * Grow m_buffer so that its entries can use at least 'min_capacity' bytes
+   * and its hash tags array can store 'tags_growth' more tags. 'used_size' is
+   * the current used size in bytes of the entries.
+   */
+  void grow_buffer(BucketStorage& storage, size_type used_size,
+                   size_type min_capacity, size_type tags_growth) {
+    const size_type new_offset = entries_offset_bytes(m_buffer) + tags_growth;
+    const size_type new_buffer_size =
+        good_buffer_size(storage, new_offset, min_capacity);
+    const size_type new_capacity = new_buffer_size - new_offset -
+                                   sizeof_in_buff<decltype(END_OF_BUCKET)>();
+    tsl_ah_assert(new_capacity >= min_capacity);
+
+    m_buffer = static_cast<CharT*>(
+        storage.reallocate(m_buffer, allocated_bytes(), new_buffer_size));
+
+    if (tags_growth > 0) {
+      CharT* entries = first_entry(m_buffer);
+      std::memmove(entries + tags_growth / sizeof(CharT), entries,
+                   used_size + sizeof_in_buff<decltype(END_OF_BUCKET)>());
+
+      write_header_field(
+          m_buffer, HEADER_TAGS_CAPACITY,
+          read_header_field(m_buffer, HEADER_TAGS_CAPACITY) + tags_growth);
     }
 
-    return emplace_impl(ibucket, it_find.first, key, key_size,
-                        std::forward<ValueArgs>(value_args)...);
+    if (TRACK_CAPACITY) {
+      write_header_field(m_buffer, HEADER_CAPACITY, new_capacity);
+    }
   }
 
-  template <class M>
-  std::pair<iterator, bool> insert_or_assign(const CharT* key,
-                                             size_type key_size, M&& obj) {
-    auto it = emplace(key, key_size, std::forward<M>(obj));
-    if (!it.second) {
-      it.first.value() = std::forward<M>(obj);
+  /**
+   * Update the header after the append of an entry with a key of size
+   * 'key_size' and a hash of 'hash'. Noop if there is no header.
+   */
+  void update_header_on_append(key_size_type key_size,
+                               std::size_t hash) noexcept {
+    if (!HAS_HEADER) {
+      return;
     }
 
-    return it;
+    write_header_field(m_buffer, HEADER_USED_SIZE,
+                       read_header_field(m_buffer, HEADER_USED_SIZE) +
+                           entry_required_bytes(key_size));
+
+    if (StoreHashTags) {
+      const size_type nb_entries =
+          read_header_field(m_buffer, HEADER_NB_ENTRIES);
+      tsl_ah_assert(nb_entries <
+                    read_header_field(m_buffer, HEADER_TAGS_CAPACITY));
+
+      hash_tags(m_buffer)[nb_entries] = hash_tag(hash);
+      write_header_field(m_buffer, HEADER_NB_ENTRIES, nb_entries + 1);
+    }
   }
 
-  iterator erase(const_iterator pos) {
-    if (should_clear_old_erased_values()) {
-      clear_old_erased_values();
+  /**
+   * Update the header before the erase of the entry at 'entry_ptr' which has a
+   * size of 'entry_size' bytes.
+   */
+  void update_header_on_erase(const CharT* entry_ptr,
+                              size_type entry_size) noexcept {
+    tsl_ah_assert(HAS_HEADER);
+
+    if (StoreHashTags) {
+      size_type ientry = 0;
+      for (const CharT* ptr = first_entry(m_buffer); ptr != entry_ptr;
+           ptr += entry_size_bytes(ptr) / sizeof(CharT)) {
+        ientry++;
+      }
+
+      const size_type nb_entries =
+          read_header_field(m_buffer, HEADER_NB_ENTRIES);
+      tsl_ah_assert(ientry < nb_entries);
+
+      unsigned char* tags = hash_tags(m_buffer);
+      std::memmove(tags + ientry, tags + ientry + 1, nb_entries - ientry - 1);
+
+      write_header_field(m_buffer, HEADER_NB_ENTRIES, nb_entries - 1);
     }
 
-    return erase_from_bucket(mutable_iterator(pos));
+    write_header_field(
+        m_buffer, HEADER_USED_SIZE,
+        read_header_field(m_buffer, HEADER_USED_SIZE) - entry_size);
   }
 
-  iterator erase(const_iterator first, const_iterator last) {
-    if (first == last) {
-      return mutable_iterator(first);
+  /**
+   * End an erase_if which stopped at 'read_ptr', the 'ientry'-th entry, after
+   * having kept 'nb_kept' entries up to 'write_ptr'. The entries from
+   * 'read_ptr' to END_OF_BUCKET are moved to 'write_ptr' with their hash tags
+   * and the header is updated.
+   */
+  void end_erase_if(BucketStorage& storage, CharT* read_ptr, CharT* write_ptr,
+                    size_type ientry, size_type nb_kept) noexcept {
+    if (write_ptr == read_ptr) {
+      return;
     }
 
-    /**
-     * When erasing an element from a bucket with erase_from_bucket, it
-     * invalidates all the iterators in the array bucket of the element
-     * (m_array_bucket_iterator) but not the iterators of the buckets itself
-     * (m_buckets_iterator).
-     *
-     * So first erase all the values between first and last which are not part
-     * of the bucket of last, and then erase carefully the values in last's
-     * bucket.
-     */
-    auto to_delete = mutable_iterator(first);
-    while (to_delete.m_buckets_iterator != last.m_buckets_iterator) {
-      to_delete = erase_from_bucket(to_delete);
+    CharT* end_ptr = read_ptr;
+    size_type nb_entries = ientry;
+    while (!is_end_of_bucket(end_ptr)) {
+      end_ptr += entry_size_bytes(end_ptr) / sizeof(CharT);
+      nb_entries++;
     }
+    end_ptr += size_as_char_t<decltype(END_OF_BUCKET)>();
 
-    std::size_t nb_elements_until_last = std::distance(
-        to_delete.m_array_bucket_iterator, last.m_array_bucket_iterator);
-    while (nb_elements_until_last > 0) {
-      to_delete = erase_from_bucket(to_delete);
-      nb_elements_until_last--;
+    std::memmove(write_ptr, read_ptr, (end_ptr - read_ptr) * sizeof(CharT));
+
+    if (StoreHashTags) {
+      unsigned char* tags = hash_tags(m_buffer);
+      std::memmove(tags + nb_kept, tags + ientry, nb_entries - ientry);
+      write_header_field(m_buffer, HEADER_NB_ENTRIES,
+                         nb_kept + nb_entries - ientry);
     }
 
-    if (should_clear_old_erased_values()) {
-      clear_old_erased_values();
+    if (HAS_HEADER) {
+      write_header_field(m_buffer, HEADER_USED_SIZE,
+                         read_header_field(m_buffer, HEADER_USED_SIZE) -
+                             (read_ptr - write_ptr) * sizeof(CharT));
     }
 
-    return to_delete;
+    if (is_end_of_bucket(first_entry(m_buffer))) {
+      clear(storage);
+    }
   }
 
-  size_type erase(const CharT* key, size_type key_size) {
-    return erase(key, key_size, hash_key(key, key_size));
-  }
+  /**
+   * Transform m_buffer, which only contains 'entries_size' CharT of entries
+   * followed by END_OF_BUCKET, into a buffer with a header and, if
+   * StoreHashTags is true, hash tags.
+   */
+  template <class KeyHash>
+  void add_header(BucketStorage& storage, size_type entries_size,
+                  const KeyHash& key_hash) {
+    tsl_ah_assert(HAS_HEADER && m_buffer != nullptr);
+
+    size_type nb_entries = 0;
+    if (StoreHashTags) {
+      for (const CharT* ptr = m_buffer; !is_end_of_bucket(ptr);
+           ptr += entry_size_bytes(ptr) / sizeof(CharT)) {
+        nb_entries++;
+      }
+    }
 
-  size_type erase(const CharT* key, size_type key_size, std::size_t hash) {
+    const size_type tags_capacity = hash_tags_capacity_for(nb_entries);
+    const size_type entries_with_end_bytes =
+        entries_size * sizeof(CharT) +
+        sizeof_in_buff<decltype(END_OF_BUCKET)>();
+
+    m_buffer = static_cast<CharT*>(
+        storage.reallocate(m_buffer, entries_with_end_bytes,
+                           header_bytes() + tags_capacity +
+                               entries_with_end_bytes));
+
+    std::memmove(m_buffer + (header_bytes() + tags_capacity) / sizeof(CharT),
+                 m_buffer, entries_with_end_bytes);
+
+    write_empty_header(m_buffer, entries_size * sizeof(CharT), tags_capacity);
+
+    for (const CharT* ptr = first_entry(m_buffer); !is_end_of_bucket(ptr);
+         ptr += entry_size_bytes(ptr) / sizeof(CharT)) {
+      const key_size_type key_size = read_key_size(ptr);
+
+      // The tags come from the full hash, the stored truncated hash isn't
+      // enough to rebuild them.
+      const std::size_t hash =
+          StoreHashTags ? key_hash(ptr + key_offset(), key_size) : 0;
+      update_header_on_append(key_size, hash);
+    }
+  }
+
+  /**
+   * Write the size of the key and, if StoreHash is true, the truncated hash at
+   * 'buffer_append_pos'. Return the position of the key.
+   */
+  static CharT* append_key_size_and_hash(key_size_type key_size,
+                                         std::size_t hash,
+                                         CharT* buffer_append_pos) noexcept {
+    std::memcpy(buffer_append_pos, &key_size, sizeof(key_size));
+
+    if (StoreHash) {
+      const truncated_hash_type truncated_hash =
+          static_cast<truncated_hash_type>(hash);
+      std::memcpy(buffer_append_pos + size_as_char_t<key_size_type>(),
+                  &truncated_hash, sizeof(truncated_hash));
+    }
+
+    return buffer_append_pos + key_offset();
+  }
+
+  template <typename U = T, typename std::enable_if<
+                                !has_mapped_type<U>::value>::type* = nullptr>
+  void append_impl(const CharT* key, key_size_type key_size, std::size_t hash,
+                   CharT* buffer_append_pos) noexcept {
+    buffer_append_pos = append_key_size_and_hash(key_size, hash,
+                                                 buffer_append_pos);
+
+    std::memcpy(buffer_append_pos, key, key_size * sizeof(CharT));
+    buffer_append_pos += key_size;
+
+    const CharT zero = 0;
+    std::memcpy(buffer_append_pos, &zero, KEY_EXTRA_SIZE * sizeof(CharT));
+    buffer_append_pos += KEY_EXTRA_SIZE;
+
+    const auto end_of_bucket = END_OF_BUCKET;
+    std::memcpy(buffer_append_pos, &end_of_bucket, sizeof(end_of_bucket));
+  }
+
+  template <typename U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  void append_impl(const CharT* key, key_size_type key_size, std::size_t hash,
+                   CharT* buffer_append_pos,
+                   typename array_bucket<
+                       CharT, U, KeyEqual, KeySizeT, StoreNullTerminator,
+                       StoreHashTags, BucketGrowthPolicy, BucketStorage,
+                       StoreHash, AlignValues>::mapped_type value) noexcept {
+    CharT* const entry_pos = buffer_append_pos;
+    buffer_append_pos = append_key_size_and_hash(key_size, hash,
+                                                 buffer_append_pos);
+
+    std::memcpy(buffer_append_pos, key, key_size * sizeof(CharT));
+    buffer_append_pos += key_size;
+
+    // Null terminator and padding before the value, if any.
+    CharT* const value_pos = entry_pos + value_offset(key_size);
+    std::memset(buffer_append_pos, 0,
+                (value_pos - buffer_append_pos) * sizeof(CharT));
+    buffer_append_pos = value_pos;
+
+    std::memcpy(buffer_append_pos, &value, sizeof(value));
+    buffer_append_pos += size_as_char_t<mapped_type>();
+
+    const auto end_of_bucket = END_OF_BUCKET;
+    std::memcpy(buffer_append_pos, &end_of_bucket, sizeof(end_of_bucket));
+  }
+
+  /**
+   * Copy the buffer of 'other' in m_buffer, which must be null. The copy only
+   * reserves the used size of 'other', not its capacity.
+   */
+  void copy_buffer(BucketStorage& storage, const array_bucket& other) {
+    tsl_ah_assert(m_buffer == nullptr);
+    if (other.m_buffer == nullptr) {
+      return;
+    }
+
+    const size_type other_used_bytes = used_bytes(other.m_buffer);
+    const size_type other_offset_bytes = entries_offset_bytes(other.m_buffer);
+    const size_type buffer_size =
+        good_buffer_size(storage, other_offset_bytes, other_used_bytes);
+
+    m_buffer = static_cast<CharT*>(storage.allocate(buffer_size));
+    std::memcpy(m_buffer, other.m_buffer,
+                other_offset_bytes + other_used_bytes);
+    if (TRACK_CAPACITY) {
+      write_header_field(m_buffer, HEADER_CAPACITY,
+                         buffer_size - other_offset_bytes -
+                             sizeof_in_buff<decltype(END_OF_BUCKET)>());
+    }
+
+    const auto end_of_bucket = END_OF_BUCKET;
+    std::memcpy(m_buffer + (other_offset_bytes + other_used_bytes) /
+                               sizeof(CharT),
+                &end_of_bucket, sizeof(end_of_bucket));
+  }
+
+  /**
+   * Deallocate m_buffer when it only contains 'entries_size' CharT of entries
+   * and no header yet.
+   */
+  void clear_unfinished_buffer(BucketStorage& storage,
+                               size_type entries_size) noexcept {
+    storage.deallocate(m_buffer, entries_size * sizeof(CharT) +
+                                     sizeof_in_buff<decltype(END_OF_BUCKET)>());
+    m_buffer = nullptr;
+  }
+
+  /**
+   * Return the size in bytes of m_buffer as given to the storage. The size is
+   * only known if TRACK_CAPACITY is true, 0 is returned otherwise (the storage
+   * doesn't need it if BucketStorage::owns_buffers is false).
+   */
+  size_type allocated_bytes() const noexcept {
+    tsl_ah_assert(m_buffer != nullptr);
+    if (!TRACK_CAPACITY) {
+      return 0;
+    }
+
+    return entries_offset_bytes(m_buffer) +
+           read_header_field(m_buffer, HEADER_CAPACITY) +
+           sizeof_in_buff<decltype(END_OF_BUCKET)>();
+  }
+
+  /**
+   * Return the number of CharT used by the entries of m_buffer, see
+   * used_bytes.
+   */
+  size_type size() const noexcept {
+    if (m_buffer == nullptr) {
+      return 0;
+    }
+
+    return used_bytes(m_buffer) / sizeof(CharT);
+  }
+
+ public:
+  /**
+   * Add the buffer of the bucket to 'usage', split between the keys, the
+   * inline values, the metadata and the unused capacity.
+   */
+  void add_memory_usage(tsl::ah::memory_usage& usage) const noexcept {
+    if (m_buffer == nullptr) {
+      return;
+    }
+
+    size_type nb_entries = 0;
+    size_type key_bytes = 0;
+    for (const CharT* ptr = first_entry(m_buffer); !is_end_of_bucket(ptr);
+         ptr += entry_size_bytes(ptr) / sizeof(CharT)) {
+      key_bytes += read_key_size(ptr) * sizeof(CharT);
+      nb_entries++;
+    }
+
+    const size_type used = used_bytes(m_buffer);
+    const size_type capacity =
+        TRACK_CAPACITY ? read_header_field(m_buffer, HEADER_CAPACITY) : used;
+    const size_type buffer_bytes = entries_offset_bytes(m_buffer) + capacity +
+                                   sizeof_in_buff<decltype(END_OF_BUCKET)>();
+    const size_type value_bytes = nb_entries * inline_value_bytes();
+    const size_type unused_bytes =
+        (capacity - used) +
+        (StoreHashTags ? read_header_field(m_buffer, HEADER_TAGS_CAPACITY) -
+                             nb_entries
+                       : 0);
+
+    usage.nb_bucket_buffers++;
+    usage.bucket_buffers_bytes += buffer_bytes;
+    usage.key_bytes += key_bytes;
+    usage.inline_value_bytes += value_bytes;
+    usage.unused_bucket_bytes += unused_bytes;
+    usage.metadata_bytes +=
+        buffer_bytes - key_bytes - value_bytes - unused_bytes;
+  }
+
+  /**
+   * Add the bucket to the histograms of 'stats'. The size of the bucket goes
+   * from the beginning of the buffer to the end of bucket marker.
+   */
+  void add_bucket_stats(tsl::ah::bucket_stats& stats) const {
+    size_type nb_entries = 0;
+    size_type bytes = 0;
+    size_type nb_cache_lines = 0;
+    if (m_buffer != nullptr) {
+      const CharT* buffer_ptr = first_entry(m_buffer);
+      while (!is_end_of_bucket(buffer_ptr)) {
+        buffer_ptr += entry_size_bytes(buffer_ptr) / sizeof(CharT);
+        nb_entries++;
+      }
+
+      bytes = (buffer_ptr - m_buffer) * sizeof(CharT) +
+              sizeof_in_buff<decltype(END_OF_BUCKET)>();
+
+      const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(m_buffer);
+      const std::uintptr_t line_size = tsl::ah::bucket_stats::CACHE_LINE_SIZE;
+      nb_cache_lines = (begin + bytes - 1) / line_size - begin / line_size + 1;
+    }
+
+    if (nb_entries == 0) {
+      stats.nb_empty_buckets++;
+    }
+    stats.max_bucket_entries = std::max(stats.max_bucket_entries, nb_entries);
+    stats.max_bucket_bytes = std::max(stats.max_bucket_bytes, bytes);
+
+    add_to_histogram(stats.entries_histogram, nb_entries);
+    add_to_histogram(stats.bytes_histogram, bit_width(bytes));
+    add_to_histogram(stats.cache_lines_histogram, nb_cache_lines);
+  }
+
+ private:
+  /**
+   * Size in bytes of a value stored in an entry, 0 if the entries store an
+   * index to the value or no value.
+   */
+  template <class U = T, typename std::enable_if<!has_mapped_type<U>::value ||
+                                                 !AlignValues>::type* = nullptr>
+  static constexpr size_type inline_value_bytes() noexcept {
+    return 0;
+  }
+
+  template <class U = T, typename std::enable_if<has_mapped_type<U>::value &&
+                                                 AlignValues>::type* = nullptr>
+  static constexpr size_type inline_value_bytes() noexcept {
+    return sizeof_in_buff<U>();
+  }
+
+  static const key_size_type END_OF_BUCKET =
+      std::numeric_limits<key_size_type>::max();
+  static const key_size_type KEY_EXTRA_SIZE = StoreNullTerminator ? 1 : 0;
+
+  /**
+   * A storage which owns the buffers needs to know their exact size.
+   */
+  static const bool TRACK_CAPACITY =
+      BucketGrowthPolicy::track_capacity || BucketStorage::owns_buffers;
+  static const bool HAS_HEADER = StoreHashTags || TRACK_CAPACITY;
+
+  /**
+   * Fields of the header. HEADER_USED_SIZE is present if HAS_HEADER is true,
+   * HEADER_CAPACITY if TRACK_CAPACITY is true and HEADER_NB_ENTRIES and
+   * HEADER_TAGS_CAPACITY if StoreHashTags is true.
+   */
+  static const size_type HEADER_USED_SIZE = 0;
+  static const size_type HEADER_CAPACITY = 1;
+  static const size_type HEADER_NB_ENTRIES = TRACK_CAPACITY ? 2 : 1;
+  static const size_type HEADER_TAGS_CAPACITY = HEADER_NB_ENTRIES + 1;
+  static const size_type NB_HEADER_FIELDS =
+      (HAS_HEADER ? 1 : 0) + (TRACK_CAPACITY ? 1 : 0) + (StoreHashTags ? 2 : 0);
+
+  CharT* m_buffer;
+
+ public:
+  static const key_size_type MAX_KEY_SIZE =
+      // -1 for END_OF_BUCKET
+      key_size_type(std::numeric_limits<key_size_type>::max() - KEY_EXTRA_SIZE -
+                    1);
+};
+
+template <class T, class IndexSizeT>
+class value_container {
+ public:
+  void clear() noexcept {
+    m_values.clear();
+    m_free_values.clear();
+  }
+
+  void reserve(std::size_t new_cap) { m_values.reserve(new_cap); }
+
+  void shrink_to_fit() {
+    m_values.shrink_to_fit();
+    m_free_values.shrink_to_fit();
+  }
+
+  friend void swap(value_container& lhs, value_container& rhs) {
+    lhs.m_values.swap(rhs.m_values);
+    lhs.m_free_values.swap(rhs.m_free_values);
+  }
+
+ protected:
+  static constexpr float VECTOR_GROWTH_RATE = 1.5f;
+
+  // TODO use a sparse array? or a std::deque
+  std::vector<T> m_values;
+
+  /**
+   * Indexes in m_values of erased values which can be reused by the next
+   * insertions. The slots still hold the erased values until they are reused
+   * or until clear_old_erased_values is called.
+   */
+  std::vector<IndexSizeT> m_free_values;
+};
+
+template <class IndexSizeT>
+class value_container<void, IndexSizeT> {
+ public:
+  void clear() noexcept {}
+
+  void shrink_to_fit() {}
+
+  void reserve(std::size_t /*new_cap*/) {}
+};
+
+/**
+ * If there is no value in the array_hash (in the case of a set for example), T
+ * should be void.
+ *
+ * If StoreHashTags is true, each bucket stores an 8-bit tag of the hash of each
+ * of its keys (see array_bucket).
+ *
+ * BucketGrowthPolicy defines how the buffer of a bucket grows on insertion
+ * (see tsl::ah::exact_bucket_growth_policy).
+ *
+ * The buffers of the buckets are allocated through BucketStorage (see
+ * tsl::ah::malloc_bucket_storage). If BucketStorage::owns_buffers is true, the
+ * buffers are released all at once on clear, rehash and destruction instead of
+ * one by one.
+ *
+ * If StoreHash is true, each entry of a bucket also stores the truncated hash
+ * of its key (see array_bucket), which is used on rehash when the GrowthPolicy
+ * allows it (see USE_STORED_HASH_ON_REHASH).
+ *
+ * The size of a key string is limited to std::numeric_limits<KeySizeT>::max()
+ * - 1.
+ *
+ * The number of elements in the map is limited to
+ * std::numeric_limits<IndexSizeT>::max().
+ */
+template <class CharT, class T, class Hash, class KeyEqual,
+          bool StoreNullTerminator, class KeySizeT, class IndexSizeT,
+          class GrowthPolicy, bool StoreHashTags, class BucketGrowthPolicy,
+          class BucketStorage, bool StoreHash, bool InlineValues>
+class array_hash
+    : private value_container<
+          typename std::conditional<InlineValues, void, T>::type, IndexSizeT>,
+      private Hash,
+      private GrowthPolicy,
+      private BucketStorage {
+ private:
+  template <typename U>
+  using has_mapped_type =
+      typename std::integral_constant<bool, !std::is_same<U, void>::value>;
+
+  /**
+   * True if the values are stored in m_values, false if there is no value or
+   * if the values are stored directly in the buckets (InlineValues).
+   */
+  template <typename U>
+  using has_values_container =
+      typename std::integral_constant<bool, has_mapped_type<U>::value &&
+                                                !InlineValues>;
+
+  template <typename U>
+  using has_inline_values =
+      typename std::integral_constant<bool, has_mapped_type<U>::value &&
+                                                InlineValues>;
+
+  /**
+   * The slots of the erased values are reused by the next insertions if the
+   * values can be move-assigned (see m_free_values).
+   */
+  template <typename U>
+  using can_reuse_erased_values =
+      typename std::integral_constant<bool,
+                                      has_values_container<U>::value &&
+                                          std::is_move_assignable<U>::value>;
+
+  using values_container = value_container<
+      typename std::conditional<InlineValues, void, T>::type, IndexSizeT>;
+
+  /**
+   * Type of the values stored by parsed_chunk, unused without mapped value.
+   */
+  using chunk_value_type =
+      typename std::conditional<has_mapped_type<T>::value, T, char>::type;
+
+  /**
+   * If there is a mapped type in array_hash, we store the values in m_values of
+   * value_container class and we store an index to m_values in the bucket. The
+   * index is of type IndexSizeT.
+   *
+   * If InlineValues is true, the values are instead stored, aligned, directly
+   * in the buckets.
+   */
+  using array_bucket = tsl::detail_array_hash::array_bucket<
+      CharT,
+      typename std::conditional<
+          has_mapped_type<T>::value,
+          typename std::conditional<InlineValues, T, IndexSizeT>::type,
+          void>::type,
+      KeyEqual, KeySizeT, StoreNullTerminator, StoreHashTags,
+      BucketGrowthPolicy, BucketStorage, StoreHash, InlineValues>;
+
+ public:
+  template <bool IsConst>
+  class array_hash_iterator;
+
+  using char_type = CharT;
+  using key_size_type = KeySizeT;
+  using index_size_type = IndexSizeT;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using iterator = array_hash_iterator<false>;
+  using const_iterator = array_hash_iterator<true>;
+
+  /*
+   * Iterator classes
+   */
+ public:
+  template <bool IsConst>
+  class array_hash_iterator {
+    friend class array_hash;
+
+   private:
+    using iterator_array_bucket = typename array_bucket::const_iterator;
+
+    using iterator_buckets = typename std::conditional<
+        IsConst, typename std::vector<array_bucket>::const_iterator,
+        typename std::vector<array_bucket>::iterator>::type;
+
+    using array_hash_ptr = typename std::conditional<IsConst, const array_hash*,
+                                                     array_hash*>::type;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type =
+        typename std::conditional<has_mapped_type<T>::value, T, void>::type;
+    using difference_type = std::ptrdiff_t;
+    using reference = typename std::conditional<
+        has_mapped_type<T>::value,
+        typename std::conditional<
+            IsConst, typename std::add_lvalue_reference<const T>::type,
+            typename std::add_lvalue_reference<T>::type>::type,
+        void>::type;
+    using pointer = typename std::conditional<
+        has_mapped_type<T>::value,
+        typename std::conditional<IsConst, const T*, T*>::type, void>::type;
+
+   private:
+    array_hash_iterator(iterator_buckets buckets_iterator,
+                        iterator_array_bucket array_bucket_iterator,
+                        array_hash_ptr array_hash_p) noexcept
+        : m_buckets_iterator(buckets_iterator),
+          m_array_bucket_iterator(array_bucket_iterator),
+          m_array_hash(array_hash_p) {
+      tsl_ah_assert(m_array_hash != nullptr);
+    }
+
+   public:
+    array_hash_iterator() noexcept : m_array_hash(nullptr) {}
+
+    template <bool TIsConst = IsConst,
+              typename std::enable_if<TIsConst>::type* = nullptr>
+    array_hash_iterator(const array_hash_iterator<!TIsConst>& other) noexcept
+        : m_buckets_iterator(other.m_buckets_iterator),
+          m_array_bucket_iterator(other.m_array_bucket_iterator),
+          m_array_hash(other.m_array_hash) {}
+
+    array_hash_iterator(const array_hash_iterator& other) = default;
+    array_hash_iterator(array_hash_iterator&& other) = default;
+    array_hash_iterator& operator=(const array_hash_iterator& other) = default;
+    array_hash_iterator& operator=(array_hash_iterator&& other) = default;
+
+    const CharT* key() const { return m_array_bucket_iterator.key(); }
+
+    size_type key_size() const { return m_array_bucket_iterator.key_size(); }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+    std::basic_string_view<CharT> key_sv() const {
+      return std::basic_string_view<CharT>(key(), key_size());
+    }
+#endif
+
+    template <class U = T, typename std::enable_if<
+                               has_mapped_type<U>::value>::type* = nullptr>
+    reference value() const {
+      return const_cast<reference>(
+          m_array_hash->entry_value(m_array_bucket_iterator));
+    }
+
+    template <class U = T, typename std::enable_if<
+                               has_mapped_type<U>::value>::type* = nullptr>
+    reference operator*() const {
+      return value();
+    }
+
+    template <class U = T, typename std::enable_if<
+                               has_mapped_type<U>::value>::type* = nullptr>
+    pointer operator->() const {
+      return std::addressof(value());
+    }
+
+    array_hash_iterator& operator++() {
+      tsl_ah_assert(m_buckets_iterator != m_array_hash->m_buckets_data.end());
+      tsl_ah_assert(m_array_bucket_iterator != m_buckets_iterator->cend());
+
+      ++m_array_bucket_iterator;
+      if (m_array_bucket_iterator == m_buckets_iterator->cend()) {
+        do {
+          ++m_buckets_iterator;
+        } while (m_buckets_iterator != m_array_hash->m_buckets_data.end() &&
+                 m_buckets_iterator->empty());
+
+        if (m_buckets_iterator != m_array_hash->m_buckets_data.end()) {
+          m_array_bucket_iterator = m_buckets_iterator->cbegin();
+        }
+      }
+
+      return *this;
+    }
+
+    array_hash_iterator operator++(int) {
+      array_hash_iterator tmp(*this);
+      ++*this;
+
+      return tmp;
+    }
+
+    friend bool operator==(const array_hash_iterator& lhs,
+                           const array_hash_iterator& rhs) {
+      return lhs.m_buckets_iterator == rhs.m_buckets_iterator &&
+             lhs.m_array_bucket_iterator == rhs.m_array_bucket_iterator &&
+             lhs.m_array_hash == rhs.m_array_hash;
+    }
+
+    friend bool operator!=(const array_hash_iterator& lhs,
+                           const array_hash_iterator& rhs) {
+      return !(lhs == rhs);
+    }
+
+   private:
+    iterator_buckets m_buckets_iterator;
+    iterator_array_bucket m_array_bucket_iterator;
+
+    array_hash_ptr m_array_hash;
+  };
+
+ public:
+  array_hash(size_type bucket_count, const Hash& hash, float max_load_factor)
+      : values_container(),
+        Hash(hash),
+        GrowthPolicy(bucket_count),
+        BucketStorage(),
+        m_buckets_data(bucket_count > max_bucket_count()
+                           ? throw std::length_error(
+                                 "The map exceeds its maximum bucket count.")
+                           : bucket_count),
+        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
+                                         : m_buckets_data.data()),
+        m_nb_elements(0),
+        m_entries_bytes(0),
+        m_max_load_bytes(0) {
+    this->max_load_factor(max_load_factor);
+  }
+
+  array_hash(const array_hash& other)
+      : values_container(other),
+        Hash(other),
+        GrowthPolicy(other),
+        BucketStorage(other),
+        m_buckets_data(copy_buckets(other.m_buckets_data, bucket_storage())),
+        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
+                                         : m_buckets_data.data()),
+        m_nb_elements(other.m_nb_elements),
+        m_max_load_factor(other.m_max_load_factor),
+        m_load_threshold(other.m_load_threshold),
+        m_entries_bytes(other.m_entries_bytes),
+        m_max_load_bytes(other.m_max_load_bytes),
+        m_load_bytes_threshold(other.m_load_bytes_threshold) {}
+
+  array_hash(array_hash&& other) noexcept(
+      std::is_nothrow_move_constructible<
+          values_container>::value&&
+          std::is_nothrow_move_constructible<Hash>::value&&
+              std::is_nothrow_move_constructible<GrowthPolicy>::value&&
+                  std::is_nothrow_move_constructible<BucketStorage>::value&&
+                      std::is_nothrow_move_constructible<
+                          std::vector<array_bucket>>::value)
+      : values_container(std::move(other)),
+        Hash(std::move(other)),
+        GrowthPolicy(std::move(other)),
+        BucketStorage(std::move(other)),
+        m_buckets_data(std::move(other.m_buckets_data)),
+        m_buckets(m_buckets_data.empty() ? static_empty_bucket_ptr()
+                                         : m_buckets_data.data()),
+        m_nb_elements(other.m_nb_elements),
+        m_max_load_factor(other.m_max_load_factor),
+        m_load_threshold(other.m_load_threshold),
+        m_entries_bytes(other.m_entries_bytes),
+        m_max_load_bytes(other.m_max_load_bytes),
+        m_load_bytes_threshold(other.m_load_bytes_threshold) {
+    other.values_container::clear();
+    other.GrowthPolicy::clear();
+    other.m_buckets_data.clear();
+    other.m_buckets = static_empty_bucket_ptr();
+    other.m_nb_elements = 0;
+    other.m_load_threshold = 0;
+    other.m_entries_bytes = 0;
+    other.m_load_bytes_threshold = 0;
+  }
+
+  array_hash& operator=(const array_hash& other) {
+    if (&other != this) {
+      // Copy the buckets in a new storage first. The old buckets are then
+      // destroyed before their storage at the end of the scope.
+      BucketStorage new_bucket_storage;
+      std::vector<array_bucket> new_buckets =
+          copy_buckets(other.m_buckets_data, new_bucket_storage);
+
+      values_container::operator=(other);
+      Hash::operator=(other);
+      GrowthPolicy::operator=(other);
+
+      using std::swap;
+      swap(static_cast<BucketStorage&>(*this), new_bucket_storage);
+      m_buckets_data.swap(new_buckets);
+      m_buckets = m_buckets_data.empty() ? static_empty_bucket_ptr()
+                                         : m_buckets_data.data();
+      m_nb_elements = other.m_nb_elements;
+      m_max_load_factor = other.m_max_load_factor;
+      m_load_threshold = other.m_load_threshold;
+      m_entries_bytes = other.m_entries_bytes;
+      m_max_load_bytes = other.m_max_load_bytes;
+      m_load_bytes_threshold = other.m_load_bytes_threshold;
+    }
+
+    return *this;
+  }
+
+  array_hash& operator=(array_hash&& other) {
+    other.swap(*this);
+    other.clear();
+
+    return *this;
+  }
+
+  /*
+   * Iterators
+   */
+  iterator begin() noexcept {
+    auto begin = m_buckets_data.begin();
+    while (begin != m_buckets_data.end() && begin->empty()) {
+      ++begin;
+    }
+
+    return (begin != m_buckets_data.end())
+               ? iterator(begin, begin->cbegin(), this)
+               : end();
+  }
+
+  const_iterator begin() const noexcept { return cbegin(); }
+
+  const_iterator cbegin() const noexcept {
+    auto begin = m_buckets_data.cbegin();
+    while (begin != m_buckets_data.cend() && begin->empty()) {
+      ++begin;
+    }
+
+    return (begin != m_buckets_data.cend())
+               ? const_iterator(begin, begin->cbegin(), this)
+               : cend();
+  }
+
+  iterator end() noexcept {
+    return iterator(m_buckets_data.end(), array_bucket::cend_it(), this);
+  }
+
+  const_iterator end() const noexcept { return cend(); }
+
+  const_iterator cend() const noexcept {
+    return const_iterator(m_buckets_data.end(), array_bucket::cend_it(), this);
+  }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_nb_elements == 0; }
+
+  size_type size() const noexcept { return m_nb_elements; }
+
+  size_type max_size() const noexcept {
+    return std::numeric_limits<IndexSizeT>::max();
+  }
+
+  size_type max_key_size() const noexcept { return MAX_KEY_SIZE; }
+
+  void shrink_to_fit() {
+    clear_old_erased_values();
+    values_container::shrink_to_fit();
+
+    rehash_impl(min_bucket_count_for_load());
+  }
+
+  /**
+   * Walk all the buckets to compute the memory used by the table.
+   */
+  tsl::ah::memory_usage memory_usage() const {
+    tsl::ah::memory_usage usage;
+    usage.bucket_array_bytes =
+        m_buckets_data.capacity() * sizeof(array_bucket);
+    for (const auto& bucket : m_buckets_data) {
+      bucket.add_memory_usage(usage);
+    }
+
+    usage.allocator_overhead_bytes = bucket_storage().overhead_bytes(
+        usage.bucket_buffers_bytes, usage.nb_bucket_buffers);
+    add_values_memory_usage(usage);
+
+    return usage;
+  }
+
+  /*
+   * Modifiers
+   */
+  void clear() noexcept {
+    values_container::clear();
+
+    if (BucketStorage::owns_buffers) {
+      for (auto& bucket : m_buckets_data) {
+        bucket.clear_without_deallocation();
+      }
+      bucket_storage().release();
+    } else {
+      for (auto& bucket : m_buckets_data) {
+        bucket.clear(bucket_storage());
+      }
+    }
+
+    m_nb_elements = 0;
+    m_entries_bytes = 0;
+  }
+
+  /**
+   * Replace the content of the table by the elements of [first, last). The
+   * keys are hashed once, each bucket is allocated once with the exact size
+   * needed by all the keys of the range which go in it, duplicates included,
+   * and the elements are then appended to their bucket.
+   *
+   * If [first, last) are random access iterators, the keys are hashed by up
+   * to 'nb_threads' threads. The table is left unchanged if an exception is
+   * thrown before the elements are appended.
+   */
+  template <class InputIt>
+  void bulk_load(InputIt first, InputIt last,
+                 tsl::ah::duplicate_policy policy, std::size_t nb_threads) {
+    bulk_load_impl(
+        first, last, policy, nb_threads,
+        typename std::iterator_traits<InputIt>::iterator_category());
+  }
+
+  template <class... ValueArgs>
+  std::pair<iterator, bool> emplace(const CharT* key, size_type key_size,
+                                    ValueArgs&&... value_args) {
+    return emplace_with_hash(key, key_size, hash_key(key, key_size),
+                             std::forward<ValueArgs>(value_args)...);
+  }
+
+  /**
+   * Same as emplace but use 'hash' as the hash of the key instead of hashing
+   * it. 'hash' must be the same as hash_function()(key, key_size).
+   */
+  template <class... ValueArgs>
+  std::pair<iterator, bool> emplace_with_hash(const CharT* key,
+                                              size_type key_size,
+                                              std::size_t hash,
+                                              ValueArgs&&... value_args) {
+    std::size_t ibucket = bucket_for_hash(hash);
+
+    auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      return std::make_pair(
+          iterator(m_buckets_data.begin() + ibucket, it_find.first, this),
+          false);
+    }
+
+    if (grow_on_high_load()) {
+      ibucket = bucket_for_hash(hash);
+      it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    }
+
+    return emplace_impl(ibucket, it_find.first, key, key_size, hash,
+                        std::forward<ValueArgs>(value_args)...);
+  }
+
+  template <class M>
+  std::pair<iterator, bool> insert_or_assign(const CharT* key,
+                                             size_type key_size, M&& obj) {
+    return insert_or_assign(key, key_size, hash_key(key, key_size),
+                            std::forward<M>(obj));
+  }
+
+  template <class M>
+  std::pair<iterator, bool> insert_or_assign(const CharT* key,
+                                             size_type key_size,
+                                             std::size_t hash, M&& obj) {
+    auto it = emplace_with_hash(key, key_size, hash, std::forward<M>(obj));
+    if (!it.second) {
+      it.first.value() = std::forward<M>(obj);
+    }
+
+    return it;
+  }
+
+  iterator erase(const_iterator pos) {
+    if (should_clear_old_erased_values()) {
+      clear_old_erased_values();
+    }
+
+    return erase_from_bucket(mutable_iterator(pos));
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    if (first == last) {
+      return mutable_iterator(first);
+    }
+
+    /**
+     * When erasing an element from a bucket with erase_from_bucket, it
+     * invalidates all the iterators in the array bucket of the element
+     * (m_array_bucket_iterator) but not the iterators of the buckets itself
+     * (m_buckets_iterator).
+     *
+     * So first erase all the values between first and last which are not part
+     * of the bucket of last, and then erase carefully the values in last's
+     * bucket.
+     */
+    auto to_delete = mutable_iterator(first);
+    while (to_delete.m_buckets_iterator != last.m_buckets_iterator) {
+      to_delete = erase_from_bucket(to_delete);
+    }
+
+    std::size_t nb_elements_until_last = std::distance(
+        to_delete.m_array_bucket_iterator, last.m_array_bucket_iterator);
+    while (nb_elements_until_last > 0) {
+      to_delete = erase_from_bucket(to_delete);
+      nb_elements_until_last--;
+    }
+
+    if (should_clear_old_erased_values()) {
+      clear_old_erased_values();
+    }
+
+    return to_delete;
+  }
+
+  size_type erase(const CharT* key, size_type key_size) {
+    return erase(key, key_size, hash_key(key, key_size));
+  }
+
+  size_type erase(const CharT* key, size_type key_size, std::size_t hash) {
     if (should_clear_old_erased_values()) {
       clear_old_erased_values();
     }
 
-    const std::size_t ibucket = bucket_for_hash(hash);
-    if (m_buckets[ibucket].erase(key, key_size)) {
-      m_nb_elements--;
-      return 1;
+    const std::size_t ibucket = bucket_for_hash(hash);
+    const auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      release_value(it_find.first);
+      m_entries_bytes -=
+          array_bucket::entry_required_bytes(it_find.first.key_size());
+      m_buckets[ibucket].erase(bucket_storage(), it_find.first);
+      m_nb_elements--;
+      return 1;
+    } else {
+      return 0;
+    }
+  }
+
+  /**
+   * Erase the elements for which pred(key, key_size) returns true, or
+   * pred(key, key_size, value) if there is a mapped value. Each bucket is
+   * compacted in a single pass.
+   *
+   * If 'compact_values' is true, m_values is compacted at the end instead of
+   * keeping the slots of the erased values for the next insertions.
+   */
+  template <class Predicate>
+  size_type erase_if(Predicate pred, bool compact_values) {
+    const size_type nb_elements_before = m_nb_elements;
+    for (auto& bucket : m_buckets_data) {
+      bucket.erase_if(bucket_storage(),
+                      [&](typename array_bucket::const_iterator it) {
+                        if (!call_erase_predicate(pred, it)) {
+                          return false;
+                        }
+
+                        if (!compact_values) {
+                          release_value(it);
+                        }
+                        m_entries_bytes -=
+                            array_bucket::entry_required_bytes(it.key_size());
+                        m_nb_elements--;
+
+                        return true;
+                      });
+    }
+
+    if (compact_values || should_clear_old_erased_values()) {
+      clear_old_erased_values();
+    }
+
+    return nb_elements_before - m_nb_elements;
+  }
+
+  void swap(array_hash& other) {
+    using std::swap;
+
+    swap(static_cast<values_container&>(*this),
+         static_cast<values_container&>(other));
+    swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
+    swap(static_cast<GrowthPolicy&>(*this), static_cast<GrowthPolicy&>(other));
+    swap(static_cast<BucketStorage&>(*this),
+         static_cast<BucketStorage&>(other));
+    swap(m_buckets_data, other.m_buckets_data);
+    swap(m_buckets, other.m_buckets);
+    swap(m_nb_elements, other.m_nb_elements);
+    swap(m_max_load_factor, other.m_max_load_factor);
+    swap(m_load_threshold, other.m_load_threshold);
+    swap(m_entries_bytes, other.m_entries_bytes);
+    swap(m_max_load_bytes, other.m_max_load_bytes);
+    swap(m_load_bytes_threshold, other.m_load_bytes_threshold);
+  }
+
+  /*
+   * Lookup
+   */
+  template <class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  U& at(const CharT* key, size_type key_size) {
+    return at(key, key_size, hash_key(key, key_size));
+  }
+
+  template <class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  const U& at(const CharT* key, size_type key_size) const {
+    return at(key, key_size, hash_key(key, key_size));
+  }
+
+  template <class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  U& at(const CharT* key, size_type key_size, std::size_t hash) {
+    return const_cast<U&>(
+        static_cast<const array_hash*>(this)->at(key, key_size, hash));
+  }
+
+  template <class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  const U& at(const CharT* key, size_type key_size, std::size_t hash) const {
+    const std::size_t ibucket = bucket_for_hash(hash);
+
+    auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      return entry_value(it_find.first);
+    } else {
+      throw std::out_of_range("Couldn't find key.");
+    }
+  }
+
+  template <class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+  U& access_operator(const CharT* key, size_type key_size) {
+    const std::size_t hash = hash_key(key, key_size);
+    std::size_t ibucket = bucket_for_hash(hash);
+
+    auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      return const_cast<U&>(entry_value(it_find.first));
+    } else {
+      if (grow_on_high_load()) {
+        ibucket = bucket_for_hash(hash);
+        it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+      }
+
+      return emplace_impl(ibucket, it_find.first, key, key_size, hash, U{})
+          .first.value();
+    }
+  }
+
+  size_type count(const CharT* key, size_type key_size) const {
+    return count(key, key_size, hash_key(key, key_size));
+  }
+
+  size_type count(const CharT* key, size_type key_size,
+                  std::size_t hash) const {
+    const std::size_t ibucket = bucket_for_hash(hash);
+
+    auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      return 1;
+    } else {
+      return 0;
+    }
+  }
+
+  iterator find(const CharT* key, size_type key_size) {
+    return find(key, key_size, hash_key(key, key_size));
+  }
+
+  const_iterator find(const CharT* key, size_type key_size) const {
+    return find(key, key_size, hash_key(key, key_size));
+  }
+
+  iterator find(const CharT* key, size_type key_size, std::size_t hash) {
+    const std::size_t ibucket = bucket_for_hash(hash);
+
+    auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      return iterator(m_buckets_data.begin() + ibucket, it_find.first, this);
+    } else {
+      return end();
+    }
+  }
+
+  const_iterator find(const CharT* key, size_type key_size,
+                      std::size_t hash) const {
+    const std::size_t ibucket = bucket_for_hash(hash);
+
+    auto it_find =
+        m_buckets[ibucket].find_or_end_of_bucket(key, key_size, hash);
+    if (it_find.second) {
+      return const_iterator(m_buckets_data.cbegin() + ibucket, it_find.first,
+                            this);
+    } else {
+      return cend();
+    }
+  }
+
+  /**
+   * Search each key of [keys_first, keys_last) and write the resulting iterator
+   * (end() if the key is not found) to iterators_out. The keys can be of type
+   * `const CharT*`, `std::basic_string<CharT>` or
+   * `std::basic_string_view<CharT>`. The keys of a group are referenced, not
+   * copied, so ForwardIt must be a forward iterator whose operator* returns a
+   * reference.
+   *
+   * The keys are searched by groups of BATCH_LOOKUP_SIZE. The keys of a group
+   * are all hashed and their buckets prefetched before being searched so that
+   * the cache misses of the group overlap.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      OutputIt iterators_out) {
+    lookup_batch(keys_first, keys_last, hasher_batch(),
+                 [&](std::size_t ibucket, const bucket_find_result& it_find) {
+                   *iterators_out++ =
+                       it_find.second
+                           ? iterator(m_buckets_data.begin() + ibucket,
+                                      it_find.first, this)
+                           : end();
+                 });
+
+    return iterators_out;
+  }
+
+  template <class ForwardIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      OutputIt iterators_out) const {
+    lookup_batch(keys_first, keys_last, hasher_batch(),
+                 [&](std::size_t ibucket, const bucket_find_result& it_find) {
+                   *iterators_out++ =
+                       it_find.second
+                           ? const_iterator(m_buckets_data.cbegin() + ibucket,
+                                            it_find.first, this)
+                           : cend();
+                 });
+
+    return iterators_out;
+  }
+
+  /**
+   * Same as find_batch(keys_first, keys_last, iterators_out) but use the
+   * precalculated hashes starting at hashes_first instead of hashing the keys.
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      HashIt hashes_first, OutputIt iterators_out) {
+    lookup_batch(keys_first, keys_last,
+                 precalculated_hasher_batch<HashIt>(hashes_first),
+                 [&](std::size_t ibucket, const bucket_find_result& it_find) {
+                   *iterators_out++ =
+                       it_find.second
+                           ? iterator(m_buckets_data.begin() + ibucket,
+                                      it_find.first, this)
+                           : end();
+                 });
+
+    return iterators_out;
+  }
+
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      HashIt hashes_first, OutputIt iterators_out) const {
+    lookup_batch(keys_first, keys_last,
+                 precalculated_hasher_batch<HashIt>(hashes_first),
+                 [&](std::size_t ibucket, const bucket_find_result& it_find) {
+                   *iterators_out++ =
+                       it_find.second
+                           ? const_iterator(m_buckets_data.cbegin() + ibucket,
+                                            it_find.first, this)
+                           : cend();
+                 });
+
+    return iterators_out;
+  }
+
+  /**
+   * Same as find_batch but write the count (0 or 1) of each key to counts_out.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       OutputIt counts_out) const {
+    lookup_batch(keys_first, keys_last, hasher_batch(),
+                 [&](std::size_t, const bucket_find_result& it_find) {
+                   *counts_out++ = it_find.second ? 1 : 0;
+                 });
+
+    return counts_out;
+  }
+
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       HashIt hashes_first, OutputIt counts_out) const {
+    lookup_batch(keys_first, keys_last,
+                 precalculated_hasher_batch<HashIt>(hashes_first),
+                 [&](std::size_t, const bucket_find_result& it_find) {
+                   *counts_out++ = it_find.second ? 1 : 0;
+                 });
+
+    return counts_out;
+  }
+
+  std::pair<iterator, iterator> equal_range(const CharT* key,
+                                            size_type key_size) {
+    return equal_range(key, key_size, hash_key(key, key_size));
+  }
+
+  std::pair<const_iterator, const_iterator> equal_range(
+      const CharT* key, size_type key_size) const {
+    return equal_range(key, key_size, hash_key(key, key_size));
+  }
+
+  std::pair<iterator, iterator> equal_range(const CharT* key,
+                                            size_type key_size,
+                                            std::size_t hash) {
+    iterator it = find(key, key_size, hash);
+    return std::make_pair(it, (it == end()) ? it : std::next(it));
+  }
+
+  std::pair<const_iterator, const_iterator> equal_range(
+      const CharT* key, size_type key_size, std::size_t hash) const {
+    const_iterator it = find(key, key_size, hash);
+    return std::make_pair(it, (it == cend()) ? it : std::next(it));
+  }
+
+  /*
+   * Bucket interface
+   */
+  size_type bucket_count() const { return m_buckets_data.size(); }
+
+  size_type max_bucket_count() const {
+    return std::min(GrowthPolicy::max_bucket_count(),
+                    m_buckets_data.max_size());
+  }
+
+  /**
+   * Walk all the buckets to compute their statistics.
+   */
+  tsl::ah::bucket_stats bucket_stats() const {
+    tsl::ah::bucket_stats stats;
+    stats.bucket_count = bucket_count();
+    for (const auto& bucket : m_buckets_data) {
+      bucket.add_bucket_stats(stats);
+    }
+
+    if (stats.bucket_count > 0) {
+      stats.empty_buckets_fraction =
+          float(stats.nb_empty_buckets) / float(stats.bucket_count);
+    }
+
+    return stats;
+  }
+
+  /*
+   *  Hash policy
+   */
+  float load_factor() const {
+    if (bucket_count() == 0) {
+      return 0;
+    }
+
+    return float(m_nb_elements) / float(bucket_count());
+  }
+
+  float max_load_factor() const { return m_max_load_factor; }
+
+  void max_load_factor(float ml) {
+    const float min_max_load_factor = MIN_MAX_LOAD_FACTOR;
+    m_max_load_factor = std::max(min_max_load_factor, ml);
+    m_load_threshold = size_type(float(bucket_count()) * m_max_load_factor);
+
+    if (m_max_load_bytes == 0 ||
+        bucket_count() > std::numeric_limits<size_type>::max() /
+                             m_max_load_bytes) {
+      m_load_bytes_threshold = std::numeric_limits<size_type>::max();
+    } else {
+      m_load_bytes_threshold = bucket_count() * m_max_load_bytes;
+    }
+  }
+
+  float load_bytes() const {
+    if (bucket_count() == 0) {
+      return 0;
+    }
+
+    return float(m_entries_bytes) / float(bucket_count());
+  }
+
+  size_type max_load_bytes() const { return m_max_load_bytes; }
+
+  void max_load_bytes(size_type mb) {
+    m_max_load_bytes = mb;
+    // Call max_load_factor to change m_load_bytes_threshold
+    max_load_factor(m_max_load_factor);
+  }
+
+  void rehash(size_type count, std::size_t nb_threads = 1) {
+    count = std::max(count, min_bucket_count_for_load());
+    rehash_impl(count, nb_threads);
+  }
+
+  void reserve(size_type count, std::size_t nb_threads = 1) {
+    rehash(size_type(std::ceil(float(count) / max_load_factor())), nb_threads);
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return static_cast<const hasher&>(*this); }
+
+  // TODO add support for statefull KeyEqual
+  key_equal key_eq() const { return KeyEqual(); }
+
+  /*
+   * Other
+   */
+  iterator mutable_iterator(const_iterator it) noexcept {
+    auto it_bucket =
+        m_buckets_data.begin() +
+        std::distance(m_buckets_data.cbegin(), it.m_buckets_iterator);
+    return iterator(it_bucket, it.m_array_bucket_iterator, this);
+  }
+
+  template <class Serializer>
+  void serialize(Serializer& serializer) const {
+    serialize_impl(serializer);
+  }
+
+  template <class Deserializer>
+  void deserialize(Deserializer& deserializer, bool hash_compatible,
+                   std::size_t nb_threads, bool check_duplicate_keys) {
+    deserialize_impl(deserializer, hash_compatible, nb_threads,
+                     check_duplicate_keys);
+  }
+
+  template <class Writer, class ValueSerializer>
+  void serialize_chunked(Writer& writer, std::size_t chunk_size,
+                         const ValueSerializer& value_serializer) const {
+    serialize_chunked_impl(writer, chunk_size, value_serializer);
+  }
+
+  template <class Reader, class ChunkFilter, class ValueDeserializer>
+  void deserialize_chunked(Reader& reader, std::uint64_t size,
+                           std::size_t nb_threads, ChunkFilter& chunk_filter,
+                           const ValueDeserializer& value_deserializer) {
+    deserialize_chunked_impl(reader, size, nb_threads, chunk_filter,
+                             value_deserializer);
+  }
+
+  /**
+   * Check the chunk index and the checksum of each chunk of a chunked
+   * serialization, throw std::runtime_error on the first error.
+   */
+  template <class Reader>
+  static void verify_chunked(Reader& reader, std::uint64_t size,
+                             std::size_t nb_threads) {
+    const chunked_index index = read_chunked_index(reader, size);
+
+    nb_threads = std::max<std::size_t>(
+        1, std::min(nb_threads, index.entries.size()));
+    parallel_for(nb_threads, [&](std::size_t ithread) {
+      std::vector<char> buffer;
+      for (std::size_t ichunk = ithread; ichunk < index.entries.size();
+           ichunk += nb_threads) {
+        read_chunk(reader, index.entries[ichunk], buffer);
+      }
+    });
+  }
+
+ private:
+  std::size_t hash_key(const CharT* key, size_type key_size) const {
+    return Hash::operator()(key, key_size);
+  }
+
+  BucketStorage& bucket_storage() noexcept { return *this; }
+
+  const BucketStorage& bucket_storage() const noexcept { return *this; }
+
+  static std::vector<array_bucket> copy_buckets(
+      const std::vector<array_bucket>& buckets, BucketStorage& storage) {
+    std::vector<array_bucket> buckets_copy;
+    buckets_copy.reserve(buckets.size());
+    for (const array_bucket& bucket : buckets) {
+      buckets_copy.emplace_back(storage, bucket);
+    }
+
+    return buckets_copy;
+  }
+
+  std::size_t bucket_for_hash(std::size_t hash) const {
+    return GrowthPolicy::bucket_for_hash(hash);
+  }
+
+  /*
+   * Batched lookups
+   */
+  using bucket_find_result =
+      std::pair<typename array_bucket::const_iterator, bool>;
+
+  static std::pair<const CharT*, size_type> batch_key(const CharT* key) {
+    return std::make_pair(key, std::char_traits<CharT>::length(key));
+  }
+
+  static std::pair<const CharT*, size_type> batch_key(
+      const std::basic_string<CharT>& key) {
+    return std::make_pair(key.data(), key.size());
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  static std::pair<const CharT*, size_type> batch_key(
+      const std::basic_string_view<CharT>& key) {
+    return std::make_pair(key.data(), key.size());
+  }
+#endif
+
+  class hasher_batch {
+   public:
+    std::size_t operator()(const array_hash& ht, const CharT* key,
+                           size_type key_size) {
+      return ht.hash_key(key, key_size);
+    }
+  };
+
+  template <class HashIt>
+  class precalculated_hasher_batch {
+   public:
+    explicit precalculated_hasher_batch(HashIt hashes_it)
+        : m_hashes_it(hashes_it) {}
+
+    std::size_t operator()(const array_hash& /*ht*/, const CharT* /*key*/,
+                           size_type /*key_size*/) {
+      return *m_hashes_it++;
+    }
+
+   private:
+    HashIt m_hashes_it;
+  };
+
+  /**
+   * Search the keys of [keys_first, keys_last) by groups of BATCH_LOOKUP_SIZE
+   * and call on_result(ibucket, it_find) for each key in order, where it_find
+   * is the result of find_or_end_of_bucket on the bucket ibucket.
+   *
+   * For each group, the buckets are prefetched while the keys are hashed, then
+   * the buffers of the buckets are prefetched and only then are the buckets
+   * searched.
+   */
+  template <class ForwardIt, class BatchHasher, class OnResult>
+  void lookup_batch(ForwardIt keys_first, ForwardIt keys_last,
+                    BatchHasher batch_hasher, OnResult on_result) const {
+    static_assert(
+        std::is_base_of<std::forward_iterator_tag,
+                        typename std::iterator_traits<
+                            ForwardIt>::iterator_category>::value &&
+            std::is_reference<
+                typename std::iterator_traits<ForwardIt>::reference>::value,
+        "The keys of a batch must be accessed through a forward iterator "
+        "returning a reference, they are kept until their group is searched.");
+
+    std::pair<const CharT*, size_type> keys[BATCH_LOOKUP_SIZE];
+    std::size_t hashes[BATCH_LOOKUP_SIZE];
+    std::size_t ibuckets[BATCH_LOOKUP_SIZE];
+
+    while (keys_first != keys_last) {
+      std::size_t nb_keys = 0;
+      for (; nb_keys < BATCH_LOOKUP_SIZE && keys_first != keys_last;
+           ++nb_keys, ++keys_first) {
+        keys[nb_keys] = batch_key(*keys_first);
+        hashes[nb_keys] =
+            batch_hasher(*this, keys[nb_keys].first, keys[nb_keys].second);
+        ibuckets[nb_keys] = bucket_for_hash(hashes[nb_keys]);
+        tsl_ah_prefetch(m_buckets + ibuckets[nb_keys]);
+      }
+
+      for (std::size_t i = 0; i < nb_keys; i++) {
+        m_buckets[ibuckets[i]].prefetch();
+      }
+
+      for (std::size_t i = 0; i < nb_keys; i++) {
+        on_result(ibuckets[i], m_buckets[ibuckets[i]].find_or_end_of_bucket(
+                                   keys[i].first, keys[i].second, hashes[i]));
+      }
+    }
+  }
+
+  /**
+   * If there is a mapped_type, the mapped value in m_values is not erased now.
+   * Its slot is reused by a next insertion (see release_value) or it will be
+   * erased when the ratio between the size of the map and the size of the
+   * map + the number of deleted values still stored is low enough (see
+   * clear_old_erased_values).
+   */
+  iterator erase_from_bucket(iterator pos) noexcept {
+    release_value(pos.m_array_bucket_iterator);
+    m_entries_bytes -= array_bucket::entry_required_bytes(
+        pos.m_array_bucket_iterator.key_size());
+    auto array_bucket_next_it = pos.m_buckets_iterator->erase(
+        bucket_storage(), pos.m_array_bucket_iterator);
+    m_nb_elements--;
+
+    if (array_bucket_next_it != pos.m_buckets_iterator->cend()) {
+      return iterator(pos.m_buckets_iterator, array_bucket_next_it, this);
+    } else {
+      do {
+        ++pos.m_buckets_iterator;
+      } while (pos.m_buckets_iterator != m_buckets_data.end() &&
+               pos.m_buckets_iterator->empty());
+
+      if (pos.m_buckets_iterator != m_buckets_data.end()) {
+        return iterator(pos.m_buckets_iterator,
+                        pos.m_buckets_iterator->cbegin(), this);
+      } else {
+        return end();
+      }
+    }
+  }
+
+  /**
+   * Add the slot of the value of the entry 'it', which is being erased, to the
+   * free slots if it can be reused. Otherwise, or if there isn't enough memory
+   * to keep track of the slot, the value stays in m_values until the next
+   * clear_old_erased_values.
+   */
+  template <class U = T,
+            typename std::enable_if<
+                !can_reuse_erased_values<U>::value>::type* = nullptr>
+  void release_value(typename array_bucket::const_iterator /*it*/) noexcept {}
+
+  template <class U = T,
+            typename std::enable_if<
+                can_reuse_erased_values<U>::value>::type* = nullptr>
+  void release_value(typename array_bucket::const_iterator it) noexcept {
+    try {
+      this->m_free_values.push_back(it.value());
+    } catch (...) {
+    }
+  }
+
+  /**
+   * Return the value of the entry 'it'.
+   */
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  const U& entry_value(typename array_bucket::const_iterator it) const {
+    return this->m_values[it.value()];
+  }
+
+  template <class U = T, typename std::enable_if<
+                             has_inline_values<U>::value>::type* = nullptr>
+  const U& entry_value(typename array_bucket::const_iterator it) const {
+    return *it.value_ptr();
+  }
+
+  template <class U = T, typename std::enable_if<
+                             !has_values_container<U>::value>::type* = nullptr>
+  void add_values_memory_usage(tsl::ah::memory_usage& /*usage*/) const {}
+
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  void add_values_memory_usage(tsl::ah::memory_usage& usage) const {
+    usage.live_value_bytes = m_nb_elements * sizeof(U);
+    usage.dead_value_bytes =
+        (this->m_values.size() - m_nb_elements) * sizeof(U);
+    usage.unused_value_bytes =
+        (this->m_values.capacity() - this->m_values.size()) * sizeof(U);
+    usage.free_slots_bytes =
+        this->m_free_values.capacity() * sizeof(IndexSizeT);
+  }
+
+  /**
+   * Call the predicate of erase_if on the entry 'it'.
+   */
+  template <class Predicate, class U = T,
+            typename std::enable_if<!has_mapped_type<U>::value>::type* =
+                nullptr>
+  static bool call_erase_predicate(Predicate& pred,
+                                   typename array_bucket::const_iterator it) {
+    return pred(it.key(), it.key_size());
+  }
+
+  template <class Predicate, class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* =
+                nullptr>
+  bool call_erase_predicate(Predicate& pred,
+                            typename array_bucket::const_iterator it) const {
+    return pred(it.key(), it.key_size(), entry_value(it));
+  }
+
+  template <class U = T, typename std::enable_if<
+                             !has_values_container<U>::value>::type* = nullptr>
+  bool should_clear_old_erased_values(
+      float /*threshold*/ = DEFAULT_CLEAR_OLD_ERASED_VALUE_THRESHOLD) const {
+    return false;
+  }
+
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  bool should_clear_old_erased_values(
+      float threshold = DEFAULT_CLEAR_OLD_ERASED_VALUE_THRESHOLD) const {
+    if (this->m_values.size() == 0) {
+      return false;
+    }
+
+    return float(m_nb_elements) / float(this->m_values.size()) < threshold;
+  }
+
+  template <class U = T, typename std::enable_if<
+                             !has_values_container<U>::value>::type* = nullptr>
+  void clear_old_erased_values() {}
+
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  void clear_old_erased_values() {
+    static_assert(std::is_nothrow_move_constructible<U>::value ||
+                      std::is_copy_constructible<U>::value,
+                  "mapped_value must be either copy constructible or nothrow "
+                  "move constructible.");
+
+    if (m_nb_elements == this->m_values.size()) {
+      return;
+    }
+
+    std::vector<T> new_values;
+    new_values.reserve(size());
+
+    for (auto it = begin(); it != end(); ++it) {
+      new_values.push_back(std::move_if_noexcept(it.value()));
+    }
+
+    IndexSizeT ivalue = 0;
+    for (auto it = begin(); it != end(); ++it) {
+      auto it_array_bucket =
+          it.m_buckets_iterator->mutable_iterator(it.m_array_bucket_iterator);
+      it_array_bucket.set_value(ivalue);
+      ivalue++;
+    }
+
+    new_values.swap(this->m_values);
+    this->m_free_values.clear();
+    tsl_ah_assert(m_nb_elements == this->m_values.size());
+  }
+
+  /**
+   * Return true if the number of elements or, if max_load_bytes() isn't 0, the
+   * size of the entries reached the threshold of the current bucket count.
+   */
+  bool is_high_load() const noexcept {
+    return size() >= m_load_threshold ||
+           m_entries_bytes >= m_load_bytes_threshold;
+  }
+
+  /**
+   * Minimum bucket count keeping the table under max_load_factor() and, if it
+   * isn't 0, under max_load_bytes().
+   */
+  size_type min_bucket_count_for_load() const {
+    return min_bucket_count_for_load(size(), m_entries_bytes);
+  }
+
+  size_type min_bucket_count_for_load(size_type nb_elements,
+                                      size_type entries_bytes) const {
+    size_type count =
+        size_type(std::ceil(float(nb_elements) / max_load_factor()));
+    if (m_max_load_bytes != 0) {
+      const size_type count_bytes =
+          entries_bytes / m_max_load_bytes +
+          (entries_bytes % m_max_load_bytes != 0 ? 1 : 0);
+      count = std::max(count, count_bytes);
+    }
+
+    return count;
+  }
+
+  /**
+   * Return true if a rehash occurred.
+   */
+  template <class U = GrowthPolicy,
+            typename std::enable_if<
+                !is_linear_hashing_policy<U>::value>::type* = nullptr>
+  bool grow_on_high_load() {
+    if (is_high_load()) {
+      rehash_impl(GrowthPolicy::next_bucket_count());
+      return true;
+    }
+
+    return false;
+  }
+
+  /**
+   * Return true if a rehash or a split of some buckets occurred.
+   *
+   * Only up to MAX_SPLITS_ON_HIGH_LOAD buckets are split. If it's not enough
+   * to go back under the load threshold, the next insertions will continue the
+   * splits.
+   */
+  template <class U = GrowthPolicy,
+            typename std::enable_if<
+                is_linear_hashing_policy<U>::value>::type* = nullptr>
+  bool grow_on_high_load() {
+    if (is_high_load()) {
+      if (bucket_count() == 0) {
+        rehash_impl(GrowthPolicy::next_bucket_count());
+        return true;
+      }
+
+      std::size_t nb_splits = 0;
+      do {
+        split_bucket();
+        nb_splits++;
+      } while (is_high_load() && nb_splits < MAX_SPLITS_ON_HIGH_LOAD);
+
+      return true;
+    }
+
+    return false;
+  }
+
+  /**
+   * Split the next bucket of the linear hashing GrowthPolicy. The keys of the
+   * split bucket are redistributed between itself and a new bucket added at the
+   * end of m_buckets_data. Only the keys of the split bucket are moved.
+   */
+  template <class U = GrowthPolicy,
+            typename std::enable_if<
+                is_linear_hashing_policy<U>::value>::type* = nullptr>
+  void split_bucket() {
+    GrowthPolicy new_growth_policy(static_cast<const GrowthPolicy&>(*this));
+    const std::size_t isplit = new_growth_policy.split_bucket();
+    const std::size_t inew = m_buckets_data.size();
+    const bool use_stored_hash = USE_STORED_HASH_ON_REHASH(inew + 1);
+
+    // The hashes of the keys of the split bucket. Buckets are short, so the
+    // hashes usually fit in stack_hashes and the split doesn't allocate.
+    // Only the hashes past SPLIT_STACK_HASHES go in overflow_hashes.
+    const array_bucket& split = m_buckets_data[isplit];
+    std::size_t stack_hashes[SPLIT_STACK_HASHES];
+    std::vector<std::size_t> overflow_hashes;
+    std::size_t required_size[2] = {0, 0};
+    std::size_t nb_entries[2] = {0, 0};
+    std::size_t ientry = 0;
+    for (auto it = split.cbegin(); it != split.cend(); ++it, ++ientry) {
+      const std::size_t hash = use_stored_hash
+                                   ? split.stored_hash(it, ientry)
+                                   : hash_key(it.key(), it.key_size());
+      const std::size_t i =
+          (new_growth_policy.bucket_for_hash(hash) == isplit) ? 0 : 1;
+      tsl_ah_assert(i == 0 || new_growth_policy.bucket_for_hash(hash) == inew);
+
+      if (ientry < SPLIT_STACK_HASHES) {
+        stack_hashes[ientry] = hash;
+      } else {
+        overflow_hashes.push_back(hash);
+      }
+      required_size[i] += array_bucket::entry_required_bytes(it.key_size());
+      nb_entries[i]++;
+    }
+
+    array_bucket new_buckets[2] = {
+        array_bucket(bucket_storage(), required_size[0],
+                     StoreHashTags ? nb_entries[0] : 0),
+        array_bucket(bucket_storage(), required_size[1],
+                     StoreHashTags ? nb_entries[1] : 0)};
+
+    ientry = 0;
+    for (auto it = split.cbegin(); it != split.cend(); ++it) {
+      const std::size_t hash =
+          (ientry < SPLIT_STACK_HASHES)
+              ? stack_hashes[ientry]
+              : overflow_hashes[ientry - SPLIT_STACK_HASHES];
+      const std::size_t i =
+          (new_growth_policy.bucket_for_hash(hash) == isplit) ? 0 : 1;
+      append_iterator_in_reserved_bucket_no_check(new_buckets[i], it, hash);
+
+      ientry++;
+    }
+
+    m_buckets_data.emplace_back();
+
+    m_buckets_data[isplit].swap(new_buckets[0]);
+    m_buckets_data.back().swap(new_buckets[1]);
+    // new_buckets[0] now holds the old buffer of the split bucket.
+    new_buckets[0].clear(bucket_storage());
+
+    using std::swap;
+    swap(static_cast<GrowthPolicy&>(*this), new_growth_policy);
+    m_buckets = m_buckets_data.data();
+
+    // Call max_load_factor to change m_load_threshold
+    max_load_factor(m_max_load_factor);
+  }
+
+  template <class... ValueArgs, class U = T,
+            typename std::enable_if<
+                has_values_container<U>::value>::type* = nullptr>
+  std::pair<iterator, bool> emplace_impl(
+      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
+      const CharT* key, size_type key_size, std::size_t hash,
+      ValueArgs&&... value_args) {
+    return emplace_in_values(can_reuse_erased_values<U>(), ibucket,
+                             end_of_bucket, key, key_size, hash,
+                             std::forward<ValueArgs>(value_args)...);
+  }
+
+  /**
+   * Insert the new value in a free slot of m_values if there is one.
+   */
+  template <class... ValueArgs>
+  std::pair<iterator, bool> emplace_in_values(
+      std::true_type /*can_reuse_erased_values*/, std::size_t ibucket,
+      typename array_bucket::const_iterator end_of_bucket, const CharT* key,
+      size_type key_size, std::size_t hash, ValueArgs&&... value_args) {
+    if (!this->m_free_values.empty()) {
+      return emplace_in_free_value(ibucket, end_of_bucket, key, key_size, hash,
+                                   std::forward<ValueArgs>(value_args)...);
+    }
+
+    return emplace_in_new_value(ibucket, end_of_bucket, key, key_size, hash,
+                                std::forward<ValueArgs>(value_args)...);
+  }
+
+  /**
+   * m_free_values stays empty if the values can't be reused.
+   */
+  template <class... ValueArgs>
+  std::pair<iterator, bool> emplace_in_values(
+      std::false_type /*can_reuse_erased_values*/, std::size_t ibucket,
+      typename array_bucket::const_iterator end_of_bucket, const CharT* key,
+      size_type key_size, std::size_t hash, ValueArgs&&... value_args) {
+    tsl_ah_assert(this->m_free_values.empty());
+    return emplace_in_new_value(ibucket, end_of_bucket, key, key_size, hash,
+                                std::forward<ValueArgs>(value_args)...);
+  }
+
+  /**
+   * Insert the new value at the end of m_values.
+   */
+  template <class... ValueArgs>
+  std::pair<iterator, bool> emplace_in_new_value(
+      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
+      const CharT* key, size_type key_size, std::size_t hash,
+      ValueArgs&&... value_args) {
+    if (this->m_values.size() >= max_size()) {
+      // Try to clear old erased values lingering in m_values. Throw if it
+      // doesn't change anything.
+      clear_old_erased_values();
+      if (this->m_values.size() >= max_size()) {
+        throw std::length_error(
+            "Can't insert value, too much values in the map.");
+      }
+    }
+
+    if (this->m_values.size() == this->m_values.capacity()) {
+      this->m_values.reserve(
+          std::size_t(float(this->m_values.size()) *
+                      values_container::VECTOR_GROWTH_RATE));
+    }
+
+    this->m_values.emplace_back(std::forward<ValueArgs>(value_args)...);
+
+    try {
+      auto it = m_buckets[ibucket].append(
+          bucket_storage(), end_of_bucket, key, key_size, hash,
+          IndexSizeT(this->m_values.size() - 1));
+      m_nb_elements++;
+      m_entries_bytes += array_bucket::entry_required_bytes(key_size);
+
+      return std::make_pair(
+          iterator(m_buckets_data.begin() + ibucket, it, this), true);
+    } catch (...) {
+      // Rollback
+      this->m_values.pop_back();
+      throw;
+    }
+  }
+
+  /**
+   * Insert the new value in the last free slot of m_values. If the append in
+   * the bucket fails, the slot stays free.
+   */
+  template <class... ValueArgs>
+  std::pair<iterator, bool> emplace_in_free_value(
+      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
+      const CharT* key, size_type key_size, std::size_t hash,
+      ValueArgs&&... value_args) {
+    const IndexSizeT ivalue = this->m_free_values.back();
+    this->m_values[ivalue] = T(std::forward<ValueArgs>(value_args)...);
+
+    auto it = m_buckets[ibucket].append(bucket_storage(), end_of_bucket, key,
+                                        key_size, hash, ivalue);
+    this->m_free_values.pop_back();
+    m_nb_elements++;
+    m_entries_bytes += array_bucket::entry_required_bytes(key_size);
+
+    return std::make_pair(iterator(m_buckets_data.begin() + ibucket, it, this),
+                          true);
+  }
+
+  template <class... ValueArgs, class U = T,
+            typename std::enable_if<
+                has_inline_values<U>::value>::type* = nullptr>
+  std::pair<iterator, bool> emplace_impl(
+      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
+      const CharT* key, size_type key_size, std::size_t hash,
+      ValueArgs&&... value_args) {
+    if (m_nb_elements >= max_size()) {
+      throw std::length_error(
+          "Can't insert value, too much values in the map.");
+    }
+
+    auto it = m_buckets[ibucket].append(
+        bucket_storage(), end_of_bucket, key, key_size, hash,
+        T(std::forward<ValueArgs>(value_args)...));
+    m_nb_elements++;
+    m_entries_bytes += array_bucket::entry_required_bytes(key_size);
+
+    return std::make_pair(iterator(m_buckets_data.begin() + ibucket, it, this),
+                          true);
+  }
+
+  template <class U = T, typename std::enable_if<
+                             !has_mapped_type<U>::value>::type* = nullptr>
+  std::pair<iterator, bool> emplace_impl(
+      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
+      const CharT* key, size_type key_size, std::size_t hash) {
+    if (m_nb_elements >= max_size()) {
+      throw std::length_error(
+          "Can't insert value, too much values in the map.");
+    }
+
+    auto it = m_buckets[ibucket].append(bucket_storage(), end_of_bucket, key,
+                                        key_size, hash);
+    m_nb_elements++;
+    m_entries_bytes += array_bucket::entry_required_bytes(key_size);
+
+    return std::make_pair(iterator(m_buckets_data.begin() + ibucket, it, this),
+                          true);
+  }
+
+  /**
+   * Rehash the table in 'bucket_count' buckets. If 'nb_threads' > 1, the work
+   * is split between up to 'nb_threads' threads (see rehash_entries_parallel).
+   * The result is the same in both cases.
+   */
+  void rehash_impl(size_type bucket_count, std::size_t nb_threads = 1) {
+    GrowthPolicy new_growth_policy(bucket_count);
+    if (bucket_count == this->bucket_count()) {
+      return;
+    }
+
+    if (should_clear_old_erased_values(
+            REHASH_CLEAR_OLD_ERASED_VALUE_THRESHOLD)) {
+      clear_old_erased_values();
+    }
+
+    nb_threads = std::min({nb_threads, bucket_count, this->bucket_count()});
+
+    // The new buckets are allocated in a new storage. The old buckets are
+    // destroyed before the old storage at the end of the scope which, if
+    // BucketStorage::owns_buffers is true, releases all their buffers at once.
+    BucketStorage new_bucket_storage;
+    std::vector<array_bucket> new_buckets;
+    if (nb_threads > 1 && !empty()) {
+      rehash_entries_parallel(new_growth_policy, bucket_count, nb_threads,
+                              new_bucket_storage, new_buckets);
     } else {
-      return 0;
+      rehash_entries(new_growth_policy, bucket_count, new_bucket_storage,
+                     new_buckets);
     }
-  }
 
-  void swap(array_hash& other) {
     using std::swap;
+    swap(static_cast<GrowthPolicy&>(*this), new_growth_policy);
+    swap(static_cast<BucketStorage&>(*this), new_bucket_storage);
 
-    swap(static_cast<value_container<T>&>(*this),
-         static_cast<value_container<T>&>(other));
-    swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
-    swap(static_cast<GrowthPolicy&>(*this), static_cast<GrowthPolicy&>(other));
-    swap(m_buckets_data, other.m_buckets_data);
-    swap(m_buckets, other.m_buckets);
-    swap(m_nb_elements, other.m_nb_elements);
-    swap(m_max_load_factor, other.m_max_load_factor);
-    swap(m_load_threshold, other.m_load_threshold);
+    m_buckets_data.swap(new_buckets);
+    m_buckets = !m_buckets_data.empty() ? m_buckets_data.data()
+                                        : static_empty_bucket_ptr();
+
+    // Call max_load_factor to change m_load_threshold
+    max_load_factor(m_max_load_factor);
   }
 
-  /*
-   * Lookup
+  /**
+   * Fill 'new_buckets' with the entries of the table distributed in
+   * 'bucket_count' buckets according to 'new_growth_policy'. Each new bucket
+   * is allocated once with the exact size it needs.
    */
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  U& at(const CharT* key, size_type key_size) {
-    return at(key, key_size, hash_key(key, key_size));
+  void rehash_entries(const GrowthPolicy& new_growth_policy,
+                      size_type bucket_count, BucketStorage& new_bucket_storage,
+                      std::vector<array_bucket>& new_buckets) {
+    std::vector<std::size_t> required_size_for_bucket(bucket_count, 0);
+    std::vector<std::size_t> nb_entries_for_bucket(
+        StoreHashTags ? bucket_count : 0, 0);
+    const bool use_stored_hash = USE_STORED_HASH_ON_REHASH(bucket_count);
+    std::vector<std::size_t> hash_for_ivalue(use_stored_hash ? 0 : size(), 0);
+
+    std::size_t ivalue = 0;
+    for (const array_bucket& bucket : m_buckets_data) {
+      std::size_t ientry = 0;
+      for (auto it = bucket.cbegin(); it != bucket.cend(); ++it, ++ientry) {
+        const std::size_t hash = use_stored_hash
+                                     ? bucket.stored_hash(it, ientry)
+                                     : hash_key(it.key(), it.key_size());
+        const std::size_t ibucket = new_growth_policy.bucket_for_hash(hash);
+
+        if (!use_stored_hash) {
+          hash_for_ivalue[ivalue] = hash;
+        }
+        required_size_for_bucket[ibucket] +=
+            array_bucket::entry_required_bytes(it.key_size());
+        if (StoreHashTags) {
+          nb_entries_for_bucket[ibucket]++;
+        }
+        ivalue++;
+      }
+    }
+
+    new_buckets.reserve(bucket_count);
+    for (std::size_t ibucket = 0; ibucket < bucket_count; ibucket++) {
+      new_buckets.emplace_back(
+          new_bucket_storage, required_size_for_bucket[ibucket],
+          StoreHashTags ? nb_entries_for_bucket[ibucket] : 0);
+    }
+
+    ivalue = 0;
+    for (const array_bucket& bucket : m_buckets_data) {
+      std::size_t ientry = 0;
+      for (auto it = bucket.cbegin(); it != bucket.cend(); ++it, ++ientry) {
+        const std::size_t hash = use_stored_hash
+                                     ? bucket.stored_hash(it, ientry)
+                                     : hash_for_ivalue[ivalue];
+        const std::size_t ibucket = new_growth_policy.bucket_for_hash(hash);
+        append_iterator_in_reserved_bucket_no_check(new_buckets[ibucket], it,
+                                                    hash);
+
+        ivalue++;
+      }
+    }
   }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  const U& at(const CharT* key, size_type key_size) const {
-    return at(key, key_size, hash_key(key, key_size));
+  struct rehash_entry {
+    std::size_t hash;
+    typename array_bucket::const_iterator it;
+  };
+
+  /**
+   * Same as rehash_entries but with 'nb_threads' threads. Hash must be safe to
+   * call concurrently.
+   *
+   * The new buckets are divided in 'nb_threads' contiguous ranges, and the old
+   * buckets too. First, each thread hashes the entries of its range of old
+   * buckets and sorts them by range of new buckets. Then each thread computes
+   * the exact size of the new buckets of its range, allocates them and fills
+   * them with the entries destined to its range, taking them in the order of
+   * the old buckets so that each new bucket ends up exactly as with
+   * rehash_entries.
+   *
+   * If BucketStorage::owns_buffers is true, the storage can't be used
+   * concurrently and the new buckets are allocated by the current thread.
+   */
+  void rehash_entries_parallel(const GrowthPolicy& new_growth_policy,
+                               size_type bucket_count, std::size_t nb_threads,
+                               BucketStorage& new_bucket_storage,
+                               std::vector<array_bucket>& new_buckets) {
+    tsl_ah_assert(nb_threads > 1 && nb_threads <= bucket_count &&
+                  nb_threads <= this->bucket_count());
+
+    const bool use_stored_hash = USE_STORED_HASH_ON_REHASH(bucket_count);
+    const std::size_t old_range_size =
+        (this->bucket_count() + nb_threads - 1) / nb_threads;
+    const std::size_t new_range_size =
+        (bucket_count + nb_threads - 1) / nb_threads;
+
+    // entries_for_range[ithread * nb_threads + irange] contains the entries
+    // of the old buckets of ithread which go in the new buckets of irange.
+    std::vector<std::vector<rehash_entry>> entries_for_range(nb_threads *
+                                                             nb_threads);
+    parallel_for(nb_threads, [&](std::size_t ithread) {
+      const std::size_t first = ithread * old_range_size;
+      const std::size_t last =
+          std::min(first + old_range_size, this->bucket_count());
+
+      for (std::size_t ibucket = first; ibucket < last; ibucket++) {
+        const array_bucket& bucket = m_buckets_data[ibucket];
+        std::size_t ientry = 0;
+        for (auto it = bucket.cbegin(); it != bucket.cend(); ++it, ++ientry) {
+          const std::size_t hash = use_stored_hash
+                                       ? bucket.stored_hash(it, ientry)
+                                       : hash_key(it.key(), it.key_size());
+          const std::size_t irange =
+              new_growth_policy.bucket_for_hash(hash) / new_range_size;
+
+          entries_for_range[ithread * nb_threads + irange].push_back(
+              rehash_entry{hash, it});
+        }
+      }
+    });
+
+    std::vector<std::size_t> required_size_for_bucket(bucket_count, 0);
+    std::vector<std::size_t> nb_entries_for_bucket(
+        StoreHashTags ? bucket_count : 0, 0);
+    new_buckets.resize(bucket_count);
+
+    parallel_for(nb_threads, [&](std::size_t irange) {
+      const std::size_t first = irange * new_range_size;
+      const std::size_t last = std::min(first + new_range_size, bucket_count);
+
+      for (std::size_t ithread = 0; ithread < nb_threads; ithread++) {
+        for (const rehash_entry& entry :
+             entries_for_range[ithread * nb_threads + irange]) {
+          const std::size_t ibucket =
+              new_growth_policy.bucket_for_hash(entry.hash);
+          required_size_for_bucket[ibucket] +=
+              array_bucket::entry_required_bytes(entry.it.key_size());
+          if (StoreHashTags) {
+            nb_entries_for_bucket[ibucket]++;
+          }
+        }
+      }
+
+      if (!BucketStorage::owns_buffers) {
+        for (std::size_t ibucket = first; ibucket < last; ibucket++) {
+          new_buckets[ibucket] = array_bucket(
+              new_bucket_storage, required_size_for_bucket[ibucket],
+              StoreHashTags ? nb_entries_for_bucket[ibucket] : 0);
+        }
+      }
+    });
+
+    if (BucketStorage::owns_buffers) {
+      for (std::size_t ibucket = 0; ibucket < bucket_count; ibucket++) {
+        new_buckets[ibucket] = array_bucket(
+            new_bucket_storage, required_size_for_bucket[ibucket],
+            StoreHashTags ? nb_entries_for_bucket[ibucket] : 0);
+      }
+    }
+
+    parallel_for(nb_threads, [&](std::size_t irange) {
+      for (std::size_t ithread = 0; ithread < nb_threads; ithread++) {
+        for (const rehash_entry& entry :
+             entries_for_range[ithread * nb_threads + irange]) {
+          const std::size_t ibucket =
+              new_growth_policy.bucket_for_hash(entry.hash);
+          append_iterator_in_reserved_bucket_no_check(new_buckets[ibucket],
+                                                      entry.it, entry.hash);
+        }
+      }
+    });
+  }
+
+  template <class U = T, typename std::enable_if<
+                             !has_mapped_type<U>::value>::type* = nullptr>
+  void append_iterator_in_reserved_bucket_no_check(
+      array_bucket& bucket, typename array_bucket::const_iterator it,
+      std::size_t hash) {
+    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size(), hash);
   }
 
   template <class U = T,
             typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  U& at(const CharT* key, size_type key_size, std::size_t hash) {
-    return const_cast<U&>(
-        static_cast<const array_hash*>(this)->at(key, key_size, hash));
+  void append_iterator_in_reserved_bucket_no_check(
+      array_bucket& bucket, typename array_bucket::const_iterator it,
+      std::size_t hash) {
+    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size(), hash,
+                                              it.value());
+  }
+
+  /**
+   * On serialization the values of each bucket (if has_mapped_type is true) are
+   * serialized next to the bucket. The potential old erased values in
+   * value_container are thus not serialized.
+   *
+   * On deserialization, when hash_compatible is true, we reaffect the value
+   * index (IndexSizeT) of each bucket with set_value as the position of each
+   * value is no more the same in value_container compared to when they were
+   * serialized.
+   *
+   * It's done this way as we can't call clear_old_erased_values() because we
+   * want the serialize method to remain const and we don't want to
+   * serialize/deserialize old erased values. As we may not serialize all the
+   * values in value_container, the values we keep can change of index. We thus
+   * have to modify the value indexes in the buckets.
+   */
+  template <class Serializer>
+  void serialize_impl(Serializer& serializer) const {
+    const slz_size_type version = SERIALIZATION_PROTOCOL_VERSION;
+    serializer(version);
+
+    const slz_size_type bucket_count = m_buckets_data.size();
+    serializer(bucket_count);
+
+    const slz_size_type nb_elements = m_nb_elements;
+    serializer(nb_elements);
+
+    const float max_load_factor = m_max_load_factor;
+    serializer(max_load_factor);
+
+    for (const array_bucket& bucket : m_buckets_data) {
+      bucket.serialize(serializer);
+      serialize_bucket_values(serializer, bucket);
+    }
+  }
+
+  /**
+   * If InlineValues is true, the values are already serialized with the
+   * buckets.
+   */
+  template <class Serializer, class U = T,
+            typename std::enable_if<
+                !has_values_container<U>::value>::type* = nullptr>
+  void serialize_bucket_values(Serializer& /*serializer*/,
+                               const array_bucket& /*bucket*/) const {}
+
+  template <class Serializer, class U = T,
+            typename std::enable_if<
+                has_values_container<U>::value>::type* = nullptr>
+  void serialize_bucket_values(Serializer& serializer,
+                               const array_bucket& bucket) const {
+    for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+      serializer(this->m_values[it.value()]);
+    }
+  }
+
+  template <class Deserializer>
+  void deserialize_impl(Deserializer& deserializer, bool hash_compatible,
+                        std::size_t nb_threads, bool check_duplicate_keys) {
+    tsl_ah_assert(m_buckets_data.empty());  // Current hash table must be empty
+
+    const slz_size_type version =
+        deserialize_value<slz_size_type>(deserializer);
+    // For now we only have one version of the serialization protocol.
+    // If it doesn't match there is a problem with the file.
+    if (version != SERIALIZATION_PROTOCOL_VERSION) {
+      throw std::runtime_error(
+          "Can't deserialize the array_map/set. The protocol version header is "
+          "invalid.");
+    }
+
+    const slz_size_type bucket_count_ds =
+        deserialize_value<slz_size_type>(deserializer);
+    const slz_size_type nb_elements =
+        deserialize_value<slz_size_type>(deserializer);
+    const float max_load_factor = deserialize_value<float>(deserializer);
+
+    m_nb_elements = numeric_cast<IndexSizeT>(
+        nb_elements, "Deserialized nb_elements is too big.");
+
+    size_type bucket_count = numeric_cast<size_type>(
+        bucket_count_ds, "Deserialized bucket_count is too big.");
+    GrowthPolicy::operator=(GrowthPolicy(bucket_count));
+
+    // max_load_bytes() isn't serialized, a deserialized table starts without
+    // a limit on the bytes per bucket and keeps the serialized bucket count.
+    tsl_ah_assert(m_max_load_bytes == 0);
+    this->max_load_factor(max_load_factor);
+    values_container::reserve(m_nb_elements);
+
+    // Only used by the buckets to rebuild their hash tags.
+    const auto key_hasher = [this](const CharT* key, size_type key_size) {
+      return hash_key(key, key_size);
+    };
+
+    if (hash_compatible) {
+      if (bucket_count != bucket_count_ds) {
+        throw std::runtime_error(
+            "The GrowthPolicy is not the same even though hash_compatible is "
+            "true.");
+      }
+
+      m_buckets_data.reserve(bucket_count);
+      for (size_type i = 0; i < bucket_count; i++) {
+        m_buckets_data.push_back(array_bucket::deserialize(
+            deserializer, key_hasher, bucket_storage()));
+        deserialize_bucket_values(deserializer, m_buckets_data.back());
+      }
+    } else {
+      deserialize_entries_rehashed(
+          deserializer,
+          numeric_cast<size_type>(bucket_count_ds,
+                                  "Deserialized bucket_count is too big."),
+          bucket_count, nb_threads, check_duplicate_keys);
+    }
+
+    m_buckets = m_buckets_data.data();
+
+    for (const array_bucket& bucket : m_buckets_data) {
+      for (auto it = bucket.cbegin(); it != bucket.cend(); ++it) {
+        m_entries_bytes += array_bucket::entry_required_bytes(it.key_size());
+      }
+    }
+
+    if (load_factor() > this->max_load_factor()) {
+      throw std::runtime_error(
+          "Invalid max_load_factor. Check that the serializer and deserializer "
+          "support "
+          "floats correctly as they can be converted implicitely to ints.");
+    }
   }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  const U& at(const CharT* key, size_type key_size, std::size_t hash) const {
-    const std::size_t ibucket = bucket_for_hash(hash);
+  /**
+   * Deserialize the 'nb_serialized_buckets' buckets of a table which is not
+   * hash compatible and distribute their entries in 'bucket_count' buckets.
+   *
+   * The entries of all the serialized buckets are first read one after the
+   * other in a single buffer. The keys are then hashed, by 'nb_threads'
+   * threads if it's > 1 (Hash must then be safe to call concurrently). As for
+   * rehash_entries, the exact size of each bucket is computed before the
+   * bucket is allocated once and filled.
+   *
+   * If 'check_duplicate_keys' is false, the keys are not searched in their
+   * bucket before being appended. The serialized table must then not contain
+   * the same key multiple times, which is always the case if it was
+   * serialized by array_map or array_set.
+   */
+  template <class Deserializer>
+  void deserialize_entries_rehashed(Deserializer& deserializer,
+                                    size_type nb_serialized_buckets,
+                                    size_type bucket_count,
+                                    std::size_t nb_threads,
+                                    bool check_duplicate_keys) {
+    std::vector<std::size_t> required_size_for_bucket(bucket_count, 0);
+    std::vector<std::size_t> nb_entries_for_bucket(
+        StoreHashTags ? bucket_count : 0, 0);
+    const auto count_entry = [&](typename array_bucket::const_iterator it,
+                                 std::size_t hash) {
+      const std::size_t ibucket = bucket_for_hash(hash);
+      required_size_for_bucket[ibucket] +=
+          array_bucket::entry_required_bytes(it.key_size());
+      if (StoreHashTags) {
+        nb_entries_for_bucket[ibucket]++;
+      }
+    };
+
+    // With a single thread, the entries are hashed and counted while they are
+    // still in the cache, right after being read.
+    nb_threads = std::min(nb_threads, nb_serialized_buckets);
+    const bool hash_on_read = nb_threads <= 1;
+
+    // For each non-empty serialized bucket, the offset of its first entry in
+    // 'entries' and the index of this entry.
+    std::vector<std::pair<std::size_t, std::size_t>> serialized_buckets;
+    std::vector<CharT> entries = array_bucket::empty_entries();
+    std::vector<std::size_t> hashes;
+    hashes.reserve(m_nb_elements);
+
+    std::size_t nb_entries = 0;
+    for (size_type i = 0; i < nb_serialized_buckets; i++) {
+      const std::size_t offset =
+          array_bucket::deserialize_entries(deserializer, entries);
+      const auto first_entry =
+          array_bucket::entries_iterator(entries.data() + offset);
+      if (first_entry == array_bucket::cend_it()) {
+        continue;
+      }
 
-    auto it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
-    if (it_find.second) {
-      return this->m_values[it_find.first.value()];
-    } else {
-      throw std::out_of_range("Couldn't find key.");
+      serialized_buckets.emplace_back(offset, nb_entries);
+      for (auto it = first_entry; it != array_bucket::cend_it(); ++it) {
+        deserialize_entry_value(deserializer);
+        if (hash_on_read) {
+          hashes.push_back(hash_key(it.key(), it.key_size()));
+          count_entry(it, hashes.back());
+        }
+        nb_entries++;
+      }
     }
-  }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  U& access_operator(const CharT* key, size_type key_size) {
-    const std::size_t hash = hash_key(key, key_size);
-    std::size_t ibucket = bucket_for_hash(hash);
+    if (!hash_on_read) {
+      hashes.resize(nb_entries);
+
+      const std::size_t range_size =
+          (serialized_buckets.size() + nb_threads - 1) / nb_threads;
+      parallel_for(nb_threads, [&](std::size_t ithread) {
+        const std::size_t first = ithread * range_size;
+        const std::size_t last =
+            std::min(first + range_size, serialized_buckets.size());
+        hash_entries(entries, serialized_buckets, first, last, nb_entries,
+                     hashes);
+      });
+
+      std::size_t ientry = 0;
+      for (auto it = array_bucket::entries_iterator(entries.data());
+           it != array_bucket::cend_it(); ++it) {
+        count_entry(it, hashes[ientry]);
+        ientry++;
+      }
+    }
 
-    auto it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
-    if (it_find.second) {
-      return this->m_values[it_find.first.value()];
-    } else {
-      if (grow_on_high_load()) {
-        ibucket = bucket_for_hash(hash);
-        it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
+    m_buckets_data.reserve(bucket_count);
+    for (std::size_t ibucket = 0; ibucket < bucket_count; ibucket++) {
+      m_buckets_data.emplace_back(
+          bucket_storage(), required_size_for_bucket[ibucket],
+          StoreHashTags ? nb_entries_for_bucket[ibucket] : 0);
+    }
+
+    std::size_t ientry = 0;
+    for (auto it = array_bucket::entries_iterator(entries.data());
+         it != array_bucket::cend_it(); ++it) {
+      prefetch_append_buckets(hashes, ientry);
+
+      const std::size_t hash = hashes[ientry];
+      array_bucket& bucket = m_buckets_data[bucket_for_hash(hash)];
+      if (check_duplicate_keys &&
+          bucket.find_or_end_of_bucket(it.key(), it.key_size(), hash).second) {
+        throw std::runtime_error(
+            "Error on deserialization, the same key is presents multiple "
+            "times.");
       }
 
-      return emplace_impl(ibucket, it_find.first, key, key_size, U{})
-          .first.value();
+      append_deserialized_entry(bucket, it, hash, ientry);
+      ientry++;
     }
   }
 
-  size_type count(const CharT* key, size_type key_size) const {
-    return count(key, key_size, hash_key(key, key_size));
-  }
+  /**
+   * Hash the entries of the non-empty serialized buckets [first, last) of
+   * deserialize_entries_rehashed.
+   */
+  void hash_entries(
+      const std::vector<CharT>& entries,
+      const std::vector<std::pair<std::size_t, std::size_t>>&
+          serialized_buckets,
+      std::size_t first, std::size_t last, std::size_t nb_entries,
+      std::vector<std::size_t>& hashes) const {
+    if (first >= last) {
+      return;
+    }
 
-  size_type count(const CharT* key, size_type key_size,
-                  std::size_t hash) const {
-    const std::size_t ibucket = bucket_for_hash(hash);
+    const std::size_t last_entry = (last < serialized_buckets.size())
+                                       ? serialized_buckets[last].second
+                                       : nb_entries;
 
-    auto it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
-    if (it_find.second) {
-      return 1;
-    } else {
-      return 0;
+    auto it = array_bucket::entries_iterator(entries.data() +
+                                             serialized_buckets[first].first);
+    for (std::size_t ientry = serialized_buckets[first].second;
+         ientry < last_entry; ientry++) {
+      hashes[ientry] = hash_key(it.key(), it.key_size());
+      ++it;
     }
   }
 
-  iterator find(const CharT* key, size_type key_size) {
-    return find(key, key_size, hash_key(key, key_size));
-  }
+  /*
+   * Bulk load
+   */
 
-  const_iterator find(const CharT* key, size_type key_size) const {
-    return find(key, key_size, hash_key(key, key_size));
+  /**
+   * Single-pass input iterators are first copied in a vector.
+   */
+  template <class InputIt>
+  void bulk_load_impl(InputIt first, InputIt last,
+                      tsl::ah::duplicate_policy policy,
+                      std::size_t nb_threads, std::input_iterator_tag) {
+    std::vector<typename std::iterator_traits<InputIt>::value_type> elements(
+        first, last);
+    bulk_load_impl(std::make_move_iterator(elements.begin()),
+                   std::make_move_iterator(elements.end()), policy,
+                   nb_threads, std::random_access_iterator_tag());
   }
 
-  iterator find(const CharT* key, size_type key_size, std::size_t hash) {
-    const std::size_t ibucket = bucket_for_hash(hash);
+  template <class ForwardIt>
+  void bulk_load_impl(ForwardIt first, ForwardIt last,
+                      tsl::ah::duplicate_policy policy,
+                      std::size_t nb_threads, std::forward_iterator_tag) {
+    const std::size_t nb_elements =
+        static_cast<std::size_t>(std::distance(first, last));
+    if (nb_elements > max_size()) {
+      throw std::length_error(
+          "Can't insert value, too much values in the map.");
+    }
 
-    auto it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
-    if (it_find.second) {
-      return iterator(m_buckets_data.begin() + ibucket, it_find.first, this);
-    } else {
-      return end();
+    // The buckets are chosen while the keys are counted, the size of the
+    // entries must thus be known beforehand if max_load_bytes() isn't 0.
+    size_type entries_bytes = 0;
+    if (m_max_load_bytes != 0) {
+      for (auto it = first; it != last; ++it) {
+        entries_bytes += array_bucket::entry_required_bytes(
+            checked_key_size(bulk_key(*it).second));
+      }
     }
-  }
 
-  const_iterator find(const CharT* key, size_type key_size,
-                      std::size_t hash) const {
-    const std::size_t ibucket = bucket_for_hash(hash);
+    size_type bucket_count =
+        std::max(this->bucket_count(),
+                 min_bucket_count_for_load(nb_elements, entries_bytes));
+    GrowthPolicy new_growth_policy(bucket_count);
 
-    auto it_find = m_buckets[ibucket].find_or_end_of_bucket(key, key_size);
-    if (it_find.second) {
-      return const_iterator(m_buckets_data.cbegin() + ibucket, it_find.first,
-                            this);
+    std::vector<std::size_t> required_size_for_bucket(bucket_count, 0);
+    std::vector<std::size_t> nb_entries_for_bucket(
+        StoreHashTags ? bucket_count : 0, 0);
+    const auto count_entry = [&](size_type key_size, std::size_t hash) {
+      const std::size_t ibucket = new_growth_policy.bucket_for_hash(hash);
+      required_size_for_bucket[ibucket] +=
+          array_bucket::entry_required_bytes(key_size);
+      if (StoreHashTags) {
+        nb_entries_for_bucket[ibucket]++;
+      }
+    };
+
+    std::vector<std::size_t> hashes(nb_elements);
+    nb_threads = std::min(nb_threads, nb_elements);
+    if (nb_threads > 1 && is_random_access(first)) {
+      const std::size_t range_size =
+          (nb_elements + nb_threads - 1) / nb_threads;
+      parallel_for(nb_threads, [&](std::size_t ithread) {
+        const std::size_t ifirst = std::min(ithread * range_size, nb_elements);
+        const std::size_t ilast = std::min(ifirst + range_size, nb_elements);
+        ForwardIt it = std::next(first, static_cast<std::ptrdiff_t>(ifirst));
+        for (std::size_t i = ifirst; i < ilast; ++i, ++it) {
+          const auto key = bulk_key(*it);
+          hashes[i] = hash_key(key.first, checked_key_size(key.second));
+        }
+      });
+
+      std::size_t i = 0;
+      for (auto it = first; it != last; ++it, ++i) {
+        count_entry(bulk_key(*it).second, hashes[i]);
+      }
     } else {
-      return cend();
+      // With a single thread, the keys are counted right after being hashed.
+      std::size_t i = 0;
+      for (auto it = first; it != last; ++it, ++i) {
+        const auto key = bulk_key(*it);
+        hashes[i] = hash_key(key.first, checked_key_size(key.second));
+        count_entry(key.second, hashes[i]);
+      }
     }
-  }
 
-  std::pair<iterator, iterator> equal_range(const CharT* key,
-                                            size_type key_size) {
-    return equal_range(key, key_size, hash_key(key, key_size));
-  }
+    BucketStorage new_bucket_storage;
+    std::vector<array_bucket> new_buckets;
+    new_buckets.reserve(bucket_count);
+    for (std::size_t ibucket = 0; ibucket < bucket_count; ibucket++) {
+      new_buckets.emplace_back(
+          new_bucket_storage, required_size_for_bucket[ibucket],
+          StoreHashTags ? nb_entries_for_bucket[ibucket] : 0);
+    }
 
-  std::pair<const_iterator, const_iterator> equal_range(
-      const CharT* key, size_type key_size) const {
-    return equal_range(key, key_size, hash_key(key, key_size));
-  }
+    clear();
+    values_container::reserve(nb_elements);
 
-  std::pair<iterator, iterator> equal_range(const CharT* key,
-                                            size_type key_size,
-                                            std::size_t hash) {
-    iterator it = find(key, key_size, hash);
-    return std::make_pair(it, (it == end()) ? it : std::next(it));
-  }
+    using std::swap;
+    swap(static_cast<GrowthPolicy&>(*this), new_growth_policy);
+    swap(static_cast<BucketStorage&>(*this), new_bucket_storage);
 
-  std::pair<const_iterator, const_iterator> equal_range(
-      const CharT* key, size_type key_size, std::size_t hash) const {
-    const_iterator it = find(key, key_size, hash);
-    return std::make_pair(it, (it == cend()) ? it : std::next(it));
-  }
+    m_buckets_data.swap(new_buckets);
+    m_buckets = !m_buckets_data.empty() ? m_buckets_data.data()
+                                        : static_empty_bucket_ptr();
+    // Call max_load_factor to change m_load_threshold
+    max_load_factor(m_max_load_factor);
 
-  /*
-   * Bucket interface
-   */
-  size_type bucket_count() const { return m_buckets_data.size(); }
+    std::size_t i = 0;
+    for (auto it = first; it != last; ++it, ++i) {
+      prefetch_append_buckets(hashes, i);
+
+      const auto key = bulk_key(*it);
+      const std::size_t hash = hashes[i];
+      array_bucket& bucket = m_buckets_data[bucket_for_hash(hash)];
+
+      const auto it_find =
+          bucket.find_or_end_of_bucket(key.first, key.second, hash);
+      if (!it_find.second) {
+        append_bulk_element(bucket, key.first, key.second, hash, *it);
+        m_nb_elements++;
+        m_entries_bytes += array_bucket::entry_required_bytes(key.second);
+      } else if (policy == tsl::ah::duplicate_policy::keep_last) {
+        replace_bulk_value(bucket, it_find.first, *it);
+      }
+    }
+  }
 
-  size_type max_bucket_count() const {
-    return std::min(GrowthPolicy::max_bucket_count(),
-                    m_buckets_data.max_size());
+  template <class ForwardIt>
+  static bool is_random_access(const ForwardIt& /*it*/) {
+    return std::is_base_of<
+        std::random_access_iterator_tag,
+        typename std::iterator_traits<ForwardIt>::iterator_category>::value;
   }
 
-  /*
-   *  Hash policy
-   */
-  float load_factor() const {
-    if (bucket_count() == 0) {
-      return 0;
+  static size_type checked_key_size(size_type key_size) {
+    if (key_size > MAX_KEY_SIZE) {
+      throw std::length_error("Key is too long.");
     }
 
-    return float(m_nb_elements) / float(bucket_count());
+    return key_size;
   }
 
-  float max_load_factor() const { return m_max_load_factor; }
-
-  void max_load_factor(float ml) {
-    const float min_max_load_factor = MIN_MAX_LOAD_FACTOR;
-    m_max_load_factor = std::max(min_max_load_factor, ml);
-    m_load_threshold = size_type(float(bucket_count()) * m_max_load_factor);
+  /**
+   * The elements of a set are keys, the elements of a map are pairs of a key
+   * and a value.
+   */
+  template <class Element, class U = T,
+            typename std::enable_if<!has_mapped_type<U>::value>::type* =
+                nullptr>
+  static std::pair<const CharT*, size_type> bulk_key(const Element& element) {
+    return batch_key(element);
   }
 
-  void rehash(size_type count) {
-    count = std::max(count,
-                     size_type(std::ceil(float(size()) / max_load_factor())));
-    rehash_impl(count);
+  template <class Element, class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* =
+                nullptr>
+  static std::pair<const CharT*, size_type> bulk_key(const Element& element) {
+    return batch_key(element.first);
   }
 
-  void reserve(size_type count) {
-    rehash(size_type(std::ceil(float(count) / max_load_factor())));
+  template <class Element, class U = T,
+            typename std::enable_if<!has_mapped_type<U>::value>::type* =
+                nullptr>
+  void append_bulk_element(array_bucket& bucket, const CharT* key,
+                           size_type key_size, std::size_t hash,
+                           Element&& /*element*/) {
+    bucket.append_in_reserved_bucket_no_check(key, key_size, hash);
   }
 
-  /*
-   * Observers
-   */
-  hasher hash_function() const { return static_cast<const hasher&>(*this); }
-
-  // TODO add support for statefull KeyEqual
-  key_equal key_eq() const { return KeyEqual(); }
-
-  /*
-   * Other
-   */
-  iterator mutable_iterator(const_iterator it) noexcept {
-    auto it_bucket =
-        m_buckets_data.begin() +
-        std::distance(m_buckets_data.cbegin(), it.m_buckets_iterator);
-    return iterator(it_bucket, it.m_array_bucket_iterator, this);
+  template <class Element, class U = T,
+            typename std::enable_if<has_values_container<U>::value>::type* =
+                nullptr>
+  void append_bulk_element(array_bucket& bucket, const CharT* key,
+                           size_type key_size, std::size_t hash,
+                           Element&& element) {
+    this->m_values.emplace_back(std::forward<Element>(element).second);
+    bucket.append_in_reserved_bucket_no_check(
+        key, key_size, hash, IndexSizeT(this->m_values.size() - 1));
   }
 
-  template <class Serializer>
-  void serialize(Serializer& serializer) const {
-    serialize_impl(serializer);
+  template <class Element, class U = T,
+            typename std::enable_if<has_inline_values<U>::value>::type* =
+                nullptr>
+  void append_bulk_element(array_bucket& bucket, const CharT* key,
+                           size_type key_size, std::size_t hash,
+                           Element&& element) {
+    bucket.append_in_reserved_bucket_no_check(key, key_size, hash,
+                                              U(element.second));
   }
 
-  template <class Deserializer>
-  void deserialize(Deserializer& deserializer, bool hash_compatible) {
-    deserialize_impl(deserializer, hash_compatible);
-  }
+  template <class Element, class U = T,
+            typename std::enable_if<!has_mapped_type<U>::value>::type* =
+                nullptr>
+  void replace_bulk_value(array_bucket& /*bucket*/,
+                          typename array_bucket::const_iterator /*it*/,
+                          Element&& /*element*/) {}
 
- private:
-  std::size_t hash_key(const CharT* key, size_type key_size) const {
-    return Hash::operator()(key, key_size);
+  /**
+   * The new value takes a new slot in m_values, the slot of the replaced
+   * value is released as on erase. T doesn't need to be assignable.
+   */
+  template <class Element, class U = T,
+            typename std::enable_if<has_values_container<U>::value>::type* =
+                nullptr>
+  void replace_bulk_value(array_bucket& bucket,
+                          typename array_bucket::const_iterator it,
+                          Element&& element) {
+    this->m_values.emplace_back(std::forward<Element>(element).second);
+    release_value(it);
+    bucket.mutable_iterator(it).set_value(
+        IndexSizeT(this->m_values.size() - 1));
   }
 
-  std::size_t bucket_for_hash(std::size_t hash) const {
-    return GrowthPolicy::bucket_for_hash(hash);
+  template <class Element, class U = T,
+            typename std::enable_if<has_inline_values<U>::value>::type* =
+                nullptr>
+  void replace_bulk_value(array_bucket& bucket,
+                          typename array_bucket::const_iterator it,
+                          Element&& element) {
+    bucket.mutable_iterator(it).set_value(U(element.second));
   }
 
   /**
-   * If there is a mapped_type, the mapped value in m_values is not erased now.
-   * It will be erased when the ratio between the size of the map and
-   * the size of the map + the number of deleted values still stored is low
-   * enough (see clear_old_erased_values).
+   * Prefetch the buckets of the entries ahead of the 'ientry'-th one, whose
+   * hashes are in 'hashes', while entries are appended in order to reserved
+   * buckets. As the entries usually go to random buckets, the array_bucket of
+   * an entry is prefetched first and its buffer later.
    */
-  iterator erase_from_bucket(iterator pos) noexcept {
-    auto array_bucket_next_it =
-        pos.m_buckets_iterator->erase(pos.m_array_bucket_iterator);
-    m_nb_elements--;
+  void prefetch_append_buckets(const std::vector<std::size_t>& hashes,
+                               std::size_t ientry) const {
+    const std::size_t iprefetch = ientry + APPEND_PREFETCH_DISTANCE;
+    if (iprefetch + APPEND_PREFETCH_DISTANCE < hashes.size()) {
+      tsl_ah_prefetch(
+          m_buckets_data.data() +
+          bucket_for_hash(hashes[iprefetch + APPEND_PREFETCH_DISTANCE]));
+    }
+    if (iprefetch < hashes.size()) {
+      m_buckets_data[bucket_for_hash(hashes[iprefetch])].prefetch();
+    }
+  }
 
-    if (array_bucket_next_it != pos.m_buckets_iterator->cend()) {
-      return iterator(pos.m_buckets_iterator, array_bucket_next_it, this);
-    } else {
-      do {
-        ++pos.m_buckets_iterator;
-      } while (pos.m_buckets_iterator != m_buckets_data.end() &&
-               pos.m_buckets_iterator->empty());
+  template <class Deserializer, class U = T,
+            typename std::enable_if<
+                !has_values_container<U>::value>::type* = nullptr>
+  void deserialize_entry_value(Deserializer& /*deserializer*/) {}
 
-      if (pos.m_buckets_iterator != m_buckets_data.end()) {
-        return iterator(pos.m_buckets_iterator,
-                        pos.m_buckets_iterator->cbegin(), this);
-      } else {
-        return end();
-      }
-    }
+  template <class Deserializer, class U = T,
+            typename std::enable_if<
+                has_values_container<U>::value>::type* = nullptr>
+  void deserialize_entry_value(Deserializer& deserializer) {
+    this->m_values.emplace_back(deserialize_value<U>(deserializer));
   }
 
+  /**
+   * Append the deserialized entry 'it', the 'ientry'-th one, to the reserved
+   * 'bucket'. The values in value_container are in the order of the entries.
+   */
   template <class U = T, typename std::enable_if<
                              !has_mapped_type<U>::value>::type* = nullptr>
-  bool should_clear_old_erased_values(
-      float /*threshold*/ = DEFAULT_CLEAR_OLD_ERASED_VALUE_THRESHOLD) const {
-    return false;
+  void append_deserialized_entry(array_bucket& bucket,
+                                 typename array_bucket::const_iterator it,
+                                 std::size_t hash, std::size_t /*ientry*/) {
+    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size(), hash);
   }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  bool should_clear_old_erased_values(
-      float threshold = DEFAULT_CLEAR_OLD_ERASED_VALUE_THRESHOLD) const {
-    if (this->m_values.size() == 0) {
-      return false;
-    }
-
-    return float(m_nb_elements) / float(this->m_values.size()) < threshold;
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  void append_deserialized_entry(array_bucket& bucket,
+                                 typename array_bucket::const_iterator it,
+                                 std::size_t hash, std::size_t ientry) {
+    tsl_ah_assert(ientry <= std::numeric_limits<IndexSizeT>::max());
+    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size(), hash,
+                                              IndexSizeT(ientry));
   }
 
   template <class U = T, typename std::enable_if<
-                             !has_mapped_type<U>::value>::type* = nullptr>
-  void clear_old_erased_values() {}
+                             has_inline_values<U>::value>::type* = nullptr>
+  void append_deserialized_entry(array_bucket& bucket,
+                                 typename array_bucket::const_iterator it,
+                                 std::size_t hash, std::size_t /*ientry*/) {
+    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size(), hash,
+                                              it.value());
+  }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  void clear_old_erased_values() {
-    static_assert(std::is_nothrow_move_constructible<U>::value ||
-                      std::is_copy_constructible<U>::value,
-                  "mapped_value must be either copy constructible or nothrow "
-                  "move constructible.");
+  /**
+   * Chunked serialization, see chunked_file_header for the format. A chunk is
+   * closed once its payload reaches 'chunk_size' bytes, at the end of a
+   * bucket.
+   */
+  template <class Writer, class ValueSerializer>
+  void serialize_chunked_impl(Writer& writer, std::size_t chunk_size,
+                              const ValueSerializer& value_serializer) const {
+    const chunked_file_header file_header = {
+        CHUNKED_SERIALIZATION_MAGIC, CHUNKED_SERIALIZATION_PROTOCOL_VERSION,
+        CHUNKED_SERIALIZATION_LAYOUT};
+    write_chunked_struct(writer, file_header);
+    slz_size_type offset = sizeof(file_header);
+
+    std::vector<chunk_index_entry> index;
+    std::vector<char> payload;
+    chunk_payload_writer payload_writer(payload);
+    chunk_header header = {0, 0, 0, 0, 0};
+
+    for (size_type ibucket = 0; ibucket < m_buckets_data.size(); ibucket++) {
+      const array_bucket& bucket = m_buckets_data[ibucket];
+      for (auto it = bucket.begin(); it != bucket.end(); ++it) {
+        const slz_size_type key_size = it.key_size();
+        payload_writer(reinterpret_cast<const char*>(&key_size),
+                       sizeof(key_size));
+        payload_writer(reinterpret_cast<const char*>(it.key()),
+                       it.key_size() * sizeof(CharT));
+        serialize_chunked_value(it, value_serializer, payload_writer);
+        header.nb_entries++;
+      }
 
-    if (m_nb_elements == this->m_values.size()) {
-      return;
-    }
+      if (payload.size() >= chunk_size ||
+          ibucket + 1 == m_buckets_data.size()) {
+        header.nb_buckets = ibucket + 1 - header.first_bucket;
+        header.payload_size = payload.size();
+        header.crc = crc32c(0, payload.data(), payload.size());
 
-    std::vector<T> new_values;
-    new_values.reserve(size());
+        write_chunked_struct(writer, header);
+        writer(payload.data(), payload.size());
 
-    for (auto it = begin(); it != end(); ++it) {
-      new_values.push_back(std::move_if_noexcept(it.value()));
-    }
+        index.push_back(chunk_index_entry{offset, header});
+        offset += sizeof(header) + payload.size();
 
-    IndexSizeT ivalue = 0;
-    for (auto it = begin(); it != end(); ++it) {
-      auto it_array_bucket =
-          it.m_buckets_iterator->mutable_iterator(it.m_array_bucket_iterator);
-      it_array_bucket.set_value(ivalue);
-      ivalue++;
+        payload.clear();
+        header = chunk_header{ibucket + 1, 0, 0, 0, 0};
+      }
     }
 
-    new_values.swap(this->m_values);
-    tsl_ah_assert(m_nb_elements == this->m_values.size());
+    const std::size_t index_size = index.size() * sizeof(chunk_index_entry);
+    writer(reinterpret_cast<const char*>(index.data()), index_size);
+
+    static_assert(sizeof(float) == sizeof(std::uint32_t), "");
+    std::uint32_t max_load_factor_bits;
+    std::memcpy(&max_load_factor_bits, &m_max_load_factor,
+                sizeof(max_load_factor_bits));
+
+    const chunked_file_trailer trailer = {offset,
+                                          index.size(),
+                                          m_buckets_data.size(),
+                                          m_nb_elements,
+                                          max_load_factor_bits,
+                                          crc32c(0, index.data(), index_size),
+                                          CHUNKED_SERIALIZATION_MAGIC};
+    write_chunked_struct(writer, trailer);
+  }
+
+  template <class Writer, class Struct>
+  static void write_chunked_struct(Writer& writer, const Struct& value) {
+    writer(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  template <class ValueSerializer, class U = T,
+            typename std::enable_if<!has_mapped_type<U>::value>::type* =
+                nullptr>
+  void serialize_chunked_value(
+      typename array_bucket::const_iterator /*it*/,
+      const ValueSerializer& /*value_serializer*/,
+      chunk_payload_writer& /*payload_writer*/) const {}
+
+  template <class ValueSerializer, class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* =
+                nullptr>
+  void serialize_chunked_value(typename array_bucket::const_iterator it,
+                               const ValueSerializer& value_serializer,
+                               chunk_payload_writer& payload_writer) const {
+    value_serializer(entry_value(it), payload_writer);
   }
 
   /**
-   * Return true if a rehash occurred.
+   * Entries of a chunk read and hashed by deserialize_chunked_impl. The key of
+   * the i-th entry ends at keys[key_ends[i]] and starts where the previous one
+   * ends.
    */
-  bool grow_on_high_load() {
-    if (size() >= m_load_threshold) {
-      rehash_impl(GrowthPolicy::next_bucket_count());
-      return true;
-    }
+  struct parsed_chunk {
+    std::vector<char> buffer;
+    std::vector<CharT> keys;
+    std::vector<std::size_t> key_ends;
+    std::vector<std::size_t> hashes;
+    std::vector<chunk_value_type> values;
+  };
 
-    return false;
-  }
+  /**
+   * Load the chunks accepted by 'chunk_filter'. The chunks are processed in
+   * waves of 'nb_threads' chunks: each chunk of a wave is read, checked and
+   * hashed by its own thread, then the entries are inserted by
+   * insert_parsed_chunks. At most 'nb_threads' chunks are thus in memory at
+   * the same time.
+   */
+  template <class Reader, class ChunkFilter, class ValueDeserializer>
+  void deserialize_chunked_impl(Reader& reader, std::uint64_t size,
+                                std::size_t nb_threads,
+                                ChunkFilter& chunk_filter,
+                                const ValueDeserializer& value_deserializer) {
+    tsl_ah_assert(m_nb_elements == 0);  // Current hash table must be empty
+
+    const chunked_index index = read_chunked_index(reader, size);
+
+    const std::uint32_t max_load_factor_bits =
+        static_cast<std::uint32_t>(index.trailer.max_load_factor);
+    float max_load_factor;
+    std::memcpy(&max_load_factor, &max_load_factor_bits,
+                sizeof(max_load_factor));
+    this->max_load_factor(max_load_factor);
 
-  template <class... ValueArgs, class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  std::pair<iterator, bool> emplace_impl(
-      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
-      const CharT* key, size_type key_size, ValueArgs&&... value_args) {
-    if (this->m_values.size() >= max_size()) {
-      // Try to clear old erased values lingering in m_values. Throw if it
-      // doesn't change anything.
-      clear_old_erased_values();
-      if (this->m_values.size() >= max_size()) {
-        throw std::length_error(
-            "Can't insert value, too much values in the map.");
+    std::vector<std::size_t> chunks;
+    slz_size_type nb_entries = 0;
+    for (std::size_t ichunk = 0; ichunk < index.entries.size(); ichunk++) {
+      if (chunk_filter(ichunk, index.entries.size())) {
+        chunks.push_back(ichunk);
+        nb_entries += index.entries[ichunk].header.nb_entries;
       }
     }
 
-    if (this->m_values.size() == this->m_values.capacity()) {
-      this->m_values.reserve(
-          std::size_t(float(this->m_values.size()) *
-                      value_container<T>::VECTOR_GROWTH_RATE));
+    const size_type nb_entries_to_load = numeric_cast<IndexSizeT>(
+        nb_entries, "Deserialized nb_elements is too big.");
+    // The bucket count doesn't change once reserved, the entries are appended
+    // without going through emplace.
+    reserve(nb_entries_to_load);
+    values_container::reserve(nb_entries_to_load);
+
+    nb_threads =
+        std::max<std::size_t>(1, std::min(nb_threads, chunks.size()));
+    std::vector<parsed_chunk> parsed_chunks(nb_threads);
+    chunks_insertion insertion(bucket_count(), nb_threads);
+    for (std::size_t first = 0; first < chunks.size(); first += nb_threads) {
+      const std::size_t wave_size =
+          std::min(nb_threads, chunks.size() - first);
+      parallel_for(wave_size, [&](std::size_t i) {
+        parse_chunk(reader, index.entries[chunks[first + i]],
+                    value_deserializer, parsed_chunks[i]);
+      });
+
+      insert_parsed_chunks(parsed_chunks, wave_size, insertion);
     }
+  }
 
-    this->m_values.emplace_back(std::forward<ValueArgs>(value_args)...);
+  /**
+   * Chunk index of a chunked serialization, validated against the size of the
+   * serialization.
+   */
+  struct chunked_index {
+    chunked_file_trailer trailer;
+    std::vector<chunk_index_entry> entries;
+  };
 
-    try {
-      auto it = m_buckets[ibucket].append(
-          end_of_bucket, key, key_size, IndexSizeT(this->m_values.size() - 1));
-      m_nb_elements++;
+  template <class Struct, class Reader>
+  static Struct read_chunked_struct(Reader& reader, std::uint64_t offset) {
+    Struct value;
+    reader(offset, reinterpret_cast<char*>(&value), sizeof(value));
 
-      return std::make_pair(
-          iterator(m_buckets_data.begin() + ibucket, it, this), true);
-    } catch (...) {
-      // Rollback
-      this->m_values.pop_back();
-      throw;
-    }
+    return value;
   }
 
-  template <class U = T, typename std::enable_if<
-                             !has_mapped_type<U>::value>::type* = nullptr>
-  std::pair<iterator, bool> emplace_impl(
-      std::size_t ibucket, typename array_bucket::const_iterator end_of_bucket,
-      const CharT* key, size_type key_size) {
-    if (m_nb_elements >= max_size()) {
-      throw std::length_error(
-          "Can't insert value, too much values in the map.");
+  template <class Reader>
+  static chunked_index read_chunked_index(Reader& reader, std::uint64_t size) {
+    if (size < sizeof(chunked_file_header) + sizeof(chunked_file_trailer)) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The serialization is "
+          "truncated.");
     }
 
-    auto it = m_buckets[ibucket].append(end_of_bucket, key, key_size);
-    m_nb_elements++;
-
-    return std::make_pair(iterator(m_buckets_data.begin() + ibucket, it, this),
-                          true);
-  }
+    const chunked_file_header file_header =
+        read_chunked_struct<chunked_file_header>(reader, 0);
+    if (file_header.magic != CHUNKED_SERIALIZATION_MAGIC) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The serialization "
+          "isn't a chunked serialization.");
+    }
+    if (file_header.version != CHUNKED_SERIALIZATION_PROTOCOL_VERSION) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The protocol version "
+          "header is invalid.");
+    }
+    if (file_header.layout != CHUNKED_SERIALIZATION_LAYOUT) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The serialization was "
+          "done with a different character type or without values.");
+    }
 
-  void rehash_impl(size_type bucket_count) {
-    GrowthPolicy new_growth_policy(bucket_count);
-    if (bucket_count == this->bucket_count()) {
-      return;
+    chunked_index index;
+    index.trailer = read_chunked_struct<chunked_file_trailer>(
+        reader, size - sizeof(chunked_file_trailer));
+    const chunked_file_trailer& trailer = index.trailer;
+    if (trailer.magic != CHUNKED_SERIALIZATION_MAGIC) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The trailer is "
+          "invalid, the serialization may be truncated.");
     }
 
-    if (should_clear_old_erased_values(
-            REHASH_CLEAR_OLD_ERASED_VALUE_THRESHOLD)) {
-      clear_old_erased_values();
+    const std::uint64_t chunks_end = size - sizeof(chunked_file_trailer);
+    const std::uint64_t max_nb_chunks =
+        (chunks_end - sizeof(chunked_file_header)) / sizeof(chunk_index_entry);
+    if (trailer.nb_chunks > max_nb_chunks ||
+        trailer.index_offset !=
+            chunks_end - trailer.nb_chunks * sizeof(chunk_index_entry)) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The position of the "
+          "chunk index is invalid.");
     }
 
-    std::vector<std::size_t> required_size_for_bucket(bucket_count, 0);
-    std::vector<std::size_t> bucket_for_ivalue(size(), 0);
+    index.entries.resize(numeric_cast<std::size_t>(
+        trailer.nb_chunks, "Deserialized nb_chunks is too big."));
+    const std::size_t index_size =
+        index.entries.size() * sizeof(chunk_index_entry);
+    if (index_size > 0) {
+      reader(trailer.index_offset,
+             reinterpret_cast<char*>(index.entries.data()), index_size);
+    }
+    if (crc32c(0, index.entries.data(), index_size) != trailer.index_crc) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The checksum of the "
+          "chunk index doesn't match.");
+    }
 
-    std::size_t ivalue = 0;
-    for (auto it = begin(); it != end(); ++it) {
-      const std::size_t hash = hash_key(it.key(), it.key_size());
-      const std::size_t ibucket = new_growth_policy.bucket_for_hash(hash);
+    // The chunks must follow each other and cover all the buckets and entries.
+    std::uint64_t offset = sizeof(chunked_file_header);
+    slz_size_type nb_buckets = 0;
+    slz_size_type nb_entries = 0;
+    for (const chunk_index_entry& entry : index.entries) {
+      const chunk_header& header = entry.header;
+      if (entry.offset != offset ||
+          trailer.index_offset - offset < sizeof(chunk_header) ||
+          header.payload_size >
+              trailer.index_offset - offset - sizeof(chunk_header) ||
+          header.first_bucket != nb_buckets ||
+          header.nb_buckets > trailer.bucket_count - nb_buckets ||
+          header.nb_entries > trailer.nb_elements - nb_entries ||
+          header.nb_entries > header.payload_size / sizeof(slz_size_type)) {
+        throw std::runtime_error(
+            "Can't deserialize the chunked array_map/set. The chunk index is "
+            "inconsistent.");
+      }
 
-      bucket_for_ivalue[ivalue] = ibucket;
-      required_size_for_bucket[ibucket] +=
-          array_bucket::entry_required_bytes(it.key_size());
-      ivalue++;
+      offset += sizeof(chunk_header) + header.payload_size;
+      nb_buckets += header.nb_buckets;
+      nb_entries += header.nb_entries;
     }
 
-    std::vector<array_bucket> new_buckets;
-    new_buckets.reserve(bucket_count);
-    for (std::size_t ibucket = 0; ibucket < bucket_count; ibucket++) {
-      new_buckets.emplace_back(required_size_for_bucket[ibucket]);
+    if (offset != trailer.index_offset || nb_buckets != trailer.bucket_count ||
+        nb_entries != trailer.nb_elements) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The chunk index is "
+          "inconsistent.");
     }
 
-    ivalue = 0;
-    for (auto it = begin(); it != end(); ++it) {
-      const std::size_t ibucket = bucket_for_ivalue[ivalue];
-      append_iterator_in_reserved_bucket_no_check(new_buckets[ibucket], it);
+    return index;
+  }
 
-      ivalue++;
+  /**
+   * Read the chunk of 'entry' in 'buffer', its header followed by its payload,
+   * and check it against the chunk index.
+   */
+  template <class Reader>
+  static void read_chunk(Reader& reader, const chunk_index_entry& entry,
+                         std::vector<char>& buffer) {
+    buffer.resize(sizeof(chunk_header) +
+                  numeric_cast<std::size_t>(entry.header.payload_size,
+                                            "Chunk payload_size is too big."));
+    reader(entry.offset, buffer.data(), buffer.size());
+
+    chunk_header header;
+    std::memcpy(&header, buffer.data(), sizeof(header));
+    if (header.first_bucket != entry.header.first_bucket ||
+        header.nb_buckets != entry.header.nb_buckets ||
+        header.nb_entries != entry.header.nb_entries ||
+        header.payload_size != entry.header.payload_size ||
+        header.crc != entry.header.crc) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The header of a chunk "
+          "doesn't match the chunk index.");
     }
 
-    using std::swap;
-    swap(static_cast<GrowthPolicy&>(*this), new_growth_policy);
+    if (crc32c(0, buffer.data() + sizeof(chunk_header),
+               buffer.size() - sizeof(chunk_header)) != header.crc) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The checksum of a "
+          "chunk doesn't match, the chunk is corrupted.");
+    }
+  }
 
-    m_buckets_data.swap(new_buckets);
-    m_buckets = !m_buckets_data.empty() ? m_buckets_data.data()
-                                        : static_empty_bucket_ptr();
+  template <class Reader, class ValueDeserializer>
+  void parse_chunk(Reader& reader, const chunk_index_entry& entry,
+                   const ValueDeserializer& value_deserializer,
+                   parsed_chunk& chunk) const {
+    read_chunk(reader, entry, chunk.buffer);
+
+    const std::size_t payload_size = chunk.buffer.size() - sizeof(chunk_header);
+    const std::size_t nb_entries = static_cast<std::size_t>(
+        entry.header.nb_entries);  // Bounded by payload_size.
+    chunk_payload_reader payload(chunk.buffer.data() + sizeof(chunk_header),
+                                 payload_size);
+
+    chunk.keys.clear();
+    chunk.key_ends.clear();
+    chunk.hashes.clear();
+    chunk.values.clear();
+    // Keep keys.data() non-null for empty keys.
+    chunk.keys.reserve(payload_size / sizeof(CharT) + 1);
+    chunk.key_ends.reserve(nb_entries);
+    chunk.hashes.reserve(nb_entries);
+    reserve_chunk_values(chunk.values, nb_entries);
+
+    for (std::size_t ientry = 0; ientry < nb_entries; ientry++) {
+      slz_size_type key_size;
+      payload(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+      if (key_size > MAX_KEY_SIZE) {
+        throw std::runtime_error(
+            "Can't deserialize the chunked array_map/set. A key is too "
+            "long.");
+      }
 
-    // Call max_load_factor to change m_load_threshold
-    max_load_factor(m_max_load_factor);
+      const std::size_t key_start = chunk.keys.size();
+      chunk.keys.resize(key_start + static_cast<std::size_t>(key_size));
+      payload(reinterpret_cast<char*>(chunk.keys.data() + key_start),
+              static_cast<std::size_t>(key_size) * sizeof(CharT));
+
+      chunk.key_ends.push_back(chunk.keys.size());
+      chunk.hashes.push_back(hash_key(chunk.keys.data() + key_start,
+                                      static_cast<size_type>(key_size)));
+      deserialize_chunked_value(payload, value_deserializer, chunk.values);
+    }
+
+    if (!payload.at_end()) {
+      throw std::runtime_error(
+          "Can't deserialize the chunked array_map/set. The entries of a "
+          "chunk don't match its payload size.");
+    }
   }
 
   template <class U = T, typename std::enable_if<
                              !has_mapped_type<U>::value>::type* = nullptr>
-  void append_iterator_in_reserved_bucket_no_check(array_bucket& bucket,
-                                                   iterator it) {
-    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size());
+  static void reserve_chunk_values(std::vector<chunk_value_type>& /*values*/,
+                                   std::size_t /*nb_entries*/) {}
+
+  template <class U = T, typename std::enable_if<
+                             has_mapped_type<U>::value>::type* = nullptr>
+  static void reserve_chunk_values(std::vector<chunk_value_type>& values,
+                                   std::size_t nb_entries) {
+    values.reserve(nb_entries);
   }
 
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  void append_iterator_in_reserved_bucket_no_check(array_bucket& bucket,
-                                                   iterator it) {
-    bucket.append_in_reserved_bucket_no_check(it.key(), it.key_size(),
-                                              it.value_position());
+  template <class ValueDeserializer, class U = T,
+            typename std::enable_if<!has_mapped_type<U>::value>::type* =
+                nullptr>
+  static void deserialize_chunked_value(
+      chunk_payload_reader& /*payload*/,
+      const ValueDeserializer& /*value_deserializer*/,
+      std::vector<chunk_value_type>& /*values*/) {}
+
+  template <class ValueDeserializer, class U = T,
+            typename std::enable_if<has_mapped_type<U>::value>::type* =
+                nullptr>
+  static void deserialize_chunked_value(
+      chunk_payload_reader& payload,
+      const ValueDeserializer& value_deserializer,
+      std::vector<chunk_value_type>& values) {
+    values.push_back(value_deserializer.template operator()<U>(payload));
   }
 
   /**
-   * On serialization the values of each bucket (if has_mapped_type is true) are
-   * serialized next to the bucket. The potential old erased values in
-   * value_container are thus not serialized.
-   *
-   * On deserialization, when hash_compatible is true, we reaffect the value
-   * index (IndexSizeT) of each bucket with set_value as the position of each
-   * value is no more the same in value_container compared to when they were
-   * serialized.
+   * State of insert_parsed_chunks kept between the waves of chunks. The
+   * buckets are split in 'nb_ranges' ranges of consecutive buckets.
+   * entries_for_range[ichunk * nb_ranges + irange] contains the entries of
+   * the ichunk-th chunk of a wave which go in the buckets of irange.
+   */
+  struct chunks_insertion {
+    struct chunk_entry {
+      std::size_t ibucket;
+      std::size_t ientry;
+    };
+
+    chunks_insertion(size_type bucket_count, std::size_t nb_chunks)
+        : nb_ranges(std::max<std::size_t>(
+              1, std::min<std::size_t>(nb_chunks, bucket_count))),
+          range_size((bucket_count + nb_ranges - 1) / nb_ranges),
+          entries_for_range(nb_chunks * nb_ranges),
+          required_size_for_bucket(bucket_count, 0),
+          nb_entries_for_bucket(StoreHashTags ? bucket_count : 0, 0),
+          entries_bytes_for_range(nb_ranges, 0) {}
+
+    std::size_t nb_ranges;
+    std::size_t range_size;
+    std::vector<std::vector<chunk_entry>> entries_for_range;
+    std::vector<std::size_t> required_size_for_bucket;
+    std::vector<std::size_t> nb_entries_for_bucket;
+    std::vector<size_type> entries_bytes_for_range;
+  };
+
+  /**
+   * Insert the entries of the 'nb_chunks' first chunks of 'chunks'. As in
+   * rehash_entries_parallel, the size each bucket needs for the entries of
+   * the wave is computed first, each bucket then grows once to its exact size
+   * and the entries are appended. The ranges of buckets are processed by
+   * their own thread, the entries of a bucket keep the order of the chunks.
    *
-   * It's done this way as we can't call clear_old_erased_values() because we
-   * want the serialize method to remain const and we don't want to
-   * serialize/deserialize old erased values. As we may not serialize all the
-   * values in value_container, the values we keep can change of index. We thus
-   * have to modify the value indexes in the buckets.
+   * If BucketStorage::owns_buffers is true, the storage can't be used
+   * concurrently and the buckets grow in the current thread.
    */
-  template <class Serializer>
-  void serialize_impl(Serializer& serializer) const {
-    const slz_size_type version = SERIALIZATION_PROTOCOL_VERSION;
-    serializer(version);
+  void insert_parsed_chunks(std::vector<parsed_chunk>& chunks,
+                            std::size_t nb_chunks,
+                            chunks_insertion& insertion) {
+    const std::size_t nb_ranges = insertion.nb_ranges;
+    const std::size_t range_size = insertion.range_size;
+
+    std::vector<std::size_t> first_value_for_chunk(nb_chunks);
+    for (std::size_t ichunk = 0; ichunk < nb_chunks; ichunk++) {
+      first_value_for_chunk[ichunk] = move_parsed_values(chunks[ichunk]);
+    }
 
-    const slz_size_type bucket_count = m_buckets_data.size();
-    serializer(bucket_count);
+    parallel_for(nb_chunks, [&](std::size_t ichunk) {
+      const std::vector<std::size_t>& hashes = chunks[ichunk].hashes;
+      for (std::size_t irange = 0; irange < nb_ranges; irange++) {
+        insertion.entries_for_range[ichunk * nb_ranges + irange].clear();
+      }
 
-    const slz_size_type nb_elements = m_nb_elements;
-    serializer(nb_elements);
+      for (std::size_t ientry = 0; ientry < hashes.size(); ientry++) {
+        const std::size_t ibucket = bucket_for_hash(hashes[ientry]);
+        insertion.entries_for_range[ichunk * nb_ranges + ibucket / range_size]
+            .push_back({ibucket, ientry});
+      }
+    });
+
+    const auto count_entry = [&](std::size_t ibucket, std::size_t ichunk,
+                                 std::size_t ientry) {
+      insertion.required_size_for_bucket[ibucket] +=
+          array_bucket::entry_required_bytes(
+              parsed_key_size(chunks[ichunk], ientry));
+      if (StoreHashTags) {
+        insertion.nb_entries_for_bucket[ibucket]++;
+      }
+    };
+
+    // Grow a bucket on its first entry and reset its counters.
+    const auto reserve_bucket = [&](std::size_t ibucket,
+                                    std::size_t /*ichunk*/,
+                                    std::size_t /*ientry*/) {
+      std::size_t& required_size = insertion.required_size_for_bucket[ibucket];
+      if (required_size != 0) {
+        m_buckets_data[ibucket].reserve_append(
+            bucket_storage(), required_size,
+            StoreHashTags ? insertion.nb_entries_for_bucket[ibucket] : 0);
+        required_size = 0;
+        if (StoreHashTags) {
+          insertion.nb_entries_for_bucket[ibucket] = 0;
+        }
+      }
+    };
 
-    const float max_load_factor = m_max_load_factor;
-    serializer(max_load_factor);
+    parallel_for(nb_ranges, [&](std::size_t irange) {
+      for_each_entry_of_range(nb_chunks, insertion, irange, count_entry);
+      if (!BucketStorage::owns_buffers) {
+        for_each_entry_of_range(nb_chunks, insertion, irange, reserve_bucket);
+      }
+    });
 
-    for (const array_bucket& bucket : m_buckets_data) {
-      bucket.serialize(serializer);
-      serialize_bucket_values(serializer, bucket);
+    if (BucketStorage::owns_buffers) {
+      for (std::size_t irange = 0; irange < nb_ranges; irange++) {
+        for_each_entry_of_range(nb_chunks, insertion, irange, reserve_bucket);
+      }
     }
-  }
 
-  template <
-      class Serializer, class U = T,
-      typename std::enable_if<!has_mapped_type<U>::value>::type* = nullptr>
-  void serialize_bucket_values(Serializer& /*serializer*/,
-                               const array_bucket& /*bucket*/) const {}
+    parallel_for(nb_ranges, [&](std::size_t irange) {
+      size_type entries_bytes = 0;
+      const auto append_entry = [&](std::size_t ibucket, std::size_t ichunk,
+                                    std::size_t ientry) {
+        const parsed_chunk& chunk = chunks[ichunk];
+        const CharT* key = chunk.keys.data() + parsed_key_start(chunk, ientry);
+        const size_type key_size = parsed_key_size(chunk, ientry);
+        const std::size_t hash = chunk.hashes[ientry];
+
+        array_bucket& bucket = m_buckets_data[ibucket];
+        if (bucket.find_or_end_of_bucket(key, key_size, hash).second) {
+          throw std::runtime_error(
+              "Can't deserialize the chunked array_map/set. The serialization "
+              "contains duplicate keys.");
+        }
 
-  template <class Serializer, class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  void serialize_bucket_values(Serializer& serializer,
-                               const array_bucket& bucket) const {
-    for (auto it = bucket.begin(); it != bucket.end(); ++it) {
-      serializer(this->m_values[it.value()]);
-    }
-  }
+        append_parsed_entry(bucket, key, key_size, hash, chunk, ientry,
+                            first_value_for_chunk[ichunk]);
+        entries_bytes += array_bucket::entry_required_bytes(key_size);
+      };
 
-  template <class Deserializer>
-  void deserialize_impl(Deserializer& deserializer, bool hash_compatible) {
-    tsl_ah_assert(m_buckets_data.empty());  // Current hash table must be empty
+      for_each_entry_of_range(nb_chunks, insertion, irange, append_entry);
+      insertion.entries_bytes_for_range[irange] = entries_bytes;
+    });
 
-    const slz_size_type version =
-        deserialize_value<slz_size_type>(deserializer);
-    // For now we only have one version of the serialization protocol.
-    // If it doesn't match there is a problem with the file.
-    if (version != SERIALIZATION_PROTOCOL_VERSION) {
-      throw std::runtime_error(
-          "Can't deserialize the array_map/set. The protocol version header is "
-          "invalid.");
+    for (std::size_t ichunk = 0; ichunk < nb_chunks; ichunk++) {
+      m_nb_elements += chunks[ichunk].hashes.size();
     }
+    for (std::size_t irange = 0; irange < nb_ranges; irange++) {
+      m_entries_bytes += insertion.entries_bytes_for_range[irange];
+    }
+  }
 
-    const slz_size_type bucket_count_ds =
-        deserialize_value<slz_size_type>(deserializer);
-    const slz_size_type nb_elements =
-        deserialize_value<slz_size_type>(deserializer);
-    const float max_load_factor = deserialize_value<float>(deserializer);
-
-    m_nb_elements = numeric_cast<IndexSizeT>(
-        nb_elements, "Deserialized nb_elements is too big.");
+  /**
+   * Call 'function(ibucket, ichunk, ientry)' for each entry of the 'nb_chunks'
+   * first chunks of a wave which goes in the buckets of 'irange', in the order
+   * of the chunks.
+   */
+  template <class Function>
+  static void for_each_entry_of_range(std::size_t nb_chunks,
+                                      const chunks_insertion& insertion,
+                                      std::size_t irange, Function function) {
+    for (std::size_t ichunk = 0; ichunk < nb_chunks; ichunk++) {
+      for (const auto& entry :
+           insertion.entries_for_range[ichunk * insertion.nb_ranges +
+                                       irange]) {
+        function(entry.ibucket, ichunk, entry.ientry);
+      }
+    }
+  }
 
-    size_type bucket_count = numeric_cast<size_type>(
-        bucket_count_ds, "Deserialized bucket_count is too big.");
-    GrowthPolicy::operator=(GrowthPolicy(bucket_count));
+  static std::size_t parsed_key_start(const parsed_chunk& chunk,
+                                      std::size_t ientry) {
+    return (ientry == 0) ? 0 : chunk.key_ends[ientry - 1];
+  }
 
-    this->max_load_factor(max_load_factor);
-    value_container<T>::reserve(m_nb_elements);
+  static size_type parsed_key_size(const parsed_chunk& chunk,
+                                   std::size_t ientry) {
+    return size_type(chunk.key_ends[ientry] - parsed_key_start(chunk, ientry));
+  }
 
-    if (hash_compatible) {
-      if (bucket_count != bucket_count_ds) {
-        throw std::runtime_error(
-            "The GrowthPolicy is not the same even though hash_compatible is "
-            "true.");
-      }
+  /**
+   * Move the values of 'chunk' at the end of m_values and return the index of
+   * the first one. Without values container, the values stay in the chunk.
+   */
+  template <class U = T, typename std::enable_if<
+                             !has_values_container<U>::value>::type* = nullptr>
+  std::size_t move_parsed_values(parsed_chunk& /*chunk*/) {
+    return 0;
+  }
 
-      m_buckets_data.reserve(bucket_count);
-      for (size_type i = 0; i < bucket_count; i++) {
-        m_buckets_data.push_back(array_bucket::deserialize(deserializer));
-        deserialize_bucket_values(deserializer, m_buckets_data.back());
-      }
-    } else {
-      m_buckets_data.resize(bucket_count);
-      for (size_type i = 0; i < bucket_count; i++) {
-        // TODO use buffer to avoid reallocation on each deserialization.
-        array_bucket bucket = array_bucket::deserialize(deserializer);
-        deserialize_bucket_values(deserializer, bucket);
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  std::size_t move_parsed_values(parsed_chunk& chunk) {
+    const std::size_t first_value = this->m_values.size();
+    for (chunk_value_type& value : chunk.values) {
+      this->m_values.emplace_back(std::move(value));
+    }
 
-        for (auto it_val = bucket.cbegin(); it_val != bucket.cend(); ++it_val) {
-          const std::size_t ibucket =
-              bucket_for_hash(hash_key(it_val.key(), it_val.key_size()));
-
-          auto it_find = m_buckets_data[ibucket].find_or_end_of_bucket(
-              it_val.key(), it_val.key_size());
-          if (it_find.second) {
-            throw std::runtime_error(
-                "Error on deserialization, the same key is presents multiple "
-                "times.");
-          }
+    return first_value;
+  }
 
-          append_array_bucket_iterator_in_bucket(m_buckets_data[ibucket],
-                                                 it_find.first, it_val);
-        }
-      }
-    }
+  template <class U = T, typename std::enable_if<
+                             !has_mapped_type<U>::value>::type* = nullptr>
+  void append_parsed_entry(array_bucket& bucket, const CharT* key,
+                           size_type key_size, std::size_t hash,
+                           const parsed_chunk& /*chunk*/,
+                           std::size_t /*ientry*/,
+                           std::size_t /*first_value*/) {
+    bucket.append_in_reserved_bucket_no_check(key, key_size, hash);
+  }
 
-    m_buckets = m_buckets_data.data();
+  template <class U = T, typename std::enable_if<
+                             has_values_container<U>::value>::type* = nullptr>
+  void append_parsed_entry(array_bucket& bucket, const CharT* key,
+                           size_type key_size, std::size_t hash,
+                           const parsed_chunk& /*chunk*/, std::size_t ientry,
+                           std::size_t first_value) {
+    tsl_ah_assert(first_value + ientry <=
+                  std::numeric_limits<IndexSizeT>::max());
+    bucket.append_in_reserved_bucket_no_check(
+        key, key_size, hash, IndexSizeT(first_value + ientry));
+  }
 
-    if (load_factor() > this->max_load_factor()) {
-      throw std::runtime_error(
-          "Invalid max_load_factor. Check that the serializer and deserializer "
-          "support "
-          "floats correctly as they can be converted implicitely to ints.");
-    }
+  template <class U = T, typename std::enable_if<
+                             has_inline_values<U>::value>::type* = nullptr>
+  void append_parsed_entry(array_bucket& bucket, const CharT* key,
+                           size_type key_size, std::size_t hash,
+                           const parsed_chunk& chunk, std::size_t ientry,
+                           std::size_t /*first_value*/) {
+    bucket.append_in_reserved_bucket_no_check(key, key_size, hash,
+                                              chunk.values[ientry]);
   }
 
-  template <
-      class Deserializer, class U = T,
-      typename std::enable_if<!has_mapped_type<U>::value>::type* = nullptr>
+  template <class Deserializer, class U = T,
+            typename std::enable_if<
+                !has_values_container<U>::value>::type* = nullptr>
   void deserialize_bucket_values(Deserializer& /*deserializer*/,
                                  array_bucket& /*bucket*/) {}
 
   template <class Deserializer, class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
+            typename std::enable_if<
+                has_values_container<U>::value>::type* = nullptr>
   void deserialize_bucket_values(Deserializer& deserializer,
                                  array_bucket& bucket) {
     for (auto it = bucket.begin(); it != bucket.end(); ++it) {
@@ -1745,27 +5430,22 @@ class array_hash : private value_container<T>,
     }
   }
 
-  template <class U = T, typename std::enable_if<
-                             !has_mapped_type<U>::value>::type* = nullptr>
-  void append_array_bucket_iterator_in_bucket(
-      array_bucket& bucket, typename array_bucket::const_iterator end_of_bucket,
-      typename array_bucket::const_iterator it_val) {
-    bucket.append(end_of_bucket, it_val.key(), it_val.key_size());
-  }
-
-  template <class U = T,
-            typename std::enable_if<has_mapped_type<U>::value>::type* = nullptr>
-  void append_array_bucket_iterator_in_bucket(
-      array_bucket& bucket, typename array_bucket::const_iterator end_of_bucket,
-      typename array_bucket::const_iterator it_val) {
-    bucket.append(end_of_bucket, it_val.key(), it_val.key_size(),
-                  it_val.value());
-  }
-
  public:
   static const size_type DEFAULT_INIT_BUCKET_COUNT = 0;
   static constexpr float DEFAULT_MAX_LOAD_FACTOR = 2.0f;
   static const size_type MAX_KEY_SIZE = array_bucket::MAX_KEY_SIZE;
+  static const size_type MAX_INLINE_VALUE_SIZE = 8;
+  static const std::size_t DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024;
+
+  using inline_value_type =
+      typename std::conditional<InlineValues && has_mapped_type<T>::value, T,
+                                char>::type;
+
+  static_assert(std::is_trivially_copyable<inline_value_type>::value &&
+                    sizeof(inline_value_type) <= MAX_INLINE_VALUE_SIZE &&
+                    is_power_of_two(sizeof(inline_value_type)),
+                "With InlineValues, T must be trivially copyable and its size "
+                "a power of two <= MAX_INLINE_VALUE_SIZE.");
   static constexpr float MIN_MAX_LOAD_FACTOR = 0.1f;
 
  private:
@@ -1774,9 +5454,56 @@ class array_hash : private value_container<T>,
    */
   static const slz_size_type SERIALIZATION_PROTOCOL_VERSION = 1;
 
+  static const slz_size_type CHUNKED_SERIALIZATION_LAYOUT =
+      sizeof(CharT) | (slz_size_type(has_mapped_type<T>::value) << 8);
+
   static constexpr float DEFAULT_CLEAR_OLD_ERASED_VALUE_THRESHOLD = 0.6f;
   static constexpr float REHASH_CLEAR_OLD_ERASED_VALUE_THRESHOLD = 0.9f;
 
+  /**
+   * The truncated hash stored in the buckets can only be used on rehash if it
+   * gives the same bucket as the full hash with 'bucket_count' buckets.
+   */
+  static bool USE_STORED_HASH_ON_REHASH(size_type bucket_count) {
+    if (StoreHash && sizeof(std::size_t) == sizeof(truncated_hash_type)) {
+      return true;
+    } else if (StoreHash && is_power_of_two_policy<GrowthPolicy>::value) {
+      return bucket_count == 0 ||
+             (bucket_count - 1) <=
+                 std::numeric_limits<truncated_hash_type>::max();
+    } else if (StoreHash && is_linear_hashing_policy<GrowthPolicy>::value) {
+      // The mask used by the buckets already split in the current round can go
+      // up to twice the bucket count.
+      return bucket_count <=
+             std::numeric_limits<truncated_hash_type>::max() / 2;
+    } else {
+      return false;
+    }
+  }
+
+  /**
+   * Maximum number of buckets split by grow_on_high_load with a linear hashing
+   * GrowthPolicy.
+   */
+  static const std::size_t MAX_SPLITS_ON_HIGH_LOAD = 16;
+
+  /**
+   * Number of hashes of a split bucket kept on the stack by split_bucket.
+   */
+  static const std::size_t SPLIT_STACK_HASHES = 32;
+
+  /**
+   * Number of keys searched together by the batched lookups.
+   */
+  static const std::size_t BATCH_LOOKUP_SIZE = 16;
+
+  /**
+   * How many entries ahead the buckets are prefetched when entries are
+   * appended to buckets allocated with their exact size, see
+   * prefetch_append_buckets.
+   */
+  static const std::size_t APPEND_PREFETCH_DISTANCE = 8;
+
   /**
    * Return an always valid pointer to a static empty array_bucket.
    */
@@ -1801,6 +5528,19 @@ class array_hash : private value_container<T>,
   IndexSizeT m_nb_elements;
   float m_max_load_factor;
   size_type m_load_threshold;
+
+  /**
+   * Sum of the sizes in bytes of the entries of all the buckets (see
+   * array_bucket::entry_required_bytes). The headers of the buckets, their
+   * hash tags and their unused capacity are not included.
+   */
+  size_type m_entries_bytes;
+
+  /**
+   * Maximum average of m_entries_bytes per bucket, 0 if there is no limit.
+   */
+  size_type m_max_load_bytes;
+  size_type m_load_bytes_threshold;
 };
 
 }  // end namespace detail_array_hash
@@ -58,6 +58,52 @@ namespace tsl {
  * can be raised with the `IndexSizeT` template parameter. See `max_size()` for
  * an easy access to this limit.
  *
+ * If `GrowthPolicy` is `tsl::ah::linear_hashing_growth_policy`, the map grows
+ * with linear hashing. Instead of rehashing all the keys at once when the load
+ * threshold is reached, each insertion past the threshold splits a few buckets
+ * in two, moving only the keys of these buckets. It avoids the latency spikes
+ * of a full rehash on large maps and the temporary doubling of the memory used
+ * by the buckets.
+ *
+ * If `StoreHashTags` is true, each bucket also stores an 8-bit tag of the hash
+ * of each of its keys. On lookup, the tags are compared with SIMD instructions
+ * (when available) and only the keys with a matching tag are compared, which
+ * speeds up lookups in long buckets, especially on misses, at the cost of a
+ * small header and one byte per key in each bucket.
+ *
+ * `BucketGrowthPolicy` defines how the buffer of a bucket grows when a key is
+ * inserted in it. The default `tsl::ah::exact_bucket_growth_policy` grows the
+ * buffer by exactly the size of the new key with a `std::realloc` on each
+ * insertion. `tsl::ah::geometric_bucket_growth_policy` instead stores the used
+ * size and the capacity of the buffer in a small header and grows the buffer
+ * geometrically, which avoids most of the reallocations of insert-heavy
+ * workloads at the cost of some unused memory in each bucket.
+ *
+ * `BucketStorage` defines where the buffers of the buckets are allocated. The
+ * default `tsl::ah::malloc_bucket_storage` allocates each buffer separately
+ * with `std::malloc`. `tsl::ah::arena_bucket_storage` instead serves them from
+ * slabs divided in size classes, which avoids a malloc header per bucket and
+ * the fragmentation of the heap, and frees all the buffers at once on `clear`,
+ * rehash and destruction. It implies that each bucket keeps track of its
+ * capacity.
+ *
+ * If `StoreHash` is true, the lowest 32 bits of the hash of each key are stored
+ * alongside the key. On lookup, the stored hash is compared before the key
+ * itself, which avoids most of the key comparisons with long keys. On rehash,
+ * the keys don't need to be hashed again if the `GrowthPolicy` is
+ * `tsl::ah::power_of_two_growth_policy` (or if `std::size_t` is 32 bits) and
+ * the new bucket count is at most 2^32. The same goes for the bucket splits of
+ * `tsl::ah::linear_hashing_growth_policy` up to 2^31 buckets. It costs 4 bytes
+ * per key.
+ *
+ * If `InlineValues` is true, the values are stored directly in the buckets,
+ * right after their key, instead of in a separate vector indexed by an
+ * `IndexSizeT` stored after the key. A lookup then only needs to access the
+ * bucket, which saves a cache miss, and an erase frees the value immediately.
+ * The values are padded to be aligned in the buckets, so that they can still be
+ * accessed by reference. `T` must be trivially copyable and its size a power of
+ * two up to 8 bytes (e.g. an integer, a float or a pointer).
+ *
  * Iterators invalidation:
  *  - clear, operator=: always invalidate the iterators.
  *  - insert, emplace, operator[]: always invalidate the iterators.
@@ -68,7 +114,11 @@ template <class CharT, class T, class Hash = tsl::ah::str_hash<CharT>,
           class KeyEqual = tsl::ah::str_equal<CharT>,
           bool StoreNullTerminator = true, class KeySizeT = std::uint16_t,
           class IndexSizeT = std::uint32_t,
-          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>>
+          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>,
+          bool StoreHashTags = false,
+          class BucketGrowthPolicy = tsl::ah::exact_bucket_growth_policy,
+          class BucketStorage = tsl::ah::malloc_bucket_storage,
+          bool StoreHash = false, bool InlineValues = false>
 class array_map {
  private:
   template <typename U>
@@ -76,7 +126,11 @@ class array_map {
 
   using ht = tsl::detail_array_hash::array_hash<CharT, T, Hash, KeyEqual,
                                                 StoreNullTerminator, KeySizeT,
-                                                IndexSizeT, GrowthPolicy>;
+                                                IndexSizeT, GrowthPolicy,
+                                                StoreHashTags,
+                                                BucketGrowthPolicy,
+                                                BucketStorage, StoreHash,
+                                                InlineValues>;
 
  public:
   using char_type = typename ht::char_type;
@@ -164,6 +218,20 @@ class array_map {
   size_type max_key_size() const noexcept { return m_ht.max_key_size(); }
   void shrink_to_fit() { m_ht.shrink_to_fit(); }
 
+  /**
+   * Return the memory used by the map, walking all its buckets. The memory of
+   * the buffers of the buckets is split between the keys, the values stored in
+   * the buckets if InlineValues is true, the metadata (key sizes, hashes,
+   * headers, ...) and the capacity not used yet. The values storage is split
+   * between the values of the elements, the erased values still stored (see
+   * `erase(const_iterator pos)`) and the unused capacity. The overhead of the
+   * allocator is an estimate.
+   *
+   * A high amount of dead values or unused capacity can be reclaimed with
+   * `shrink_to_fit()`.
+   */
+  tsl::ah::memory_usage memory_usage() const { return m_ht.memory_usage(); }
+
   /*
    * Modifiers
    */
@@ -216,6 +284,11 @@ class array_map {
     if (std::is_base_of<
             std::forward_iterator_tag,
             typename std::iterator_traits<InputIt>::iterator_category>::value) {
+      if (empty()) {
+        m_ht.bulk_load(first, last, tsl::ah::duplicate_policy::keep_first, 1);
+        return;
+      }
+
       const auto nb_elements_insert = std::distance(first, last);
       const std::size_t nb_free_buckets =
           std::size_t(float(bucket_count()) * max_load_factor()) - size();
@@ -242,6 +315,36 @@ class array_map {
   }
 #endif
 
+  /**
+   * Replace the content of the map by the elements of [first, last), as
+   * `clear()` followed by `insert(first, last)` but without growing the
+   * buffer of a bucket on each insertion. The keys are hashed once, then each
+   * bucket is allocated once with the exact size needed by its keys (the keys
+   * of duplicate elements included) before the elements are appended to it.
+   * `insert(first, last)` on an empty map does the same with forward
+   * iterators.
+   *
+   * The elements must be `std::pair<Key, T>` where `Key` is `const CharT*`,
+   * `std::basic_string<CharT>` or `std::basic_string_view<CharT>` (C++17).
+   * With a `std::move_iterator`, the values are moved into the map. When a
+   * key appears multiple times, `policy` defines which element is kept, the
+   * first one (as with `insert`) or the last one (as with
+   * `insert_or_assign`).
+   *
+   * If [first, last) are random access iterators, the keys are hashed by up
+   * to `nb_threads` threads, `Hash` must then be safe to call concurrently.
+   * Single-pass input iterators are copied in a vector first. The map is left
+   * unchanged if a key is too long.
+   */
+  template <class InputIt, typename std::enable_if<
+                               is_iterator<InputIt>::value>::type* = nullptr>
+  void bulk_load(
+      InputIt first, InputIt last,
+      tsl::ah::duplicate_policy policy = tsl::ah::duplicate_policy::keep_first,
+      std::size_t nb_threads = 1) {
+    m_ht.bulk_load(first, last, policy, nb_threads);
+  }
+
 #ifdef TSL_AH_HAS_STRING_VIEW
   template <class M>
   std::pair<iterator, bool> insert_or_assign(
@@ -296,9 +399,11 @@ class array_map {
    * Erase has an amortized O(1) runtime complexity, but even if it removes the
    * key immediately, it doesn't do the same for the associated value T.
    *
-   * T will only be removed when the ratio between the size of the map and
-   * the size of the map + the number of deleted values still stored is low
-   * enough.
+   * If T is move-assignable, the slot of the erased value is reused by the
+   * next insertion, which then replaces the old value by move-assignment.
+   * Otherwise, and for the slots not reused, T will only be removed when the
+   * ratio between the size of the map and the size of the map + the number of
+   * deleted values still stored is low enough.
    *
    * To force the deletion you can call shrink_to_fit.
    */
@@ -380,6 +485,24 @@ class array_map {
     return m_ht.erase(key, key_size, precalculated_hash);
   }
 
+  /**
+   * Erase all the elements for which `pred(key, key_size, value)` returns
+   * true, where `key` is a `const CharT*` of `key_size` characters and `value`
+   * a `const T&`. Return the number of erased elements.
+   *
+   * Contrary to a loop of `erase`, which moves the tail of the bucket on each
+   * erased element, each bucket is compacted in a single pass. If
+   * `compact_values` is true, the erased values are removed from the values
+   * storage at the end, as with `shrink_to_fit`, instead of keeping their
+   * slots for the next insertions (see `erase(const_iterator pos)`).
+   *
+   * If `pred` throws, the elements already erased stay erased.
+   */
+  template <class Predicate>
+  size_type erase_if(Predicate pred, bool compact_values = false) {
+    return m_ht.erase_if(pred, compact_values);
+  }
+
   void swap(array_map& other) { other.m_ht.swap(m_ht); }
 
   /*
@@ -787,12 +910,92 @@ class array_map {
     return m_ht.equal_range(key, key_size, precalculated_hash);
   }
 
+  /**
+   * Search all the keys in [keys_first, keys_last) and write for each of them,
+   * in order, the iterator to the key (or end() if the key is not in the
+   * map) to `iterators_out`. Return the output iterator past the last
+   * element written.
+   *
+   * The keys can be of type `const CharT*`, `std::basic_string<CharT>` or
+   * `std::basic_string_view<CharT>` (C++17). ForwardIt must be at least a
+   * forward iterator and `*it` must return a reference: the keys of a group
+   * are not copied and must stay valid until the group is searched.
+   *
+   * Faster than calling `find` for each key when there are many keys to
+   * search, the keys are processed in small groups and the buckets of a group
+   * are prefetched before being searched, so that the cache misses of the group
+   * overlap instead of stalling each lookup one after the other.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      OutputIt iterators_out) {
+    return m_ht.find_batch(keys_first, keys_last, iterators_out);
+  }
+
+  template <class ForwardIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      OutputIt iterators_out) const {
+    return m_ht.find_batch(keys_first, keys_last, iterators_out);
+  }
+
+  /**
+   * Use the hash values in [hashes_first, hashes_first + std::distance(
+   * keys_first, keys_last)) instead of hashing the keys. Each hash value
+   * should be the same as hash_function()(key) for its key.
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      HashIt hashes_first, OutputIt iterators_out) {
+    return m_ht.find_batch(keys_first, keys_last, hashes_first,
+                           iterators_out);
+  }
+
+  /**
+   * @copydoc find_batch(ForwardIt keys_first, ForwardIt keys_last, HashIt
+   * hashes_first, OutputIt iterators_out)
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      HashIt hashes_first, OutputIt iterators_out) const {
+    return m_ht.find_batch(keys_first, keys_last, hashes_first,
+                           iterators_out);
+  }
+
+  /**
+   * Same as `find_batch` but write the count (0 or 1) of each key to
+   * `counts_out` instead of an iterator.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       OutputIt counts_out) const {
+    return m_ht.count_batch(keys_first, keys_last, counts_out);
+  }
+
+  /**
+   * @copydoc find_batch(ForwardIt keys_first, ForwardIt keys_last, HashIt
+   * hashes_first, OutputIt iterators_out)
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       HashIt hashes_first, OutputIt counts_out) const {
+    return m_ht.count_batch(keys_first, keys_last, hashes_first, counts_out);
+  }
+
   /*
    * Bucket interface
    */
   size_type bucket_count() const { return m_ht.bucket_count(); }
   size_type max_bucket_count() const { return m_ht.max_bucket_count(); }
 
+  /**
+   * Return statistics over all the buckets of the map: histograms of the
+   * number of elements, the size in bytes and the number of cache lines of the
+   * buckets, the fraction of empty buckets and the longest bucket. Useful to
+   * check if the hash function and the growth policy suit the keys and to tune
+   * `max_load_factor`. All the buckets are walked.
+   */
+  tsl::ah::bucket_stats bucket_stats() const { return m_ht.bucket_stats(); }
+
   /*
    *  Hash policy
    */
@@ -800,9 +1003,42 @@ class array_map {
   float max_load_factor() const { return m_ht.max_load_factor(); }
   void max_load_factor(float ml) { m_ht.max_load_factor(ml); }
 
+  /**
+   * Average size in bytes of the entries of a bucket: the keys with their size
+   * and, depending on the template parameters, their null terminator, their
+   * truncated hash and their value. The headers, the hash tags and the unused
+   * capacity of the buckets are not counted.
+   */
+  float load_bytes() const { return m_ht.load_bytes(); }
+
+  /**
+   * If not 0, the map also grows when load_bytes() reaches
+   * max_load_bytes(), e.g. 128 bytes to keep the buckets within two cache
+   * lines. Combined with a high max_load_factor(), the bucket count adapts to
+   * the length of the keys. 0 by default, the limit isn't serialized.
+   */
+  size_type max_load_bytes() const { return m_ht.max_load_bytes(); }
+  void max_load_bytes(size_type mb) { m_ht.max_load_bytes(mb); }
+
   void rehash(size_type count) { m_ht.rehash(count); }
   void reserve(size_type count) { m_ht.reserve(count); }
 
+  /**
+   * Same as rehash(count) and reserve(count) but split the work between up to
+   * 'nb_threads' threads, the current one included. Each thread hashes the keys
+   * of a range of the current buckets, then builds a range of the new buckets.
+   * The resulting map is the same as with a single thread.
+   *
+   * The hash function must be safe to call concurrently. Only useful for very
+   * large maps, the cost of creating the threads dominates otherwise.
+   */
+  void rehash(size_type count, std::size_t nb_threads) {
+    m_ht.rehash(count, nb_threads);
+  }
+  void reserve(size_type count, std::size_t nb_threads) {
+    m_ht.reserve(count, nb_threads);
+  }
+
   /*
    * Observers
    */
@@ -831,6 +1067,10 @@ class array_map {
    * The implementation leaves binary compatibility (endianness, IEEE 754 for
    * floats, ...) of the types it serializes in the hands of the `Serializer`
    * function object if compatibility is required.
+   *
+   * If `InlineValues` is true, the values are serialized as raw bytes along
+   * with the keys of their bucket and `T` doesn't need to be supported by the
+   * `serializer`.
    */
   template <class Serializer>
   void serialize(Serializer& serializer) const {
@@ -851,26 +1091,112 @@ class array_map {
    * map, the deserialization process can be sped up by setting
    * `hash_compatible` to true. To be hash compatible, the Hash (take care of
    * the 32-bits vs 64 bits), KeyEqual, GrowthPolicy, StoreNullTerminator,
-   * KeySizeT and IndexSizeT must behave the same than the ones used on the
-   * serialized map. Otherwise the behaviour is undefined with `hash_compatible`
-   * sets to true.
+   * KeySizeT, IndexSizeT, StoreHash and InlineValues must behave the same than
+   * the ones used on the serialized map. Otherwise the behaviour is undefined
+   * with `hash_compatible` sets to true.
    *
    * The behaviour is undefined if the type `CharT` and `T` of the `array_map`
    * are not the same as the types used during serialization.
    *
+   * Otherwise, all the serialized keys are read in a single buffer, hashed
+   * and distributed in buckets which are each allocated once with their exact
+   * size. If `nb_threads` > 1, the keys are hashed by up to `nb_threads`
+   * threads, `Hash` must then be safe to call concurrently. The keys are not
+   * checked for duplicates if `check_duplicate_keys` is false, which is faster
+   * but must only be used on trusted input as the map is left with
+   * duplicate keys otherwise (an `array_map` never serializes the same key
+   * twice). Both parameters are ignored if `hash_compatible` is true.
+   *
    * The implementation leaves binary compatibility (endianness, IEEE 754 for
    * floats, size of int, ...) of the types it deserializes in the hands of the
    * `Deserializer` function object if compatibility is required.
    */
   template <class Deserializer>
   static array_map deserialize(Deserializer& deserializer,
-                               bool hash_compatible = false) {
+                               bool hash_compatible = false,
+                               std::size_t nb_threads = 1,
+                               bool check_duplicate_keys = true) {
+    array_map map(0);
+    map.m_ht.deserialize(deserializer, hash_compatible, nb_threads,
+                          check_duplicate_keys);
+
+    return map;
+  }
+
+  /**
+   * Serialize the map in a chunked format through the `writer` parameter, a
+   * function object supporting the call
+   * `void operator()(const char* data, std::size_t size);`.
+   *
+   * Contrary to `serialize`, each chunk covers a range of consecutive buckets
+   * and carries the CRC32C of its content, and a chunk index is written at the
+   * end. A chunked serialization can thus be verified with `verify_chunked`
+   * and loaded with `deserialize_chunked` in parallel, in whole or in part. A
+   * chunk is closed once it reaches `chunk_size` bytes, at the end of a bucket.
+   *
+   * The values are written by the `value_serializer` function object with the
+   * call `template<class U, class Writer> void operator()(const U& value,
+   * Writer& writer) const;` where `writer` supports the same call as the
+   * `writer` parameter. By default the raw bytes of the values are written,
+   * `T` must then be trivially copyable.
+   *
+   * The format stores the integers in the native endianness of the platform.
+   */
+  template <class Writer,
+            class ValueSerializer = tsl::ah::raw_value_serializer>
+  void serialize_chunked(
+      Writer& writer, std::size_t chunk_size = ht::DEFAULT_CHUNK_SIZE,
+      const ValueSerializer& value_serializer = ValueSerializer()) const {
+    m_ht.serialize_chunked(writer, chunk_size, value_serializer);
+  }
+
+  /**
+   * Deserialize a map serialized with `serialize_chunked` through the `reader`
+   * parameter, a function object supporting the call
+   * `void operator()(std::uint64_t offset, char* data, std::size_t size);`
+   * which reads `size` bytes at `offset`. `size` is the total size of the
+   * serialization.
+   *
+   * The chunks are read, checked and hashed by up to `nb_threads` threads.
+   * The `reader` and `Hash` must then be safe to call concurrently. The
+   * entries are then appended by as many threads, each one filling its own
+   * range of buckets, and a bucket grows at most once per group of
+   * `nb_threads` chunks. Only the chunks for which
+   * `chunk_filter(ichunk, nb_chunks)` returns true are loaded, which allows to
+   * split a serialization between multiple maps.
+   *
+   * The values are read by the `value_deserializer` function object with the
+   * call `template<class U, class Reader> U operator()(Reader& reader) const;`
+   * where `reader` supports the call
+   * `void operator()(char* data, std::size_t size);`.
+   *
+   * Throw `std::runtime_error` if the serialization is truncated or if a
+   * checksum doesn't match.
+   */
+  template <class Reader, class ChunkFilter = tsl::ah::all_chunks,
+            class ValueDeserializer = tsl::ah::raw_value_deserializer>
+  static array_map deserialize_chunked(
+      Reader& reader, std::uint64_t size, std::size_t nb_threads = 1,
+      ChunkFilter chunk_filter = ChunkFilter(),
+      const ValueDeserializer& value_deserializer = ValueDeserializer()) {
     array_map map(0);
-    map.m_ht.deserialize(deserializer, hash_compatible);
+    map.m_ht.deserialize_chunked(reader, size, nb_threads, chunk_filter,
+                                 value_deserializer);
 
     return map;
   }
 
+  /**
+   * Check the chunk index and the checksum of each chunk of a serialization
+   * done with `serialize_chunked`, see `deserialize_chunked` for `reader` and
+   * `nb_threads`. Throw `std::runtime_error` on the first error found.
+   */
+  template <class Reader>
+  static void verify_chunked(Reader& reader, std::uint64_t size,
+                             std::size_t nb_threads = 1) {
+    ht::verify_chunked(reader, size, nb_threads);
+  }
+
   friend bool operator==(const array_map& lhs, const array_map& rhs) {
     if (lhs.size() != rhs.size()) {
       return false;
@@ -55,6 +55,44 @@ namespace tsl {
  * can be raised with the `IndexSizeT` template parameter. See `max_size()` for
  * an easy access to this limit.
  *
+ * If `GrowthPolicy` is `tsl::ah::linear_hashing_growth_policy`, the set grows
+ * with linear hashing. Instead of rehashing all the keys at once when the load
+ * threshold is reached, each insertion past the threshold splits a few buckets
+ * in two, moving only the keys of these buckets. It avoids the latency spikes
+ * of a full rehash on large sets and the temporary doubling of the memory used
+ * by the buckets.
+ *
+ * If `StoreHashTags` is true, each bucket also stores an 8-bit tag of the hash
+ * of each of its keys. On lookup, the tags are compared with SIMD instructions
+ * (when available) and only the keys with a matching tag are compared, which
+ * speeds up lookups in long buckets, especially on misses, at the cost of a
+ * small header and one byte per key in each bucket.
+ *
+ * `BucketGrowthPolicy` defines how the buffer of a bucket grows when a key is
+ * inserted in it. The default `tsl::ah::exact_bucket_growth_policy` grows the
+ * buffer by exactly the size of the new key with a `std::realloc` on each
+ * insertion. `tsl::ah::geometric_bucket_growth_policy` instead stores the used
+ * size and the capacity of the buffer in a small header and grows the buffer
+ * geometrically, which avoids most of the reallocations of insert-heavy
+ * workloads at the cost of some unused memory in each bucket.
+ *
+ * `BucketStorage` defines where the buffers of the buckets are allocated. The
+ * default `tsl::ah::malloc_bucket_storage` allocates each buffer separately
+ * with `std::malloc`. `tsl::ah::arena_bucket_storage` instead serves them from
+ * slabs divided in size classes, which avoids a malloc header per bucket and
+ * the fragmentation of the heap, and frees all the buffers at once on `clear`,
+ * rehash and destruction. It implies that each bucket keeps track of its
+ * capacity.
+ *
+ * If `StoreHash` is true, the lowest 32 bits of the hash of each key are stored
+ * alongside the key. On lookup, the stored hash is compared before the key
+ * itself, which avoids most of the key comparisons with long keys. On rehash,
+ * the keys don't need to be hashed again if the `GrowthPolicy` is
+ * `tsl::ah::power_of_two_growth_policy` (or if `std::size_t` is 32 bits) and
+ * the new bucket count is at most 2^32. The same goes for the bucket splits of
+ * `tsl::ah::linear_hashing_growth_policy` up to 2^31 buckets. It costs 4 bytes
+ * per key.
+ *
  * Iterators invalidation:
  *  - clear, operator=: always invalidate the iterators.
  *  - insert, emplace, operator[]: always invalidate the iterators.
@@ -65,7 +103,11 @@ template <class CharT, class Hash = tsl::ah::str_hash<CharT>,
           class KeyEqual = tsl::ah::str_equal<CharT>,
           bool StoreNullTerminator = true, class KeySizeT = std::uint16_t,
           class IndexSizeT = std::uint32_t,
-          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>>
+          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>,
+          bool StoreHashTags = false,
+          class BucketGrowthPolicy = tsl::ah::exact_bucket_growth_policy,
+          class BucketStorage = tsl::ah::malloc_bucket_storage,
+          bool StoreHash = false>
 class array_set {
  private:
   template <typename U>
@@ -73,7 +115,11 @@ class array_set {
 
   using ht = tsl::detail_array_hash::array_hash<CharT, void, Hash, KeyEqual,
                                                 StoreNullTerminator, KeySizeT,
-                                                IndexSizeT, GrowthPolicy>;
+                                                IndexSizeT, GrowthPolicy,
+                                                StoreHashTags,
+                                                BucketGrowthPolicy,
+                                                BucketStorage, StoreHash,
+                                                false>;
 
  public:
   using char_type = typename ht::char_type;
@@ -156,6 +202,12 @@ class array_set {
   size_type max_key_size() const noexcept { return m_ht.max_key_size(); }
   void shrink_to_fit() { m_ht.shrink_to_fit(); }
 
+  /**
+   * Return the memory used by the set, walking all its buckets, see
+   * `tsl::array_map::memory_usage`.
+   */
+  tsl::ah::memory_usage memory_usage() const { return m_ht.memory_usage(); }
+
   /*
    * Modifiers
    */
@@ -184,6 +236,11 @@ class array_set {
     if (std::is_base_of<
             std::forward_iterator_tag,
             typename std::iterator_traits<InputIt>::iterator_category>::value) {
+      if (empty()) {
+        m_ht.bulk_load(first, last, tsl::ah::duplicate_policy::keep_first, 1);
+        return;
+      }
+
       const auto nb_elements_insert = std::distance(first, last);
       const std::size_t nb_free_buckets =
           std::size_t(float(bucket_count()) * max_load_factor()) - size();
@@ -209,6 +266,23 @@ class array_set {
   }
 #endif
 
+  /**
+   * Replace the content of the set by the keys of [first, last), as `clear()`
+   * followed by `insert(first, last)` but with each bucket allocated once with
+   * its exact size, see `tsl::array_map::bulk_load`.
+   *
+   * The keys can be of type `const CharT*`, `std::basic_string<CharT>` or
+   * `std::basic_string_view<CharT>` (C++17). If [first, last) are random
+   * access iterators, the keys are hashed by up to `nb_threads` threads,
+   * `Hash` must then be safe to call concurrently.
+   */
+  template <class InputIt, typename std::enable_if<
+                               is_iterator<InputIt>::value>::type* = nullptr>
+  void bulk_load(InputIt first, InputIt last, std::size_t nb_threads = 1) {
+    m_ht.bulk_load(first, last, tsl::ah::duplicate_policy::keep_first,
+                   nb_threads);
+  }
+
 #ifdef TSL_AH_HAS_STRING_VIEW
   /**
    * @copydoc emplace_ks(const CharT* key, size_type key_size)
@@ -299,6 +373,16 @@ class array_set {
     return m_ht.erase(key, key_size, precalculated_hash);
   }
 
+  /**
+   * Erase all the keys for which `pred(key, key_size)` returns true, where
+   * `key` is a `const CharT*` of `key_size` characters. Return the number of
+   * erased keys. Each bucket is compacted in a single pass.
+   */
+  template <class Predicate>
+  size_type erase_if(Predicate pred) {
+    return m_ht.erase_if(pred, false);
+  }
+
   void swap(array_set& other) { other.m_ht.swap(m_ht); }
 
   /*
@@ -586,12 +670,89 @@ class array_set {
     return m_ht.equal_range(key, key_size, precalculated_hash);
   }
 
+  /**
+   * Search all the keys in [keys_first, keys_last) and write for each of them,
+   * in order, the iterator to the key (or end() if the key is not in the
+   * set) to `iterators_out`. Return the output iterator past the last
+   * element written.
+   *
+   * The keys can be of type `const CharT*`, `std::basic_string<CharT>` or
+   * `std::basic_string_view<CharT>` (C++17). ForwardIt must be at least a
+   * forward iterator and `*it` must return a reference: the keys of a group
+   * are not copied and must stay valid until the group is searched.
+   *
+   * Faster than calling `find` for each key when there are many keys to
+   * search, the keys are processed in small groups and the buckets of a group
+   * are prefetched before being searched, so that the cache misses of the group
+   * overlap instead of stalling each lookup one after the other.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      OutputIt iterators_out) {
+    return m_ht.find_batch(keys_first, keys_last, iterators_out);
+  }
+
+  template <class ForwardIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      OutputIt iterators_out) const {
+    return m_ht.find_batch(keys_first, keys_last, iterators_out);
+  }
+
+  /**
+   * Use the hash values in [hashes_first, hashes_first + std::distance(
+   * keys_first, keys_last)) instead of hashing the keys. Each hash value
+   * should be the same as hash_function()(key) for its key.
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      HashIt hashes_first, OutputIt iterators_out) {
+    return m_ht.find_batch(keys_first, keys_last, hashes_first,
+                           iterators_out);
+  }
+
+  /**
+   * @copydoc find_batch(ForwardIt keys_first, ForwardIt keys_last, HashIt
+   * hashes_first, OutputIt iterators_out)
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt find_batch(ForwardIt keys_first, ForwardIt keys_last,
+                      HashIt hashes_first, OutputIt iterators_out) const {
+    return m_ht.find_batch(keys_first, keys_last, hashes_first,
+                           iterators_out);
+  }
+
+  /**
+   * Same as `find_batch` but write the count (0 or 1) of each key to
+   * `counts_out` instead of an iterator.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       OutputIt counts_out) const {
+    return m_ht.count_batch(keys_first, keys_last, counts_out);
+  }
+
+  /**
+   * @copydoc find_batch(ForwardIt keys_first, ForwardIt keys_last, HashIt
+   * hashes_first, OutputIt iterators_out)
+   */
+  template <class ForwardIt, class HashIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       HashIt hashes_first, OutputIt counts_out) const {
+    return m_ht.count_batch(keys_first, keys_last, hashes_first, counts_out);
+  }
+
   /*
    * Bucket interface
    */
   size_type bucket_count() const { return m_ht.bucket_count(); }
   size_type max_bucket_count() const { return m_ht.max_bucket_count(); }
 
+  /**
+   * Return statistics over all the buckets of the set, see
+   * `tsl::array_map::bucket_stats`.
+   */
+  tsl::ah::bucket_stats bucket_stats() const { return m_ht.bucket_stats(); }
+
   /*
    *  Hash policy
    */
@@ -599,9 +760,42 @@ class array_set {
   float max_load_factor() const { return m_ht.max_load_factor(); }
   void max_load_factor(float ml) { m_ht.max_load_factor(ml); }
 
+  /**
+   * Average size in bytes of the entries of a bucket: the keys with their size
+   * and, depending on the template parameters, their null terminator and their
+   * truncated hash. The headers, the hash tags and the unused capacity of the
+   * buckets are not counted.
+   */
+  float load_bytes() const { return m_ht.load_bytes(); }
+
+  /**
+   * If not 0, the set also grows when load_bytes() reaches
+   * max_load_bytes(), e.g. 128 bytes to keep the buckets within two cache
+   * lines. Combined with a high max_load_factor(), the bucket count adapts to
+   * the length of the keys. 0 by default, the limit isn't serialized.
+   */
+  size_type max_load_bytes() const { return m_ht.max_load_bytes(); }
+  void max_load_bytes(size_type mb) { m_ht.max_load_bytes(mb); }
+
   void rehash(size_type count) { m_ht.rehash(count); }
   void reserve(size_type count) { m_ht.reserve(count); }
 
+  /**
+   * Same as rehash(count) and reserve(count) but split the work between up to
+   * 'nb_threads' threads, the current one included. Each thread hashes the keys
+   * of a range of the current buckets, then builds a range of the new buckets.
+   * The resulting set is the same as with a single thread.
+   *
+   * The hash function must be safe to call concurrently. Only useful for very
+   * large sets, the cost of creating the threads dominates otherwise.
+   */
+  void rehash(size_type count, std::size_t nb_threads) {
+    m_ht.rehash(count, nb_threads);
+  }
+  void reserve(size_type count, std::size_t nb_threads) {
+    m_ht.reserve(count, nb_threads);
+  }
+
   /*
    * Observers
    */
@@ -650,26 +844,83 @@ class array_set {
    * set, the deserialization process can be sped up by setting
    * `hash_compatible` to true. To be hash compatible, the Hash (take care of
    * the 32-bits vs 64 bits), KeyEqual, GrowthPolicy, StoreNullTerminator,
-   * KeySizeT and IndexSizeT must behave the same than the ones used on the
+   * KeySizeT, IndexSizeT and StoreHash must behave the same than the ones used
+   * on the
    * serialized set. Otherwise the behaviour is undefined with `hash_compatible`
    * sets to true.
    *
    * The behaviour is undefined if the type `CharT` of the `array_set` is not
    * the same as the type used during serialization.
    *
+   * Otherwise, all the serialized keys are read in a single buffer, hashed
+   * and distributed in buckets which are each allocated once with their exact
+   * size. If `nb_threads` > 1, the keys are hashed by up to `nb_threads`
+   * threads, `Hash` must then be safe to call concurrently. The keys are not
+   * checked for duplicates if `check_duplicate_keys` is false, which is faster
+   * but must only be used on trusted input as the set is left with
+   * duplicate keys otherwise (an `array_set` never serializes the same key
+   * twice). Both parameters are ignored if `hash_compatible` is true.
+   *
    * The implementation leaves binary compatibility (endianness, IEEE 754 for
    * floats, size of int, ...) of the types it deserializes in the hands of the
    * `Deserializer` function object if compatibility is required.
    */
   template <class Deserializer>
   static array_set deserialize(Deserializer& deserializer,
-                               bool hash_compatible = false) {
+                               bool hash_compatible = false,
+                               std::size_t nb_threads = 1,
+                               bool check_duplicate_keys = true) {
     array_set set(0);
-    set.m_ht.deserialize(deserializer, hash_compatible);
+    set.m_ht.deserialize(deserializer, hash_compatible, nb_threads,
+                          check_duplicate_keys);
 
     return set;
   }
 
+  /**
+   * Serialize the set in a chunked format through the `writer` parameter, a
+   * function object supporting the call
+   * `void operator()(const char* data, std::size_t size);`.
+   *
+   * See `tsl::array_map::serialize_chunked` for the details of the format.
+   */
+  template <class Writer>
+  void serialize_chunked(
+      Writer& writer, std::size_t chunk_size = ht::DEFAULT_CHUNK_SIZE) const {
+    m_ht.serialize_chunked(writer, chunk_size,
+                           tsl::ah::raw_value_serializer());
+  }
+
+  /**
+   * Deserialize a set serialized with `serialize_chunked` through the `reader`
+   * parameter, a function object supporting the call
+   * `void operator()(std::uint64_t offset, char* data, std::size_t size);`.
+   *
+   * See `tsl::array_map::deserialize_chunked` for the details.
+   */
+  template <class Reader, class ChunkFilter = tsl::ah::all_chunks>
+  static array_set deserialize_chunked(Reader& reader, std::uint64_t size,
+                                       std::size_t nb_threads = 1,
+                                       ChunkFilter chunk_filter =
+                                           ChunkFilter()) {
+    array_set set(0);
+    set.m_ht.deserialize_chunked(reader, size, nb_threads, chunk_filter,
+                                 tsl::ah::raw_value_deserializer());
+
+    return set;
+  }
+
+  /**
+   * Check the chunk index and the checksum of each chunk of a serialization
+   * done with `serialize_chunked`, see `deserialize_chunked` for `reader` and
+   * `nb_threads`. Throw `std::runtime_error` on the first error found.
+   */
+  template <class Reader>
+  static void verify_chunked(Reader& reader, std::uint64_t size,
+                             std::size_t nb_threads = 1) {
+    ht::verify_chunked(reader, size, nb_threads);
+  }
+
   friend bool operator==(const array_set& lhs, const array_set& rhs) {
     if (lhs.size() != rhs.size()) {
       return false;
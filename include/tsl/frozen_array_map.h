@@ -0,0 +1,683 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_FROZEN_ARRAY_MAP_H
+#define TSL_FROZEN_ARRAY_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "array_map.h"
+
+namespace tsl {
+
+template <class CharT, class T, class Hash, class KeyEqual,
+          bool StoreNullTerminator, class KeySizeT, class IndexSizeT,
+          class GrowthPolicy>
+class mapped_array_map;
+
+/**
+ * Immutable version of `tsl::array_map` optimized for read-only lookups.
+ *
+ * A `frozen_array_map` is built once from an `array_map` (see the constructors
+ * and `tsl::freeze`) and can't be modified afterwards. Instead of a separately
+ * allocated buffer per bucket, all the buckets are packed one after the other
+ * in a single contiguous buffer. An array of `bucket_count() + 1` offsets gives
+ * the start of each bucket in this buffer (the end of a bucket is the start of
+ * the next one). A lookup thus only needs the two offsets of its bucket before
+ * scanning the keys, without any per-bucket allocation or pointer chasing.
+ *
+ * The entries of a bucket have the same format as in `array_map` (size of the
+ * key, key, optional null-terminator and index of the value) and the values
+ * are stored in a separate array. The map uses the same bucket count, `Hash`,
+ * `KeyEqual` and `GrowthPolicy` as the `array_map` it's built from, the
+ * `precalculated_hash` of a key is thus the same for both maps.
+ *
+ * The map can be written as a flat image with
+ * `tsl::mapped_array_map::write_image` and later queried in place, e.g. from a
+ * `mmap`ed file, with a `tsl::mapped_array_map`.
+ *
+ * Iterators invalidation:
+ *  - operator=: always invalidate the iterators.
+ */
+template <class CharT, class T, class Hash = tsl::ah::str_hash<CharT>,
+          class KeyEqual = tsl::ah::str_equal<CharT>,
+          bool StoreNullTerminator = true, class KeySizeT = std::uint16_t,
+          class IndexSizeT = std::uint32_t,
+          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>>
+class frozen_array_map : private Hash, private GrowthPolicy {
+ public:
+  class const_iterator;
+
+  using char_type = CharT;
+  using mapped_type = T;
+  using key_size_type = KeySizeT;
+  using index_size_type = IndexSizeT;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using iterator = const_iterator;
+
+ private:
+  template <bool StoreHashTags, class BucketGrowthPolicy, class BucketStorage,
+            bool StoreHash, bool InlineValues>
+  using source_map =
+      array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                IndexSizeT, GrowthPolicy, StoreHashTags, BucketGrowthPolicy,
+                BucketStorage, StoreHash, InlineValues>;
+
+  // Writes the image of the map, see mapped_array_map::write_image.
+  friend class mapped_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator,
+                                KeySizeT, IndexSizeT, GrowthPolicy>;
+
+ public:
+  class const_iterator {
+    friend class frozen_array_map;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using reference = const T&;
+    using pointer = const T*;
+
+   private:
+    const_iterator(const CharT* position,
+                   const frozen_array_map* map) noexcept
+        : m_position(position), m_map(map) {}
+
+   public:
+    const_iterator() noexcept : m_position(nullptr), m_map(nullptr) {}
+
+    const CharT* key() const {
+      return m_position + size_as_char_t<key_size_type>();
+    }
+
+    size_type key_size() const { return read_key_size(m_position); }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+    std::basic_string_view<CharT> key_sv() const {
+      return std::basic_string_view<CharT>(key(), key_size());
+    }
+#endif
+
+    reference value() const {
+      return m_map->m_values[read_value_index(m_position)];
+    }
+
+    reference operator*() const { return value(); }
+
+    pointer operator->() const { return std::addressof(value()); }
+
+    const_iterator& operator++() {
+      m_position += entry_size_as_char_t(read_key_size(m_position));
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp(*this);
+      ++*this;
+
+      return tmp;
+    }
+
+    friend bool operator==(const const_iterator& lhs,
+                           const const_iterator& rhs) {
+      return lhs.m_position == rhs.m_position;
+    }
+
+    friend bool operator!=(const const_iterator& lhs,
+                           const const_iterator& rhs) {
+      return !(lhs == rhs);
+    }
+
+   private:
+    const CharT* m_position;
+    const frozen_array_map* m_map;
+  };
+
+ public:
+  frozen_array_map() : frozen_array_map(Hash(), 0) {}
+
+  /**
+   * Build a frozen copy of `map`.
+   */
+  template <bool StoreHashTags, class BucketGrowthPolicy, class BucketStorage,
+            bool StoreHash, bool InlineValues>
+  explicit frozen_array_map(
+      const source_map<StoreHashTags, BucketGrowthPolicy, BucketStorage,
+                       StoreHash, InlineValues>& map)
+      : frozen_array_map(map.hash_function(), map.bucket_count()) {
+    build(map, std::false_type());
+  }
+
+  /**
+   * Build a frozen map from `map`, moving its values instead of copying them.
+   * `map` is cleared afterwards.
+   */
+  template <bool StoreHashTags, class BucketGrowthPolicy, class BucketStorage,
+            bool StoreHash, bool InlineValues>
+  explicit frozen_array_map(source_map<StoreHashTags, BucketGrowthPolicy,
+                                       BucketStorage, StoreHash, InlineValues>&&
+                                map)
+      : frozen_array_map(map.hash_function(), map.bucket_count()) {
+    build(map, std::true_type());
+    map.clear();
+  }
+
+  /*
+   * Iterators
+   */
+  const_iterator begin() const noexcept { return cbegin(); }
+  const_iterator cbegin() const noexcept {
+    return const_iterator(m_entries.data(), this);
+  }
+
+  const_iterator end() const noexcept { return cend(); }
+  const_iterator cend() const noexcept {
+    return const_iterator(m_entries.data() + m_entries.size(), this);
+  }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_values.empty(); }
+  size_type size() const noexcept { return m_values.size(); }
+  size_type max_key_size() const noexcept { return MAX_KEY_SIZE; }
+
+  /*
+   * Lookup
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  const T& at(const std::basic_string_view<CharT>& key) const {
+    return at_ks(key.data(), key.size());
+  }
+#else
+  const T& at(const CharT* key) const {
+    return at_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  const T& at(const std::basic_string<CharT>& key) const {
+    return at_ks(key.data(), key.size());
+  }
+#endif
+  const T& at_ks(const CharT* key, size_type key_size) const {
+    return at_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc at_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const T& at(const std::basic_string_view<CharT>& key,
+              std::size_t precalculated_hash) const {
+    return at_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc at_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const T& at(const CharT* key, std::size_t precalculated_hash) const {
+    return at_ks(key, std::char_traits<CharT>::length(key),
+                 precalculated_hash);
+  }
+
+  /**
+   * @copydoc at_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const T& at(const std::basic_string<CharT>& key,
+              std::size_t precalculated_hash) const {
+    return at_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  const T& at_ks(const CharT* key, size_type key_size,
+                 std::size_t precalculated_hash) const {
+    const const_iterator it = find_ks(key, key_size, precalculated_hash);
+    if (it == cend()) {
+      throw std::out_of_range("Couldn't find key.");
+    }
+
+    return it.value();
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  size_type count(const std::basic_string_view<CharT>& key) const {
+    return count_ks(key.data(), key.size());
+  }
+#else
+  size_type count(const CharT* key) const {
+    return count_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  size_type count(const std::basic_string<CharT>& key) const {
+    return count_ks(key.data(), key.size());
+  }
+#endif
+  size_type count_ks(const CharT* key, size_type key_size) const {
+    return count_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc count_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  size_type count(const std::basic_string_view<CharT>& key,
+                  std::size_t precalculated_hash) const {
+    return count_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc count_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  size_type count(const CharT* key, std::size_t precalculated_hash) const {
+    return count_ks(key, std::char_traits<CharT>::length(key),
+                    precalculated_hash);
+  }
+
+  /**
+   * @copydoc count_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  size_type count(const std::basic_string<CharT>& key,
+                  std::size_t precalculated_hash) const {
+    return count_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  size_type count_ks(const CharT* key, size_type key_size,
+                     std::size_t precalculated_hash) const {
+    return find_ks(key, key_size, precalculated_hash) != cend() ? 1 : 0;
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  const_iterator find(const std::basic_string_view<CharT>& key) const {
+    return find_ks(key.data(), key.size());
+  }
+#else
+  const_iterator find(const CharT* key) const {
+    return find_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  const_iterator find(const std::basic_string<CharT>& key) const {
+    return find_ks(key.data(), key.size());
+  }
+#endif
+  const_iterator find_ks(const CharT* key, size_type key_size) const {
+    return find_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc find_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const_iterator find(const std::basic_string_view<CharT>& key,
+                      std::size_t precalculated_hash) const {
+    return find_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc find_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const_iterator find(const CharT* key, std::size_t precalculated_hash) const {
+    return find_ks(key, std::char_traits<CharT>::length(key),
+                   precalculated_hash);
+  }
+
+  /**
+   * @copydoc find_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const_iterator find(const std::basic_string<CharT>& key,
+                      std::size_t precalculated_hash) const {
+    return find_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  const_iterator find_ks(const CharT* key, size_type key_size,
+                         std::size_t precalculated_hash) const {
+    const std::size_t ibucket =
+        GrowthPolicy::bucket_for_hash(precalculated_hash);
+
+    const CharT* entry = m_entries.data() + m_bucket_offsets[ibucket];
+    const CharT* const bucket_end =
+        m_entries.data() + m_bucket_offsets[ibucket + 1];
+    while (entry != bucket_end) {
+      const key_size_type entry_key_size = read_key_size(entry);
+      if (KeyEqual()(entry + size_as_char_t<key_size_type>(), entry_key_size,
+                     key, key_size)) {
+        return const_iterator(entry, this);
+      }
+
+      entry += entry_size_as_char_t(entry_key_size);
+    }
+
+    return cend();
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string_view<CharT>& key) const {
+    return equal_range_ks(key.data(), key.size());
+  }
+#else
+  std::pair<const_iterator, const_iterator> equal_range(
+      const CharT* key) const {
+    return equal_range_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string<CharT>& key) const {
+    return equal_range_ks(key.data(), key.size());
+  }
+#endif
+  std::pair<const_iterator, const_iterator> equal_range_ks(
+      const CharT* key, size_type key_size) const {
+    return equal_range_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc equal_range_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string_view<CharT>& key,
+      std::size_t precalculated_hash) const {
+    return equal_range_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc equal_range_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  std::pair<const_iterator, const_iterator> equal_range(
+      const CharT* key, std::size_t precalculated_hash) const {
+    return equal_range_ks(key, std::char_traits<CharT>::length(key),
+                          precalculated_hash);
+  }
+
+  /**
+   * @copydoc equal_range_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string<CharT>& key,
+      std::size_t precalculated_hash) const {
+    return equal_range_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  std::pair<const_iterator, const_iterator> equal_range_ks(
+      const CharT* key, size_type key_size,
+      std::size_t precalculated_hash) const {
+    const const_iterator it = find_ks(key, key_size, precalculated_hash);
+    return std::make_pair(it, (it == cend()) ? it : std::next(it));
+  }
+
+  /*
+   * Bucket interface
+   */
+  size_type bucket_count() const { return m_bucket_count; }
+
+  /*
+   *  Hash policy
+   */
+  float load_factor() const {
+    if (bucket_count() == 0) {
+      return 0;
+    }
+
+    return float(size()) / float(bucket_count());
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return static_cast<const Hash&>(*this); }
+  key_equal key_eq() const { return KeyEqual(); }
+
+  /*
+   * Other
+   */
+  friend bool operator==(const frozen_array_map& lhs,
+                         const frozen_array_map& rhs) {
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+
+    for (auto it = lhs.cbegin(); it != lhs.cend(); ++it) {
+      const auto it_element_rhs = rhs.find_ks(it.key(), it.key_size());
+      if (it_element_rhs == rhs.cend() ||
+          it.value() != it_element_rhs.value()) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  friend bool operator!=(const frozen_array_map& lhs,
+                         const frozen_array_map& rhs) {
+    return !operator==(lhs, rhs);
+  }
+
+  void swap(frozen_array_map& other) {
+    using std::swap;
+
+    swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
+    swap(static_cast<GrowthPolicy&>(*this), static_cast<GrowthPolicy&>(other));
+    swap(m_bucket_count, other.m_bucket_count);
+    swap(m_bucket_offsets, other.m_bucket_offsets);
+    swap(m_entries, other.m_entries);
+    swap(m_values, other.m_values);
+  }
+
+  friend void swap(frozen_array_map& lhs, frozen_array_map& rhs) {
+    lhs.swap(rhs);
+  }
+
+ private:
+  /**
+   * `bucket_count` is rounded by the `GrowthPolicy` before the offsets are
+   * allocated. There is always at least one bucket worth of offsets so that a
+   * lookup in an empty map doesn't need any special case.
+   */
+  frozen_array_map(const Hash& hash, size_type bucket_count)
+      : Hash(hash),
+        GrowthPolicy(bucket_count),
+        m_bucket_count(bucket_count),
+        m_bucket_offsets(std::max(bucket_count, size_type(1)) + 1, 0) {}
+
+  /**
+   * Two passes on `map`. The first one computes the size of each bucket in the
+   * contiguous buffer, the second one copies the entries at their final place.
+   */
+  template <class Map, class MoveValues>
+  void build(Map& map, MoveValues move_values) {
+    std::vector<size_type> ibuckets;
+    ibuckets.reserve(map.size());
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+      const std::size_t ibucket =
+          GrowthPolicy::bucket_for_hash(hash_key(it.key(), it.key_size()));
+
+      ibuckets.push_back(ibucket);
+      m_bucket_offsets[ibucket + 1] += entry_size_as_char_t(it.key_size());
+    }
+
+    std::partial_sum(m_bucket_offsets.begin(), m_bucket_offsets.end(),
+                     m_bucket_offsets.begin());
+    m_entries.resize(m_bucket_offsets.back());
+    m_values.reserve(map.size());
+
+    std::vector<size_type> bucket_positions(m_bucket_offsets.begin(),
+                                            m_bucket_offsets.end() - 1);
+    for (auto it = map.begin(); it != map.end(); ++it) {
+      const key_size_type key_size = key_size_type(it.key_size());
+      const index_size_type value_index = index_size_type(m_values.size());
+      CharT* entry =
+          m_entries.data() + bucket_positions[ibuckets[m_values.size()]];
+
+      // The null-terminator is already there, the buffer is zero-initialized.
+      std::memcpy(entry, &key_size, sizeof(key_size));
+      std::memcpy(entry + size_as_char_t<key_size_type>(), it.key(),
+                  key_size * sizeof(CharT));
+      std::memcpy(entry + size_as_char_t<key_size_type>() + key_size +
+                      KEY_EXTRA_SIZE,
+                  &value_index, sizeof(value_index));
+
+      bucket_positions[ibuckets[m_values.size()]] +=
+          entry_size_as_char_t(key_size);
+      m_values.push_back(forward_value(it.value(), move_values));
+    }
+  }
+
+  template <class U>
+  static const U& forward_value(const U& value, std::false_type) {
+    return value;
+  }
+
+  template <class U>
+  static U&& forward_value(U& value, std::true_type) {
+    return std::move(value);
+  }
+
+  std::size_t hash_key(const CharT* key, size_type key_size) const {
+    return Hash::operator()(key, key_size);
+  }
+
+  /**
+   * Same as in `array_bucket`, size in CharT units that the type U takes in
+   * the buffer.
+   */
+  template <typename U>
+  static constexpr size_type size_as_char_t() noexcept {
+    return (sizeof(U) > sizeof(CharT)) ? sizeof(U) / sizeof(CharT) : 1;
+  }
+
+  static size_type entry_size_as_char_t(size_type key_size) noexcept {
+    return size_as_char_t<key_size_type>() + key_size + KEY_EXTRA_SIZE +
+           size_as_char_t<index_size_type>();
+  }
+
+  static key_size_type read_key_size(const CharT* entry) noexcept {
+    key_size_type key_size;
+    std::memcpy(&key_size, entry, sizeof(key_size));
+
+    return key_size;
+  }
+
+  static index_size_type read_value_index(const CharT* entry) noexcept {
+    index_size_type value_index;
+    std::memcpy(&value_index,
+                entry + size_as_char_t<key_size_type>() +
+                    read_key_size(entry) + KEY_EXTRA_SIZE,
+                sizeof(value_index));
+
+    return value_index;
+  }
+
+ public:
+  static const size_type MAX_KEY_SIZE =
+      source_map<false, tsl::ah::exact_bucket_growth_policy,
+                 tsl::ah::malloc_bucket_storage, false, false>::MAX_KEY_SIZE;
+
+ private:
+  static const size_type KEY_EXTRA_SIZE = StoreNullTerminator ? 1 : 0;
+
+  size_type m_bucket_count;
+  std::vector<size_type> m_bucket_offsets;
+  std::vector<CharT> m_entries;
+  std::vector<T> m_values;
+};
+
+/**
+ * Return a `frozen_array_map` with the same keys and values as `map`.
+ */
+template <class CharT, class T, class Hash, class KeyEqual,
+          bool StoreNullTerminator, class KeySizeT, class IndexSizeT,
+          class GrowthPolicy, bool StoreHashTags, class BucketGrowthPolicy,
+          class BucketStorage, bool StoreHash, bool InlineValues>
+frozen_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                 IndexSizeT, GrowthPolicy>
+freeze(const array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                       IndexSizeT, GrowthPolicy, StoreHashTags,
+                       BucketGrowthPolicy, BucketStorage, StoreHash,
+                       InlineValues>& map) {
+  return frozen_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator,
+                          KeySizeT, IndexSizeT, GrowthPolicy>(map);
+}
+
+/**
+ * Same as `freeze(const array_map&)` but move the values out of `map`, which
+ * is cleared afterwards.
+ */
+template <class CharT, class T, class Hash, class KeyEqual,
+          bool StoreNullTerminator, class KeySizeT, class IndexSizeT,
+          class GrowthPolicy, bool StoreHashTags, class BucketGrowthPolicy,
+          class BucketStorage, bool StoreHash, bool InlineValues>
+frozen_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                 IndexSizeT, GrowthPolicy>
+freeze(array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                 IndexSizeT, GrowthPolicy, StoreHashTags, BucketGrowthPolicy,
+                 BucketStorage, StoreHash, InlineValues>&& map) {
+  return frozen_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator,
+                          KeySizeT, IndexSizeT, GrowthPolicy>(std::move(map));
+}
+
+}  // end namespace tsl
+
+#endif
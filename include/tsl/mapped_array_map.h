@@ -0,0 +1,787 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_MAPPED_ARRAY_MAP_H
+#define TSL_MAPPED_ARRAY_MAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "frozen_array_map.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define TSL_AH_HAS_MLOCK
+#endif
+
+namespace tsl {
+
+/**
+ * Read-only view of a `tsl::frozen_array_map` image, queried in place.
+ *
+ * `write_image` writes a frozen map as a single flat image: a header followed
+ * by the bucket offsets, the packed entries and the values, each section
+ * being suitably aligned. The image can be stored in a file and later
+ * `mmap`ed (or read in any buffer). A `mapped_array_map` is then constructed
+ * on top of these bytes without copying or allocating anything: a lookup
+ * computes the bucket from the hash and the bucket count of the header and
+ * scans the entries of the bucket directly in the mapped bytes. Opening an
+ * image is O(1) and, with `mmap`, only the pages touched by the lookups are
+ * read from the disk. `prefault` and `lock` can be used to avoid the page
+ * faults on the first lookups.
+ *
+ * The view doesn't own the memory, which must outlive it and be aligned on
+ * `IMAGE_ALIGNMENT` (a `mmap`ed file is always suitably aligned). The `T`
+ * values are read directly from the image and must thus be trivially
+ * copyable.
+ *
+ * The image is not portable across platforms with a different endianness or
+ * `std::size_t` size, and the `Hash` must give the same hashes in the process
+ * writing the image and in the one reading it (which is not the case of
+ * `std::hash` on some platforms). The header stores the size of the types and
+ * the hash of a sample key, the constructor throws `std::runtime_error` if
+ * they don't match instead of silently failing the lookups. The content of
+ * the entries themselves is not validated, the image must come from a trusted
+ * source.
+ *
+ * The template parameters are the same as for `tsl::frozen_array_map`.
+ */
+template <class CharT, class T, class Hash = tsl::ah::str_hash<CharT>,
+          class KeyEqual = tsl::ah::str_equal<CharT>,
+          bool StoreNullTerminator = true, class KeySizeT = std::uint16_t,
+          class IndexSizeT = std::uint32_t,
+          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>>
+class mapped_array_map : private Hash, private GrowthPolicy {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable to be read in place.");
+
+ public:
+  class const_iterator;
+
+  using frozen_map_type =
+      frozen_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                       IndexSizeT, GrowthPolicy>;
+  using char_type = CharT;
+  using mapped_type = T;
+  using key_size_type = KeySizeT;
+  using index_size_type = IndexSizeT;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using iterator = const_iterator;
+
+  /**
+   * Alignment required for the start of an image.
+   */
+  static const size_type IMAGE_ALIGNMENT = (alignof(T) > alignof(std::uint64_t))
+                                               ? alignof(T)
+                                               : alignof(std::uint64_t);
+
+ private:
+  /**
+   * All the fields are 64 bits so that the layout of the header doesn't
+   * depend on the platform padding. The positions are in bytes from the start
+   * of the image.
+   */
+  struct image_header {
+    std::uint64_t magic;
+    std::uint64_t version;
+    std::uint64_t layout;
+    std::uint64_t value_size;
+    std::uint64_t hash_check;
+    std::uint64_t bucket_count;
+    std::uint64_t nb_values;
+    std::uint64_t nb_bucket_offsets;
+    std::uint64_t entries_size;
+    std::uint64_t bucket_offsets_position;
+    std::uint64_t entries_position;
+    std::uint64_t values_position;
+    std::uint64_t image_size;
+  };
+
+  static_assert(sizeof(image_header) == 13 * sizeof(std::uint64_t),
+                "image_header must not have any padding.");
+
+  // "TSLAHMAP" read as a little-endian integer. A byte-swapped magic means
+  // that the image was written on a platform with a different endianness.
+  static const std::uint64_t IMAGE_MAGIC = 0x50414d4841534c54;
+  static const std::uint64_t IMAGE_VERSION = 1;
+
+ public:
+  class const_iterator {
+    friend class mapped_array_map;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using reference = const T&;
+    using pointer = const T*;
+
+   private:
+    const_iterator(const CharT* position,
+                   const mapped_array_map* map) noexcept
+        : m_position(position), m_map(map) {}
+
+   public:
+    const_iterator() noexcept : m_position(nullptr), m_map(nullptr) {}
+
+    const CharT* key() const {
+      return m_position + size_as_char_t<key_size_type>();
+    }
+
+    size_type key_size() const { return read_key_size(m_position); }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+    std::basic_string_view<CharT> key_sv() const {
+      return std::basic_string_view<CharT>(key(), key_size());
+    }
+#endif
+
+    reference value() const {
+      return m_map->m_values[read_value_index(m_position)];
+    }
+
+    reference operator*() const { return value(); }
+
+    pointer operator->() const { return std::addressof(value()); }
+
+    const_iterator& operator++() {
+      m_position += entry_size_as_char_t(read_key_size(m_position));
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator tmp(*this);
+      ++*this;
+
+      return tmp;
+    }
+
+    friend bool operator==(const const_iterator& lhs,
+                           const const_iterator& rhs) {
+      return lhs.m_position == rhs.m_position;
+    }
+
+    friend bool operator!=(const const_iterator& lhs,
+                           const const_iterator& rhs) {
+      return !(lhs == rhs);
+    }
+
+   private:
+    const CharT* m_position;
+    const mapped_array_map* m_map;
+  };
+
+ public:
+  /**
+   * Open the image of `image_size` bytes starting at `image`. Only the header
+   * is read, the constructor throws `std::runtime_error` if the image is
+   * truncated, misaligned or was written for another type of map.
+   */
+  mapped_array_map(const void* image, size_type image_size,
+                   const Hash& hash = Hash())
+      : mapped_array_map(image, image_size, hash,
+                         read_header(image, image_size)) {}
+
+  /**
+   * Write the image of `map` with `writer`. The writer must be a function
+   * object with the signature `void operator()(const char* data, std::size_t
+   * size)` appending `size` bytes to the image, e.g. to a file.
+   */
+  template <class Writer>
+  static void write_image(const frozen_map_type& map, Writer& writer) {
+    const auto& bucket_offsets = map.m_bucket_offsets;
+    const auto& entries = map.m_entries;
+    const auto& values = map.m_values;
+
+    image_header header;
+    header.magic = IMAGE_MAGIC;
+    header.version = IMAGE_VERSION;
+    header.layout = image_layout();
+    header.value_size = sizeof(T);
+    header.hash_check = hash_check(map.hash_function());
+    header.bucket_count = map.bucket_count();
+    header.nb_values = values.size();
+    header.nb_bucket_offsets = bucket_offsets.size();
+    header.entries_size = entries.size();
+    header.bucket_offsets_position = align_position(sizeof(image_header));
+    header.entries_position =
+        align_position(header.bucket_offsets_position +
+                       bucket_offsets.size() * sizeof(std::uint64_t));
+    header.values_position = align_position(header.entries_position +
+                                            entries.size() * sizeof(CharT));
+    header.image_size = header.values_position + values.size() * sizeof(T);
+
+    std::uint64_t position = 0;
+    write_bytes(writer, position, &header, sizeof(header));
+
+    write_padding(writer, position, header.bucket_offsets_position);
+    for (const size_type offset : bucket_offsets) {
+      const std::uint64_t offset64 = offset;
+      write_bytes(writer, position, &offset64, sizeof(offset64));
+    }
+
+    write_padding(writer, position, header.entries_position);
+    write_bytes(writer, position, entries.data(),
+                entries.size() * sizeof(CharT));
+
+    write_padding(writer, position, header.values_position);
+    write_bytes(writer, position, values.data(), values.size() * sizeof(T));
+
+    tsl_ah_assert(position == header.image_size);
+  }
+
+  /*
+   * Iterators
+   */
+  const_iterator begin() const noexcept { return cbegin(); }
+  const_iterator cbegin() const noexcept {
+    return const_iterator(m_entries, this);
+  }
+
+  const_iterator end() const noexcept { return cend(); }
+  const_iterator cend() const noexcept {
+    return const_iterator(m_entries + m_entries_size, this);
+  }
+
+  /*
+   * Capacity
+   */
+  bool empty() const noexcept { return m_nb_values == 0; }
+  size_type size() const noexcept { return m_nb_values; }
+  size_type max_key_size() const noexcept {
+    return frozen_map_type::MAX_KEY_SIZE;
+  }
+
+  /*
+   * Lookup
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  const T& at(const std::basic_string_view<CharT>& key) const {
+    return at_ks(key.data(), key.size());
+  }
+#else
+  const T& at(const CharT* key) const {
+    return at_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  const T& at(const std::basic_string<CharT>& key) const {
+    return at_ks(key.data(), key.size());
+  }
+#endif
+  const T& at_ks(const CharT* key, size_type key_size) const {
+    return at_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc at_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const T& at(const std::basic_string_view<CharT>& key,
+              std::size_t precalculated_hash) const {
+    return at_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc at_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const T& at(const CharT* key, std::size_t precalculated_hash) const {
+    return at_ks(key, std::char_traits<CharT>::length(key),
+                 precalculated_hash);
+  }
+
+  /**
+   * @copydoc at_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const T& at(const std::basic_string<CharT>& key,
+              std::size_t precalculated_hash) const {
+    return at_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  const T& at_ks(const CharT* key, size_type key_size,
+                 std::size_t precalculated_hash) const {
+    const const_iterator it = find_ks(key, key_size, precalculated_hash);
+    if (it == cend()) {
+      throw std::out_of_range("Couldn't find key.");
+    }
+
+    return it.value();
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  size_type count(const std::basic_string_view<CharT>& key) const {
+    return count_ks(key.data(), key.size());
+  }
+#else
+  size_type count(const CharT* key) const {
+    return count_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  size_type count(const std::basic_string<CharT>& key) const {
+    return count_ks(key.data(), key.size());
+  }
+#endif
+  size_type count_ks(const CharT* key, size_type key_size) const {
+    return count_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc count_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  size_type count(const std::basic_string_view<CharT>& key,
+                  std::size_t precalculated_hash) const {
+    return count_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc count_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  size_type count(const CharT* key, std::size_t precalculated_hash) const {
+    return count_ks(key, std::char_traits<CharT>::length(key),
+                    precalculated_hash);
+  }
+
+  /**
+   * @copydoc count_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  size_type count(const std::basic_string<CharT>& key,
+                  std::size_t precalculated_hash) const {
+    return count_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  size_type count_ks(const CharT* key, size_type key_size,
+                     std::size_t precalculated_hash) const {
+    return find_ks(key, key_size, precalculated_hash) != cend() ? 1 : 0;
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  const_iterator find(const std::basic_string_view<CharT>& key) const {
+    return find_ks(key.data(), key.size());
+  }
+#else
+  const_iterator find(const CharT* key) const {
+    return find_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  const_iterator find(const std::basic_string<CharT>& key) const {
+    return find_ks(key.data(), key.size());
+  }
+#endif
+  const_iterator find_ks(const CharT* key, size_type key_size) const {
+    return find_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc find_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const_iterator find(const std::basic_string_view<CharT>& key,
+                      std::size_t precalculated_hash) const {
+    return find_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc find_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const_iterator find(const CharT* key, std::size_t precalculated_hash) const {
+    return find_ks(key, std::char_traits<CharT>::length(key),
+                   precalculated_hash);
+  }
+
+  /**
+   * @copydoc find_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  const_iterator find(const std::basic_string<CharT>& key,
+                      std::size_t precalculated_hash) const {
+    return find_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  const_iterator find_ks(const CharT* key, size_type key_size,
+                         std::size_t precalculated_hash) const {
+    const std::size_t ibucket =
+        GrowthPolicy::bucket_for_hash(precalculated_hash);
+
+    const CharT* entry = m_entries + m_bucket_offsets[ibucket];
+    const CharT* const bucket_end = m_entries + m_bucket_offsets[ibucket + 1];
+    while (entry != bucket_end) {
+      const key_size_type entry_key_size = read_key_size(entry);
+      if (KeyEqual()(entry + size_as_char_t<key_size_type>(), entry_key_size,
+                     key, key_size)) {
+        return const_iterator(entry, this);
+      }
+
+      entry += entry_size_as_char_t(entry_key_size);
+    }
+
+    return cend();
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string_view<CharT>& key) const {
+    return equal_range_ks(key.data(), key.size());
+  }
+#else
+  std::pair<const_iterator, const_iterator> equal_range(
+      const CharT* key) const {
+    return equal_range_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string<CharT>& key) const {
+    return equal_range_ks(key.data(), key.size());
+  }
+#endif
+  std::pair<const_iterator, const_iterator> equal_range_ks(
+      const CharT* key, size_type key_size) const {
+    return equal_range_ks(key, key_size, hash_key(key, key_size));
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  /**
+   * @copydoc equal_range_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string_view<CharT>& key,
+      std::size_t precalculated_hash) const {
+    return equal_range_ks(key.data(), key.size(), precalculated_hash);
+  }
+#else
+  /**
+   * @copydoc equal_range_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  std::pair<const_iterator, const_iterator> equal_range(
+      const CharT* key, std::size_t precalculated_hash) const {
+    return equal_range_ks(key, std::char_traits<CharT>::length(key),
+                          precalculated_hash);
+  }
+
+  /**
+   * @copydoc equal_range_ks(const CharT* key, size_type key_size, std::size_t
+   * precalculated_hash) const
+   */
+  std::pair<const_iterator, const_iterator> equal_range(
+      const std::basic_string<CharT>& key,
+      std::size_t precalculated_hash) const {
+    return equal_range_ks(key.data(), key.size(), precalculated_hash);
+  }
+#endif
+  /**
+   * Use the hash value 'precalculated_hash' instead of hashing the key. The
+   * hash value should be the same as hash_function()(key). Useful to speed-up
+   * the lookup to the value if you already have the hash.
+   */
+  std::pair<const_iterator, const_iterator> equal_range_ks(
+      const CharT* key, size_type key_size,
+      std::size_t precalculated_hash) const {
+    const const_iterator it = find_ks(key, key_size, precalculated_hash);
+    return std::make_pair(it, (it == cend()) ? it : std::next(it));
+  }
+
+  /*
+   * Bucket interface
+   */
+  size_type bucket_count() const { return m_bucket_count; }
+
+  /*
+   *  Hash policy
+   */
+  float load_factor() const {
+    if (bucket_count() == 0) {
+      return 0;
+    }
+
+    return float(size()) / float(bucket_count());
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return static_cast<const Hash&>(*this); }
+  key_equal key_eq() const { return KeyEqual(); }
+
+  /*
+   * Image
+   */
+  const void* image() const noexcept { return m_image; }
+  size_type image_size() const noexcept { return m_image_size; }
+
+  /**
+   * Read one byte of each page of the image so that the following lookups
+   * don't have to wait for the pages to be read from the disk. Useful after
+   * `mmap`ing the image if the first lookups are latency sensitive.
+   */
+  void prefault() const noexcept {
+    const volatile unsigned char* bytes =
+        static_cast<const volatile unsigned char*>(m_image);
+
+    unsigned char sink = 0;
+    for (size_type i = 0; i < m_image_size; i += PREFAULT_STRIDE) {
+      sink = static_cast<unsigned char>(sink ^ bytes[i]);
+    }
+    if (m_image_size > 0) {
+      sink = static_cast<unsigned char>(sink ^ bytes[m_image_size - 1]);
+    }
+
+    static_cast<void>(sink);
+  }
+
+#ifdef TSL_AH_HAS_MLOCK
+  /**
+   * Lock the pages of the image in memory with `mlock`, which also faults
+   * them in. Return false if the pages couldn't be locked, e.g. because the
+   * `RLIMIT_MEMLOCK` limit of the process is too low (see `errno`).
+   *
+   * The pages stay locked until `unlock` is called or the image is unmapped.
+   */
+  bool lock() const noexcept { return mlock(m_image, m_image_size) == 0; }
+
+  /**
+   * Unlock the pages locked by `lock`. Return false on failure (see `errno`).
+   */
+  bool unlock() const noexcept { return munlock(m_image, m_image_size) == 0; }
+#endif
+
+ private:
+  mapped_array_map(const void* image, size_type image_size, const Hash& hash,
+                   const image_header& header)
+      : Hash(hash),
+        GrowthPolicy(make_growth_policy(header)),
+        m_image(image),
+        m_image_size(image_size),
+        m_bucket_count(size_type(header.bucket_count)),
+        m_nb_values(size_type(header.nb_values)),
+        m_entries_size(size_type(header.entries_size)),
+        m_bucket_offsets(reinterpret_cast<const std::uint64_t*>(
+            static_cast<const char*>(image) + header.bucket_offsets_position)),
+        m_entries(reinterpret_cast<const CharT*>(
+            static_cast<const char*>(image) + header.entries_position)),
+        m_values(reinterpret_cast<const T*>(static_cast<const char*>(image) +
+                                            header.values_position)) {
+    if (header.hash_check != hash_check(hash_function())) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The hash function gives "
+          "different hashes than the one used to write the image.");
+    }
+  }
+
+  static image_header read_header(const void* image, size_type image_size) {
+    if (reinterpret_cast<std::uintptr_t>(image) % IMAGE_ALIGNMENT != 0) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The image is misaligned.");
+    }
+
+    if (image_size < sizeof(image_header)) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The image is truncated.");
+    }
+
+    image_header header;
+    std::memcpy(&header, image, sizeof(header));
+
+    if (header.magic != IMAGE_MAGIC) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The magic number is invalid, "
+          "the image may have been written with another endianness.");
+    }
+
+    if (header.version != IMAGE_VERSION) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The version is invalid.");
+    }
+
+    if (header.layout != image_layout() || header.value_size != sizeof(T)) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The image was written for a "
+          "map with different types.");
+    }
+
+    const std::uint64_t bucket_offsets_end =
+        header.bucket_offsets_position +
+        header.nb_bucket_offsets * sizeof(std::uint64_t);
+    const std::uint64_t entries_end =
+        header.entries_position + header.entries_size * sizeof(CharT);
+    const std::uint64_t values_end =
+        header.values_position + header.nb_values * sizeof(T);
+    if (header.image_size > image_size ||
+        header.bucket_offsets_position != align_position(sizeof(header)) ||
+        header.entries_position != align_position(bucket_offsets_end) ||
+        header.values_position != align_position(entries_end) ||
+        header.image_size != values_end ||
+        header.nb_bucket_offsets !=
+            std::max(header.bucket_count, std::uint64_t(1)) + 1) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The image is truncated or "
+          "its header is corrupted.");
+    }
+
+    return header;
+  }
+
+  /**
+   * Return the `GrowthPolicy` for the bucket count of `header`, check that the
+   * policy doesn't round it to another value.
+   */
+  static GrowthPolicy make_growth_policy(const image_header& header) {
+    const size_type bucket_count = tsl::detail_array_hash::numeric_cast<
+        size_type>(header.bucket_count,
+                   "Can't open the mapped_array_map image. The bucket count "
+                   "is too large.");
+
+    size_type rounded_bucket_count = bucket_count;
+    GrowthPolicy growth_policy(rounded_bucket_count);
+    if (rounded_bucket_count != bucket_count) {
+      throw std::runtime_error(
+          "Can't open the mapped_array_map image. The bucket count is "
+          "incompatible with the growth policy.");
+    }
+
+    return growth_policy;
+  }
+
+  static std::uint64_t image_layout() noexcept {
+    return std::uint64_t(sizeof(CharT)) |
+           (std::uint64_t(sizeof(KeySizeT)) << 8) |
+           (std::uint64_t(sizeof(IndexSizeT)) << 16) |
+           (std::uint64_t(sizeof(std::size_t)) << 24) |
+           (std::uint64_t(StoreNullTerminator ? 1 : 0) << 32);
+  }
+
+  /**
+   * Hash of a sample key, used to check that the image is read with the same
+   * hash function as the one it was written with.
+   */
+  static std::uint64_t hash_check(const Hash& hash) {
+    const CharT sample_key[] = {CharT('t'), CharT('s'), CharT('l')};
+    return hash(sample_key, sizeof(sample_key) / sizeof(CharT));
+  }
+
+  static std::uint64_t align_position(std::uint64_t position) noexcept {
+    return (position + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+  }
+
+  template <class Writer>
+  static void write_bytes(Writer& writer, std::uint64_t& position,
+                          const void* data, size_type size) {
+    if (size > 0) {
+      writer(static_cast<const char*>(data), size);
+      position += size;
+    }
+  }
+
+  template <class Writer>
+  static void write_padding(Writer& writer, std::uint64_t& position,
+                            std::uint64_t aligned_position) {
+    const char zeros[IMAGE_ALIGNMENT] = {};
+    write_bytes(writer, position, zeros,
+                size_type(aligned_position - position));
+  }
+
+  std::size_t hash_key(const CharT* key, size_type key_size) const {
+    return Hash::operator()(key, key_size);
+  }
+
+  /**
+   * Same as in `array_bucket`, size in CharT units that the type U takes in
+   * the buffer.
+   */
+  template <typename U>
+  static constexpr size_type size_as_char_t() noexcept {
+    return (sizeof(U) > sizeof(CharT)) ? sizeof(U) / sizeof(CharT) : 1;
+  }
+
+  static size_type entry_size_as_char_t(size_type key_size) noexcept {
+    return size_as_char_t<key_size_type>() + key_size + KEY_EXTRA_SIZE +
+           size_as_char_t<index_size_type>();
+  }
+
+  static key_size_type read_key_size(const CharT* entry) noexcept {
+    key_size_type key_size;
+    std::memcpy(&key_size, entry, sizeof(key_size));
+
+    return key_size;
+  }
+
+  static index_size_type read_value_index(const CharT* entry) noexcept {
+    index_size_type value_index;
+    std::memcpy(&value_index,
+                entry + size_as_char_t<key_size_type>() +
+                    read_key_size(entry) + KEY_EXTRA_SIZE,
+                sizeof(value_index));
+
+    return value_index;
+  }
+
+ private:
+  static const size_type KEY_EXTRA_SIZE = StoreNullTerminator ? 1 : 0;
+  static const size_type PREFAULT_STRIDE = 4096;
+
+  const void* m_image;
+  size_type m_image_size;
+  size_type m_bucket_count;
+  size_type m_nb_values;
+  size_type m_entries_size;
+  const std::uint64_t* m_bucket_offsets;
+  const CharT* m_entries;
+  const T* m_values;
+};
+
+}  // end namespace tsl
+
+#endif
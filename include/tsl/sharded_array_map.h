@@ -0,0 +1,749 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_SHARDED_ARRAY_MAP_H
+#define TSL_SHARDED_ARRAY_MAP_H
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "array_hash.h"
+
+#if (defined(__cplusplus) && __cplusplus >= 201703L) || \
+    (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define TSL_SAM_HAS_SHARED_MUTEX
+#include <shared_mutex>
+#elif (defined(__cplusplus) && __cplusplus >= 201402L) || \
+    (defined(_MSVC_LANG) && _MSVC_LANG >= 201402L)
+#define TSL_SAM_HAS_SHARED_TIMED_MUTEX
+#include <shared_mutex>
+#endif
+
+namespace tsl {
+
+namespace detail_sharded_array_map {
+
+#if defined(TSL_SAM_HAS_SHARED_MUTEX)
+using shared_mutex = std::shared_mutex;
+#elif defined(TSL_SAM_HAS_SHARED_TIMED_MUTEX)
+using shared_mutex = std::shared_timed_mutex;
+#else
+/**
+ * Fallback for C++11 where there is no reader-writer lock in the standard
+ * library. The readers are exclusive with each other.
+ */
+class shared_mutex {
+ public:
+  void lock() { m_mutex.lock(); }
+  void unlock() { m_mutex.unlock(); }
+  void lock_shared() { m_mutex.lock(); }
+  void unlock_shared() { m_mutex.unlock(); }
+
+ private:
+  std::mutex m_mutex;
+};
+#endif
+
+/**
+ * Equivalent of std::shared_lock, which is only available since C++14.
+ */
+template <class SharedMutex>
+class shared_lock_guard {
+ public:
+  explicit shared_lock_guard(SharedMutex& mutex) : m_mutex(mutex) {
+    m_mutex.lock_shared();
+  }
+
+  ~shared_lock_guard() { m_mutex.unlock_shared(); }
+
+  shared_lock_guard(const shared_lock_guard&) = delete;
+  shared_lock_guard& operator=(const shared_lock_guard&) = delete;
+
+ private:
+  SharedMutex& m_mutex;
+};
+
+static constexpr std::size_t log2(std::size_t value) {
+  return (value <= 1) ? 0 : 1 + log2(value / 2);
+}
+
+}  // end namespace detail_sharded_array_map
+
+/**
+ * Thread-safe string hash map made of `NbShards` independent
+ * `detail_array_hash::array_hash` tables, the same tables as `tsl::array_map`,
+ * each behind its own reader-writer lock.
+ *
+ * A key is hashed once. The highest bits of the hash select the shard and the
+ * same hash is then used inside the shard (which uses the lowest bits to select
+ * a bucket) through the precalculated hash methods of the table. Operations on
+ * keys of different shards don't contend with each other and lookups in a same
+ * shard can run concurrently (except in C++11 where there is no reader-writer
+ * lock in the standard library and a simple mutex is used instead).
+ *
+ * As the shards may be modified by other threads at any time, no iterator or
+ * reference to the values is given. The values are copied out of the map
+ * (`find`, `at`) or accessed through a function called while the lock of the
+ * shard is held (`visit`, `update`). The function must not access the map
+ * itself.
+ *
+ * The batched methods (`count_batch`, `visit_batch`, `insert_batch`) hash all
+ * the keys first, then lock each shard only once for all its keys.
+ *
+ * `NbShards` must be a power of two. The other template parameters are the
+ * same as for `tsl::array_map`.
+ *
+ * The methods which work on the whole map (`size`, `clear`, `reserve`,
+ * `for_each`, ...) lock the shards one after the other, the result is thus not
+ * an atomic snapshot of the map if it's modified concurrently.
+ */
+template <class CharT, class T, std::size_t NbShards = 16,
+          class Hash = tsl::ah::str_hash<CharT>,
+          class KeyEqual = tsl::ah::str_equal<CharT>,
+          bool StoreNullTerminator = true, class KeySizeT = std::uint16_t,
+          class IndexSizeT = std::uint32_t,
+          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>>
+class sharded_array_map {
+ private:
+  using ht = tsl::detail_array_hash::array_hash<
+      CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT, IndexSizeT,
+      GrowthPolicy, false, tsl::ah::exact_bucket_growth_policy,
+      tsl::ah::malloc_bucket_storage, false, false>;
+
+  using shared_mutex = tsl::detail_sharded_array_map::shared_mutex;
+  using shared_lock_guard =
+      tsl::detail_sharded_array_map::shared_lock_guard<shared_mutex>;
+  using unique_lock_guard = std::lock_guard<shared_mutex>;
+
+ public:
+  using char_type = CharT;
+  using mapped_type = T;
+  using key_size_type = KeySizeT;
+  using index_size_type = IndexSizeT;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using shard_type = ht;
+
+ public:
+  sharded_array_map() : sharded_array_map(0) {}
+
+  /**
+   * 'bucket_count' is the total number of buckets, divided evenly between the
+   * shards.
+   */
+  explicit sharded_array_map(size_type bucket_count, const Hash& hash = Hash())
+      : m_hash(hash), m_shards(new shard[NbShards]) {
+    for (std::size_t i = 0; i < NbShards; i++) {
+      m_shards[i].table.reset(new ht(shard_bucket_count(bucket_count), hash,
+                                     ht::DEFAULT_MAX_LOAD_FACTOR));
+    }
+  }
+
+  sharded_array_map(const sharded_array_map& other) = delete;
+  sharded_array_map& operator=(const sharded_array_map& other) = delete;
+
+  /*
+   * Capacity
+   */
+  bool empty() const { return size() == 0; }
+
+  size_type size() const {
+    size_type size = 0;
+    for (std::size_t i = 0; i < NbShards; i++) {
+      shared_lock_guard lock(m_shards[i].mutex);
+      size += m_shards[i].table->size();
+    }
+
+    return size;
+  }
+
+  size_type max_key_size() const { return m_shards[0].table->max_key_size(); }
+
+  /*
+   * Modifiers
+   */
+  void clear() {
+    for (std::size_t i = 0; i < NbShards; i++) {
+      unique_lock_guard lock(m_shards[i].mutex);
+      m_shards[i].table->clear();
+    }
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  bool insert(const std::basic_string_view<CharT>& key, const T& value) {
+    return emplace_ks(key.data(), key.size(), value);
+  }
+
+  bool insert(const std::basic_string_view<CharT>& key, T&& value) {
+    return emplace_ks(key.data(), key.size(), std::move(value));
+  }
+#else
+  bool insert(const CharT* key, const T& value) {
+    return emplace_ks(key, std::char_traits<CharT>::length(key), value);
+  }
+
+  bool insert(const CharT* key, T&& value) {
+    return emplace_ks(key, std::char_traits<CharT>::length(key),
+                      std::move(value));
+  }
+
+  bool insert(const std::basic_string<CharT>& key, const T& value) {
+    return emplace_ks(key.data(), key.size(), value);
+  }
+
+  bool insert(const std::basic_string<CharT>& key, T&& value) {
+    return emplace_ks(key.data(), key.size(), std::move(value));
+  }
+#endif
+  bool insert_ks(const CharT* key, size_type key_size, const T& value) {
+    return emplace_ks(key, key_size, value);
+  }
+
+  bool insert_ks(const CharT* key, size_type key_size, T&& value) {
+    return emplace_ks(key, key_size, std::move(value));
+  }
+
+  /**
+   * Return true if the key was inserted, false if it was already present, in
+   * which case the value is assigned.
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  template <class M>
+  bool insert_or_assign(const std::basic_string_view<CharT>& key, M&& obj) {
+    return insert_or_assign_ks(key.data(), key.size(), std::forward<M>(obj));
+  }
+#else
+  template <class M>
+  bool insert_or_assign(const CharT* key, M&& obj) {
+    return insert_or_assign_ks(key, std::char_traits<CharT>::length(key),
+                               std::forward<M>(obj));
+  }
+
+  template <class M>
+  bool insert_or_assign(const std::basic_string<CharT>& key, M&& obj) {
+    return insert_or_assign_ks(key.data(), key.size(), std::forward<M>(obj));
+  }
+#endif
+  template <class M>
+  bool insert_or_assign_ks(const CharT* key, size_type key_size, M&& obj) {
+    const std::size_t hash = hash_key(key, key_size);
+    shard& s = shard_for_hash(hash);
+
+    unique_lock_guard lock(s.mutex);
+    return s.table->insert_or_assign(key, key_size, hash, std::forward<M>(obj))
+        .second;
+  }
+
+  /**
+   * Return true if the key was inserted, false if it was already present.
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  template <class... Args>
+  bool emplace(const std::basic_string_view<CharT>& key, Args&&... args) {
+    return emplace_ks(key.data(), key.size(), std::forward<Args>(args)...);
+  }
+#else
+  template <class... Args>
+  bool emplace(const CharT* key, Args&&... args) {
+    return emplace_ks(key, std::char_traits<CharT>::length(key),
+                      std::forward<Args>(args)...);
+  }
+
+  template <class... Args>
+  bool emplace(const std::basic_string<CharT>& key, Args&&... args) {
+    return emplace_ks(key.data(), key.size(), std::forward<Args>(args)...);
+  }
+#endif
+  template <class... Args>
+  bool emplace_ks(const CharT* key, size_type key_size, Args&&... args) {
+    const std::size_t hash = hash_key(key, key_size);
+    shard& s = shard_for_hash(hash);
+
+    unique_lock_guard lock(s.mutex);
+    return s.table
+        ->emplace_with_hash(key, key_size, hash, std::forward<Args>(args)...)
+        .second;
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  size_type erase(const std::basic_string_view<CharT>& key) {
+    return erase_ks(key.data(), key.size());
+  }
+#else
+  size_type erase(const CharT* key) {
+    return erase_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  size_type erase(const std::basic_string<CharT>& key) {
+    return erase_ks(key.data(), key.size());
+  }
+#endif
+  size_type erase_ks(const CharT* key, size_type key_size) {
+    const std::size_t hash = hash_key(key, key_size);
+    shard& s = shard_for_hash(hash);
+
+    unique_lock_guard lock(s.mutex);
+    return s.table->erase(key, key_size, hash);
+  }
+
+  /**
+   * If the key is present, call 'function' with a reference to its value while
+   * the shard of the key is locked for writing. Return true if the key was
+   * present.
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  template <class Function>
+  bool update(const std::basic_string_view<CharT>& key, Function function) {
+    return update_ks(key.data(), key.size(), function);
+  }
+#else
+  template <class Function>
+  bool update(const CharT* key, Function function) {
+    return update_ks(key, std::char_traits<CharT>::length(key), function);
+  }
+
+  template <class Function>
+  bool update(const std::basic_string<CharT>& key, Function function) {
+    return update_ks(key.data(), key.size(), function);
+  }
+#endif
+  template <class Function>
+  bool update_ks(const CharT* key, size_type key_size, Function function) {
+    const std::size_t hash = hash_key(key, key_size);
+    shard& s = shard_for_hash(hash);
+
+    unique_lock_guard lock(s.mutex);
+    auto it = s.table->find(key, key_size, hash);
+    if (it == s.table->end()) {
+      return false;
+    }
+
+    function(it.value());
+    return true;
+  }
+
+  /**
+   * Insert all the key-value pairs of [first, last). The key of each pair can
+   * be a `const CharT*`, a `std::basic_string<CharT>` or a
+   * `std::basic_string_view<CharT>`. Each shard is locked once for all its
+   * keys. Return the number of inserted keys.
+   *
+   * The keys are referenced, not copied, until they are inserted: ForwardIt
+   * must be a forward iterator returning a reference. The values are only
+   * read when inserted, they are moved if ForwardIt is a
+   * `std::move_iterator`.
+   */
+  template <class ForwardIt>
+  size_type insert_batch(ForwardIt first, ForwardIt last) {
+    check_batch_iterator<ForwardIt>();
+
+    std::vector<batch_entry> entries;
+    std::vector<ForwardIt> iterators;
+    for (; first != last; ++first) {
+      entries.push_back(make_batch_entry((*first).first));
+      iterators.push_back(first);
+    }
+
+    std::vector<std::size_t> order;
+    std::size_t shard_begin[NbShards + 1];
+    sort_by_shard(entries, order, shard_begin);
+
+    size_type nb_inserted = 0;
+    for (std::size_t ishard = 0; ishard < NbShards; ishard++) {
+      if (shard_begin[ishard] == shard_begin[ishard + 1]) {
+        continue;
+      }
+
+      unique_lock_guard lock(m_shards[ishard].mutex);
+      for (std::size_t i = shard_begin[ishard]; i < shard_begin[ishard + 1];
+           i++) {
+        const batch_entry& entry = entries[order[i]];
+        if (m_shards[ishard]
+                .table
+                ->emplace_with_hash(entry.key, entry.key_size, entry.hash,
+                                    (*iterators[order[i]]).second)
+                .second) {
+          nb_inserted++;
+        }
+      }
+    }
+
+    return nb_inserted;
+  }
+
+  /*
+   * Lookup
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  T at(const std::basic_string_view<CharT>& key) const {
+    return at_ks(key.data(), key.size());
+  }
+#else
+  T at(const CharT* key) const {
+    return at_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  T at(const std::basic_string<CharT>& key) const {
+    return at_ks(key.data(), key.size());
+  }
+#endif
+  /**
+   * Return a copy of the value of the key. Throw std::out_of_range if the key
+   * is not present.
+   */
+  T at_ks(const CharT* key, size_type key_size) const {
+    const std::size_t hash = hash_key(key, key_size);
+    const shard& s = shard_for_hash(hash);
+
+    shared_lock_guard lock(s.mutex);
+    return s.table->at(key, key_size, hash);
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  size_type count(const std::basic_string_view<CharT>& key) const {
+    return count_ks(key.data(), key.size());
+  }
+#else
+  size_type count(const CharT* key) const {
+    return count_ks(key, std::char_traits<CharT>::length(key));
+  }
+
+  size_type count(const std::basic_string<CharT>& key) const {
+    return count_ks(key.data(), key.size());
+  }
+#endif
+  size_type count_ks(const CharT* key, size_type key_size) const {
+    const std::size_t hash = hash_key(key, key_size);
+    const shard& s = shard_for_hash(hash);
+
+    shared_lock_guard lock(s.mutex);
+    return s.table->count(key, key_size, hash);
+  }
+
+  /**
+   * If the key is present, copy its value in 'value' and return true.
+   * Otherwise, return false and leave 'value' untouched.
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  bool find(const std::basic_string_view<CharT>& key, T& value) const {
+    return find_ks(key.data(), key.size(), value);
+  }
+#else
+  bool find(const CharT* key, T& value) const {
+    return find_ks(key, std::char_traits<CharT>::length(key), value);
+  }
+
+  bool find(const std::basic_string<CharT>& key, T& value) const {
+    return find_ks(key.data(), key.size(), value);
+  }
+#endif
+  bool find_ks(const CharT* key, size_type key_size, T& value) const {
+    return visit_ks(key, key_size,
+                    [&value](const T& found_value) { value = found_value; });
+  }
+
+  /**
+   * If the key is present, call 'function' with a const reference to its value
+   * while the shard of the key is locked for reading. Return true if the key
+   * was present.
+   */
+#ifdef TSL_AH_HAS_STRING_VIEW
+  template <class Function>
+  bool visit(const std::basic_string_view<CharT>& key,
+             Function function) const {
+    return visit_ks(key.data(), key.size(), function);
+  }
+#else
+  template <class Function>
+  bool visit(const CharT* key, Function function) const {
+    return visit_ks(key, std::char_traits<CharT>::length(key), function);
+  }
+
+  template <class Function>
+  bool visit(const std::basic_string<CharT>& key, Function function) const {
+    return visit_ks(key.data(), key.size(), function);
+  }
+#endif
+  template <class Function>
+  bool visit_ks(const CharT* key, size_type key_size,
+                Function function) const {
+    const std::size_t hash = hash_key(key, key_size);
+    const shard& s = shard_for_hash(hash);
+
+    shared_lock_guard lock(s.mutex);
+    auto it = s.table->find(key, key_size, hash);
+    if (it == s.table->cend()) {
+      return false;
+    }
+
+    function(it.value());
+    return true;
+  }
+
+  /**
+   * For each key of [keys_first, keys_last), write its count (0 or 1) to 'out'
+   * in the same order as the keys. Each shard is locked once for all its keys.
+   * Return the output iterator past the last written count.
+   *
+   * As with insert_batch, ForwardIt must be a forward iterator returning a
+   * reference to a key which stays valid during the call.
+   */
+  template <class ForwardIt, class OutputIt>
+  OutputIt count_batch(ForwardIt keys_first, ForwardIt keys_last,
+                       OutputIt out) const {
+    const std::vector<batch_entry> entries = make_batch(keys_first, keys_last);
+
+    std::vector<size_type> counts(entries.size(), 0);
+    visit_entries(entries, [&counts](std::size_t ikey, const T* value) {
+      counts[ikey] = (value != nullptr) ? 1 : 0;
+    });
+
+    return std::copy(counts.begin(), counts.end(), out);
+  }
+
+  /**
+   * For each key of [keys_first, keys_last), call function(ikey, value) where
+   * 'ikey' is the position of the key in the range and 'value' a pointer to its
+   * value, or nullptr if the key is not present. The keys are visited shard by
+   * shard and not in the order of the range. Each shard is locked for reading
+   * once for all its keys and the function is called while the lock is held.
+   * The same requirements as count_batch apply to ForwardIt.
+   */
+  template <class ForwardIt, class Function>
+  void visit_batch(ForwardIt keys_first, ForwardIt keys_last,
+                   Function function) const {
+    visit_entries(make_batch(keys_first, keys_last), function);
+  }
+
+  /**
+   * Call function(key, key_size, value) for each element of the map, one shard
+   * after the other. Each shard is locked for reading while its elements are
+   * visited.
+   */
+  template <class Function>
+  void for_each(Function function) const {
+    for (std::size_t i = 0; i < NbShards; i++) {
+      const ht& table = *m_shards[i].table;
+      shared_lock_guard lock(m_shards[i].mutex);
+      for (auto it = table.cbegin(); it != table.cend(); ++it) {
+        function(it.key(), it.key_size(), it.value());
+      }
+    }
+  }
+
+  /*
+   * Hash policy
+   */
+  /**
+   * Reserve enough space in each shard for 'count' elements spread evenly
+   * between the shards.
+   */
+  void reserve(size_type count) {
+    for (std::size_t i = 0; i < NbShards; i++) {
+      unique_lock_guard lock(m_shards[i].mutex);
+      m_shards[i].table->reserve(shard_bucket_count(count));
+    }
+  }
+
+  void max_load_factor(float ml) {
+    for (std::size_t i = 0; i < NbShards; i++) {
+      unique_lock_guard lock(m_shards[i].mutex);
+      m_shards[i].table->max_load_factor(ml);
+    }
+  }
+
+  /*
+   * Observers
+   */
+  hasher hash_function() const { return m_hash; }
+
+  key_equal key_eq() const { return KeyEqual(); }
+
+  /*
+   * Other
+   */
+  static constexpr std::size_t shard_count() { return NbShards; }
+
+  /**
+   * Return the shard [0, shard_count()) of the key with the hash 'hash'.
+   */
+  static std::size_t shard_for_hash_index(std::size_t hash) noexcept {
+    // Double shift to avoid an undefined shift of the whole size of
+    // std::size_t if NbShards is 1.
+    return (hash >> (SHARD_SHIFT - 1)) >> 1;
+  }
+
+ private:
+  struct shard {
+    mutable shared_mutex mutex;
+    std::unique_ptr<ht> table;
+  };
+
+  struct batch_entry {
+    const CharT* key;
+    size_type key_size;
+    std::size_t hash;
+  };
+
+  /**
+   * A batch_entry points to the key of the iterator, the key must thus outlive
+   * the iteration.
+   */
+  template <class ForwardIt>
+  static void check_batch_iterator() {
+    static_assert(
+        std::is_base_of<std::forward_iterator_tag,
+                        typename std::iterator_traits<
+                            ForwardIt>::iterator_category>::value &&
+            std::is_reference<
+                typename std::iterator_traits<ForwardIt>::reference>::value,
+        "The keys of a batch must be accessed through a forward iterator "
+        "returning a reference, they are kept during the whole batch.");
+  }
+
+  template <class ForwardIt>
+  std::vector<batch_entry> make_batch(ForwardIt keys_first,
+                                      ForwardIt keys_last) const {
+    check_batch_iterator<ForwardIt>();
+
+    std::vector<batch_entry> entries;
+    for (; keys_first != keys_last; ++keys_first) {
+      entries.push_back(make_batch_entry(*keys_first));
+    }
+
+    return entries;
+  }
+
+  /**
+   * Call function(ientry, value) for each entry of 'entries', shard by shard.
+   */
+  template <class Function>
+  void visit_entries(const std::vector<batch_entry>& entries,
+                     Function function) const {
+    std::vector<std::size_t> order;
+    std::size_t shard_begin[NbShards + 1];
+    sort_by_shard(entries, order, shard_begin);
+
+    for (std::size_t ishard = 0; ishard < NbShards; ishard++) {
+      if (shard_begin[ishard] == shard_begin[ishard + 1]) {
+        continue;
+      }
+
+      const ht& table = *m_shards[ishard].table;
+      shared_lock_guard lock(m_shards[ishard].mutex);
+      for (std::size_t i = shard_begin[ishard]; i < shard_begin[ishard + 1];
+           i++) {
+        const batch_entry& entry = entries[order[i]];
+        auto it = table.find(entry.key, entry.key_size, entry.hash);
+        function(order[i], (it != table.cend()) ? &it.value() : nullptr);
+      }
+    }
+  }
+
+  std::size_t hash_key(const CharT* key, size_type key_size) const {
+    return m_hash(key, key_size);
+  }
+
+  static size_type shard_bucket_count(size_type bucket_count) {
+    return (bucket_count + NbShards - 1) / NbShards;
+  }
+
+  shard& shard_for_hash(std::size_t hash) {
+    return m_shards[shard_for_hash_index(hash)];
+  }
+
+  const shard& shard_for_hash(std::size_t hash) const {
+    return m_shards[shard_for_hash_index(hash)];
+  }
+
+  batch_entry make_batch_entry(const CharT* key) const {
+    return make_batch_entry(key, std::char_traits<CharT>::length(key));
+  }
+
+  batch_entry make_batch_entry(const std::basic_string<CharT>& key) const {
+    return make_batch_entry(key.data(), key.size());
+  }
+
+#ifdef TSL_AH_HAS_STRING_VIEW
+  batch_entry make_batch_entry(const std::basic_string_view<CharT>& key) const {
+    return make_batch_entry(key.data(), key.size());
+  }
+#endif
+
+  batch_entry make_batch_entry(const CharT* key, size_type key_size) const {
+    return batch_entry{key, key_size, hash_key(key, key_size)};
+  }
+
+  /**
+   * Fill 'order' with the indexes of 'entries' sorted by shard (keeping the
+   * order of the entries inside a shard). The entries of the shard i are
+   * then in [shard_begin[i], shard_begin[i + 1]) of 'order'.
+   */
+  static void sort_by_shard(const std::vector<batch_entry>& entries,
+                            std::vector<std::size_t>& order,
+                            std::size_t (&shard_begin)[NbShards + 1]) {
+    std::fill(std::begin(shard_begin), std::end(shard_begin), 0);
+    for (const batch_entry& entry : entries) {
+      shard_begin[shard_for_hash_index(entry.hash) + 1]++;
+    }
+
+    for (std::size_t ishard = 0; ishard < NbShards; ishard++) {
+      shard_begin[ishard + 1] += shard_begin[ishard];
+    }
+
+    std::size_t next_position[NbShards];
+    std::copy(std::begin(shard_begin), std::end(shard_begin) - 1,
+              std::begin(next_position));
+
+    order.resize(entries.size());
+    for (std::size_t i = 0; i < entries.size(); i++) {
+      order[next_position[shard_for_hash_index(entries[i].hash)]++] = i;
+    }
+  }
+
+ private:
+  static_assert(NbShards > 0 && (NbShards & (NbShards - 1)) == 0,
+                "NbShards must be a power of two.");
+
+  static const std::size_t SHARD_SHIFT =
+      sizeof(std::size_t) * CHAR_BIT -
+      tsl::detail_sharded_array_map::log2(NbShards);
+
+  Hash m_hash;
+  std::unique_ptr<shard[]> m_shards;
+};
+
+}  // end namespace tsl
+
+#endif
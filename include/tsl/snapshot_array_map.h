@@ -0,0 +1,309 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TSL_SNAPSHOT_ARRAY_MAP_H
+#define TSL_SNAPSHOT_ARRAY_MAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "array_map.h"
+
+namespace tsl {
+
+/**
+ * Read-mostly wrapper around `tsl::array_map` in the style of RCU
+ * (read-copy-update). Readers access an immutable version of the map without
+ * ever blocking, while writers build the next version on the side and
+ * publish it atomically.
+ *
+ * Each reading thread gets its own `reader` with `make_reader()` and takes a
+ * `snapshot` of the current version with `reader::take_snapshot()`. Taking and
+ * releasing a snapshot are wait-free: a few atomic loads and stores, without
+ * any lock or retry loop. The snapshot gives a const access to the map of
+ * its version, which is never modified, so a reader never sees a partially
+ * applied update or rehash. Snapshots should be short-lived as they delay the
+ * reclamation of their version.
+ *
+ * Writers either publish a new map with `publish` or copy the current version,
+ * modify the copy and publish it with `update`. Writers are serialized with a
+ * mutex. The old version is reclaimed with an epoch scheme: publishing a
+ * version increments a global epoch and the old version is destroyed once
+ * every reader holding a snapshot has entered a later epoch. The writer waits
+ * for these readers, the readers never wait for the writer.
+ *
+ * The `reader` and `snapshot` objects must not outlive the
+ * `snapshot_array_map`, and a `reader` must only be used by one thread at a
+ * time. A same reader can hold multiple nested snapshots, the outermost one
+ * then keeps the version of all of them alive.
+ *
+ * The template parameters are the same as for `tsl::array_map`.
+ */
+template <class CharT, class T, class Hash = tsl::ah::str_hash<CharT>,
+          class KeyEqual = tsl::ah::str_equal<CharT>,
+          bool StoreNullTerminator = true, class KeySizeT = std::uint16_t,
+          class IndexSizeT = std::uint32_t,
+          class GrowthPolicy = tsl::ah::power_of_two_growth_policy<2>,
+          bool StoreHashTags = false,
+          class BucketGrowthPolicy = tsl::ah::exact_bucket_growth_policy,
+          class BucketStorage = tsl::ah::malloc_bucket_storage,
+          bool StoreHash = false, bool InlineValues = false>
+class snapshot_array_map {
+ public:
+  using map_type =
+      array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator, KeySizeT,
+                IndexSizeT, GrowthPolicy, StoreHashTags, BucketGrowthPolicy,
+                BucketStorage, StoreHash, InlineValues>;
+
+ private:
+  using epoch_type = std::uint64_t;
+
+  static const std::size_t CACHE_LINE_SIZE = 64;
+  static const epoch_type INACTIVE_EPOCH = 0;
+  static const epoch_type FIRST_EPOCH = 1;
+
+  /**
+   * Epoch of a reader while it holds a snapshot, INACTIVE_EPOCH otherwise. Each
+   * slot is allocated separately and padded so that two readers never write
+   * to the same cache line.
+   */
+  struct reader_slot {
+    reader_slot() : epoch(INACTIVE_EPOCH), nb_snapshots(0), in_use(true) {}
+
+    /**
+     * Release a snapshot of the reader owning the slot.
+     */
+    void release() noexcept {
+      tsl_ah_assert(nb_snapshots > 0);
+      nb_snapshots--;
+      if (nb_snapshots == 0) {
+        epoch.store(INACTIVE_EPOCH, std::memory_order_release);
+      }
+    }
+
+    std::atomic<epoch_type> epoch;
+    // Only used by the thread of the reader owning the slot. The count is kept
+    // in the slot rather than in the reader so that the snapshots stay valid
+    // if the reader is moved.
+    std::size_t nb_snapshots;
+    // Guarded by m_readers_mutex.
+    bool in_use;
+    char padding[CACHE_LINE_SIZE];
+  };
+
+ public:
+  class reader;
+
+  /**
+   * Pins a version of the map. Movable but not copyable.
+   */
+  class snapshot {
+    friend class reader;
+
+   private:
+    snapshot(reader_slot* slot, const map_type* map) noexcept
+        : m_slot(slot), m_map(map) {}
+
+   public:
+    snapshot(snapshot&& other) noexcept
+        : m_slot(other.m_slot), m_map(other.m_map) {
+      other.m_slot = nullptr;
+      other.m_map = nullptr;
+    }
+
+    snapshot(const snapshot& other) = delete;
+    snapshot& operator=(const snapshot& other) = delete;
+    snapshot& operator=(snapshot&& other) = delete;
+
+    ~snapshot() {
+      if (m_slot != nullptr) {
+        m_slot->release();
+      }
+    }
+
+    const map_type& operator*() const noexcept { return *m_map; }
+    const map_type* operator->() const noexcept { return m_map; }
+    const map_type& get() const noexcept { return *m_map; }
+
+   private:
+    reader_slot* m_slot;
+    const map_type* m_map;
+  };
+
+  /**
+   * Handle of a reading thread, see make_reader(). Movable but not copyable,
+   * the snapshots taken before a move stay valid.
+   */
+  class reader {
+    friend class snapshot_array_map;
+
+   private:
+    reader(const snapshot_array_map* map, reader_slot* slot) noexcept
+        : m_map(map), m_slot(slot) {}
+
+   public:
+    reader(reader&& other) noexcept
+        : m_map(other.m_map), m_slot(other.m_slot) {
+      other.m_slot = nullptr;
+    }
+
+    reader(const reader& other) = delete;
+    reader& operator=(const reader& other) = delete;
+    reader& operator=(reader&& other) = delete;
+
+    ~reader() {
+      if (m_slot != nullptr) {
+        tsl_ah_assert(m_slot->nb_snapshots == 0);
+        m_map->release_slot(m_slot);
+      }
+    }
+
+    /**
+     * Return a snapshot of the current version of the map. Wait-free.
+     */
+    snapshot take_snapshot() {
+      if (m_slot->nb_snapshots == 0) {
+        m_slot->epoch.store(m_map->m_epoch.load());
+      }
+      m_slot->nb_snapshots++;
+
+      return snapshot(m_slot, m_map->m_current.load());
+    }
+
+   private:
+    const snapshot_array_map* m_map;
+    reader_slot* m_slot;
+  };
+
+ public:
+  snapshot_array_map() : snapshot_array_map(map_type()) {}
+
+  explicit snapshot_array_map(map_type map)
+      : m_current(new map_type(std::move(map))), m_epoch(FIRST_EPOCH) {}
+
+  snapshot_array_map(const snapshot_array_map& other) = delete;
+  snapshot_array_map& operator=(const snapshot_array_map& other) = delete;
+
+  ~snapshot_array_map() { delete m_current.load(); }
+
+  /**
+   * Return a new reader. Each reading thread should get its own reader once
+   * and reuse it for all its snapshots.
+   */
+  reader make_reader() const {
+    std::lock_guard<std::mutex> lock(m_readers_mutex);
+    for (const std::unique_ptr<reader_slot>& slot : m_reader_slots) {
+      if (!slot->in_use) {
+        slot->in_use = true;
+        return reader(this, slot.get());
+      }
+    }
+
+    m_reader_slots.emplace_back(new reader_slot());
+    return reader(this, m_reader_slots.back().get());
+  }
+
+  /**
+   * Replace the current version of the map by 'map'. Return once the previous
+   * version has been destroyed, i.e. once all the readers which could still
+   * see it have released their snapshots.
+   */
+  void publish(map_type map) {
+    std::unique_ptr<map_type> next(new map_type(std::move(map)));
+
+    std::lock_guard<std::mutex> lock(m_writer_mutex);
+    publish_locked(std::move(next));
+  }
+
+  /**
+   * Copy the current version of the map, call 'function' with a reference to
+   * the copy and publish it as the new version (see publish).
+   */
+  template <class Function>
+  void update(Function function) {
+    std::lock_guard<std::mutex> lock(m_writer_mutex);
+
+    // Only the writers modify m_current and they hold m_writer_mutex.
+    std::unique_ptr<map_type> next(
+        new map_type(*m_current.load(std::memory_order_relaxed)));
+    function(*next);
+
+    publish_locked(std::move(next));
+  }
+
+ private:
+  void publish_locked(std::unique_ptr<map_type> next) {
+    std::unique_ptr<map_type> previous(m_current.exchange(next.release()));
+    const epoch_type new_epoch = m_epoch.fetch_add(1) + 1;
+
+    // A reader which entered an epoch before new_epoch may still use
+    // 'previous'. The readers entering new_epoch or later load the new
+    // version as m_current is exchanged before m_epoch is incremented, the
+    // slots added after the copy can thus be ignored. The slots are never
+    // freed and m_readers_mutex isn't held while waiting, a reader holding a
+    // snapshot can still create or destroy readers.
+    std::vector<reader_slot*> slots;
+    {
+      std::lock_guard<std::mutex> lock(m_readers_mutex);
+      slots.reserve(m_reader_slots.size());
+      for (const std::unique_ptr<reader_slot>& slot : m_reader_slots) {
+        slots.push_back(slot.get());
+      }
+    }
+
+    for (const reader_slot* slot : slots) {
+      while (true) {
+        const epoch_type reader_epoch = slot->epoch.load();
+        if (reader_epoch == INACTIVE_EPOCH || reader_epoch >= new_epoch) {
+          break;
+        }
+
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  void release_slot(reader_slot* slot) const {
+    std::lock_guard<std::mutex> lock(m_readers_mutex);
+    slot->in_use = false;
+  }
+
+ private:
+  std::atomic<map_type*> m_current;
+  std::atomic<epoch_type> m_epoch;
+
+  std::mutex m_writer_mutex;
+
+  mutable std::mutex m_readers_mutex;
+  mutable std::vector<std::unique_ptr<reader_slot>> m_reader_slots;
+};
+
+}  // end namespace tsl
+
+#endif
@@ -31,19 +31,82 @@
 BOOST_AUTO_TEST_SUITE(test_array_bucket)
 using test_types = boost::mpl::list<
     tsl::detail_array_hash::array_bucket<
-        char, std::uint64_t, tsl::ah::str_equal<char>, std::uint16_t, true>,
-    tsl::detail_array_hash::array_bucket<wchar_t, std::uint32_t,
-                                         tsl::ah::str_equal<wchar_t>,
-                                         std::uint8_t, true>,
-    tsl::detail_array_hash::array_bucket<char16_t, std::uint32_t,
-                                         tsl::ah::str_equal<char16_t>,
-                                         std::uint8_t, true>,
-    tsl::detail_array_hash::array_bucket<char32_t, std::uint8_t,
-                                         tsl::ah::str_equal<char32_t>,
-                                         std::uint32_t, true>,
-    tsl::detail_array_hash::array_bucket<char16_t, std::uint16_t,
-                                         tsl::ah::str_equal<char16_t>,
-                                         std::uint32_t, false> >;
+        char, std::uint64_t, tsl::ah::str_equal<char>, std::uint16_t, true,
+        false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, std::uint32_t, tsl::ah::str_equal<wchar_t>, std::uint8_t, true,
+        false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char16_t, std::uint32_t, tsl::ah::str_equal<char16_t>, std::uint8_t,
+        true, false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char32_t, std::uint8_t, tsl::ah::str_equal<char32_t>, std::uint32_t,
+        true, false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char16_t, std::uint16_t, tsl::ah::str_equal<char16_t>, std::uint32_t,
+        false, false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char, std::uint64_t, tsl::ah::str_equal<char>, std::uint16_t, true,
+        true, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, std::uint32_t, tsl::ah::str_equal<wchar_t>, std::uint8_t, true,
+        true, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char32_t, std::uint8_t, tsl::ah::str_equal<char32_t>, std::uint32_t,
+        false, true, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char, std::uint64_t, tsl::ah::str_equal<char>, std::uint16_t, true,
+        false, tsl::ah::geometric_bucket_growth_policy<>,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char16_t, std::uint16_t, tsl::ah::str_equal<char16_t>, std::uint32_t,
+        false, false, tsl::ah::geometric_bucket_growth_policy<std::ratio<2>>,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, std::uint32_t, tsl::ah::str_equal<wchar_t>, std::uint8_t, true,
+        true, tsl::ah::geometric_bucket_growth_policy<>,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char, std::uint32_t, tsl::ah::str_equal<char>, std::uint16_t, true,
+        false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::arena_bucket_storage<>, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char16_t, std::uint64_t, tsl::ah::str_equal<char16_t>, std::uint8_t,
+        false, true, tsl::ah::geometric_bucket_growth_policy<>,
+        tsl::ah::arena_bucket_storage<1024>, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        char, std::uint64_t, tsl::ah::str_equal<char>, std::uint16_t, true,
+        false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, true, false>,
+    tsl::detail_array_hash::array_bucket<
+        char32_t, std::uint8_t, tsl::ah::str_equal<char32_t>, std::uint8_t,
+        false, true, tsl::ah::geometric_bucket_growth_policy<>,
+        tsl::ah::malloc_bucket_storage, true, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, std::uint32_t, tsl::ah::str_equal<wchar_t>, std::uint16_t,
+        true, true, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::arena_bucket_storage<>, true, false>,
+    tsl::detail_array_hash::array_bucket<
+        char, std::uint64_t, tsl::ah::str_equal<char>, std::uint16_t, true,
+        false, tsl::ah::exact_bucket_growth_policy,
+        tsl::ah::malloc_bucket_storage, false, true>,
+    tsl::detail_array_hash::array_bucket<
+        char16_t, std::uint32_t, tsl::ah::str_equal<char16_t>, std::uint8_t,
+        false, true, tsl::ah::geometric_bucket_growth_policy<>,
+        tsl::ah::arena_bucket_storage<>, true, true> >;
+
+template <class CharT>
+static std::size_t key_hash(const std::basic_string<CharT>& key) {
+  return tsl::ah::str_hash<CharT>()(key.data(), key.size());
+}
 
 /**
  * insert and erase
@@ -55,6 +118,7 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert, ABucket, test_types) {
   using mapped_tt = typename ABucket::mapped_type;
   using key_equal = typename ABucket::key_equal;
 
+  typename ABucket::bucket_storage storage;
   ABucket bucket;
 
   // insert `nb_values` values
@@ -62,10 +126,12 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert, ABucket, test_types) {
   for (std::size_t i = 0; i < nb_values; i++) {
     const auto key = utils::get_key<char_tt>(i);
 
-    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size());
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(),
+                                                key_hash(key));
     BOOST_REQUIRE(!it_find.second);
 
-    auto it_insert = bucket.append(it_find.first, key.data(), key.size(),
+    auto it_insert = bucket.append(storage, it_find.first, key.data(),
+                                   key.size(), key_hash(key),
                                    utils::get_value<mapped_tt>(i));
     BOOST_CHECK(key_equal()(it_insert.key(), it_insert.key_size(), key.data(),
                             key.size()));
@@ -87,7 +153,7 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert, ABucket, test_types) {
   // Remove half value
   for (i = 0; i < nb_values; i += 2) {
     const auto key = utils::get_key<char_tt>(i);
-    BOOST_CHECK(bucket.erase(key.data(), key.size()));
+    BOOST_CHECK(bucket.erase(storage, key.data(), key.size(), key_hash(key)));
   }
 
   // Check values
@@ -105,7 +171,7 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert, ABucket, test_types) {
   // Remove second half
   for (i = 1; i < nb_values; i += 2) {
     const auto key = utils::get_key<char_tt>(i);
-    BOOST_CHECK(bucket.erase(key.data(), key.size()));
+    BOOST_CHECK(bucket.erase(storage, key.data(), key.size(), key_hash(key)));
   }
 
   BOOST_CHECK_EQUAL(std::distance(bucket.begin(), bucket.end()), 0);
@@ -130,11 +196,13 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_append_in_reserved, ABucket, test_types) {
         ABucket::entry_required_bytes(utils::get_key<char_tt>(i).size());
   }
 
-  ABucket bucket(required_size);
+  typename ABucket::bucket_storage storage;
+  ABucket bucket(storage, required_size, nb_values);
 
   for (std::size_t i = 0; i < nb_values; i++) {
     const auto key = utils::get_key<char_tt>(i);
     bucket.append_in_reserved_bucket_no_check(key.data(), key.size(),
+                                              key_hash(key),
                                               utils::get_value<mapped_tt>(i));
 
     BOOST_CHECK_EQUAL(std::distance(bucket.begin(), bucket.end()), i + 1);
@@ -142,7 +210,8 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_append_in_reserved, ABucket, test_types) {
 
   for (std::size_t i = 0; i < nb_values; i++) {
     const auto key = utils::get_key<char_tt>(i);
-    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size());
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(),
+                                                key_hash(key));
 
     BOOST_REQUIRE(it_find.second);
     BOOST_CHECK(key_equal()(it_find.first.key(), it_find.first.key_size(),
@@ -160,6 +229,7 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_erase_all, ABucket, test_types) {
   using mapped_tt = typename ABucket::mapped_type;
   using key_equal = typename ABucket::key_equal;
 
+  typename ABucket::bucket_storage storage;
   ABucket bucket;
 
   // insert `nb_values` values
@@ -167,10 +237,12 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_erase_all, ABucket, test_types) {
   for (std::size_t i = 0; i < nb_values; i++) {
     const auto key = utils::get_key<char_tt>(i);
 
-    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size());
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(),
+                                                key_hash(key));
     BOOST_REQUIRE(!it_find.second);
 
-    auto it_insert = bucket.append(it_find.first, key.data(), key.size(),
+    auto it_insert = bucket.append(storage, it_find.first, key.data(),
+                                   key.size(), key_hash(key),
                                    utils::get_value<mapped_tt>(i));
     BOOST_CHECK(key_equal()(it_insert.key(), it_insert.key_size(), key.data(),
                             key.size()));
@@ -179,7 +251,7 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_erase_all, ABucket, test_types) {
   // erase all values
   auto it_erase = bucket.cbegin();
   while (it_erase != bucket.cend()) {
-    it_erase = bucket.erase(it_erase);
+    it_erase = bucket.erase(storage, it_erase);
     BOOST_CHECK_EQUAL(std::distance(bucket.begin(), bucket.end()), --nb_values);
   }
 
@@ -192,9 +264,10 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_erase_all, ABucket, test_types) {
  * iterator
  */
 BOOST_AUTO_TEST_CASE(test_iterator_empty_bucket) {
-  using ABucket =
-      tsl::detail_array_hash::array_bucket<char, void, tsl::ah::str_equal<char>,
-                                           std::uint16_t, true>;
+  using ABucket = tsl::detail_array_hash::array_bucket<
+      char, void, tsl::ah::str_equal<char>, std::uint16_t, true, false,
+      tsl::ah::exact_bucket_growth_policy, tsl::ah::malloc_bucket_storage,
+      false, false>;
   ABucket bucket;
 
   BOOST_CHECK(bucket.empty());
@@ -208,31 +281,50 @@ BOOST_AUTO_TEST_CASE(test_iterator_empty_bucket) {
 /**
  * KeyEqual
  */
-BOOST_AUTO_TEST_CASE(test_key_equal) {
+using test_key_equal_types = boost::mpl::list<
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, void, ci_str_equal<wchar_t>, std::uint8_t, false, false,
+        tsl::ah::exact_bucket_growth_policy, tsl::ah::malloc_bucket_storage,
+        false, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, void, ci_str_equal<wchar_t>, std::uint8_t, false, true,
+        tsl::ah::exact_bucket_growth_policy, tsl::ah::malloc_bucket_storage,
+        false, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, void, ci_str_equal<wchar_t>, std::uint8_t, false, true,
+        tsl::ah::geometric_bucket_growth_policy<>,
+        tsl::ah::malloc_bucket_storage, false, false>,
+    tsl::detail_array_hash::array_bucket<
+        wchar_t, void, ci_str_equal<wchar_t>, std::uint8_t, false, true,
+        tsl::ah::exact_bucket_growth_policy, tsl::ah::malloc_bucket_storage,
+        true, false> >;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_key_equal, ABucket, test_key_equal_types) {
   // insert x values using case-insensitive KeyEqual, check values with
   // different case
-  using ABucket =
-      tsl::detail_array_hash::array_bucket<wchar_t, void, ci_str_equal<wchar_t>,
-                                           std::uint8_t, false>;
   using key_equal = typename ABucket::key_equal;
 
+  typename ABucket::bucket_storage storage;
   ABucket bucket;
 
   const std::size_t nb_values = 1000;
   for (std::size_t i = 0; i < nb_values; i++) {
     const std::wstring key = L"KEy " + std::to_wstring(i);
+    const std::size_t hash = ci_str_hash<wchar_t>()(key.data(), key.size());
 
-    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size());
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(), hash);
     BOOST_REQUIRE(!it_find.second);
 
-    auto it_insert = bucket.append(it_find.first, key.data(), key.size());
+    auto it_insert =
+        bucket.append(storage, it_find.first, key.data(), key.size(), hash);
     BOOST_CHECK(key_equal()(it_insert.key(), it_insert.key_size(), key.data(),
                             key.size()));
   }
 
   for (std::size_t i = 0; i < nb_values; i++) {
     const std::wstring key = L"kEY " + std::to_wstring(i);
-    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size());
+    const std::size_t hash = ci_str_hash<wchar_t>()(key.data(), key.size());
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(), hash);
 
     BOOST_REQUIRE(it_find.second);
     BOOST_CHECK(key_equal()(it_find.first.key(), it_find.first.key_size(),
@@ -240,4 +332,97 @@ BOOST_AUTO_TEST_CASE(test_key_equal) {
   }
 }
 
+/**
+ * Hash tags
+ */
+BOOST_AUTO_TEST_CASE(test_hash_tags_collisions) {
+  // insert x values which all have the same hash tag, check that lookups and
+  // erases still compare the keys
+  using ABucket = tsl::detail_array_hash::array_bucket<
+      char, std::uint32_t, tsl::ah::str_equal<char>, std::uint16_t, true, true,
+      tsl::ah::exact_bucket_growth_policy, tsl::ah::malloc_bucket_storage,
+      false, false>;
+  const std::size_t hash = 42;
+
+  ABucket::bucket_storage storage;
+  ABucket bucket;
+
+  const std::size_t nb_values = 100;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const std::string key = utils::get_key<char>(i);
+
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(), hash);
+    BOOST_REQUIRE(!it_find.second);
+
+    bucket.append(storage, it_find.first, key.data(), key.size(), hash,
+                  utils::get_value<std::uint32_t>(i));
+  }
+
+  for (std::size_t i = 0; i < nb_values; i += 3) {
+    const std::string key = utils::get_key<char>(i);
+    BOOST_CHECK(bucket.erase(storage, key.data(), key.size(), hash));
+  }
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const std::string key = utils::get_key<char>(i);
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(), hash);
+
+    if (i % 3 == 0) {
+      BOOST_CHECK(!it_find.second);
+    } else {
+      BOOST_REQUIRE(it_find.second);
+      BOOST_CHECK_EQUAL(it_find.first.value(),
+                        utils::get_value<std::uint32_t>(i));
+    }
+  }
+
+  // A key with a different tag is never found, even if the key is the same.
+  const std::string key = utils::get_key<char>(1);
+  BOOST_CHECK(!bucket
+                   .find_or_end_of_bucket(key.data(), key.size(),
+                                          ~std::size_t(0))
+                   .second);
+}
+
+/**
+ * StoreHash
+ */
+BOOST_AUTO_TEST_CASE(test_store_hash) {
+  // insert x values, check that the stored hash is the truncated hash given on
+  // insertion and that a key with a different stored hash is never found
+  using ABucket = tsl::detail_array_hash::array_bucket<
+      char, std::uint32_t, tsl::ah::str_equal<char>, std::uint16_t, true, false,
+      tsl::ah::exact_bucket_growth_policy, tsl::ah::malloc_bucket_storage,
+      true, false>;
+
+  ABucket::bucket_storage storage;
+  ABucket bucket;
+
+  const std::size_t nb_values = 100;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const std::string key = utils::get_key<char>(i);
+
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(), i);
+    BOOST_REQUIRE(!it_find.second);
+
+    auto it_insert = bucket.append(storage, it_find.first, key.data(),
+                                   key.size(), i,
+                                   utils::get_value<std::uint32_t>(i));
+    BOOST_CHECK_EQUAL(it_insert.truncated_hash(), i);
+  }
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const std::string key = utils::get_key<char>(i);
+
+    auto it_find = bucket.find_or_end_of_bucket(key.data(), key.size(), i);
+    BOOST_REQUIRE(it_find.second);
+    BOOST_CHECK_EQUAL(it_find.first.value(),
+                      utils::get_value<std::uint32_t>(i));
+    BOOST_CHECK_EQUAL(it_find.first.truncated_hash(), i);
+
+    BOOST_CHECK(
+        !bucket.find_or_end_of_bucket(key.data(), key.size(), i + 1).second);
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -23,20 +23,28 @@
  */
 #include <tsl/array_map.h>
 
+#include <boost/mpl/joint_view.hpp>
 #include <boost/mpl/list.hpp>
 #include <boost/test/unit_test.hpp>
+#include <climits>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "utils.h"
 
 BOOST_AUTO_TEST_SUITE(test_array_map)
 
-using test_types = boost::mpl::list<
+// boost::mpl::list is limited to 20 types, the configurations which don't fit
+// in test_base_types are in test_extra_types.
+using test_base_types = boost::mpl::list<
     tsl::array_map<char, int64_t>, tsl::array_map<char, std::string>,
     tsl::array_map<char, move_only_test>,
     tsl::array_map<wchar_t, move_only_test>,
@@ -53,7 +61,53 @@ using test_types = boost::mpl::list<
     tsl::array_pg_map<char16_t, move_only_test>,
     tsl::array_map<char16_t, move_only_test, tsl::ah::str_hash<char16_t>,
                    tsl::ah::str_equal<char16_t>, false, std::uint16_t,
-                   std::uint16_t, tsl::ah::mod_growth_policy<>>>;
+                   std::uint16_t, tsl::ah::mod_growth_policy<>>,
+    tsl::array_map<char, move_only_test, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>, true>,
+    tsl::array_map<char32_t, move_only_test, tsl::ah::str_hash<char32_t>,
+                   tsl::ah::str_equal<char32_t>, false, std::uint16_t,
+                   std::uint32_t, tsl::ah::mod_growth_policy<>, true>,
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                   false, tsl::ah::geometric_bucket_growth_policy<>>,
+    tsl::array_map<wchar_t, move_only_test, tsl::ah::str_hash<wchar_t>,
+                   tsl::ah::str_equal<wchar_t>, false, std::uint8_t,
+                   std::uint32_t, tsl::ah::prime_growth_policy, true,
+                   tsl::ah::geometric_bucket_growth_policy<std::ratio<2>>>,
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                   false, tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::arena_bucket_storage<>>,
+    tsl::array_map<char16_t, move_only_test, tsl::ah::str_hash<char16_t>,
+                   tsl::ah::str_equal<char16_t>, false, std::uint16_t,
+                   std::uint32_t, tsl::ah::mod_growth_policy<>, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<1024>>,
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                   false, tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, true>,
+    tsl::array_map<wchar_t, move_only_test, tsl::ah::str_hash<wchar_t>,
+                   tsl::ah::str_equal<wchar_t>, true, std::uint8_t,
+                   std::uint32_t, tsl::ah::mod_growth_policy<>, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<>, true>>;
+
+using test_extra_types = boost::mpl::list<
+    tsl::array_map<char16_t, move_only_test, tsl::ah::str_hash<char16_t>,
+                   tsl::ah::str_equal<char16_t>, false, std::uint16_t,
+                   std::uint16_t, tsl::ah::fastmod_growth_policy<>>,
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::fibonacci_growth_policy<2>, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::malloc_bucket_storage, true>>;
+
+using test_types = boost::mpl::joint_view<test_base_types, test_extra_types>;
 
 /**
  * insert
@@ -99,6 +153,59 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert, AMap, test_types) {
   }
 }
 
+/**
+ * find_batch
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_find_batch, AMap, test_types) {
+  // insert x values, search 2x keys in batch, check that the results are the
+  // same as with find
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  AMap map = utils::get_filled_hash_map<AMap>(nb_values);
+  const AMap& map_const = map;
+
+  std::vector<std::basic_string<char_tt>> keys;
+  for (std::size_t i = 0; i < nb_values * 2; i++) {
+    keys.push_back(utils::get_key<char_tt>((i * 7) % (nb_values * 2)));
+  }
+
+  std::vector<typename AMap::iterator> its(keys.size());
+  BOOST_CHECK(map.find_batch(keys.begin(), keys.end(), its.begin()) ==
+              its.end());
+
+  std::vector<typename AMap::const_iterator> its_const(keys.size());
+  map_const.find_batch(keys.begin(), keys.end(), its_const.begin());
+
+  std::vector<std::size_t> counts(keys.size());
+  map.count_batch(keys.begin(), keys.end(), counts.begin());
+
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    BOOST_CHECK(its[i] == map.find(keys[i]));
+    BOOST_CHECK(its_const[i] == map_const.find(keys[i]));
+    BOOST_CHECK_EQUAL(counts[i], map.count(keys[i]));
+
+    if (its[i] != map.end()) {
+      BOOST_CHECK_EQUAL(its[i].value(), utils::get_value<value_tt>(
+                                            (i * 7) % (nb_values * 2)));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_find_batch_empty) {
+  tsl::array_map<char, int> map(0);
+  const std::vector<const char*> keys = {"", "test", "test2"};
+
+  std::vector<tsl::array_map<char, int>::iterator> its;
+  map.find_batch(keys.begin(), keys.end(), std::back_inserter(its));
+
+  BOOST_REQUIRE_EQUAL(its.size(), keys.size());
+  for (const auto& it : its) {
+    BOOST_CHECK(it == map.end());
+  }
+}
+
 BOOST_AUTO_TEST_CASE(test_insert_more_than_max_size) {
   tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
                  tsl::ah::str_equal<char>, true, std::uint16_t, std::uint8_t>
@@ -153,6 +260,116 @@ BOOST_AUTO_TEST_CASE(test_range_insert) {
   }
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_bulk_load, AMap, test_types) {
+  // bulk load x keys, each of them twice with different values, in a non-empty
+  // map with both duplicate policies and with one and multiple threads; check
+  // that only the first or the last value of each key is kept.
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_keys = 1000;
+  for (tsl::ah::duplicate_policy policy :
+       {tsl::ah::duplicate_policy::keep_first,
+        tsl::ah::duplicate_policy::keep_last}) {
+    for (std::size_t nb_threads : {1, 4}) {
+      std::vector<std::pair<std::basic_string<char_tt>, value_tt>> elements;
+      for (std::size_t i = 0; i < 2 * nb_keys; i++) {
+        elements.emplace_back(utils::get_key<char_tt>(i % nb_keys),
+                              utils::get_value<value_tt>(i));
+      }
+
+      AMap map;
+      map.insert(utils::get_key<char_tt>(3 * nb_keys),
+                 utils::get_value<value_tt>(0));
+      map.bulk_load(std::make_move_iterator(elements.begin()),
+                    std::make_move_iterator(elements.end()), policy,
+                    nb_threads);
+
+      BOOST_CHECK_EQUAL(map.size(), nb_keys);
+      BOOST_CHECK_EQUAL(map.count(utils::get_key<char_tt>(3 * nb_keys)), 0);
+      for (std::size_t i = 0; i < nb_keys; i++) {
+        const std::size_t ivalue =
+            (policy == tsl::ah::duplicate_policy::keep_first) ? i
+                                                              : i + nb_keys;
+        BOOST_CHECK_EQUAL(map.at(utils::get_key<char_tt>(i)),
+                          utils::get_value<value_tt>(ivalue));
+      }
+
+      // The map must still support insertions and erasures.
+      for (std::size_t i = 0; i < nb_keys; i += 2) {
+        BOOST_CHECK_EQUAL(map.erase(utils::get_key<char_tt>(i)), 1);
+        BOOST_CHECK(map.insert(utils::get_key<char_tt>(i + nb_keys),
+                               utils::get_value<value_tt>(i))
+                        .second);
+      }
+      BOOST_CHECK_EQUAL(map.size(), nb_keys);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_bulk_load_keep_last_values) {
+  // bulk load keys twice with keep_last in a map with inline values and in a
+  // map with non-assignable values; check the last values.
+  struct non_assignable {
+    explicit non_assignable(std::int64_t v) : value(v) {}
+
+    const std::int64_t value;
+  };
+
+  using inline_values_map =
+      tsl::array_map<char, std::uint32_t, tsl::ah::str_hash<char>,
+                     tsl::ah::str_equal<char>, true, std::uint16_t,
+                     std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                     false, tsl::ah::exact_bucket_growth_policy,
+                     tsl::ah::malloc_bucket_storage, false, true>;
+
+  const std::size_t nb_keys = 1000;
+  std::vector<std::pair<const char*, std::uint32_t>> inline_elements;
+  std::vector<std::pair<std::string, non_assignable>> elements;
+  std::vector<std::string> keys;
+  for (std::size_t i = 0; i < nb_keys; i++) {
+    keys.push_back(utils::get_key<char>(i));
+  }
+  for (std::size_t i = 0; i < 2 * nb_keys; i++) {
+    inline_elements.emplace_back(keys[i % nb_keys].c_str(),
+                                 std::uint32_t(i));
+    elements.emplace_back(keys[i % nb_keys], non_assignable(std::int64_t(i)));
+  }
+
+  inline_values_map map_inline;
+  map_inline.bulk_load(inline_elements.begin(), inline_elements.end(),
+                       tsl::ah::duplicate_policy::keep_last);
+
+  tsl::array_map<char, non_assignable> map;
+  map.bulk_load(elements.begin(), elements.end(),
+                tsl::ah::duplicate_policy::keep_last);
+
+  BOOST_CHECK_EQUAL(map_inline.size(), nb_keys);
+  BOOST_CHECK_EQUAL(map.size(), nb_keys);
+  for (std::size_t i = 0; i < nb_keys; i++) {
+    BOOST_CHECK_EQUAL(map_inline.at(keys[i]), i + nb_keys);
+    BOOST_CHECK_EQUAL(map.at(keys[i]).value, std::int64_t(i + nb_keys));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_bulk_load_with_too_long_string) {
+  // bulk load a range with a too long key; check that the map is unchanged.
+  tsl::array_map<char, int, tsl::ah::str_hash<char>, tsl::ah::str_equal<char>,
+                 true, std::uint8_t>
+      map = {{"key", 1}};
+
+  const std::vector<std::pair<std::string, int>> elements = {
+      {"a", 1}, {std::string(300, 'a'), 2}, {"b", 3}};
+  BOOST_CHECK_THROW(map.bulk_load(elements.begin(), elements.end()),
+                    std::length_error);
+  BOOST_CHECK_THROW(map.bulk_load(elements.begin(), elements.end(),
+                                  tsl::ah::duplicate_policy::keep_first, 2),
+                    std::length_error);
+
+  BOOST_CHECK_EQUAL(map.size(), 1);
+  BOOST_CHECK_EQUAL(map.at("key"), 1);
+}
+
 /**
  * insert_or_assign
  */
@@ -332,6 +549,103 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert_erase_insert, AMap, test_types) {
   }
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_erase_if, AMap, test_types) {
+  // insert x values, erase_if one third of them with and without compaction of
+  // the values, insert x values, find each value
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  for (bool compact_values : {false, true}) {
+    AMap map = utils::get_filled_hash_map<AMap>(nb_values);
+
+    AMap to_erase;
+    for (std::size_t i = 0; i < nb_values; i += 3) {
+      to_erase.insert(utils::get_key<char_tt>(i), utils::get_value<value_tt>(i));
+    }
+
+    std::size_t nb_calls = 0;
+    const std::size_t nb_erased = map.erase_if(
+        [&](const char_tt* key, std::size_t key_size, const value_tt& value) {
+          nb_calls++;
+          auto it = to_erase.find_ks(key, key_size);
+          if (it == to_erase.end()) {
+            return false;
+          }
+
+          BOOST_CHECK_EQUAL(value, it.value());
+          return true;
+        },
+        compact_values);
+
+    BOOST_CHECK_EQUAL(nb_calls, nb_values);
+    BOOST_CHECK_EQUAL(nb_erased, to_erase.size());
+    BOOST_CHECK_EQUAL(map.size(), nb_values - to_erase.size());
+    BOOST_CHECK_EQUAL(
+        static_cast<std::size_t>(std::distance(map.begin(), map.end())),
+        map.size());
+
+    for (std::size_t i = nb_values; i < 2 * nb_values; i++) {
+      map.insert(utils::get_key<char_tt>(i), utils::get_value<value_tt>(i));
+    }
+
+    for (std::size_t i = 0; i < 2 * nb_values; i++) {
+      auto it = map.find(utils::get_key<char_tt>(i));
+      if (i < nb_values && i % 3 == 0) {
+        BOOST_CHECK(it == map.end());
+      } else {
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it.value(), utils::get_value<value_tt>(i));
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_erase_if_compact_values) {
+  // insert x values sharing a pointer, erase_if a tenth of them; check that
+  // the erased values are only destroyed with compact_values and that a
+  // throwing predicate leaves a valid map.
+  const std::size_t nb_values = 1000;
+  const std::shared_ptr<int> value = std::make_shared<int>(1);
+  const auto ends_with_zero = [](const char* key, std::size_t key_size,
+                                 const std::shared_ptr<int>&) {
+    return key[key_size - 1] == '0';
+  };
+
+  tsl::array_map<char, std::shared_ptr<int>> map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char>(i), value);
+  }
+
+  BOOST_CHECK_EQUAL(map.erase_if(ends_with_zero), nb_values / 10);
+  BOOST_CHECK_EQUAL(value.use_count(), nb_values + 1);
+  map.clear();
+
+  tsl::array_map<char, std::shared_ptr<int>> map2;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map2.insert(utils::get_key<char>(i), value);
+  }
+  BOOST_CHECK_EQUAL(map2.erase_if(ends_with_zero, true), nb_values / 10);
+  BOOST_CHECK_EQUAL(value.use_count(), nb_values - nb_values / 10 + 1);
+
+  std::size_t nb_calls = 0;
+  BOOST_CHECK_THROW(
+      map2.erase_if([&](const char*, std::size_t, const std::shared_ptr<int>&) {
+        if (++nb_calls > nb_values / 4) {
+          throw std::runtime_error("");
+        }
+        return true;
+      }),
+      std::runtime_error);
+  BOOST_CHECK_EQUAL(map2.size(), nb_values - nb_values / 10 - nb_values / 4);
+  BOOST_CHECK_EQUAL(
+      static_cast<std::size_t>(std::distance(map2.begin(), map2.end())),
+      map2.size());
+  for (auto it = map2.begin(); it != map2.end(); ++it) {
+    BOOST_CHECK_EQUAL(map2.count_ks(it.key(), it.key_size()), 1);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(test_range_erase_same_iterators) {
   // insert x values, test erase with same iterator as each parameter, check if
   // returned mutable iterator is valid.
@@ -352,6 +666,67 @@ BOOST_AUTO_TEST_CASE(test_range_erase_same_iterators) {
   BOOST_CHECK_EQUAL(it_const.value(), -100);
 }
 
+BOOST_AUTO_TEST_CASE(test_erase_insert_reuse_values) {
+  // Insert x values, then repeatedly erase a value and insert a new one. Each
+  // insertion should reuse the slot of the erased value, so the number of
+  // copies of the shared value stays the same.
+  const std::size_t nb_values = 1000;
+  const std::shared_ptr<int> value = std::make_shared<int>(1);
+
+  tsl::array_map<char, std::shared_ptr<int>> map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char>(i), value);
+  }
+  BOOST_CHECK_EQUAL(value.use_count(), nb_values + 1);
+
+  for (std::size_t i = 0; i < nb_values * 3; i++) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<char>(i)), 1);
+    BOOST_CHECK(map.insert(utils::get_key<char>(i + nb_values), value).second);
+    BOOST_CHECK_EQUAL(value.use_count(), nb_values + 1);
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  for (std::size_t i = nb_values * 3; i < nb_values * 4; i++) {
+    BOOST_CHECK(map.at(utils::get_key<char>(i)) == value);
+  }
+
+  // Erase through iterators then insert again.
+  map.erase(map.begin(), std::next(map.begin(), 10));
+  map.erase(map.begin());
+  for (std::size_t i = 0; i < 11; i++) {
+    map.emplace(utils::get_key<char>(i), value);
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  BOOST_CHECK_EQUAL(value.use_count(), nb_values + 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_erase_insert_non_assignable_values) {
+  // Values which can't be move-assigned are never reused but the map should
+  // still work as expected.
+  struct non_assignable {
+    explicit non_assignable(std::int64_t v) : value(v) {}
+
+    const std::int64_t value;
+  };
+
+  const std::size_t nb_values = 1000;
+  tsl::array_map<char, non_assignable> map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.emplace(utils::get_key<char>(i), std::int64_t(i));
+  }
+
+  for (std::size_t i = 0; i < nb_values * 3; i++) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<char>(i)), 1);
+    map.emplace(utils::get_key<char>(i + nb_values), std::int64_t(i));
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  for (std::size_t i = nb_values * 2; i < nb_values * 3; i++) {
+    BOOST_CHECK_EQUAL(map.at(utils::get_key<char>(i + nb_values)).value,
+                      std::int64_t(i));
+  }
+}
+
 /**
  * rehash
  */
@@ -381,9 +756,250 @@ BOOST_AUTO_TEST_CASE(test_rehash_empty) {
                     utils::get_value<std::int64_t>(10));
 }
 
+/**
+ * max_load_bytes
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_max_load_bytes, AMap, test_types) {
+  // With long keys, max_load_bytes() keeps load_bytes() under the limit by
+  // growing the map earlier than max_load_factor() alone. Erasing all the
+  // elements, whichever way, brings load_bytes() back to 0.
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  const std::size_t max_load_bytes = 128;
+  const std::basic_string<char_tt> suffix(200, char_tt('x'));
+
+  AMap map;
+  AMap map_no_limit;
+  map.max_load_bytes(max_load_bytes);
+  BOOST_CHECK_EQUAL(map.max_load_bytes(), max_load_bytes);
+  BOOST_CHECK_EQUAL(map_no_limit.max_load_bytes(), 0);
+  BOOST_CHECK_EQUAL(map.load_bytes(), 0.0f);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char_tt>(i) + suffix,
+               utils::get_value<value_tt>(i));
+    map_no_limit.insert(utils::get_key<char_tt>(i) + suffix,
+                        utils::get_value<value_tt>(i));
+  }
+
+  BOOST_CHECK(map.load_bytes() > 0.0f);
+  BOOST_CHECK(map.load_bytes() < float(max_load_bytes) + 1.0f);
+  BOOST_CHECK(map_no_limit.load_bytes() > float(max_load_bytes));
+  BOOST_CHECK(map.bucket_count() > map_no_limit.bucket_count());
+  BOOST_CHECK(map.load_factor() < map_no_limit.load_factor());
+
+  map_no_limit.max_load_bytes(max_load_bytes);
+  map_no_limit.rehash(0);
+  BOOST_CHECK(map_no_limit.load_bytes() <= float(max_load_bytes));
+
+  // bulk_load, and insert(first, last) on an empty map which goes through it,
+  // size the buckets with the limit too.
+  for (std::size_t nb_threads : {1, 4}) {
+    std::vector<std::pair<std::basic_string<char_tt>, value_tt>> elements;
+    for (std::size_t i = 0; i < nb_values; i++) {
+      elements.emplace_back(utils::get_key<char_tt>(i) + suffix,
+                            utils::get_value<value_tt>(i));
+    }
+
+    AMap map_bulk;
+    map_bulk.max_load_bytes(max_load_bytes);
+    map_bulk.bulk_load(std::make_move_iterator(elements.begin()),
+                       std::make_move_iterator(elements.end()),
+                       tsl::ah::duplicate_policy::keep_first, nb_threads);
+    BOOST_CHECK_EQUAL(map_bulk.size(), nb_values);
+    BOOST_CHECK(map_bulk.load_bytes() <= float(map_bulk.max_load_bytes()));
+  }
+
+  {
+    std::vector<std::pair<std::basic_string<char_tt>, value_tt>> elements;
+    for (std::size_t i = 0; i < nb_values; i++) {
+      elements.emplace_back(utils::get_key<char_tt>(i) + suffix,
+                            utils::get_value<value_tt>(i));
+    }
+
+    AMap map_range;
+    map_range.max_load_bytes(max_load_bytes);
+    map_range.insert(std::make_move_iterator(elements.begin()),
+                     std::make_move_iterator(elements.end()));
+    BOOST_CHECK_EQUAL(map_range.size(), nb_values);
+    BOOST_CHECK(map_range.load_bytes() <= float(map_range.max_load_bytes()));
+  }
+
+  const float load_bytes = map.load_bytes();
+
+  for (std::size_t i = 0; i < nb_values / 2; i++) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<char_tt>(i) + suffix), 1);
+  }
+  for (std::size_t i = nb_values / 2; i < nb_values * 3 / 4; i++) {
+    map.erase(map.find(utils::get_key<char_tt>(i) + suffix));
+  }
+  BOOST_CHECK(map.load_bytes() < load_bytes / 2);
+
+  map.erase_if([](const char_tt*, std::size_t, const value_tt&) {
+    return true;
+  });
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK_EQUAL(map.load_bytes(), 0.0f);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char_tt>(i) + suffix,
+               utils::get_value<value_tt>(i));
+  }
+  BOOST_CHECK_EQUAL(map.load_bytes(), load_bytes);
+
+  AMap map_move = std::move(map);
+  BOOST_CHECK_EQUAL(map_move.load_bytes(), load_bytes);
+  BOOST_CHECK_EQUAL(map.load_bytes(), 0.0f);
+
+  map_move.clear();
+  BOOST_CHECK_EQUAL(map_move.load_bytes(), 0.0f);
+
+  map_move.max_load_bytes(0);
+  BOOST_CHECK_EQUAL(map_move.max_load_bytes(), 0);
+}
+
 /**
  * operator== and operator!=
  */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_rehash_multiple_threads, AMap, test_types) {
+  // Rehash two identical maps, one with a single thread and one with multiple
+  // threads, and check that the resulting maps are identical, iteration order
+  // included.
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 5000;
+  for (std::size_t nb_threads : {2, 3, 8}) {
+    AMap map = utils::get_filled_hash_map<AMap>(nb_values);
+    AMap map_threads = utils::get_filled_hash_map<AMap>(nb_values);
+    for (std::size_t i = 0; i < nb_values; i += 3) {
+      map.erase(utils::get_key<char_tt>(i));
+      map_threads.erase(utils::get_key<char_tt>(i));
+    }
+
+    for (std::size_t bucket_count : {map.bucket_count() * 4, std::size_t(5)}) {
+      map.rehash(bucket_count);
+      map_threads.rehash(bucket_count, nb_threads);
+      BOOST_CHECK_EQUAL(map_threads.bucket_count(), map.bucket_count());
+      BOOST_CHECK_EQUAL(map_threads.size(), map.size());
+
+      auto it_threads = map_threads.cbegin();
+      for (auto it = map.cbegin(); it != map.cend(); ++it, ++it_threads) {
+        BOOST_REQUIRE(it_threads != map_threads.cend());
+        BOOST_CHECK(std::basic_string<char_tt>(it_threads.key(),
+                                               it_threads.key_size()) ==
+                    std::basic_string<char_tt>(it.key(), it.key_size()));
+        BOOST_CHECK(it_threads.value() == it.value());
+      }
+      BOOST_CHECK(it_threads == map_threads.cend());
+    }
+
+    map_threads.reserve(nb_values * 10, nb_threads);
+    for (std::size_t i = 0; i < nb_values; i++) {
+      BOOST_CHECK_EQUAL(map_threads.count(utils::get_key<char_tt>(i)),
+                        i % 3 == 0 ? 0 : 1);
+    }
+    map_threads.insert(utils::get_key<char_tt>(0),
+                       utils::get_value<value_tt>(0));
+    BOOST_CHECK(map_threads.at(utils::get_key<char_tt>(0)) ==
+                utils::get_value<value_tt>(0));
+  }
+}
+
+/**
+ * linear hashing
+ */
+using test_linear_hashing_types = boost::mpl::list<
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::linear_hashing_growth_policy>,
+    tsl::array_map<wchar_t, move_only_test, tsl::ah::str_hash<wchar_t>,
+                   tsl::ah::str_equal<wchar_t>, false, std::uint16_t,
+                   std::uint32_t, tsl::ah::linear_hashing_growth_policy, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<>, true>,
+    tsl::array_map<char16_t, move_only_test, tsl::ah::str_hash<char16_t>,
+                   tsl::ah::str_equal<char16_t>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::linear_hashing_growth_policy, false,
+                   tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, true>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_linear_hashing_growth, AMap,
+                              test_linear_hashing_types) {
+  // Insert values one by one, check that the bucket count only grows by a few
+  // buckets at a time and that all the values are still there. Then erase half
+  // of them, rehash and check again.
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 5000;
+  AMap map;
+  map.max_load_factor(0.5f);
+
+  std::size_t max_bucket_count_increase = 0;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const std::size_t bucket_count = map.bucket_count();
+    map.insert(utils::get_key<char_tt>(i), utils::get_value<value_tt>(i));
+
+    if (bucket_count > 0) {
+      max_bucket_count_increase = std::max(max_bucket_count_increase,
+                                           map.bucket_count() - bucket_count);
+    }
+    BOOST_CHECK(map.load_factor() <= map.max_load_factor());
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  BOOST_CHECK(max_bucket_count_increase > 0);
+  BOOST_CHECK(max_bucket_count_increase <= 2);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.at(utils::get_key<char_tt>(i)) ==
+                utils::get_value<value_tt>(i));
+  }
+
+  for (std::size_t i = 0; i < nb_values; i += 2) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<char_tt>(i)), 1);
+  }
+
+  map.rehash(7777);
+  BOOST_CHECK_EQUAL(map.bucket_count(), 7777);
+  map.max_load_factor(4.0f);
+  map.rehash(0);
+  BOOST_CHECK_EQUAL(map.bucket_count(), 625);
+
+  map.insert(utils::get_key<char_tt>(nb_values),
+             utils::get_value<value_tt>(nb_values));
+  for (std::size_t i = 0; i <= nb_values; i++) {
+    const std::size_t expected_count = (i % 2 != 0 || i == nb_values) ? 1 : 0;
+    BOOST_CHECK_EQUAL(map.count(utils::get_key<char_tt>(i)), expected_count);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_linear_hashing_growth_long_buckets) {
+  // With a high max_load_factor, the split buckets hold more hashes than
+  // split_bucket keeps on the stack.
+  using linear_hashing_map =
+      tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                     tsl::ah::str_equal<char>, true, std::uint16_t,
+                     std::uint32_t, tsl::ah::linear_hashing_growth_policy>;
+
+  const std::size_t nb_values = 20000;
+  linear_hashing_map map;
+  map.max_load_factor(100.0f);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char>(i), utils::get_value<int64_t>(i));
+  }
+  BOOST_CHECK(map.bucket_count() > 100);
+  BOOST_CHECK(map.load_factor() > 32.0f);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(map.at(utils::get_key<char>(i)),
+                      utils::get_value<int64_t>(i));
+  }
+}
+
 BOOST_AUTO_TEST_CASE(test_compare) {
   const tsl::array_map<char, std::int64_t> map1 = {
       {"aa", 1}, {"ee", 5}, {"dd", 4}, {"cc", 3}, {"bb", 2}};
@@ -553,6 +1169,99 @@ BOOST_AUTO_TEST_CASE(test_shrink_to_fit) {
   BOOST_CHECK(map == map2);
 }
 
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_memory_usage, AMap, test_types) {
+  // insert x values, erase x/5 values, shrink_to_fit; check the memory usage
+  // after each step
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  AMap map;
+  tsl::ah::memory_usage usage = map.memory_usage();
+  BOOST_CHECK_EQUAL(usage.nb_bucket_buffers, 0);
+  BOOST_CHECK_EQUAL(usage.bucket_buffers_bytes, 0);
+  BOOST_CHECK_EQUAL(usage.live_value_bytes, 0);
+
+  map = utils::get_filled_hash_map<AMap>(nb_values);
+  const auto check_usage = [&](std::size_t nb_dead_values) {
+    usage = map.memory_usage();
+
+    std::size_t key_bytes = 0;
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+      key_bytes += it.key_size() * sizeof(char_tt);
+    }
+
+    BOOST_CHECK_EQUAL(usage.key_bytes, key_bytes);
+    BOOST_CHECK_EQUAL(usage.inline_value_bytes, 0);
+    BOOST_CHECK_EQUAL(usage.bucket_buffers_bytes,
+                      usage.key_bytes + usage.metadata_bytes +
+                          usage.unused_bucket_bytes);
+    BOOST_CHECK(usage.metadata_bytes > 0);
+    BOOST_CHECK(usage.nb_bucket_buffers > 0);
+    BOOST_CHECK(usage.nb_bucket_buffers <= map.bucket_count());
+    BOOST_CHECK(usage.bucket_array_bytes >= map.bucket_count());
+    BOOST_CHECK_EQUAL(usage.live_value_bytes, map.size() * sizeof(value_tt));
+    BOOST_CHECK_EQUAL(usage.dead_value_bytes,
+                      nb_dead_values * sizeof(value_tt));
+    BOOST_CHECK(usage.total_bytes() > usage.bucket_buffers_bytes +
+                                          usage.live_value_bytes);
+  };
+  check_usage(0);
+
+  for (std::size_t i = 0; i < nb_values / 5; i++) {
+    map.erase(utils::get_key<char_tt>(i));
+  }
+  check_usage(nb_values / 5);
+
+  map.shrink_to_fit();
+  check_usage(0);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_bucket_stats, AMap, test_types) {
+  // insert x values; check that the histograms cover all the buckets and
+  // elements
+  const std::size_t nb_values = 1000;
+  AMap map;
+  tsl::ah::bucket_stats stats = map.bucket_stats();
+  BOOST_CHECK_EQUAL(stats.bucket_count, map.bucket_count());
+  BOOST_CHECK_EQUAL(stats.nb_empty_buckets, map.bucket_count());
+  BOOST_CHECK_EQUAL(stats.max_bucket_entries, 0);
+
+  map = utils::get_filled_hash_map<AMap>(nb_values);
+  stats = map.bucket_stats();
+
+  std::size_t nb_buckets = 0;
+  std::size_t nb_elements = 0;
+  for (std::size_t i = 0; i < stats.entries_histogram.size(); i++) {
+    nb_buckets += stats.entries_histogram[i];
+    nb_elements += i * stats.entries_histogram[i];
+  }
+  BOOST_CHECK_EQUAL(nb_buckets, map.bucket_count());
+  BOOST_CHECK_EQUAL(nb_elements, map.size());
+  BOOST_CHECK_EQUAL(stats.entries_histogram.size(),
+                    stats.max_bucket_entries + 1);
+  BOOST_CHECK(stats.entries_histogram.back() > 0);
+
+  BOOST_CHECK_EQUAL(stats.nb_empty_buckets, stats.entries_histogram[0]);
+  BOOST_CHECK_EQUAL(stats.empty_buckets_fraction,
+                    float(stats.nb_empty_buckets) / float(map.bucket_count()));
+
+  for (const auto& histogram :
+       {stats.bytes_histogram, stats.cache_lines_histogram}) {
+    std::size_t nb_histogram_buckets = 0;
+    for (std::size_t count : histogram) {
+      nb_histogram_buckets += count;
+    }
+
+    BOOST_CHECK_EQUAL(nb_histogram_buckets, map.bucket_count());
+    BOOST_CHECK_EQUAL(histogram[0], stats.nb_empty_buckets);
+  }
+  BOOST_CHECK(stats.max_bucket_bytes >=
+              std::size_t(1) << (stats.bytes_histogram.size() - 2));
+  BOOST_CHECK(stats.max_bucket_bytes <
+              std::size_t(1) << (stats.bytes_histogram.size() - 1));
+}
+
 /**
  * operator=(std::initializer_list)
  */
@@ -857,6 +1566,102 @@ BOOST_AUTO_TEST_CASE(test_ci_traits) {
   BOOST_CHECK_EQUAL(map.at("tEst5"), 50);
 }
 
+/**
+ * str_equal
+ */
+using str_equal_char_types = boost::mpl::list<char, char16_t, char32_t>;
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_str_equal, CharT, str_equal_char_types) {
+  // Compare keys of each size with an equal copy of themselves and with a copy
+  // differing by one character at each position, in separate buffers so that
+  // the unaligned loads don't read the same memory.
+  const tsl::ah::str_equal<CharT> equal;
+  for (std::size_t size = 0; size <= 70; size++) {
+    std::basic_string<CharT> lhs;
+    for (std::size_t i = 0; i < size; i++) {
+      lhs.push_back(CharT('a' + i % 26));
+    }
+    const std::basic_string<CharT> rhs =
+        std::basic_string<CharT>(1, CharT('#')) + lhs;
+
+    BOOST_CHECK(equal(lhs.data(), lhs.size(), rhs.data() + 1, size));
+    if (size > 0) {
+      BOOST_CHECK(!equal(lhs.data(), size, rhs.data() + 1, size - 1));
+    }
+
+    for (std::size_t i = 0; i < size; i++) {
+      std::basic_string<CharT> different = rhs;
+      different[i + 1] = CharT(different[i + 1] ^ 0x40);
+      BOOST_CHECK(!equal(lhs.data(), size, different.data() + 1, size));
+    }
+  }
+}
+
+/**
+ * fast_str_hash
+ */
+BOOST_AUTO_TEST_CASE(test_fast_str_hash) {
+  // Hash all the prefixes of a key, check that they are all different, that
+  // flipping any bit changes the hash and that the seed changes the hash.
+  std::string key;
+  for (std::size_t i = 0; i < 200; i++) {
+    key.push_back(char('a' + (i * 7) % 26));
+  }
+
+  const tsl::ah::fast_str_hash<char> hash;
+  std::set<std::size_t> hashes;
+  for (std::size_t size = 0; size <= key.size(); size++) {
+    BOOST_CHECK(hashes.insert(hash(key.data(), size)).second);
+    BOOST_CHECK_EQUAL(hash(key.data(), size),
+                      tsl::ah::fast_str_hash<char>()(key.data(), size));
+  }
+
+  for (std::size_t size : {1, 3, 8, 15, 16, 17, 48, 49, 100}) {
+    const std::size_t key_hash = hash(key.data(), size);
+    std::size_t nb_changed_bits = 0;
+    for (std::size_t ibit = 0; ibit < size * CHAR_BIT; ibit++) {
+      std::string flipped = key.substr(0, size);
+      flipped[ibit / CHAR_BIT] ^= char(1 << (ibit % CHAR_BIT));
+
+      const std::size_t diff = key_hash ^ hash(flipped.data(), size);
+      BOOST_CHECK(diff != 0);
+      for (std::size_t d = diff; d != 0; d &= d - 1) {
+        nb_changed_bits++;
+      }
+    }
+
+    // On average, half of the bits of the hash should change.
+    const double avg_changed_bits =
+        double(nb_changed_bits) / double(size * CHAR_BIT);
+    BOOST_CHECK_GT(avg_changed_bits, sizeof(std::size_t) * CHAR_BIT * 0.4);
+    BOOST_CHECK_LT(avg_changed_bits, sizeof(std::size_t) * CHAR_BIT * 0.6);
+  }
+
+  const tsl::ah::fast_str_hash<char> seeded_hash(42);
+  BOOST_CHECK_NE(hash(key.data(), 10), seeded_hash(key.data(), 10));
+  BOOST_CHECK_EQUAL(seeded_hash(key.data(), 10),
+                    tsl::ah::fast_str_hash<char>(42)(key.data(), 10));
+}
+
+BOOST_AUTO_TEST_CASE(test_fast_str_hash_map) {
+  using HMap = tsl::array_map<char16_t, int64_t,
+                              tsl::ah::fast_str_hash<char16_t>>;
+
+  const std::size_t nb_values = 10000;
+  HMap map(0, tsl::ah::fast_str_hash<char16_t>(0x1234));
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.insert(utils::get_key<char16_t>(i),
+                           utils::get_value<int64_t>(i))
+                    .second);
+  }
+
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(map.at(utils::get_key<char16_t>(i)),
+                      utils::get_value<int64_t>(i));
+  }
+  BOOST_CHECK(map.find(utils::get_key<char16_t>(nb_values)) == map.end());
+}
+
 /**
  * serialize and deserialize
  */
@@ -902,6 +1707,7 @@ BOOST_AUTO_TEST_CASE(test_serialize_deserialize) {
   deserializer dserial(serial.str());
   auto map_deserialized = decltype(map)::deserialize(dserial, true);
   BOOST_CHECK(map == map_deserialized);
+  BOOST_CHECK_EQUAL(map_deserialized.load_bytes(), map.load_bytes());
 
   deserializer dserial2(serial.str());
   map_deserialized = decltype(map)::deserialize(dserial2, false);
@@ -948,6 +1754,629 @@ BOOST_AUTO_TEST_CASE(test_serialize_deserialize_with_different_hash) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_hash_tags) {
+  // insert x values; serialize map with hash tags; deserialize it in a map
+  // with hash tags and in a map without; check equal.
+  using hash_tags_map =
+      tsl::array_map<char32_t, move_only_test, tsl::ah::str_hash<char32_t>,
+                     tsl::ah::str_equal<char32_t>, true, std::uint16_t,
+                     std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                     true>;
+
+  const std::size_t nb_values = 1000;
+
+  hash_tags_map map(0);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char32_t>(i),
+               utils::get_value<move_only_test>(i));
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  auto map_deserialized = hash_tags_map::deserialize(dserial, true);
+  BOOST_CHECK(map == map_deserialized);
+
+  deserializer dserial2(serial.str());
+  map_deserialized = hash_tags_map::deserialize(dserial2, false);
+  BOOST_CHECK(map == map_deserialized);
+
+  deserializer dserial3(serial.str());
+  auto map_no_tags_deserialized =
+      tsl::array_map<char32_t, move_only_test>::deserialize(dserial3, true);
+  BOOST_CHECK_EQUAL(map_no_tags_deserialized.size(), nb_values);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(
+        map_no_tags_deserialized.at(utils::get_key<char32_t>(i)),
+        utils::get_value<move_only_test>(i));
+  }
+}
+
+/**
+ * Hash keeping only half of the bits of the hash of a key, in the highest
+ * half, and key equality counting its calls.
+ */
+struct high_half_hash {
+  std::size_t operator()(const char32_t* key, std::size_t key_size) const {
+    const std::size_t half = sizeof(std::size_t) * CHAR_BIT / 2;
+    return (tsl::ah::str_hash<char32_t>()(key, key_size) << half) | 0x5A5A;
+  }
+};
+
+struct counting_str_equal {
+  bool operator()(const char32_t* key_lhs, std::size_t key_size_lhs,
+                  const char32_t* key_rhs, std::size_t key_size_rhs) const {
+    nb_calls++;
+    return tsl::ah::str_equal<char32_t>()(key_lhs, key_size_lhs, key_rhs,
+                                      key_size_rhs);
+  }
+
+  static std::size_t nb_calls;
+};
+
+std::size_t counting_str_equal::nb_calls = 0;
+
+BOOST_AUTO_TEST_CASE(test_hash_tags_large_mask) {
+  // All the keys share the lowest half of their hash, as the keys of a bucket
+  // do in a table with a mask as wide as the stored truncated hash. The tags
+  // must still filter the keys of the bucket, also after a rehash from the
+  // stored hashes and after a deserialization.
+  using large_mask_map =
+      tsl::array_map<char32_t, move_only_test, high_half_hash,
+                     counting_str_equal, true, std::uint16_t, std::uint32_t,
+                     tsl::ah::power_of_two_growth_policy<2>, true,
+                     tsl::ah::exact_bucket_growth_policy,
+                     tsl::ah::malloc_bucket_storage, true>;
+
+  const std::size_t nb_values = 2000;
+  const auto check_filtered_misses = [&](const large_mask_map& map) {
+    counting_str_equal::nb_calls = 0;
+    for (std::size_t i = nb_values; i < nb_values * 2; i++) {
+      BOOST_CHECK(map.find(utils::get_key<char32_t>(i)) == map.end());
+    }
+    // Without any filtering, each miss would compare all the keys.
+    BOOST_CHECK(counting_str_equal::nb_calls < nb_values * nb_values / 16);
+
+    for (std::size_t i = 0; i < nb_values; i++) {
+      BOOST_CHECK_EQUAL(map.at(utils::get_key<char32_t>(i)),
+                        utils::get_value<move_only_test>(i));
+    }
+  };
+
+  large_mask_map map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char32_t>(i),
+               utils::get_value<move_only_test>(i));
+  }
+  check_filtered_misses(map);
+
+  map.rehash(map.bucket_count() * 4);
+  check_filtered_misses(map);
+
+  serializer serial;
+  map.serialize(serial);
+  deserializer dserial(serial.str());
+  check_filtered_misses(large_mask_map::deserialize(dserial, true));
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_store_hash) {
+  // insert x values; serialize map with stored hashes; deserialize it with and
+  // without hash_compatible; check equal and that the stored hashes are still
+  // usable on rehash.
+  using store_hash_map =
+      tsl::array_map<char32_t, move_only_test, tsl::ah::str_hash<char32_t>,
+                     tsl::ah::str_equal<char32_t>, true, std::uint16_t,
+                     std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                     true, tsl::ah::exact_bucket_growth_policy,
+                     tsl::ah::malloc_bucket_storage, true>;
+
+  const std::size_t nb_values = 1000;
+
+  store_hash_map map(0);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char32_t>(i),
+               utils::get_value<move_only_test>(i));
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  auto map_deserialized = store_hash_map::deserialize(dserial, true);
+  BOOST_CHECK(map == map_deserialized);
+
+  deserializer dserial2(serial.str());
+  map_deserialized = store_hash_map::deserialize(dserial2, false);
+  BOOST_CHECK(map == map_deserialized);
+
+  map_deserialized.rehash(map_deserialized.bucket_count() * 8);
+  BOOST_CHECK(map == map_deserialized);
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_rehashed) {
+  // insert x values; serialize map; deserialize it in a map with another
+  // growth policy, with and without multiple threads and duplicate checks;
+  // check equal.
+  using prime_map =
+      tsl::array_map<char32_t, move_only_test, tsl::ah::str_hash<char32_t>,
+                     tsl::ah::str_equal<char32_t>, true, std::uint16_t,
+                     std::uint32_t, tsl::ah::prime_growth_policy, true>;
+
+  const std::size_t nb_values = 1000;
+
+  tsl::array_map<char32_t, move_only_test> map(0);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char32_t>(i),
+               utils::get_value<move_only_test>(i));
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  for (std::size_t nb_threads : {1, 4}) {
+    for (bool check_duplicate_keys : {true, false}) {
+      deserializer dserial(serial.str());
+      const auto map_deserialized = prime_map::deserialize(
+          dserial, false, nb_threads, check_duplicate_keys);
+      BOOST_CHECK_NE(map_deserialized.bucket_count(), map.bucket_count());
+      BOOST_CHECK_EQUAL(map_deserialized.size(), nb_values);
+      for (std::size_t i = 0; i < nb_values; i++) {
+        BOOST_CHECK_EQUAL(map_deserialized.at(utils::get_key<char32_t>(i)),
+                          utils::get_value<move_only_test>(i));
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_deserialize_duplicate_keys) {
+  // serialize a map with one key and duplicate its buckets in the serialized
+  // data; check that the duplicate is detected unless check_duplicate_keys is
+  // false.
+  tsl::array_map<char32_t, move_only_test> map;
+  map.insert(U"key", utils::get_value<move_only_test>(1));
+
+  serializer serial;
+  map.serialize(serial);
+  const std::string serialized = serial.str();
+
+  // version, bucket_count, nb_elements and max_load_factor
+  const std::size_t header_size = 3 * sizeof(std::uint64_t) + sizeof(float);
+  const std::string buckets = serialized.substr(header_size);
+
+  serializer serial_duplicate;
+  serial_duplicate(std::uint64_t(1));
+  serial_duplicate(std::uint64_t(map.bucket_count() * 2));
+  serial_duplicate(std::uint64_t(2));
+  serial_duplicate(map.max_load_factor());
+  const std::string serialized_duplicate =
+      serial_duplicate.str() + buckets + buckets;
+
+  deserializer dserial(serialized_duplicate);
+  BOOST_CHECK_THROW(decltype(map)::deserialize(dserial), std::runtime_error);
+
+  deserializer dserial2(serialized_duplicate);
+  const auto map_deserialized =
+      decltype(map)::deserialize(dserial2, false, 1, false);
+  BOOST_CHECK_EQUAL(map_deserialized.at(U"key"),
+                    utils::get_value<move_only_test>(1));
+}
+
+/**
+ * InlineValues
+ */
+using inline_values_test_types = boost::mpl::list<
+    tsl::array_map<char, std::uint32_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                   false, tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, false, true>,
+    tsl::array_map<char, std::int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, false, std::uint8_t,
+                   std::uint32_t, tsl::ah::prime_growth_policy, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<>, true, true>,
+    tsl::array_map<char16_t, std::uint8_t, tsl::ah::str_hash<char16_t>,
+                   tsl::ah::str_equal<char16_t>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::linear_hashing_growth_policy,
+                   false, tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, true, true>,
+    tsl::array_map<char32_t, std::uint64_t, tsl::ah::str_hash<char32_t>,
+                   tsl::ah::str_equal<char32_t>, false, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                   true, tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, false, true>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_inline_values, AMap,
+                              inline_values_test_types) {
+  // Insert x values, check them and that they are aligned, modify them through
+  // references, erase half of them, rehash and copy the map.
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  AMap map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.insert(utils::get_key<char_tt>(i),
+                           utils::get_value<value_tt>(i))
+                    .second);
+  }
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    auto it = map.find(utils::get_key<char_tt>(i));
+    BOOST_REQUIRE(it != map.end());
+    BOOST_CHECK(it.value() == utils::get_value<value_tt>(i));
+    BOOST_CHECK_EQUAL(
+        reinterpret_cast<std::uintptr_t>(&it.value()) % alignof(value_tt), 0);
+  }
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.at(utils::get_key<char_tt>(i)) = utils::get_value<value_tt>(i + 1);
+    BOOST_CHECK(map[utils::get_key<char_tt>(i + nb_values)] == value_tt());
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values * 2);
+
+  for (std::size_t i = 0; i < nb_values * 2; i += 2) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<char_tt>(i)), 1);
+  }
+  map.rehash(map.bucket_count() * 4);
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+
+  for (std::size_t i = 1; i < nb_values * 2; i += 2) {
+    const value_tt expected =
+        (i < nb_values) ? utils::get_value<value_tt>(i + 1) : value_tt();
+    BOOST_CHECK(map.at(utils::get_key<char_tt>(i)) == expected);
+  }
+
+  const AMap map_copy = map;
+  BOOST_CHECK(map_copy == map);
+  map.shrink_to_fit();
+  BOOST_CHECK(map_copy == map);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_memory_usage_inline_values, AMap,
+                              inline_values_test_types) {
+  // insert x values; check that the values are counted in the buckets
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  const AMap map = utils::get_filled_hash_map<AMap>(nb_values);
+  const tsl::ah::memory_usage usage = map.memory_usage();
+
+  BOOST_CHECK(usage.inline_value_bytes >= nb_values * sizeof(value_tt));
+  BOOST_CHECK_EQUAL(usage.bucket_buffers_bytes,
+                    usage.key_bytes + usage.inline_value_bytes +
+                        usage.metadata_bytes + usage.unused_bucket_bytes);
+  BOOST_CHECK_EQUAL(usage.live_value_bytes, 0);
+  BOOST_CHECK_EQUAL(usage.dead_value_bytes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_inline_values) {
+  // insert x values; serialize map with inline values; deserialize it with and
+  // without hash_compatible; check equal.
+  using inline_values_map =
+      tsl::array_map<char32_t, std::uint32_t, tsl::ah::str_hash<char32_t>,
+                     tsl::ah::str_equal<char32_t>, true, std::uint16_t,
+                     std::uint32_t, tsl::ah::power_of_two_growth_policy<2>,
+                     true, tsl::ah::exact_bucket_growth_policy,
+                     tsl::ah::malloc_bucket_storage, false, true>;
+
+  const std::size_t nb_values = 1000;
+
+  inline_values_map map(0);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char32_t>(i),
+               utils::get_value<std::uint32_t>(i));
+  }
+
+  serializer serial;
+  map.serialize(serial);
+
+  deserializer dserial(serial.str());
+  auto map_deserialized = inline_values_map::deserialize(dserial, true);
+  BOOST_CHECK(map == map_deserialized);
+
+  deserializer dserial2(serial.str());
+  map_deserialized = inline_values_map::deserialize(dserial2, false);
+  BOOST_CHECK(map == map_deserialized);
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c) {
+  // check the CRC32C of the standard test vector, in one or more calls, and
+  // compare the implementation used with the table-based one.
+  const char* check = "123456789";
+  BOOST_CHECK_EQUAL(tsl::detail_array_hash::crc32c(0, check, 9), 0xE3069283);
+  BOOST_CHECK_EQUAL(tsl::detail_array_hash::crc32c(
+                        tsl::detail_array_hash::crc32c(0, check, 4),
+                        check + 4, 5),
+                    0xE3069283);
+  BOOST_CHECK_EQUAL(tsl::detail_array_hash::crc32c(0, check, 0), 0);
+
+  std::vector<unsigned char> data(100);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<unsigned char>(i * 31 + 7);
+  }
+  for (std::size_t offset = 0; offset < 8; offset++) {
+    for (std::size_t size = 0; size + offset <= data.size(); size += 13) {
+      BOOST_CHECK_EQUAL(tsl::detail_array_hash::crc32c(0, data.data() + offset,
+                                                       size),
+                        tsl::detail_array_hash::crc32c_software(
+                            0, data.data() + offset, size));
+    }
+  }
+}
+
+/**
+ * Writer and reader of the chunked serialization in a std::string.
+ */
+struct chunked_writer {
+  void operator()(const char* data, std::size_t size) {
+    buffer.append(data, size);
+  }
+
+  std::string buffer;
+};
+
+struct chunked_reader {
+  explicit chunked_reader(const std::string& buffer) : buffer(buffer) {}
+
+  void operator()(std::uint64_t offset, char* data, std::size_t size) const {
+    if (offset > buffer.size() || size > buffer.size() - offset) {
+      throw std::out_of_range("Read past the end of the buffer.");
+    }
+
+    std::memcpy(data, buffer.data() + offset, size);
+  }
+
+  const std::string& buffer;
+};
+
+/**
+ * Value codec of the chunked serialization for std::string values.
+ */
+struct string_value_serializer {
+  template <class U, class Writer>
+  void operator()(const U& value, Writer& writer) const {
+    const std::uint64_t size = value.size();
+    writer(reinterpret_cast<const char*>(&size), sizeof(size));
+    writer(value.data(), value.size());
+  }
+};
+
+struct string_value_deserializer {
+  template <class U, class Reader>
+  U operator()(Reader& reader) const {
+    std::uint64_t size;
+    reader(reinterpret_cast<char*>(&size), sizeof(size));
+
+    U value(static_cast<std::size_t>(size), '\0');
+    reader(&value[0], value.size());
+
+    return value;
+  }
+};
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_chunked) {
+  // insert x values; serialize map in small chunks; verify and deserialize it
+  // with one and multiple threads; check equal.
+  const std::size_t nb_values = 10000;
+
+  tsl::array_map<char, std::int64_t> map(0);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char>(i), utils::get_value<std::int64_t>(i));
+  }
+
+  chunked_writer writer;
+  map.serialize_chunked(writer, 1024);
+  chunked_reader reader(writer.buffer);
+
+  for (std::size_t nb_threads : {1, 4}) {
+    decltype(map)::verify_chunked(reader, writer.buffer.size(), nb_threads);
+
+    const auto map_deserialized = decltype(map)::deserialize_chunked(
+        reader, writer.buffer.size(), nb_threads);
+    BOOST_CHECK(map == map_deserialized);
+  }
+
+  tsl::array_map<char, std::int64_t> empty_map;
+  chunked_writer empty_writer;
+  empty_map.serialize_chunked(empty_writer);
+  chunked_reader empty_reader(empty_writer.buffer);
+
+  const auto empty_map_deserialized = decltype(empty_map)::deserialize_chunked(
+      empty_reader, empty_writer.buffer.size());
+  BOOST_CHECK(empty_map_deserialized.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_chunked_value_codec) {
+  // insert x values and an empty key; serialize map with a custom value codec;
+  // deserialize it; check equal.
+  const std::size_t nb_values = 1000;
+
+  tsl::array_map<char16_t, std::string> map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char16_t>(i), utils::get_value<std::string>(i));
+  }
+  map.insert(u"", "");
+
+  chunked_writer writer;
+  map.serialize_chunked(writer, 256, string_value_serializer());
+  chunked_reader reader(writer.buffer);
+
+  const auto map_deserialized = decltype(map)::deserialize_chunked(
+      reader, writer.buffer.size(), 2, tsl::ah::all_chunks(),
+      string_value_deserializer());
+  BOOST_CHECK(map == map_deserialized);
+}
+
+BOOST_AUTO_TEST_CASE(test_deserialize_chunked_subset) {
+  // insert x values; serialize map in small chunks; deserialize the even and
+  // odd chunks in two maps; check that each value is in exactly one of them.
+  const std::size_t nb_values = 5000;
+
+  tsl::array_map<char, std::int64_t> map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char>(i), utils::get_value<std::int64_t>(i));
+  }
+
+  chunked_writer writer;
+  map.serialize_chunked(writer, 512);
+  chunked_reader reader(writer.buffer);
+
+  std::size_t nb_chunks = 0;
+  const auto map_even = decltype(map)::deserialize_chunked(
+      reader, writer.buffer.size(), 2,
+      [&](std::size_t ichunk, std::size_t nb_chunks_serialized) {
+        nb_chunks = nb_chunks_serialized;
+        return ichunk % 2 == 0;
+      });
+  const auto map_odd = decltype(map)::deserialize_chunked(
+      reader, writer.buffer.size(), 2,
+      [](std::size_t ichunk, std::size_t /*nb_chunks_serialized*/) {
+        return ichunk % 2 == 1;
+      });
+
+  BOOST_CHECK_GT(nb_chunks, 2);
+  BOOST_CHECK_GT(map_even.size(), 0);
+  BOOST_CHECK_GT(map_odd.size(), 0);
+  BOOST_CHECK_EQUAL(map_even.size() + map_odd.size(), nb_values);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const std::string key = utils::get_key<char>(i);
+    BOOST_CHECK_EQUAL(map_even.count(key) + map_odd.count(key), 1);
+
+    const auto& map_key = (map_even.count(key) == 1) ? map_even : map_odd;
+    BOOST_CHECK_EQUAL(map_key.at(key), utils::get_value<std::int64_t>(i));
+  }
+}
+
+using chunked_test_types = boost::mpl::list<
+    tsl::array_map<char, std::int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<>, true>,
+    tsl::array_map<char16_t, std::uint32_t, tsl::ah::str_hash<char16_t>,
+                   tsl::ah::str_equal<char16_t>, false, std::uint16_t,
+                   std::uint32_t, tsl::ah::mod_growth_policy<>, true,
+                   tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, false, true>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_deserialize_chunked_bucket_options, AMap,
+                              chunked_test_types) {
+  // insert x values; serialize map in small chunks; deserialize it with one
+  // and multiple threads; check equal and that the map can still be modified
+  // until it's empty.
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 5000;
+
+  AMap map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    map.insert(utils::get_key<char_tt>(i), utils::get_value<value_tt>(i));
+  }
+
+  chunked_writer writer;
+  map.serialize_chunked(writer, 512);
+  chunked_reader reader(writer.buffer);
+
+  for (std::size_t nb_threads : {1, 3}) {
+    auto map_deserialized =
+        AMap::deserialize_chunked(reader, writer.buffer.size(), nb_threads);
+    BOOST_CHECK(map == map_deserialized);
+
+    for (std::size_t i = 0; i < nb_values; i++) {
+      BOOST_CHECK_EQUAL(map_deserialized.erase(utils::get_key<char_tt>(i)), 1);
+    }
+    BOOST_CHECK(map_deserialized.empty());
+    BOOST_CHECK_EQUAL(map_deserialized.load_bytes(), 0.0f);
+  }
+}
+
+/**
+ * Key comparison which can be made to consider all keys different.
+ */
+struct toggled_str_equal {
+  bool operator()(const char* key_lhs, std::size_t key_size_lhs,
+                  const char* key_rhs, std::size_t key_size_rhs) const {
+    return compare_keys &&
+           tsl::ah::str_equal<char>()(key_lhs, key_size_lhs, key_rhs,
+                                      key_size_rhs);
+  }
+
+  static bool compare_keys;
+};
+
+bool toggled_str_equal::compare_keys = true;
+
+BOOST_AUTO_TEST_CASE(test_deserialize_chunked_duplicate_keys) {
+  // insert the same keys twice while they all compare different; serialize
+  // map; check that deserialize_chunked throws once the keys compare equal.
+  using map_type = tsl::array_map<char, std::int64_t, tsl::ah::str_hash<char>,
+                                  toggled_str_equal>;
+
+  toggled_str_equal::compare_keys = false;
+  map_type map;
+  for (std::size_t i = 0; i < 1000; i++) {
+    map.insert(utils::get_key<char>(i % 500),
+               utils::get_value<std::int64_t>(i));
+  }
+  BOOST_CHECK_EQUAL(map.size(), 1000);
+  toggled_str_equal::compare_keys = true;
+
+  chunked_writer writer;
+  map.serialize_chunked(writer, 1024);
+  chunked_reader reader(writer.buffer);
+
+  for (std::size_t nb_threads : {1, 4}) {
+    BOOST_CHECK_THROW(
+        map_type::deserialize_chunked(reader, writer.buffer.size(), nb_threads),
+        std::runtime_error);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_deserialize_chunked_corrupted) {
+  // serialize map in chunks; corrupt a byte of a chunk, a byte of the index,
+  // truncate the serialization or replace it by zeros; check that
+  // verify_chunked and deserialize_chunked throw.
+  using map_type = tsl::array_map<char, std::int64_t>;
+
+  map_type map;
+  for (std::size_t i = 0; i < 1000; i++) {
+    map.insert(utils::get_key<char>(i), utils::get_value<std::int64_t>(i));
+  }
+
+  chunked_writer writer;
+  map.serialize_chunked(writer, 1024);
+  const std::string& serialized = writer.buffer;
+
+  std::string corrupted_chunk = serialized;
+  corrupted_chunk[serialized.size() / 2] ^= 1;
+
+  // The index is followed by a trailer of 7 std::uint64_t.
+  std::string corrupted_index = serialized;
+  corrupted_index[serialized.size() - 7 * sizeof(std::uint64_t) - 1] ^= 1;
+
+  const std::string truncated = serialized.substr(0, serialized.size() - 1);
+
+  // Not a chunked serialization.
+  const std::string not_chunked(serialized.size(), '\0');
+
+  const std::string* invalid_serializations[] = {
+      &corrupted_chunk, &corrupted_index, &truncated, &not_chunked};
+  for (const std::string* invalid : invalid_serializations) {
+    chunked_reader reader(*invalid);
+    for (std::size_t nb_threads : {1, 4}) {
+      BOOST_CHECK_THROW(
+          map_type::verify_chunked(reader, invalid->size(), nb_threads),
+          std::runtime_error);
+      BOOST_CHECK_THROW(
+          map_type::deserialize_chunked(reader, invalid->size(), nb_threads),
+          std::runtime_error);
+    }
+  }
+}
+
 /**
  * Various operations on empty map
  */
@@ -1064,4 +2493,30 @@ BOOST_AUTO_TEST_CASE(test_precalculated_hash) {
                     0);
 }
 
+BOOST_AUTO_TEST_CASE(test_find_batch_precalculated_hash) {
+  const tsl::array_map<char, int> map = {
+      {"k1", -1}, {"k2", -2}, {"k3", -3}, {"k4", -4}, {"k5", -5}};
+
+  const std::vector<const char*> keys = {"k3", "k6", "k1", "k3"};
+  const std::vector<std::size_t> hashes = {
+      map.hash_function()("k3", strlen("k3")),
+      map.hash_function()("k6", strlen("k6")),
+      map.hash_function()("k1", strlen("k1")),
+      map.hash_function()("k2", strlen("k2"))};
+
+  std::vector<tsl::array_map<char, int>::const_iterator> its(keys.size());
+  map.find_batch(keys.begin(), keys.end(), hashes.begin(), its.begin());
+
+  BOOST_REQUIRE(its[0] != map.end());
+  BOOST_CHECK_EQUAL(its[0].value(), -3);
+  BOOST_CHECK(its[1] == map.end());
+  BOOST_REQUIRE(its[2] != map.end());
+  BOOST_CHECK_EQUAL(its[2].value(), -1);
+  BOOST_CHECK(its[3] == map.end());
+
+  std::vector<std::size_t> counts(keys.size());
+  map.count_batch(keys.begin(), keys.end(), hashes.begin(), counts.begin());
+  BOOST_CHECK(counts == std::vector<std::size_t>({1, 0, 1, 0}));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,7 +25,13 @@
 
 #include <boost/mpl/list.hpp>
 #include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <string>
 #include <tuple>
+#include <vector>
 
 #include "utils.h"
 
@@ -45,7 +51,32 @@ using test_types = boost::mpl::list<
     tsl::array_pg_set<char16_t>,
     tsl::array_set<char16_t, tsl::ah::str_hash<char16_t>,
                    tsl::ah::str_equal<char16_t>, false, std::uint16_t,
-                   std::uint16_t, tsl::ah::mod_growth_policy<>>>;
+                   std::uint16_t, tsl::ah::mod_growth_policy<>>,
+    tsl::array_set<char, tsl::ah::str_hash<char>, tsl::ah::str_equal<char>,
+                   true, std::uint16_t, std::uint32_t,
+                   tsl::ah::power_of_two_growth_policy<2>, true>,
+    tsl::array_set<wchar_t, tsl::ah::str_hash<wchar_t>,
+                   tsl::ah::str_equal<wchar_t>, false, std::uint8_t,
+                   std::uint32_t, tsl::ah::prime_growth_policy, true>,
+    tsl::array_set<char16_t, tsl::ah::str_hash<char16_t>,
+                   tsl::ah::str_equal<char16_t>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::mod_growth_policy<>, false,
+                   tsl::ah::geometric_bucket_growth_policy<>>,
+    tsl::array_set<char, tsl::ah::str_hash<char>, tsl::ah::str_equal<char>,
+                   true, std::uint16_t, std::uint32_t,
+                   tsl::ah::power_of_two_growth_policy<2>, true,
+                   tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::arena_bucket_storage<>>,
+    tsl::array_set<char, tsl::ah::str_hash<char>, tsl::ah::str_equal<char>,
+                   true, std::uint16_t, std::uint32_t,
+                   tsl::ah::power_of_two_growth_policy<2>, false,
+                   tsl::ah::exact_bucket_growth_policy,
+                   tsl::ah::malloc_bucket_storage, true>,
+    tsl::array_set<char32_t, tsl::ah::str_hash<char32_t>,
+                   tsl::ah::str_equal<char32_t>, false, std::uint16_t,
+                   std::uint32_t, tsl::ah::prime_growth_policy, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<>, true>>;
 
 /**
  * insert
@@ -85,6 +116,60 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert, ASet, test_types) {
   }
 }
 
+/**
+ * count_batch
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_count_batch, ASet, test_types) {
+  // insert x values, count 2x keys in batch, check that the results are the
+  // same as with count and find
+  using char_tt = typename ASet::char_type;
+
+  const size_t nb_values = 1000;
+  ASet set;
+  for (size_t i = 0; i < nb_values; i++) {
+    set.insert(utils::get_key<char_tt>(i * 2));
+  }
+
+  std::vector<std::basic_string<char_tt>> keys;
+  for (size_t i = 0; i < nb_values * 2; i++) {
+    keys.push_back(utils::get_key<char_tt>(i));
+  }
+
+  std::vector<size_t> counts(keys.size());
+  BOOST_CHECK(set.count_batch(keys.begin(), keys.end(), counts.begin()) ==
+              counts.end());
+
+  std::vector<typename ASet::const_iterator> its(keys.size());
+  set.find_batch(keys.begin(), keys.end(), its.begin());
+
+  for (size_t i = 0; i < keys.size(); i++) {
+    BOOST_CHECK_EQUAL(counts[i], (i % 2 == 0) ? 1 : 0);
+    BOOST_CHECK(its[i] == set.find(keys[i]));
+  }
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_erase_if, ASet, test_types) {
+  // insert x values, erase_if the keys which end with an even digit, check
+  // the remaining keys
+  using char_tt = typename ASet::char_type;
+
+  const size_t nb_values = 1000;
+  ASet set;
+  for (size_t i = 0; i < nb_values; i++) {
+    set.insert(utils::get_key<char_tt>(i));
+  }
+
+  const auto ends_with_even_digit = [](const char_tt* key, size_t key_size) {
+    return (key[key_size - 1] - char_tt('0')) % 2 == 0;
+  };
+  BOOST_CHECK_EQUAL(set.erase_if(ends_with_even_digit), nb_values / 2);
+
+  BOOST_CHECK_EQUAL(set.size(), nb_values / 2);
+  for (size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(set.count(utils::get_key<char_tt>(i)), i % 2);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(test_insert_more_than_max_size) {
   tsl::array_set<char, tsl::ah::str_hash<char>, tsl::ah::str_equal<char>, true,
                  std::uint16_t, std::uint8_t>
@@ -178,4 +263,43 @@ BOOST_AUTO_TEST_CASE(test_serialize_deserialize) {
   BOOST_CHECK(set_deserialized == set);
 }
 
+BOOST_AUTO_TEST_CASE(test_bulk_load_input_iterator) {
+  // bulk load words with duplicates from a single-pass input iterator; check
+  // the keys.
+  std::istringstream words("one two three two one four");
+
+  tsl::array_set<char> set = {"five"};
+  set.bulk_load(std::istream_iterator<std::string>(words),
+                std::istream_iterator<std::string>());
+
+  BOOST_CHECK(set == (tsl::array_set<char>{"one", "two", "three", "four"}));
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_deserialize_chunked) {
+  // insert x values; serialize set in small chunks; verify and deserialize it
+  // with multiple threads; check equal.
+  const std::size_t nb_values = 1000;
+
+  tsl::array_set<char32_t> set;
+  set.insert(U"");
+  for (std::size_t i = 1; i < nb_values; i++) {
+    set.insert(utils::get_key<char32_t>(i));
+  }
+
+  std::string serialized;
+  const auto writer = [&](const char* data, std::size_t size) {
+    serialized.append(data, size);
+  };
+  set.serialize_chunked(writer, 512);
+
+  const auto reader = [&](std::uint64_t offset, char* data, std::size_t size) {
+    std::memcpy(data, serialized.data() + offset, size);
+  };
+  decltype(set)::verify_chunked(reader, serialized.size(), 4);
+
+  const auto set_deserialized =
+      decltype(set)::deserialize_chunked(reader, serialized.size(), 4);
+  BOOST_CHECK(set_deserialized == set);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,205 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <tsl/frozen_array_map.h>
+
+#include <boost/mpl/list.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "utils.h"
+
+BOOST_AUTO_TEST_SUITE(test_frozen_array_map)
+
+using test_types = boost::mpl::list<
+    tsl::array_map<char, int64_t>, tsl::array_map<char, std::string>,
+    tsl::array_map<wchar_t, int64_t>, tsl::array_map<char16_t, std::string>,
+    tsl::array_map<char32_t, int64_t>,
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, false>,
+    tsl::array_pg_map<char16_t, int64_t>,
+    tsl::array_map<char32_t, std::string, tsl::ah::str_hash<char32_t>,
+                   tsl::ah::str_equal<char32_t>, false, std::uint8_t,
+                   std::uint16_t, tsl::ah::mod_growth_policy<>>,
+    tsl::array_map<char, int64_t, tsl::ah::str_hash<char>,
+                   tsl::ah::str_equal<char>, true, std::uint16_t,
+                   std::uint32_t, tsl::ah::power_of_two_growth_policy<2>, true,
+                   tsl::ah::geometric_bucket_growth_policy<>,
+                   tsl::ah::arena_bucket_storage<>>>;
+
+/**
+ * freeze
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_freeze, AMap, test_types) {
+  // insert x values in a map, freeze it and check that all the values can be
+  // found in the frozen map
+  using char_tt = typename AMap::char_type;
+  using value_tt = typename AMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  const AMap map = utils::get_filled_hash_map<AMap>(nb_values);
+
+  const auto frozen_map = tsl::freeze(map);
+  BOOST_CHECK_EQUAL(frozen_map.size(), nb_values);
+  BOOST_CHECK_EQUAL(frozen_map.bucket_count(), map.bucket_count());
+  BOOST_CHECK_EQUAL(std::distance(frozen_map.begin(), frozen_map.end()),
+                    nb_values);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const auto key = utils::get_key<char_tt>(i);
+    const auto it = frozen_map.find(key);
+
+    BOOST_REQUIRE(it != frozen_map.end());
+    BOOST_CHECK(frozen_map.key_eq()(it.key(), it.key_size(), key.c_str(),
+                                    key.size()));
+    BOOST_CHECK_EQUAL(it.value(), utils::get_value<value_tt>(i));
+    BOOST_CHECK_EQUAL(frozen_map.at(key), utils::get_value<value_tt>(i));
+    BOOST_CHECK_EQUAL(frozen_map.count(key), 1);
+  }
+
+  for (std::size_t i = nb_values; i < nb_values * 2; i++) {
+    const auto key = utils::get_key<char_tt>(i);
+
+    BOOST_CHECK(frozen_map.find(key) == frozen_map.end());
+    BOOST_CHECK_EQUAL(frozen_map.count(key), 0);
+    BOOST_CHECK_THROW(frozen_map.at(key), std::out_of_range);
+  }
+
+  for (auto it = frozen_map.begin(); it != frozen_map.end(); ++it) {
+    const auto it_map = map.find_ks(it.key(), it.key_size());
+
+    BOOST_REQUIRE(it_map != map.end());
+    BOOST_CHECK_EQUAL(it.value(), it_map.value());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_freeze_move) {
+  // freeze a map of move-only values
+  const std::size_t nb_values = 1000;
+  auto map = utils::get_filled_hash_map<tsl::array_map<char, move_only_test>>(
+      nb_values);
+
+  const auto frozen_map = tsl::freeze(std::move(map));
+  BOOST_CHECK_EQUAL(frozen_map.size(), nb_values);
+  BOOST_CHECK(map.empty());
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(frozen_map.at(utils::get_key<char>(i)),
+                      utils::get_value<move_only_test>(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_freeze_null_terminator) {
+  // the keys of the frozen map are null-terminated if StoreNullTerminator is
+  // true
+  const tsl::array_map<char, int> map = {{"k1", 1}, {"key2", 2}, {"", 3}};
+  const tsl::frozen_array_map<char, int> frozen_map(map);
+
+  for (auto it = frozen_map.begin(); it != frozen_map.end(); ++it) {
+    BOOST_CHECK_EQUAL(std::strlen(it.key()), it.key_size());
+    BOOST_CHECK_EQUAL(frozen_map.at_ks(it.key(), it.key_size()), *it);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_compare) {
+  const tsl::array_map<char, int> map = {
+      {"a", 1}, {"e", 5}, {"d", 4}, {"c", 3}, {"b", 2}};
+  const tsl::array_map<char, int> map2 = {
+      {"a", 1}, {"e", 5}, {"d", 4}, {"c", 3}, {"b", -2}};
+
+  BOOST_CHECK(tsl::freeze(map) == tsl::freeze(map));
+  BOOST_CHECK(tsl::freeze(map) != tsl::freeze(map2));
+  BOOST_CHECK(tsl::freeze(map) != tsl::freeze(tsl::array_map<char, int>()));
+}
+
+BOOST_AUTO_TEST_CASE(test_copy_and_swap) {
+  const tsl::array_map<char, int> map = {{"k1", 1}, {"k2", 2}};
+
+  auto frozen_map = tsl::freeze(map);
+  tsl::frozen_array_map<char, int> frozen_map_copy(frozen_map);
+  BOOST_CHECK(frozen_map_copy == frozen_map);
+
+  tsl::frozen_array_map<char, int> frozen_map_empty;
+  swap(frozen_map_copy, frozen_map_empty);
+  BOOST_CHECK(frozen_map_copy.empty());
+  BOOST_CHECK(frozen_map_empty == frozen_map);
+  BOOST_CHECK_EQUAL(frozen_map_empty.at("k2"), 2);
+
+  frozen_map_copy = std::move(frozen_map_empty);
+  BOOST_CHECK(frozen_map_copy == frozen_map);
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_map) {
+  const tsl::frozen_array_map<char, int> frozen_map =
+      tsl::freeze(tsl::array_map<char, int>(0));
+
+  BOOST_CHECK_EQUAL(frozen_map.bucket_count(), 0);
+  BOOST_CHECK_EQUAL(frozen_map.size(), 0);
+  BOOST_CHECK_EQUAL(frozen_map.load_factor(), 0);
+  BOOST_CHECK(frozen_map.empty());
+
+  BOOST_CHECK(frozen_map.begin() == frozen_map.end());
+  BOOST_CHECK(frozen_map.cbegin() == frozen_map.cend());
+
+  BOOST_CHECK(frozen_map.find("") == frozen_map.end());
+  BOOST_CHECK(frozen_map.find("test") == frozen_map.end());
+  BOOST_CHECK_EQUAL(frozen_map.count("test"), 0);
+  BOOST_CHECK_THROW(frozen_map.at("test"), std::out_of_range);
+
+  auto range = frozen_map.equal_range("test");
+  BOOST_CHECK(range.first == range.second);
+}
+
+BOOST_AUTO_TEST_CASE(test_precalculated_hash) {
+  const tsl::array_map<char, int> map = {
+      {"k1", -1}, {"k2", -2}, {"k3", -3}, {"k4", -4}, {"k5", -5}};
+  const auto frozen_map = tsl::freeze(map);
+
+  const std::size_t hash_k2 = map.hash_function()("k2", strlen("k2"));
+  const std::size_t hash_k3 = map.hash_function()("k3", strlen("k3"));
+  BOOST_REQUIRE_NE(hash_k2, hash_k3);
+
+  BOOST_REQUIRE(frozen_map.find("k3", hash_k3) != frozen_map.end());
+  BOOST_CHECK_EQUAL(frozen_map.find("k3", hash_k3).value(), -3);
+  BOOST_CHECK(frozen_map.find("k3", hash_k2) == frozen_map.end());
+
+  BOOST_CHECK_EQUAL(frozen_map.at("k3", hash_k3), -3);
+  BOOST_CHECK_THROW(frozen_map.at("k3", hash_k2), std::out_of_range);
+
+  BOOST_CHECK_EQUAL(frozen_map.count("k3", hash_k3), 1);
+  BOOST_CHECK_EQUAL(frozen_map.count("k3", hash_k2), 0);
+
+  auto it_range = frozen_map.equal_range("k3", hash_k3);
+  BOOST_REQUIRE_EQUAL(std::distance(it_range.first, it_range.second), 1);
+  BOOST_CHECK_EQUAL(it_range.first.value(), -3);
+
+  it_range = frozen_map.equal_range("k3", hash_k2);
+  BOOST_CHECK_EQUAL(std::distance(it_range.first, it_range.second), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,283 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <tsl/mapped_array_map.h>
+
+#include <boost/mpl/list.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef TSL_AH_HAS_MLOCK
+#include <sys/mman.h>
+#endif
+
+#include "utils.h"
+
+namespace {
+
+/**
+ * Image writer appending the bytes to a std::vector<char>.
+ */
+class vector_writer {
+ public:
+  explicit vector_writer(std::vector<char>& image) : m_image(image) {}
+
+  void operator()(const char* data, std::size_t size) {
+    m_image.insert(m_image.end(), data, data + size);
+  }
+
+ private:
+  std::vector<char>& m_image;
+};
+
+/**
+ * array_map with the same template parameters as the mapped_array_map MMap.
+ */
+template <class MMap>
+struct source_map;
+
+template <class CharT, class T, class Hash, class KeyEqual,
+          bool StoreNullTerminator, class KeySizeT, class IndexSizeT,
+          class GrowthPolicy>
+struct source_map<
+    tsl::mapped_array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator,
+                          KeySizeT, IndexSizeT, GrowthPolicy>> {
+  using type = tsl::array_map<CharT, T, Hash, KeyEqual, StoreNullTerminator,
+                              KeySizeT, IndexSizeT, GrowthPolicy>;
+};
+
+template <class MMap, class AMap>
+std::vector<char> get_image(const AMap& map) {
+  std::vector<char> image;
+  vector_writer writer(image);
+  MMap::write_image(tsl::freeze(map), writer);
+
+  return image;
+}
+
+}  // namespace
+
+BOOST_AUTO_TEST_SUITE(test_mapped_array_map)
+
+using test_types = boost::mpl::list<
+    tsl::mapped_array_map<char, std::int64_t>,
+    tsl::mapped_array_map<wchar_t, std::int64_t>,
+    tsl::mapped_array_map<char16_t, std::uint32_t>,
+    tsl::mapped_array_map<char32_t, std::uint8_t>,
+    tsl::mapped_array_map<char, std::uint16_t, tsl::ah::str_hash<char>,
+                          tsl::ah::str_equal<char>, false>,
+    tsl::mapped_array_map<char32_t, std::int64_t, tsl::ah::str_hash<char32_t>,
+                          tsl::ah::str_equal<char32_t>, false, std::uint8_t,
+                          std::uint16_t, tsl::ah::mod_growth_policy<>>,
+    tsl::mapped_array_map<char, std::uint64_t, tsl::ah::fast_str_hash<char>,
+                          tsl::ah::str_equal<char>, true, std::uint16_t,
+                          std::uint32_t, tsl::ah::prime_growth_policy>>;
+
+/**
+ * write_image
+ */
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_write_image, MMap, test_types) {
+  // insert x values in a map, write its image and check that all the values
+  // can be found in the mapped map
+  using char_tt = typename MMap::char_type;
+  using value_tt = typename MMap::mapped_type;
+  using AMap = typename source_map<MMap>::type;
+
+  const std::size_t nb_values = 1000;
+  const typename MMap::frozen_map_type frozen_map(
+      utils::get_filled_hash_map<AMap>(nb_values));
+
+  std::vector<char> image;
+  vector_writer writer(image);
+  MMap::write_image(frozen_map, writer);
+
+  const MMap map(image.data(), image.size());
+  BOOST_CHECK_EQUAL(map.image(), image.data());
+  BOOST_CHECK_EQUAL(map.image_size(), image.size());
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+  BOOST_CHECK_EQUAL(map.bucket_count(), frozen_map.bucket_count());
+  BOOST_CHECK_EQUAL(std::distance(map.begin(), map.end()), nb_values);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    const auto key = utils::get_key<char_tt>(i);
+    const auto it = map.find(key);
+
+    BOOST_REQUIRE(it != map.end());
+    BOOST_CHECK(map.key_eq()(it.key(), it.key_size(), key.c_str(),
+                             key.size()));
+    BOOST_CHECK(it.value() == utils::get_value<value_tt>(i));
+    BOOST_CHECK(map.at(key) == utils::get_value<value_tt>(i));
+    BOOST_CHECK(map.at(key, map.hash_function()(key.data(), key.size())) ==
+                utils::get_value<value_tt>(i));
+    BOOST_CHECK_EQUAL(map.count(key), 1);
+  }
+
+  for (std::size_t i = nb_values; i < nb_values * 2; i++) {
+    const auto key = utils::get_key<char_tt>(i);
+    BOOST_CHECK(map.find(key) == map.end());
+    BOOST_CHECK_EQUAL(map.count(key), 0);
+    BOOST_CHECK_THROW(map.at(key), std::out_of_range);
+  }
+
+  for (auto it = map.begin(); it != map.end(); ++it) {
+    const auto it_frozen = frozen_map.find_ks(it.key(), it.key_size());
+    BOOST_REQUIRE(it_frozen != frozen_map.end());
+    BOOST_CHECK(*it == *it_frozen);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_null_terminator) {
+  using MMap = tsl::mapped_array_map<char, std::int64_t>;
+
+  const std::vector<char> image =
+      get_image<MMap>(utils::get_filled_hash_map<tsl::array_map<char, int64_t>>(
+          100));
+  const MMap map(image.data(), image.size());
+  for (auto it = map.begin(); it != map.end(); ++it) {
+    BOOST_CHECK_EQUAL(it.key()[it.key_size()], '\0');
+    BOOST_CHECK_EQUAL(std::strlen(it.key()), it.key_size());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_map) {
+  using MMap = tsl::mapped_array_map<char, std::int64_t>;
+
+  tsl::array_map<char, std::int64_t> empty_map(0);
+  BOOST_CHECK_EQUAL(empty_map.bucket_count(), 0);
+
+  const std::vector<char> image = get_image<MMap>(empty_map);
+  const MMap map(image.data(), image.size());
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK_EQUAL(map.size(), 0);
+  BOOST_CHECK_EQUAL(map.bucket_count(), 0);
+  BOOST_CHECK(map.begin() == map.end());
+  BOOST_CHECK(map.find("") == map.end());
+  BOOST_CHECK(map.find("test") == map.end());
+  BOOST_CHECK_THROW(map.at("test"), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_image) {
+  using MMap = tsl::mapped_array_map<char, std::int64_t>;
+
+  const std::vector<char> image =
+      get_image<MMap>(utils::get_filled_hash_map<tsl::array_map<char, int64_t>>(
+          100));
+  BOOST_CHECK_NO_THROW(MMap(image.data(), image.size()));
+
+  // Truncated
+  BOOST_CHECK_THROW(MMap(image.data(), image.size() - 1), std::runtime_error);
+  BOOST_CHECK_THROW(MMap(image.data(), 8), std::runtime_error);
+
+  // Misaligned
+  std::vector<char> misaligned_image(image.size() + 1);
+  std::memcpy(misaligned_image.data() + 1, image.data(), image.size());
+  BOOST_CHECK_THROW(MMap(misaligned_image.data() + 1, image.size()),
+                    std::runtime_error);
+
+  // Invalid magic
+  std::vector<char> invalid_image = image;
+  invalid_image[0] = 'X';
+  BOOST_CHECK_THROW(MMap(invalid_image.data(), invalid_image.size()),
+                    std::runtime_error);
+
+  // Other types
+  using MMapU32 = tsl::mapped_array_map<char, std::uint32_t>;
+  using MMapChar16 = tsl::mapped_array_map<char16_t, std::int64_t>;
+  using MMapNoNullTerminator =
+      tsl::mapped_array_map<char, std::int64_t, tsl::ah::str_hash<char>,
+                            tsl::ah::str_equal<char>, false>;
+  BOOST_CHECK_THROW(MMapU32(image.data(), image.size()), std::runtime_error);
+  BOOST_CHECK_THROW(MMapChar16(image.data(), image.size()),
+                    std::runtime_error);
+  BOOST_CHECK_THROW(MMapNoNullTerminator(image.data(), image.size()),
+                    std::runtime_error);
+
+  // Other hash function
+  using MMapFastHash =
+      tsl::mapped_array_map<char, std::int64_t, tsl::ah::fast_str_hash<char>>;
+  const std::vector<char> fast_hash_image = get_image<MMapFastHash>(
+      tsl::array_map<char, std::int64_t, tsl::ah::fast_str_hash<char>>(
+          {{"a", 1}, {"b", 2}}));
+  BOOST_CHECK_NO_THROW(
+      MMapFastHash(fast_hash_image.data(), fast_hash_image.size()));
+  BOOST_CHECK_THROW(MMapFastHash(fast_hash_image.data(),
+                                 fast_hash_image.size(),
+                                 tsl::ah::fast_str_hash<char>(42)),
+                    std::runtime_error);
+
+  // Bucket count incompatible with the growth policy
+  using MMapPrime =
+      tsl::mapped_array_map<char, std::int64_t, tsl::ah::str_hash<char>,
+                            tsl::ah::str_equal<char>, true, std::uint16_t,
+                            std::uint32_t, tsl::ah::prime_growth_policy>;
+  BOOST_CHECK_THROW(MMapPrime(image.data(), image.size()), std::runtime_error);
+}
+
+#ifdef TSL_AH_HAS_MLOCK
+BOOST_AUTO_TEST_CASE(test_mmap_file) {
+  // Write the image to a file, mmap it and query it in place.
+  using MMap = tsl::mapped_array_map<char, std::int64_t>;
+
+  const std::size_t nb_values = 10000;
+  const std::vector<char> image = get_image<MMap>(
+      utils::get_filled_hash_map<tsl::array_map<char, int64_t>>(nb_values));
+
+  std::FILE* file = std::tmpfile();
+  BOOST_REQUIRE(file != nullptr);
+  BOOST_REQUIRE_EQUAL(std::fwrite(image.data(), 1, image.size(), file),
+                      image.size());
+  BOOST_REQUIRE_EQUAL(std::fflush(file), 0);
+
+  void* mapping =
+      mmap(nullptr, image.size(), PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  BOOST_REQUIRE(mapping != MAP_FAILED);
+
+  {
+    const MMap map(mapping, image.size());
+    map.prefault();
+    // May fail if RLIMIT_MEMLOCK is too low, the lookups must work anyway.
+    if (map.lock()) {
+      BOOST_CHECK(map.unlock());
+    }
+
+    BOOST_CHECK_EQUAL(map.size(), nb_values);
+    for (std::size_t i = 0; i < nb_values; i++) {
+      BOOST_CHECK_EQUAL(map.at(utils::get_key<char>(i)),
+                        utils::get_value<std::int64_t>(i));
+    }
+    BOOST_CHECK(map.find(utils::get_key<char>(nb_values)) == map.end());
+  }
+
+  BOOST_CHECK_EQUAL(munmap(mapping, image.size()), 0);
+  std::fclose(file);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,22 +21,32 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
+#include <tsl/array_bucket_storage.h>
 #include <tsl/array_growth_policy.h>
 
+#include <algorithm>
 #include <boost/mpl/list.hpp>
 #include <boost/test/unit_test.hpp>
 #include <cstddef>
+#include <cstring>
 #include <limits>
 #include <ratio>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 BOOST_AUTO_TEST_SUITE(test_policy)
 
 using test_types =
     boost::mpl::list<tsl::ah::power_of_two_growth_policy<2>,
                      tsl::ah::power_of_two_growth_policy<4>,
+                     tsl::ah::fibonacci_growth_policy<2>,
+                     tsl::ah::fibonacci_growth_policy<4>,
                      tsl::ah::prime_growth_policy, tsl::ah::mod_growth_policy<>,
-                     tsl::ah::mod_growth_policy<std::ratio<7, 2>>>;
+                     tsl::ah::mod_growth_policy<std::ratio<7, 2>>,
+                     tsl::ah::fastmod_growth_policy<>,
+                     tsl::ah::fastmod_growth_policy<std::ratio<7, 2>>,
+                     tsl::ah::linear_hashing_growth_policy>;
 
 BOOST_AUTO_TEST_CASE_TEMPLATE(test_policy, Policy, test_types) {
   // Call next_bucket_count() on the policy until we reach its
@@ -91,4 +101,246 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_policy_max_bucket_count, Policy,
   BOOST_CHECK_THROW((Policy(bucket_count)), std::length_error);
 }
 
+BOOST_AUTO_TEST_CASE(test_linear_hashing_growth_policy_split) {
+  // Split the buckets one by one and check that, on each split, the hashes
+  // either stay in their bucket or move to the new bucket.
+  const std::size_t nb_hashes = 5000;
+
+  std::size_t bucket_count = 1;
+  tsl::ah::linear_hashing_growth_policy policy(bucket_count);
+  BOOST_CHECK_EQUAL(bucket_count, 1);
+
+  std::vector<std::size_t> buckets(nb_hashes);
+  for (std::size_t hash = 0; hash < nb_hashes; hash++) {
+    buckets[hash] = policy.bucket_for_hash(hash * 2654435761u);
+    BOOST_CHECK_EQUAL(buckets[hash], 0);
+  }
+
+  for (; bucket_count < 1000; bucket_count++) {
+    const std::size_t isplit = policy.split_bucket();
+    BOOST_CHECK(isplit < bucket_count);
+
+    for (std::size_t hash = 0; hash < nb_hashes; hash++) {
+      const std::size_t ibucket = policy.bucket_for_hash(hash * 2654435761u);
+      BOOST_CHECK(ibucket <= bucket_count);
+
+      if (buckets[hash] == isplit) {
+        BOOST_CHECK(ibucket == isplit || ibucket == bucket_count);
+      } else {
+        BOOST_CHECK_EQUAL(ibucket, buckets[hash]);
+      }
+      buckets[hash] = ibucket;
+    }
+
+    // A policy created with the current bucket count must be in the same state.
+    std::size_t bucket_count_copy = bucket_count + 1;
+    tsl::ah::linear_hashing_growth_policy policy_copy(bucket_count_copy);
+    BOOST_CHECK_EQUAL(bucket_count_copy, bucket_count + 1);
+    for (std::size_t hash = 0; hash < nb_hashes; hash += 7) {
+      BOOST_CHECK_EQUAL(policy_copy.bucket_for_hash(hash * 2654435761u),
+                        buckets[hash]);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_fibonacci_growth_policy_weak_low_bits) {
+  // Hashes that only differ in their high bits all fall in the same bucket
+  // with a mask but are spread over the buckets with a multiply-shift.
+  const std::size_t nb_hashes = 1024;
+
+  std::size_t bucket_count = nb_hashes;
+  tsl::ah::power_of_two_growth_policy<2> mask_policy(bucket_count);
+  tsl::ah::fibonacci_growth_policy<2> fibonacci_policy(bucket_count);
+  BOOST_CHECK_EQUAL(bucket_count, nb_hashes);
+
+  std::vector<std::size_t> nb_hashes_per_bucket(bucket_count, 0);
+  for (std::size_t i = 0; i < nb_hashes; i++) {
+    const std::size_t hash = i << 16;
+    BOOST_CHECK_EQUAL(mask_policy.bucket_for_hash(hash), 0);
+
+    const std::size_t ibucket = fibonacci_policy.bucket_for_hash(hash);
+    BOOST_REQUIRE(ibucket < bucket_count);
+    nb_hashes_per_bucket[ibucket]++;
+  }
+
+  BOOST_CHECK(*std::max_element(nb_hashes_per_bucket.begin(),
+                                nb_hashes_per_bucket.end()) <= 4);
+
+  // A bucket count of one maps every hash to the only bucket.
+  bucket_count = 1;
+  tsl::ah::fibonacci_growth_policy<2> one_bucket_policy(bucket_count);
+  BOOST_CHECK_EQUAL(bucket_count, 1);
+  BOOST_CHECK_EQUAL(one_bucket_policy.bucket_for_hash(
+                        std::numeric_limits<std::size_t>::max()),
+                    0);
+}
+
+BOOST_AUTO_TEST_CASE(test_fastmod_growth_policy_same_buckets) {
+  // The policy must map each hash to the same bucket as the modulo operator,
+  // for growing bucket counts and for hashes up to the largest std::size_t.
+  std::vector<std::size_t> hashes = {
+      0, 1, 2, std::numeric_limits<std::size_t>::max(),
+      std::numeric_limits<std::size_t>::max() - 1};
+  std::size_t hash = 0;
+  for (std::size_t i = 0; i < 1000; i++) {
+    hash = hash * 6364136223846793005u + 1442695040888963407u;
+    hashes.push_back(hash);
+  }
+
+  std::size_t bucket_count = 0;
+  tsl::ah::fastmod_growth_policy<> policy(bucket_count);
+  BOOST_CHECK_EQUAL(policy.bucket_for_hash(hashes[3]), 0);
+
+  try {
+    while (true) {
+      bucket_count = policy.next_bucket_count();
+      policy = tsl::ah::fastmod_growth_policy<>(bucket_count);
+
+      for (const std::size_t h : hashes) {
+        BOOST_REQUIRE_EQUAL(policy.bucket_for_hash(h), h % bucket_count);
+        BOOST_REQUIRE_EQUAL(policy.bucket_for_hash(h + bucket_count),
+                            (h + bucket_count) % bucket_count);
+      }
+    }
+  } catch (const std::length_error&) {
+  }
+
+  policy.clear();
+  BOOST_CHECK_EQUAL(policy.bucket_for_hash(hashes[3]), 0);
+}
+
+using test_bucket_types =
+    boost::mpl::list<tsl::ah::exact_bucket_growth_policy,
+                     tsl::ah::geometric_bucket_growth_policy<>,
+                     tsl::ah::geometric_bucket_growth_policy<std::ratio<2>>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_bucket_policy, Policy, test_bucket_types) {
+  // Grow a capacity from 0 to at least 'target_capacity' by small steps, check
+  // that next_capacity() always returns at least the required capacity.
+  const std::size_t target_capacity = 100000;
+  const std::size_t step = 10;
+
+  std::size_t capacity = 0;
+  std::size_t nb_growths = 0;
+  for (std::size_t used = 0; used < target_capacity; used += step) {
+    if (used + step > capacity) {
+      const std::size_t new_capacity =
+          Policy::next_capacity(capacity, used + step);
+      BOOST_CHECK(new_capacity >= used + step);
+
+      if (!Policy::track_capacity) {
+        BOOST_CHECK_EQUAL(new_capacity, used + step);
+      }
+
+      capacity = new_capacity;
+      nb_growths++;
+    }
+  }
+
+  if (Policy::track_capacity) {
+    BOOST_CHECK(nb_growths < 100);
+  } else {
+    BOOST_CHECK_EQUAL(nb_growths, target_capacity / step);
+  }
+
+  BOOST_CHECK(Policy::next_capacity(std::numeric_limits<std::size_t>::max() -
+                                        1,
+                                    std::numeric_limits<std::size_t>::max()) ==
+              std::numeric_limits<std::size_t>::max());
+}
+
+using test_bucket_storage_types =
+    boost::mpl::list<tsl::ah::malloc_bucket_storage,
+                     tsl::ah::arena_bucket_storage<>,
+                     tsl::ah::arena_bucket_storage<1024>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_bucket_storage, Storage,
+                              test_bucket_storage_types) {
+  // Allocate buffers of various sizes, grow half of them, deallocate a third
+  // of them and check that the content of the remaining ones is intact.
+  const std::size_t nb_buffers = 10000;
+
+  Storage storage;
+  std::vector<std::pair<unsigned char*, std::size_t>> buffers;
+  for (std::size_t i = 0; i < nb_buffers; i++) {
+    const std::size_t size = 1 + (i * 7919) % 20000;
+    BOOST_CHECK(storage.good_size(size) >= size);
+
+    unsigned char* buffer =
+        static_cast<unsigned char*>(storage.allocate(storage.good_size(size)));
+    std::memset(buffer, int(i % 256), storage.good_size(size));
+    buffers.emplace_back(buffer, storage.good_size(size));
+  }
+
+  for (std::size_t i = 0; i < nb_buffers; i += 2) {
+    const std::size_t new_size = buffers[i].second * 2 + 1;
+    buffers[i].first = static_cast<unsigned char*>(
+        storage.reallocate(buffers[i].first, buffers[i].second, new_size));
+    std::memset(buffers[i].first + buffers[i].second, int(i % 256),
+                new_size - buffers[i].second);
+    buffers[i].second = new_size;
+  }
+
+  for (std::size_t i = 0; i < nb_buffers; i += 3) {
+    storage.deallocate(buffers[i].first, buffers[i].second);
+    buffers[i].first = nullptr;
+  }
+
+  for (std::size_t i = 0; i < nb_buffers; i++) {
+    if (buffers[i].first != nullptr) {
+      const std::vector<unsigned char> expected(
+          buffers[i].second, static_cast<unsigned char>(i % 256));
+      BOOST_CHECK(std::memcmp(buffers[i].first, expected.data(),
+                              expected.size()) == 0);
+    }
+  }
+
+  if (Storage::owns_buffers) {
+    storage.release();
+  } else {
+    for (std::size_t i = 0; i < nb_buffers; i++) {
+      if (buffers[i].first != nullptr) {
+        storage.deallocate(buffers[i].first, buffers[i].second);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_bucket_storage_size_classes) {
+  // A reallocation inside the same size class doesn't move the buffer.
+  tsl::ah::arena_bucket_storage<> storage;
+
+  void* buffer = storage.allocate(70);
+  BOOST_CHECK_EQUAL(storage.good_size(70), 80);
+  BOOST_CHECK(storage.reallocate(buffer, 70, 80) == buffer);
+  BOOST_CHECK_EQUAL(storage.good_size(1), 16);
+  BOOST_CHECK_EQUAL(storage.good_size(129), 160);
+
+  // A deallocated block is reused by the next allocation of the same class.
+  storage.deallocate(buffer, 80);
+  BOOST_CHECK(storage.allocate(65) == buffer);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_bucket_storage_overhead_bytes) {
+  // The unused space of a slab is part of the overhead, a large buffer only
+  // adds the overhead of its header and of malloc.
+  tsl::ah::arena_bucket_storage<1024> storage;
+
+  void* small_buffer = storage.allocate(16);
+  BOOST_CHECK(storage.overhead_bytes(16, 1) >= 1024 - 16);
+  const std::size_t slab_overhead = storage.overhead_bytes(16, 1);
+
+  void* large_buffer = storage.allocate(100000);
+  BOOST_CHECK(storage.overhead_bytes(16 + 100000, 2) < slab_overhead + 100);
+
+  large_buffer = storage.reallocate(large_buffer, 100000, 200000);
+  BOOST_CHECK(storage.overhead_bytes(16 + 200000, 2) < slab_overhead + 100);
+
+  storage.deallocate(large_buffer, 200000);
+  BOOST_CHECK_EQUAL(storage.overhead_bytes(16, 1), slab_overhead);
+
+  storage.deallocate(small_buffer, 16);
+  BOOST_CHECK_EQUAL(storage.overhead_bytes(0, 0), slab_overhead + 16);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,250 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <tsl/sharded_array_map.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/mpl/list.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+BOOST_AUTO_TEST_SUITE(test_sharded_array_map)
+
+using test_types =
+    boost::mpl::list<tsl::sharded_array_map<char, int64_t>,
+                     tsl::sharded_array_map<char, std::string, 1>,
+                     tsl::sharded_array_map<char16_t, int64_t, 64>,
+                     tsl::sharded_array_map<
+                         char32_t, std::string, 8, tsl::ah::str_hash<char32_t>,
+                         tsl::ah::str_equal<char32_t>, false, std::uint16_t,
+                         std::uint32_t, tsl::ah::prime_growth_policy>>;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_insert_find_erase, SMap, test_types) {
+  // Insert x values, insert them again, check them, update and erase half of
+  // them.
+  using char_tt = typename SMap::char_type;
+  using value_tt = typename SMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  SMap map;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.insert(utils::get_key<char_tt>(i),
+                           utils::get_value<value_tt>(i)));
+  }
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(!map.insert(utils::get_key<char_tt>(i),
+                            utils::get_value<value_tt>(i + 1)));
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+
+  for (std::size_t i = 0; i < nb_values; i++) {
+    value_tt value;
+    BOOST_CHECK(map.find(utils::get_key<char_tt>(i), value));
+    BOOST_CHECK(value == utils::get_value<value_tt>(i));
+    BOOST_CHECK(map.at(utils::get_key<char_tt>(i)) ==
+                utils::get_value<value_tt>(i));
+  }
+
+  value_tt value;
+  BOOST_CHECK(!map.find(utils::get_key<char_tt>(nb_values), value));
+  BOOST_CHECK_THROW(map.at(utils::get_key<char_tt>(nb_values)),
+                    std::out_of_range);
+
+  for (std::size_t i = 0; i < nb_values; i += 2) {
+    BOOST_CHECK(map.update(utils::get_key<char_tt>(i), [](value_tt& v) {
+      v = utils::get_value<value_tt>(0);
+    }));
+    BOOST_CHECK(!map.insert_or_assign(utils::get_key<char_tt>(i + 1),
+                                      utils::get_value<value_tt>(1)));
+  }
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK(map.at(utils::get_key<char_tt>(i)) ==
+                utils::get_value<value_tt>(i % 2));
+  }
+
+  for (std::size_t i = 0; i < nb_values; i += 2) {
+    BOOST_CHECK_EQUAL(map.erase(utils::get_key<char_tt>(i)), 1);
+  }
+  BOOST_CHECK_EQUAL(map.size(), nb_values / 2);
+
+  std::size_t nb_visited = 0;
+  map.for_each([&](const char_tt* key, std::size_t key_size,
+                   const value_tt& v) {
+    BOOST_CHECK(SMap::shard_for_hash_index(map.hash_function()(
+                    key, key_size)) < SMap::shard_count());
+    BOOST_CHECK(v == utils::get_value<value_tt>(1));
+    nb_visited++;
+  });
+  BOOST_CHECK_EQUAL(nb_visited, nb_values / 2);
+
+  map.clear();
+  BOOST_CHECK(map.empty());
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_batch, SMap, test_types) {
+  // Insert half the keys with insert_batch and check all the keys with
+  // count_batch and visit_batch.
+  using char_tt = typename SMap::char_type;
+  using value_tt = typename SMap::mapped_type;
+
+  const std::size_t nb_values = 1000;
+  std::vector<std::pair<std::basic_string<char_tt>, value_tt>> values;
+  std::vector<std::basic_string<char_tt>> keys;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    if (i % 2 == 0) {
+      values.emplace_back(utils::get_key<char_tt>(i),
+                          utils::get_value<value_tt>(i));
+    }
+    keys.push_back(utils::get_key<char_tt>(i));
+  }
+
+  SMap map;
+  map.reserve(nb_values);
+  BOOST_CHECK_EQUAL(map.insert_batch(values.begin(), values.end()),
+                    nb_values / 2);
+  BOOST_CHECK_EQUAL(map.insert_batch(values.begin(), values.end()), 0);
+
+  std::vector<std::size_t> counts;
+  map.count_batch(keys.begin(), keys.end(), std::back_inserter(counts));
+  BOOST_REQUIRE_EQUAL(counts.size(), nb_values);
+  for (std::size_t i = 0; i < nb_values; i++) {
+    BOOST_CHECK_EQUAL(counts[i], i % 2 == 0 ? 1 : 0);
+  }
+
+  std::vector<bool> visited(nb_values, false);
+  map.visit_batch(keys.begin(), keys.end(),
+                  [&](std::size_t ikey, const value_tt* value) {
+                    BOOST_CHECK(!visited[ikey]);
+                    visited[ikey] = true;
+
+                    if (ikey % 2 == 0) {
+                      BOOST_REQUIRE(value != nullptr);
+                      BOOST_CHECK(*value == utils::get_value<value_tt>(ikey));
+                    } else {
+                      BOOST_CHECK(value == nullptr);
+                    }
+                  });
+  BOOST_CHECK(std::find(visited.begin(), visited.end(), false) ==
+              visited.end());
+}
+
+BOOST_AUTO_TEST_CASE(test_insert_batch_move_only_values) {
+  // insert_batch with a std::move_iterator moves the values of the inserted
+  // keys and doesn't touch the values of the keys already present.
+  tsl::sharded_array_map<char, move_only_test> map;
+  map.insert(utils::get_key<char>(0), move_only_test(-1));
+
+  const std::size_t nb_values = 100;
+  std::vector<std::pair<std::string, move_only_test>> values;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    values.emplace_back(utils::get_key<char>(i),
+                        utils::get_value<move_only_test>(i));
+  }
+
+  BOOST_CHECK_EQUAL(map.insert_batch(std::make_move_iterator(values.begin()),
+                                     std::make_move_iterator(values.end())),
+                    nb_values - 1);
+  BOOST_CHECK_EQUAL(map.size(), nb_values);
+
+  std::vector<std::string> keys;
+  for (std::size_t i = 0; i < nb_values; i++) {
+    keys.push_back(utils::get_key<char>(i));
+    BOOST_CHECK_EQUAL(values[i].second == utils::get_value<move_only_test>(i),
+                      i == 0);
+  }
+
+  map.visit_batch(keys.begin(), keys.end(),
+                  [&](std::size_t ikey, const move_only_test* value) {
+                    BOOST_REQUIRE(value != nullptr);
+                    if (ikey == 0) {
+                      BOOST_CHECK_EQUAL(*value, move_only_test(-1));
+                    } else {
+                      BOOST_CHECK_EQUAL(*value,
+                                        utils::get_value<move_only_test>(ikey));
+                    }
+                  });
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_insert_find) {
+  // Insert distinct ranges of keys from multiple threads while other threads
+  // look them up, then check that all the keys are there.
+  const std::size_t nb_threads = 4;
+  const std::size_t nb_values_per_thread = 20000;
+
+  tsl::sharded_array_map<char, std::int64_t> map;
+  std::atomic<bool> writers_done(false);
+
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < nb_threads; t++) {
+    threads.emplace_back([&map, t]() {
+      for (std::size_t i = t * nb_values_per_thread;
+           i < (t + 1) * nb_values_per_thread; i++) {
+        map.insert(utils::get_key<char>(i),
+                   utils::get_value<std::int64_t>(i));
+      }
+    });
+  }
+
+  std::atomic<std::size_t> nb_errors(0);
+  std::vector<std::thread> readers;
+  for (std::size_t t = 0; t < 2; t++) {
+    readers.emplace_back([&]() {
+      while (!writers_done.load()) {
+        for (std::size_t i = 0; i < nb_threads * nb_values_per_thread;
+             i += 97) {
+          std::int64_t value;
+          if (map.find(utils::get_key<char>(i), value) &&
+              value != utils::get_value<std::int64_t>(i)) {
+            nb_errors++;
+          }
+        }
+      }
+    });
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  writers_done = true;
+  for (std::thread& thread : readers) {
+    thread.join();
+  }
+
+  BOOST_CHECK_EQUAL(nb_errors.load(), 0);
+  BOOST_CHECK_EQUAL(map.size(), nb_threads * nb_values_per_thread);
+  for (std::size_t i = 0; i < nb_threads * nb_values_per_thread; i++) {
+    BOOST_CHECK_EQUAL(map.at(utils::get_key<char>(i)),
+                      utils::get_value<std::int64_t>(i));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
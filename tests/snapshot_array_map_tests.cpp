@@ -0,0 +1,211 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Thibaut Goetghebuer-Planchon <tessil@gmx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <tsl/snapshot_array_map.h>
+
+#include <atomic>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+BOOST_AUTO_TEST_SUITE(test_snapshot_array_map)
+
+using snapshot_map = tsl::snapshot_array_map<char, std::int64_t>;
+
+BOOST_AUTO_TEST_CASE(test_publish_update) {
+  // A snapshot keeps seeing its version after an update while a new snapshot
+  // sees the new version.
+  snapshot_map map(snapshot_map::map_type({{"one", 1}, {"two", 2}}));
+  auto reader = map.make_reader();
+
+  {
+    auto snapshot = reader.take_snapshot();
+    BOOST_CHECK_EQUAL(snapshot->size(), 2);
+    BOOST_CHECK_EQUAL(snapshot->at("one"), 1);
+  }
+
+  map.update([](snapshot_map::map_type& next) {
+    next.insert("three", 3);
+    next.erase("one");
+  });
+
+  {
+    auto snapshot = reader.take_snapshot();
+    BOOST_CHECK_EQUAL(snapshot->size(), 2);
+    BOOST_CHECK_EQUAL(snapshot->count("one"), 0);
+    BOOST_CHECK_EQUAL(snapshot->at("three"), 3);
+  }
+
+  map.publish(snapshot_map::map_type());
+  BOOST_CHECK(reader.take_snapshot()->empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_publish_waits_for_readers) {
+  // The writer can't destroy the version seen by a snapshot before the
+  // snapshot is released, the reader is never blocked meanwhile.
+  snapshot_map map(snapshot_map::map_type({{"key", 1}}));
+  auto reader = map.make_reader();
+
+  std::atomic<bool> published(false);
+  std::thread writer;
+  {
+    auto snapshot = reader.take_snapshot();
+    const snapshot_map::map_type* version = &snapshot.get();
+
+    writer = std::thread([&]() {
+      map.publish(snapshot_map::map_type({{"key", 2}}));
+      published = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(!published.load());
+
+    // Nested snapshots on the same reader don't block either.
+    for (int i = 0; i < 10; i++) {
+      auto nested_snapshot = reader.take_snapshot();
+      BOOST_CHECK(nested_snapshot->count("key") == 1);
+    }
+
+    BOOST_CHECK(&snapshot.get() == version);
+    BOOST_CHECK_EQUAL(snapshot->at("key"), 1);
+  }
+
+  writer.join();
+  BOOST_CHECK(published.load());
+  BOOST_CHECK_EQUAL(reader.take_snapshot()->at("key"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_make_reader_while_publish_waits) {
+  // A thread holding a snapshot can create and destroy readers while a writer
+  // waits for its snapshot.
+  snapshot_map map(snapshot_map::map_type({{"key", 1}}));
+  auto reader = map.make_reader();
+
+  std::atomic<bool> published(false);
+  std::thread writer;
+  {
+    auto snapshot = reader.take_snapshot();
+
+    writer = std::thread([&]() {
+      map.publish(snapshot_map::map_type({{"key", 2}}));
+      published = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    BOOST_CHECK(!published.load());
+
+    {
+      auto other_reader = map.make_reader();
+      BOOST_CHECK_EQUAL(other_reader.take_snapshot()->count("key"), 1);
+    }
+    BOOST_CHECK(!published.load());
+    BOOST_CHECK_EQUAL(snapshot->at("key"), 1);
+  }
+
+  writer.join();
+  BOOST_CHECK(published.load());
+}
+
+BOOST_AUTO_TEST_CASE(test_move_reader_with_snapshots) {
+  // Move a reader while it holds snapshots; the snapshots stay valid and
+  // release the slot of the moved-to reader, which doesn't block the writer
+  // once they are released.
+  snapshot_map map(snapshot_map::map_type({{"key", 1}}));
+  auto reader = map.make_reader();
+
+  {
+    auto snapshot = reader.take_snapshot();
+    auto nested_snapshot = reader.take_snapshot();
+
+    auto moved_reader = std::move(reader);
+    BOOST_CHECK_EQUAL(snapshot->at("key"), 1);
+    BOOST_CHECK_EQUAL(moved_reader.take_snapshot()->at("key"), 1);
+    {
+      auto moved_snapshot = std::move(nested_snapshot);
+      BOOST_CHECK_EQUAL(moved_snapshot->at("key"), 1);
+    }
+    {
+      // Release the last snapshot before moved_reader is destroyed.
+      auto released_snapshot = std::move(snapshot);
+    }
+
+    map.publish(snapshot_map::map_type({{"key", 2}}));
+    BOOST_CHECK_EQUAL(moved_reader.take_snapshot()->at("key"), 2);
+  }
+
+  map.publish(snapshot_map::map_type({{"key", 3}}));
+  BOOST_CHECK_EQUAL(map.make_reader().take_snapshot()->at("key"), 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_readers) {
+  // Readers check that each version they see is consistent (the version i
+  // contains the keys [0, i) with the value i) while a writer publishes new
+  // versions.
+  const std::size_t nb_versions = 200;
+  const std::size_t nb_readers = 3;
+
+  snapshot_map map;
+  std::atomic<bool> done(false);
+  std::atomic<std::size_t> nb_errors(0);
+
+  std::vector<std::thread> readers;
+  for (std::size_t t = 0; t < nb_readers; t++) {
+    readers.emplace_back([&]() {
+      auto reader = map.make_reader();
+      while (!done.load()) {
+        auto snapshot = reader.take_snapshot();
+        const std::int64_t version = std::int64_t(snapshot->size());
+        for (const std::int64_t value : *snapshot) {
+          if (value != version) {
+            nb_errors++;
+          }
+        }
+      }
+    });
+  }
+
+  for (std::size_t version = 1; version <= nb_versions; version++) {
+    map.update([version](snapshot_map::map_type& next) {
+      for (auto it = next.begin(); it != next.end(); ++it) {
+        it.value() = std::int64_t(version);
+      }
+      next.insert(utils::get_key<char>(version - 1), std::int64_t(version));
+    });
+  }
+  done = true;
+
+  for (std::thread& thread : readers) {
+    thread.join();
+  }
+
+  BOOST_CHECK_EQUAL(nb_errors.load(), 0);
+  BOOST_CHECK_EQUAL(map.make_reader().take_snapshot()->size(), nb_versions);
+}
+
+BOOST_AUTO_TEST_SUITE_END()